@@ -2,24 +2,59 @@
 #ifndef DRAKO_ASYNC_READER_POOL_HPP
 #define DRAKO_ASYNC_READER_POOL_HPP
 
-#include "drako/concurrency/lockfree_ringbuffer.hpp"
-#include "drako/core/container/static_vector.hpp"
+/// @file
+/// @brief  Asynchronous reads of file ranges.
+/// @author Grassi Edoardo
+///
+/// Two backends implement the same interface. The portable one serves each
+/// request with a blocking positional read on a small pool of threads. On Linux,
+/// the io_uring backend keeps many reads in flight from a single thread, which
+/// submits them in batches and harvests their completions from the kernel ring.
+
+#include "drako/concurrency/idle_strategy.hpp"
+#include "drako/concurrency/lockfree_mrmwqueue.hpp"
+#include "drako/core/compiler.hpp"
+#include "drako/core/platform.hpp"
 
 #include <rio/input_file_handle.hpp>
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
-#include <iostream>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
 #include <span>
+#include <system_error>
 #include <thread>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
+#if defined(DRAKO_PLT_WIN32)
+#include <Windows.h>
+#elif defined(DRAKO_PLT_LINUX)
+#include <cerrno>
+#include <unistd.h>
+#endif
+
 namespace drako
 {
     class AsyncReaderPoolInterface
     {
     public:
+        /// @brief Identifier of a submitted request, unique among the pending ones.
+        using RequestID = std::uint64_t;
+
+        /// @brief Value that never identifies a request.
+        static constexpr const RequestID invalid_request = 0;
+
+        struct Completion;
+
+        /// @brief Function invoked by a reader thread when a request completes.
+        using Callback = void (*)(const Completion&) noexcept;
+
         struct Request
         {
             /// @brief Source open handle of the file
@@ -30,164 +65,507 @@ namespace drako
 
             /// @brief Bytes offset from the start of the file
             std::size_t offset;
+
+            /// @brief Invoked instead of queuing the completion for retrieve(), if set
+            Callback callback = nullptr;
+
+            /// @brief Value for the owner of the request, like the index of its batch
+            std::uint64_t user_data = 0;
+        };
+
+        /// @brief Outcome of a request.
+        ///
+        /// A request that reached the end of the file completes without error
+        /// and with fewer bytes than its destination buffer.
+        ///
+        struct Completion
+        {
+            /// @brief Identifier returned by submit()
+            RequestID id = invalid_request;
+
+            /// @brief Completed request
+            const Request* request = nullptr;
+
+            /// @brief Number of bytes read at the start of the destination buffer
+            std::size_t bytes = 0;
+
+            /// @brief Error of the read, or std::errc::operation_canceled
+            std::error_code error = {};
         };
 
-        virtual bool submit(const Request*) noexcept;
-        virtual bool retrive(Request*) noexcept;
+        virtual ~AsyncReaderPoolInterface() noexcept = default;
+
+        /// @brief Queues a request, which must stay alive until completed.
+        ///
+        /// @return Identifier of the request, or invalid_request if the submit queue is full.
+        ///
+        [[nodiscard]] virtual RequestID submit(const Request*) noexcept = 0;
+
+        /// @brief Retrieves the completions of the requests without a callback.
+        ///
+        /// @return Number of completions stored in a prefix of the span.
+        ///
+        [[nodiscard]] virtual std::size_t retrieve(std::span<Completion>) noexcept = 0;
+
+        /// @brief Cancels a pending request.
+        ///
+        /// A request that is still queued always completes as cancelled. The io_uring
+        /// backend also interrupts the reads in flight, if the kernel allows it.
+        ///
+        /// @return Returns false if the request completed or can't be cancelled anymore.
+        ///
+        virtual bool cancel(RequestID) noexcept = 0;
+
+        /// @brief Registers the files that will be read, so that the backend
+        ///        can skip the lookup of the handle on each request.
+        ///
+        /// Replaces the previous registration. Can only be called while
+        /// no request is pending.
+        ///
+        /// @return Returns false if the backend doesn't benefit from the registration.
+        ///
+        virtual bool register_files(std::span<const rio::Handle>) { return false; }
+
+        /// @brief Registers the memory that will receive the data, so that the
+        ///        backend can skip pinning the pages on each request.
+        ///
+        /// Replaces the previous registration. Can only be called while
+        /// no request is pending.
+        ///
+        /// @return Returns false if the backend doesn't benefit from the registration.
+        ///
+        virtual bool register_buffers(std::span<const std::span<std::byte>>) { return false; }
     };
 
 
-    class AsyncReaderPool : AsyncReaderPoolInterface
+    /// @brief Configuration shared by the reader backends.
+    struct AsyncReaderArgs
     {
-    public:
-        struct Args
+        /// @brief Number of worker threads of the thread pool backend.
+        std::size_t workers = 2;
+
+        /// @brief Max number of reads in flight of the io_uring backend.
+        std::uint32_t queue_depth = 64;
+
+        /// @brief Capacity of the input buffer shared by the workers.
+        std::size_t submit_queue_size = 256;
+
+        /// @brief Capacity of the output buffer shared by the workers.
+        std::size_t output_queue_size = 256;
+
+        /// @brief Backoff of the workers that ran out of requests.
+        IdleStrategy::Args idle = {};
+    };
+
+
+    namespace _detail
+    {
+        // reads the whole range, stopping early only at the end of the file or on errors
+        [[nodiscard]] inline std::size_t read_at(
+            rio::Handle src, std::span<std::byte> dst, std::size_t offset, std::error_code& error) noexcept
         {
-            /// @brief Number of worker threads.
-            std::size_t workers;
+            std::size_t done = 0;
+            while (done < std::size(dst))
+            {
+#if defined(DRAKO_PLT_WIN32)
+                const auto   position = static_cast<std::uint64_t>(offset + done);
+                ::OVERLAPPED at       = {};
+                at.Offset             = static_cast<DWORD>(position);
+                at.OffsetHigh         = static_cast<DWORD>(position >> 32);
+                const auto bytes      = static_cast<DWORD>(std::min<std::size_t>(std::size(dst) - done, MAXDWORD));
+                DWORD      count      = 0;
+                if (!::ReadFile(src, dst.data() + done, bytes, &count, &at))
+                {
+                    if (const auto e = ::GetLastError(); e != ERROR_HANDLE_EOF)
+                        error.assign(static_cast<int>(e), std::system_category());
+                    break;
+                }
+                if (count == 0)
+                    break;
+                done += count;
+#elif defined(DRAKO_PLT_LINUX)
+                const auto count = ::pread(src, dst.data() + done, std::size(dst) - done, static_cast<::off_t>(offset + done));
+                if (count > 0)
+                    done += static_cast<std::size_t>(count);
+                else if (count == 0)
+                    break;
+                else if (errno != EINTR)
+                {
+                    error.assign(errno, std::system_category());
+                    break;
+                }
+#else
+#error Platform currently not supported
+#endif
+            }
+            return done;
+        }
 
-            /// @brief Capacity of the input buffer of each worker.
-            std::size_t submit_queue_size;
+        // submitted requests of a reader, indexed by the low half of their identifiers
+        //
+        // Each slot carries a generation in the high half, bumped when the slot is
+        // released, so that stale identifiers never match a newer request.
+        //
+        class _request_table
+        {
+            using _request   = AsyncReaderPoolInterface::Request;
+            using _id        = AsyncReaderPoolInterface::RequestID;
 
-            /// @brief Capacity of the output buffer of each worker.
-            std::size_t output_queue_size;
+        public:
+            enum class State : std::uint32_t
+            {
+                free,
+                queued,
+                running,
+                cancelled,
+            };
+
+            explicit _request_table(std::size_t capacity)
+                : _size{ capacity }, _slots{ std::make_unique<_slot[]>(capacity) }, _free{ capacity }
+            {
+                assert(capacity > 0 && capacity <= std::numeric_limits<std::uint32_t>::max());
+                for (std::uint32_t i = 0; i < capacity; ++i)
+                {
+                    [[maybe_unused]] const auto pushed = _free.try_push(i);
+                    assert(pushed);
+                }
+            }
+
+            [[nodiscard]] static std::uint32_t index(_id id) noexcept { return static_cast<std::uint32_t>(id); }
+
+            // reserves a slot for a queued request
+            [[nodiscard]] _id acquire(const _request* r) noexcept
+            {
+                std::uint32_t i;
+                if (!_free.try_pop(i))
+                    return AsyncReaderPoolInterface::invalid_request;
+
+                auto&      s          = _slots[i];
+                const auto generation = static_cast<std::uint32_t>(s.word.load(std::memory_order::relaxed) >> 32);
+                s.request             = r;
+                s.word.store(_pack(generation, State::queued), std::memory_order::release);
+                return (static_cast<_id>(generation) << 32) | i;
+            }
+
+            // identifier of the request in a slot, only for the thread that owns it
+            [[nodiscard]] _id id(std::uint32_t i) const noexcept
+            {
+                return (_slots[i].word.load(std::memory_order::acquire) & ~_id{ 0xffff'ffff }) | i;
+            }
+
+            [[nodiscard]] const _request* request(std::uint32_t i) const noexcept { return _slots[i].request; }
+
+            // fails if the request completed or was moved to another state
+            [[nodiscard]] bool transition(_id id, State from, State to) noexcept
+            {
+                if (index(id) >= _size)
+                    return false;
+
+                const auto generation = static_cast<std::uint32_t>(id >> 32);
+                auto       expected   = _pack(generation, from);
+                return _slots[index(id)].word.compare_exchange_strong(expected, _pack(generation, to),
+                    std::memory_order::acq_rel, std::memory_order::relaxed);
+            }
+
+            [[nodiscard]] bool cancelled(_id id) const noexcept
+            {
+                return _slots[index(id)].word.load(std::memory_order::acquire) == _pack(static_cast<std::uint32_t>(id >> 32), State::cancelled);
+            }
+
+            // makes the slot available to a new request
+            void release(_id id) noexcept
+            {
+                auto generation = static_cast<std::uint32_t>(id >> 32) + 1;
+                if (generation == 0) // identifiers are never zero
+                    generation = 1;
+
+                _slots[index(id)].word.store(_pack(generation, State::free), std::memory_order::release);
+                while (!_free.try_push(index(id))) // a thread is still popping the previous round
+                    std::this_thread::yield();
+            }
+
+        private:
+            struct _slot
+            {
+                const _request*            request = nullptr;
+                std::atomic<std::uint64_t> word    = _pack(1, State::free); // generation and state
+            };
+
+            const std::size_t                         _size;
+            std::unique_ptr<_slot[]>                  _slots;
+            drako::lockfree::MRMWQueue<std::uint32_t> _free;
+
+            [[nodiscard]] static constexpr std::uint64_t _pack(std::uint32_t generation, State s) noexcept
+            {
+                return (static_cast<std::uint64_t>(generation) << 32) | static_cast<std::uint32_t>(s);
+            }
         };
 
-        explicit AsyncReaderPool(const Args& args) //std::size_t workers, std::size_t capacity)
+        // the queue has room for all the requests, but a place is reused only
+        // after the thread that popped its previous element is done
+        template <typename T>
+        void push(drako::lockfree::MRMWQueue<T>& queue, const T& value) noexcept
+        {
+            while (!queue.try_push(value))
+                std::this_thread::yield();
+        }
+
+        // invokes the callback of the request or queues the completion, dropped on shutdown
+        inline void deliver(drako::lockfree::MRMWQueue<AsyncReaderPoolInterface::Completion>& out,
+            const std::atomic_flag& done, const AsyncReaderPoolInterface::Completion& c) noexcept
+        {
+            if (c.request->callback)
+                return c.request->callback(c);
+
+            while (!out.try_push(c) && !done.test(std::memory_order::acquire))
+                std::this_thread::yield();
+        }
+
+        // drains the completions queued for retrieve()
+        [[nodiscard]] inline std::size_t retrieve(drako::lockfree::MRMWQueue<AsyncReaderPoolInterface::Completion>& in,
+            std::span<AsyncReaderPoolInterface::Completion> out) noexcept
+        {
+            std::size_t count = 0;
+            while (count < std::size(out) && in.try_pop(out[count]))
+                ++count;
+            return count;
+        }
+    } // namespace _detail
+
+
+    /// @brief Serves the requests with blocking reads on a pool of threads.
+    ///
+    /// Requests that a worker already started can't be cancelled.
+    ///
+    class AsyncReaderPool final : public AsyncReaderPoolInterface
+    {
+    public:
+        using Args = AsyncReaderArgs;
+
+        explicit AsyncReaderPool(const Args& args)
+            : _requests{ args.submit_queue_size + args.workers }
+            , _submit_queue{ args.submit_queue_size + args.workers }
+            , _output_queue{ args.output_queue_size }
+            , _parking{ args.idle }
         {
             assert(args.workers > 0);
             assert(args.submit_queue_size > 0);
             assert(args.output_queue_size > 0);
 
-            for (auto i = 0; i < args.workers; ++i)
-                _submit_queues.emplace_back(args.submit_queue_size);
-
-            for (auto i = 0; i < args.workers; ++i)
-                _output_queues.emplace_back(args.output_queue_size);
-
             // create background threads
             _workers.reserve(args.workers);
-            for (auto i = 0; i < args.workers; ++i)
-                _workers.push_back(std::thread{
-                    _run, std::ref(_done),
-                    std::ref(_submit_queues[i]), std::ref(_output_queues[i]) });
+            for (std::size_t i = 0; i < args.workers; ++i)
+                _workers.push_back(std::thread{ [this]() { _run(); } });
         }
 
         ~AsyncReaderPool() noexcept
         {
             _done.test_and_set(std::memory_order::release);
+            _parking.notify_all();
             for (auto& w : _workers)
                 w.join();
         }
 
-        /*
-        [[nodiscard]] bool submit(std::size_t worker,
-            UniqueInputFile& src, std::span<std::byte> dst, Callable c)
+        /// @brief Queues a request for any of the workers.
+        [[nodiscard]] RequestID submit(const Request* r) noexcept override
         {
-            assert(worker < std::size(_workers)); // invalid worker index
-
-            const auto handle = src.native_handle();
-            return _workers[worker].queue().emplace(c, handle, dst, 0);
-        }
+            assert(r);
+            const auto id = _requests.acquire(r);
+            if (id == invalid_request)
+                return id;
 
-        [[nodiscard]] bool submit(std::size_t worker,
-            UniqueInputFile& src, std::span<std::byte> dst, std::size_t offset, Callable c)
-        {
-            assert(worker < std::size(_workers)); // invalid worker index
+            // a slot of the table is also a place in the queue
+            _detail::push(_submit_queue, _detail::_request_table::index(id));
 
-            const auto handle = src.native_handle();
-            return _workers[worker].queue().emplace(c, handle, dst, offset);
+            _parking.notify_one();
+            return id;
         }
-        */
 
-        [[nodiscard]] bool submit(const Request* r) noexcept
+        [[nodiscard]] std::size_t retrieve(std::span<Completion> out) noexcept override
         {
-            //static thread_local std::size_t worker = 0; 
-            //return _submit(worker++ % std::size(_workers), r);
-            return _submit(0, r);
+            return _detail::retrieve(_output_queue, out);
         }
 
-        [[nodiscard]] bool retrieve(Request* r) noexcept
+        bool cancel(RequestID id) noexcept override
         {
-            //static thread_local std::size_t worker = 0;
-            //return _retrive(worker++ % std::size(_workers), r);
-            return _retrive(0, r);
+            using _state = _detail::_request_table::State;
+            return _requests.transition(id, _state::queued, _state::cancelled);
         }
 
+        /// @brief Counters of the idle events of the workers.
+        [[nodiscard]] IdleStrategy::Stats idle_stats() const noexcept { return _parking.stats(); }
+
 
     private:
-        /*
-        struct _packet
+        _detail::_request_table                     _requests;
+        drako::lockfree::MRMWQueue<std::uint32_t>   _submit_queue; // shared by all the workers
+        drako::lockfree::MRMWQueue<Completion>      _output_queue;
+        IdleStrategy                                _parking;
+        std::vector<std::thread>                    _workers;
+        std::atomic_flag                            _done; // since c++20 is initialized to clear state
+
+        void _run() noexcept
         {
-            _packet() = default;
+            using _state = _detail::_request_table::State;
 
-            constexpr _packet(
-                Callable c, _handle src, std::span<std::byte> dst, std::size_t offset)
-                : callback{ c }, src{ src }, dst{ dst }, offset{ offset } {}
+            while (!_done.test(std::memory_order::acquire))
+            {
+                for (std::uint32_t index; _submit_queue.try_pop(index);)
+                {
+                    Completion c{ .id = _requests.id(index), .request = _requests.request(index) };
+                    if (_requests.transition(c.id, _state::queued, _state::running))
+                        c.bytes = _detail::read_at(c.request->src, c.request->dst, c.request->offset, c.error);
+                    else
+                        c.error = std::make_error_code(std::errc::operation_canceled);
+
+                    // the callback can submit again
+                    _requests.release(c.id);
+                    _detail::deliver(_output_queue, _done, c);
+                }
 
-            _packet(const _packet&) noexcept = default;
-            _packet& operator=(const _packet&) noexcept = default;
+                _parking.wait_until([&]() noexcept {
+                    return !_submit_queue.empty() || _done.test(std::memory_order::acquire);
+                });
+            }
+        }
+    };
 
-            Callable             callback;
-            std::span<std::byte> dst;
-            _handle              src;
-            std::size_t          offset;
-        };
-        static_assert(std::is_nothrow_default_constructible_v<_packet>);
-        static_assert(std::is_nothrow_copy_constructible_v<_packet>);
-        */
 
-        using _queue = drako::lockfree::RingBuffer<const Request*>;
+#if defined(DRAKO_PLT_LINUX)
+
+    /// @brief Serves the requests with io_uring, from a single thread.
+    ///
+    /// The thread moves the queued requests to the submission ring, hands them
+    /// to the kernel with a single system call and sleeps inside the same call
+    /// until a read completes or a new request is submitted. Short reads are
+    /// resubmitted until the range is complete or the end of the file is reached.
+    ///
+    /// Registered files are referenced by their index in the kernel table, and
+    /// reads into registered buffers use the pages pinned at registration.
+    /// Registrations are performed by the thread itself, while its wakeup read
+    /// isn't in flight, as older kernels wait for every pending request.
+    ///
+    class UringReaderPool final : public AsyncReaderPoolInterface
+    {
+    public:
+        using Args = AsyncReaderArgs;
 
-        StaticVector<_queue, 4>  _submit_queues;
-        StaticVector<_queue, 4>  _output_queues;
-        std::vector<std::thread> _workers;
-        std::atomic_flag         _done; // since c++20 is initialized to clear state
+        /// @brief Checks whether the kernel supports the backend.
+        [[nodiscard]] static bool supported() noexcept;
 
-        static void _run(std::atomic_flag& done, _queue& in, _queue& out)
-        {
-            while (!done.test(std::memory_order::acquire))
-            {
-                while (const auto result = in.pop())
-                {
-                    const auto& request = result.value();
-                    //packet.src.read(packet.dst, packet.bytes);
-                    std::clog << "Thread " << std::this_thread::get_id()
-                              << ": read " << request->dst.size_bytes() << " bytes.\n";
+        /// @brief Constructor.
+        ///
+        /// @throw std::system_error if the ring can't be created.
+        ///
+        explicit UringReaderPool(const Args& args);
 
-                    //std::invoke(request.callback);
-                    assert(out.push(request));
-                }
+        /// @brief Destructor, waits for the reads in flight and drops the queued ones.
+        ~UringReaderPool() noexcept;
 
-                // TODO: this should be supported in c++20 to avoid busy wait
-                // done.wait(false, std::memory_order::acquire);
-                std::this_thread::yield();
-            }
-        }
+        UringReaderPool(const UringReaderPool&) = delete;
+        UringReaderPool& operator=(const UringReaderPool&) = delete;
 
-        [[nodiscard]] bool _submit(const std::size_t worker, const Request* r)
-        {
-            assert(worker < std::size(_workers));
-            assert(r);
+        [[nodiscard]] RequestID submit(const Request* r) noexcept override;
 
-            return _submit_queues[worker].push(r);
-        }
+        [[nodiscard]] std::size_t retrieve(std::span<Completion> out) noexcept override;
 
-        [[nodiscard]] bool _retrive(const std::size_t worker, const Request* r)
+        bool cancel(RequestID id) noexcept override;
+
+        bool register_files(std::span<const rio::Handle> files) override;
+
+        bool register_buffers(std::span<const std::span<std::byte>> buffers) override;
+
+    private:
+        struct _kernel_ring; // queues shared with the kernel
+        struct _registration; // handed to the ring thread, that registers between waits
+
+        // read in flight, identified by its index in the kernel queues
+        struct _read
         {
-            assert(worker < std::size(_workers));
-            assert(r);
+            RequestID      id;
+            const Request* request;
+            std::size_t    done; // bytes already read
+        };
 
-            if (auto result = _output_queues[worker].pop(); result)
-                *r = *result.value();
-        }
+        std::unique_ptr<_kernel_ring>                      _ring;
+        _detail::_request_table                            _requests;
+        drako::lockfree::MRMWQueue<std::uint32_t>          _submit_queue;
+        drako::lockfree::MRMWQueue<RequestID>              _cancel_queue; // reads in flight to interrupt
+        drako::lockfree::MRMWQueue<Completion>             _output_queue;
+        std::vector<_read>                                 _reads;       // owned by the ring thread
+        std::vector<std::uint32_t>                         _read_of;     // read of each request slot, owned by the ring thread
+        std::vector<std::uint32_t>                         _free_reads;  // owned by the ring thread
+        std::vector<std::uint32_t>                         _short_reads; // owned by the ring thread, to be resumed
+        std::vector<std::pair<rio::Handle, std::uint32_t>> _files;       // sorted registered files
+        std::vector<std::span<std::byte>>                  _buffers;     // registered buffers
+        int                                                _wakeup;       // eventfd that interrupts the wait for completions
+        std::uint64_t                                      _wakeup_value; // written by the kernel
+        std::atomic<bool>                                  _sleeping;     // the ring thread waits for completions
+        std::atomic<_registration*>                        _registration_pending;
+        std::atomic_flag                                   _done;
+        std::thread                                        _thread;
+
+        void _run() noexcept;
+        void _wake() noexcept;
+        void _post(_registration& r) noexcept;
+        void _apply(_registration& r) noexcept;
+        void _prepare(std::uint32_t read) noexcept;
+        void _prepare_wakeup() noexcept;
+        void _prepare_cancel(RequestID id) noexcept;
+        void _complete(std::uint32_t read, std::int32_t result) noexcept;
+        void _finish(std::uint32_t read, std::error_code error) noexcept;
     };
 
+#endif
+
+
+    /// @brief Creates the most efficient reader supported by the platform.
+    ///
+    /// Uses io_uring when available, otherwise falls back to a thread pool.
+    ///
+    [[nodiscard]] inline std::unique_ptr<AsyncReaderPoolInterface> make_async_reader_pool(const AsyncReaderArgs& args)
+    {
+#if defined(DRAKO_PLT_LINUX)
+        if (UringReaderPool::supported())
+            return std::make_unique<UringReaderPool>(args);
+#endif
+        return std::make_unique<AsyncReaderPool>(args);
+    }
+
 
     /// @brief Mock class for testing without actual I/O operations
-    class AsyncReaderPoolMock : AsyncReaderPoolInterface
+    ///
+    /// Requests are completed immediately, without touching their buffers.
+    ///
+    class AsyncReaderPoolMock final : public AsyncReaderPoolInterface
     {
+    public:
+        explicit AsyncReaderPoolMock(std::size_t capacity)
+            : _completed{ capacity } {}
+
+        [[nodiscard]] RequestID submit(const Request* r) noexcept override
+        {
+            assert(r);
+            const Completion c{ .id = _next.fetch_add(1, std::memory_order::relaxed), .request = r, .bytes = std::size(r->dst) };
+            if (r->callback)
+                r->callback(c);
+            else if (!_completed.try_push(c))
+                return invalid_request;
+            return c.id;
+        }
+
+        [[nodiscard]] std::size_t retrieve(std::span<Completion> out) noexcept override
+        {
+            return _detail::retrieve(_completed, out);
+        }
+
+        bool cancel(RequestID) noexcept override { return false; }
+
+    private:
+        drako::lockfree::MRMWQueue<Completion> _completed;
+        std::atomic<RequestID>                 _next = 1;
     };
 
 } // namespace drako
 
-#endif // !DRAKO_ASYNC_READER_POOL_HPP
\ No newline at end of file
+#endif // !DRAKO_ASYNC_READER_POOL_HPP
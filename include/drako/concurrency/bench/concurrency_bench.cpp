@@ -0,0 +1,495 @@
+//
+// @brief   Throughput and latency of the concurrency primitives and of the job scheduler.
+//
+// Usage: drako-concurrency-bench [--json] [--max-threads N] [--ops N] [--filter NAME]
+//
+// Each benchmark runs for every thread count from 1 to the max (doubling) and every payload size.
+// One row is printed per run, as CSV or as one JSON object per line:
+//
+//     benchmark,threads,payload,ops_per_sec,p50_ns,p99_ns
+//
+// Latencies are sampled once every _sample_rate operations, to keep the clock out of the hot path:
+//  - srsw_queue, mrmw_queue: time from the push to the pop of an element
+//  - static_pool:            time of an allocation followed by a deallocation
+//  - spin_lock, ticket_lock,
+//    mcs_lock, rw_spin_lock:   time to acquire the lock and run the critical section
+//  - scheduler:              time from the submission to the execution of a job
+//  - lazy_list, lockfree_list,
+//    locked_set:               time of a lookup, insertion or removal of a key, with the
+//                              percentage of lookups in the name (e.g. lazy_list/r90)
+//
+
+#include "drako/concurrency/concurrent_list.hpp"
+#include "drako/concurrency/lock.hpp"
+#include "drako/concurrency/lockfree_mrmwqueue.hpp"
+#include "drako/concurrency/lockfree_pool_allocator.hpp"
+#include "drako/concurrency/lockfree_ringbuffer.hpp"
+#include "drako/jobs/job_api.hpp"
+#include "drako/jobs/job_system.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace drako;
+
+using _clock = std::chrono::steady_clock;
+
+static constexpr const std::size_t _sample_rate = 64;
+
+// element moved around by the benchmarks, the first bytes store the timestamp of the sampled ones
+template <std::size_t Bytes>
+struct _payload
+{
+    static_assert(Bytes >= sizeof(std::int64_t));
+
+    std::int64_t                                       stamp = 0;
+    std::array<std::byte, Bytes - sizeof(std::int64_t)> data  = {};
+};
+
+static std::int64_t _now() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(_clock::now().time_since_epoch()).count();
+}
+
+struct _result
+{
+    double        ops_per_sec;
+    std::uint64_t p50_ns;
+    std::uint64_t p99_ns;
+};
+
+// collects the latency samples of all the threads of a run
+class _samples
+{
+public:
+    void merge(const std::vector<std::uint64_t>& local)
+    {
+        const std::scoped_lock guard{ _lock };
+        _values.insert(std::end(_values), std::begin(local), std::end(local));
+    }
+
+    [[nodiscard]] std::uint64_t percentile(double p)
+    {
+        if (std::empty(_values))
+            return 0;
+
+        const auto nth = std::begin(_values) + static_cast<std::ptrdiff_t>(p * static_cast<double>(std::size(_values) - 1));
+        std::nth_element(std::begin(_values), nth, std::end(_values));
+        return *nth;
+    }
+
+private:
+    std::mutex                 _lock;
+    std::vector<std::uint64_t> _values;
+};
+
+// starts the threads at the same time and measures until all of them completed
+template <typename Fn>
+static _result _measure(std::size_t threads, std::size_t total_ops, _samples& samples, Fn&& fn)
+{
+    std::atomic<bool>        start = false;
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+
+    for (std::size_t i = 0; i < threads; ++i)
+        workers.emplace_back([&, i]() {
+            std::vector<std::uint64_t> local;
+            while (!start.load(std::memory_order::acquire))
+                std::this_thread::yield();
+
+            fn(i, local);
+            samples.merge(local);
+        });
+
+    const auto begin = _clock::now();
+    start.store(true, std::memory_order::release);
+    for (auto& w : workers)
+        w.join();
+    const std::chrono::duration<double> elapsed = _clock::now() - begin;
+
+    return { static_cast<double>(total_ops) / elapsed.count(), samples.percentile(0.5), samples.percentile(0.99) };
+}
+
+
+template <std::size_t Bytes>
+static _result _srsw_queue(std::size_t, std::size_t ops)
+{
+    using T = _payload<Bytes>;
+
+    lockfree::SRSWQueue<T> q{ 4096 };
+    _samples               samples;
+    return _measure(2, ops, samples, [&](std::size_t id, std::vector<std::uint64_t>& local) {
+        if (id == 0)
+        {
+            for (std::size_t i = 0; i < ops; ++i)
+            {
+                T value{};
+                if (i % _sample_rate == 0)
+                    value.stamp = _now();
+                while (!q.push(value))
+                    std::this_thread::yield();
+            }
+        }
+        else
+        {
+            for (std::size_t i = 0; i < ops; ++i)
+            {
+                T value;
+                while (!q.pop(value))
+                    std::this_thread::yield();
+                if (value.stamp != 0)
+                    local.push_back(static_cast<std::uint64_t>(_now() - value.stamp));
+            }
+        }
+    });
+}
+
+template <std::size_t Bytes>
+static _result _mrmw_queue(std::size_t threads, std::size_t ops)
+{
+    using T = _payload<Bytes>;
+
+    // half of the threads produce, the other half consume
+    const auto producers = std::max<std::size_t>(threads / 2, 1);
+    const auto total     = producers * ops;
+
+    lockfree::MRMWQueue<T>   q{ 4096 };
+    std::atomic<std::size_t> popped = 0;
+    _samples                 samples;
+    return _measure(producers * 2, total, samples, [&](std::size_t id, std::vector<std::uint64_t>& local) {
+        if (id < producers)
+        {
+            for (std::size_t i = 0; i < ops; ++i)
+            {
+                T value{};
+                if (i % _sample_rate == 0)
+                    value.stamp = _now();
+                while (!q.try_push(value))
+                    std::this_thread::yield();
+            }
+        }
+        else
+        {
+            while (popped.load(std::memory_order::relaxed) < total)
+            {
+                T value;
+                if (!q.try_pop(value))
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                popped.fetch_add(1, std::memory_order::relaxed);
+                if (value.stamp != 0)
+                    local.push_back(static_cast<std::uint64_t>(_now() - value.stamp));
+            }
+        }
+    });
+}
+
+template <std::size_t Bytes>
+static _result _static_pool(std::size_t threads, std::size_t ops)
+{
+    using T = _payload<Bytes>;
+
+    // each thread holds up to a few blocks at a time, the pool never runs out
+    static constexpr const std::size_t held = 4;
+
+    const auto pool = std::make_unique<lockfree::StaticPool<T, 256 * held>>();
+    _samples   samples;
+    return _measure(threads, threads * ops, samples, [&](std::size_t, std::vector<std::uint64_t>& local) {
+        std::array<T*, held> blocks;
+        for (std::size_t i = 0; i < ops; i += held)
+        {
+            const auto begin = (i % _sample_rate == 0) ? _now() : 0;
+            for (auto& b : blocks)
+                b = std::construct_at(pool->allocate(1));
+            for (auto b : blocks)
+                pool->deallocate(b, 1);
+            if (begin != 0)
+                local.push_back(static_cast<std::uint64_t>(_now() - begin) / held);
+        }
+    });
+}
+
+// runs a critical section that touches the whole protected object, acquire(i, fn) runs fn under the lock
+template <std::size_t Bytes, typename Lock, typename Acquire>
+static _result _lock(std::size_t threads, std::size_t ops, Acquire&& acquire)
+{
+    using T = _payload<Bytes>;
+
+    Lock     lock;
+    T        shared{};
+    _samples samples;
+    return _measure(threads, threads * ops, samples, [&](std::size_t, std::vector<std::uint64_t>& local) {
+        for (std::size_t i = 0; i < ops; ++i)
+        {
+            const auto begin = (i % _sample_rate == 0) ? _now() : 0;
+            acquire(lock, i, [&]() {
+                for (auto& b : shared.data)
+                    b = static_cast<std::byte>(static_cast<unsigned>(b) + 1);
+            });
+            if (begin != 0)
+                local.push_back(static_cast<std::uint64_t>(_now() - begin));
+        }
+    });
+}
+
+template <std::size_t Bytes, typename Lock>
+static _result _exclusive_lock(std::size_t threads, std::size_t ops)
+{
+    return _lock<Bytes, Lock>(threads, ops, [](Lock& l, std::size_t, auto&& critical_section) {
+        const std::scoped_lock guard{ l };
+        critical_section();
+    });
+}
+
+template <std::size_t Bytes>
+static _result _mcs_lock(std::size_t threads, std::size_t ops)
+{
+    using concurrency::mcs_lock;
+    return _lock<Bytes, mcs_lock>(threads, ops, [](mcs_lock& l, std::size_t, auto&& critical_section) {
+        const mcs_lock::guard guard{ l };
+        critical_section();
+    });
+}
+
+template <std::size_t Bytes>
+static _result _rw_spin_lock(std::size_t threads, std::size_t ops)
+{
+    using concurrency::rw_spin_lock;
+
+    // read-mostly workload, one write every 16 operations
+    return _lock<Bytes, rw_spin_lock>(threads, ops, [](rw_spin_lock& l, std::size_t i, auto&& critical_section) {
+        if (i % 16 == 0)
+        {
+            const std::scoped_lock guard{ l };
+            critical_section();
+        }
+        else
+        {
+            l.lock_shared();
+            l.unlock_shared();
+        }
+    });
+}
+
+template <std::size_t Bytes>
+static _result _scheduler(std::size_t threads, std::size_t ops)
+{
+    using T = _payload<Bytes>;
+
+    struct _state
+    {
+        std::atomic<std::size_t>   remaining;
+        jobs::Event                done{ 1 };
+        std::vector<std::uint64_t> latencies; // one slot per job, written only by the job
+    };
+
+    // outlives the scheduler, which joins the workers that could still be signalling it
+    _state state{ .remaining = ops, .latencies = std::vector<std::uint64_t>(ops, 0) };
+
+    jobs::Scheduler::Args args;
+    args.workers = threads;
+    jobs::Scheduler s{ args };
+
+    _samples samples;
+
+    // a single external thread submits, the jobs run on the workers
+    const auto result = _measure(1, ops, samples, [&](std::size_t, std::vector<std::uint64_t>& local) {
+        for (std::size_t i = 0; i < ops; ++i)
+        {
+            T value{};
+            if (i % _sample_rate == 0)
+                value.stamp = _now();
+
+            s.submit(jobs::Job{ [p = &state, i, value]() {
+                if (value.stamp != 0)
+                    p->latencies[i] = static_cast<std::uint64_t>(_now() - value.stamp);
+                if (p->remaining.fetch_sub(1, std::memory_order::acq_rel) == 1)
+                    p->done.signal();
+            } });
+        }
+        s.wait_for(state.done);
+
+        for (const auto l : state.latencies)
+            if (l != 0)
+                local.push_back(l);
+    });
+    return result;
+}
+
+
+// reference for the concurrent lists
+class _locked_set
+{
+public:
+    explicit _locked_set(lockfree::EpochDomain&) noexcept {}
+
+    bool insert(std::int64_t key)
+    {
+        const std::scoped_lock guard{ _lock };
+        return _set.insert(key).second;
+    }
+
+    bool remove(std::int64_t key)
+    {
+        const std::scoped_lock guard{ _lock };
+        return _set.erase(key) > 0;
+    }
+
+    [[nodiscard]] bool contains(std::int64_t key) const
+    {
+        const std::scoped_lock guard{ _lock };
+        return _set.contains(key);
+    }
+
+private:
+    mutable std::mutex     _lock;
+    std::set<std::int64_t> _set;
+};
+
+template <typename Set>
+static _result _set_ops(std::size_t threads, std::size_t ops, std::uint32_t read_percent)
+{
+    // half of the keys are present at the start, insertions and removals keep the ratio
+    static constexpr const std::int64_t keys = 1024;
+
+    lockfree::EpochDomain domain;
+    Set                   set{ domain };
+    for (std::int64_t k = 0; k < keys; k += 2)
+        set.insert(k);
+
+    _samples samples;
+    return _measure(threads, threads * ops, samples, [&](std::size_t id, std::vector<std::uint64_t>& local) {
+        std::minstd_rand                            rng{ static_cast<std::uint32_t>(id + 1) };
+        std::uniform_int_distribution<std::int64_t> key{ 0, keys - 1 };
+        for (std::size_t i = 0; i < ops; ++i)
+        {
+            const auto k     = key(rng);
+            const auto op    = rng() % 100;
+            const auto begin = (i % _sample_rate == 0) ? _now() : 0;
+            if (op < read_percent)
+                (void)set.contains(k);
+            else if (op % 2 == 0)
+                set.insert(k);
+            else
+                set.remove(k);
+            if (begin != 0)
+                local.push_back(static_cast<std::uint64_t>(_now() - begin));
+        }
+    });
+}
+
+
+struct _options
+{
+    bool             json        = false;
+    std::size_t      max_threads = std::max(std::thread::hardware_concurrency(), 2u);
+    std::size_t      ops         = 200'000;
+    std::string_view filter      = {};
+};
+
+static void _print(const _options& o, std::string_view name, std::size_t threads, std::size_t payload, const _result& r)
+{
+    const auto ops_per_sec = static_cast<std::uint64_t>(r.ops_per_sec);
+    if (o.json)
+        std::cout << "{\"benchmark\":\"" << name << "\",\"threads\":" << threads
+                  << ",\"payload\":" << payload << ",\"ops_per_sec\":" << ops_per_sec
+                  << ",\"p50_ns\":" << r.p50_ns << ",\"p99_ns\":" << r.p99_ns << "}\n";
+    else
+        std::cout << name << ',' << threads << ',' << payload << ',' << ops_per_sec
+                  << ',' << r.p50_ns << ',' << r.p99_ns << '\n';
+}
+
+template <std::size_t Bytes>
+static void _run_payload(const _options& o)
+{
+    const auto enabled = [&](std::string_view name) {
+        return std::empty(o.filter) || name.find(o.filter) != std::string_view::npos;
+    };
+
+    if (enabled("srsw_queue")) // always one producer and one consumer
+        _print(o, "srsw_queue", 2, Bytes, _srsw_queue<Bytes>(2, o.ops));
+
+    for (std::size_t threads = 1; threads <= o.max_threads; threads *= 2)
+    {
+        if (enabled("mrmw_queue") && threads > 1)
+            _print(o, "mrmw_queue", threads, Bytes, _mrmw_queue<Bytes>(threads, o.ops));
+        if (enabled("static_pool"))
+            _print(o, "static_pool", threads, Bytes, _static_pool<Bytes>(threads, o.ops));
+        if (enabled("spin_lock"))
+            _print(o, "spin_lock", threads, Bytes, _exclusive_lock<Bytes, concurrency::spin_lock>(threads, o.ops));
+        if (enabled("ticket_lock"))
+            _print(o, "ticket_lock", threads, Bytes, _exclusive_lock<Bytes, concurrency::ticket_lock>(threads, o.ops));
+        if (enabled("mcs_lock"))
+            _print(o, "mcs_lock", threads, Bytes, _mcs_lock<Bytes>(threads, o.ops));
+        if (enabled("rw_spin_lock"))
+            _print(o, "rw_spin_lock", threads, Bytes, _rw_spin_lock<Bytes>(threads, o.ops));
+
+        // the payload is captured by the job, large ones don't fit
+        if constexpr (Bytes + 2 * sizeof(void*) <= jobs::Job::max_size)
+            if (enabled("scheduler"))
+                _print(o, "scheduler", threads, Bytes, _scheduler<Bytes>(threads, o.ops));
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    _options o;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string_view arg = argv[i];
+        if (arg == "--json")
+            o.json = true;
+        else if (arg == "--max-threads" && i + 1 < argc)
+            o.max_threads = std::stoul(argv[++i]);
+        else if (arg == "--ops" && i + 1 < argc)
+            o.ops = std::stoul(argv[++i]);
+        else if (arg == "--filter" && i + 1 < argc)
+            o.filter = argv[++i];
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--json] [--max-threads N] [--ops N] [--filter NAME]\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!o.json)
+        std::cout << "benchmark,threads,payload,ops_per_sec,p50_ns,p99_ns\n";
+
+    _run_payload<8>(o);
+    _run_payload<32>(o);
+    _run_payload<256>(o);
+
+    for (const std::uint32_t reads : { 50u, 90u, 99u })
+    {
+        const auto suffix = "/r" + std::to_string(reads);
+        for (std::size_t threads = 1; threads <= o.max_threads; threads *= 2)
+        {
+            const auto run = [&]<typename Set>(std::string_view name) {
+                const auto label = std::string{ name } + suffix;
+                if (std::empty(o.filter) || label.find(o.filter) != std::string::npos)
+                    _print(o, label, threads, sizeof(std::int64_t), _set_ops<Set>(threads, o.ops, reads));
+            };
+            run.template operator()<concurrency::lazy_list<std::int64_t>>("lazy_list");
+            run.template operator()<concurrency::lockfree_list<std::int64_t>>("lockfree_list");
+            run.template operator()<_locked_set>("locked_set");
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -2,52 +2,325 @@
 #ifndef DRAKO_CONCURRENT_LIST_HPP
 #define DRAKO_CONCURRENT_LIST_HPP
 
-#include <atomic>
+/// @file
+/// @brief  Thread-safe sorted linked lists with set semantics.
+/// @author Grassi Edoardo
+///
+/// Keys are immutable once a node is published, so lookups traverse the lists
+/// without locks or writes. Removed nodes are retired to an epoch domain and
+/// freed when no traversal can reach them anymore.
+
+#include "drako/concurrency/lock.hpp"
+#include "drako/concurrency/lockfree_epoch.hpp"
 
-#include "core/compiler_macros.hpp"
+#include <atomic>
+#include <cassert>
+#include <concepts>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <type_traits>
+#include <utility>
 
 namespace drako::concurrency
 {
-
     // CLASS TEMPLATE
-    // Thread-safe list implemented with lazy syncronization.
+    // Thread-safe list implemented with lazy syncronization (Heller et al.).
+    //
+    // Writers find their position without locks, then lock the two nodes
+    // around it and validate that they are still adjacent and not removed.
+    // Nodes are first marked as removed, then unlinked: lookups are wait-free.
     //
-    template <typename T>
-    class lazy_list final
+    template <typename T, typename Compare = std::less<T>> // clang-format off
+    requires std::copy_constructible<T> && std::strict_weak_order<Compare, const T&, const T&>
+    class lazy_list final // clang-format on
     {
     public:
 
+        explicit lazy_list(lockfree::EpochDomain& domain, const Compare& cmp = Compare()) noexcept
+            : _domain(domain), _less(cmp) {}
+
+        ~lazy_list() noexcept
+        {
+            for (auto n = _head.next.load(std::memory_order_acquire); n != nullptr;)
+                delete std::exchange(n, n->next.load(std::memory_order_relaxed));
+        }
+
+        lazy_list(const lazy_list&) = delete;
+        lazy_list& operator=(const lazy_list&) = delete;
+
+        // Adds a key to the list.
+        // Returns false if the key was already present.
+        //
+        bool insert(const T& key)
+        {
+            const auto guard = _domain.pin();
+            for (;;)
+            {
+                auto [pred, curr] = _find(key);
+
+                const std::scoped_lock pred_guard{ pred->lock };
+                if (!_validate(pred, curr))
+                    continue;
+
+                if (curr != nullptr && !_less(key, curr->key))
+                    return false; // curr can't be removed while pred is locked
+
+                pred->next.store(new _node{ key, curr }, std::memory_order_release);
+                return true;
+            }
+        }
+
+        // Removes a key from the list.
+        // Returns false if the key wasn't present.
+        //
+        bool remove(const T& key)
+        {
+            const auto guard = _domain.pin();
+            for (;;)
+            {
+                auto [pred, curr] = _find(key);
+                if (curr == nullptr || _less(key, curr->key))
+                {
+                    // absent, unless an insertion happened after the traversal
+                    const std::scoped_lock pred_guard{ pred->lock };
+                    if (_validate(pred, curr))
+                        return false;
+                    continue;
+                }
+
+                {
+                    const std::scoped_lock locks{ pred->lock, curr->lock };
+                    if (!_validate(pred, curr))
+                        continue;
+
+                    curr->marked.store(true, std::memory_order_release); // logical removal
+                    pred->next.store(curr->next.load(std::memory_order_relaxed), std::memory_order_release);
+                }
+                _domain.retire(curr);
+                return true;
+            }
+        }
+
+        // Checks whether a key is in the list.
+        //
+        [[nodiscard]] bool contains(const T& key) const
+        {
+            const auto guard = _domain.pin();
+
+            auto curr = _head.next.load(std::memory_order_acquire);
+            while (curr != nullptr && _less(curr->key, key))
+                curr = curr->next.load(std::memory_order_acquire);
+
+            return curr != nullptr && !_less(key, curr->key) && !curr->marked.load(std::memory_order_acquire);
+        }
+
     private:
+
+        struct _node;
+
+        // head sentinel and base of the nodes
+        struct _link
+        {
+            std::atomic<_node*> next{ nullptr };
+            std::atomic<bool>   marked{ false }; // removed from the list
+            spin_lock           lock;            // guards next and marked
+        };
+
+        struct _node : _link
+        {
+            const T key;
+
+            explicit _node(const T& k, _node* n) : key(k) { this->next.store(n, std::memory_order_relaxed); }
+        };
+
+        lockfree::EpochDomain& _domain;
+        const Compare          _less;
+        _link                  _head;
+
+        // returns the last node with a key less than the one searched and its successor
+        std::pair<_link*, _node*> _find(const T& key) noexcept
+        {
+            _link* pred = &_head;
+            auto   curr = _head.next.load(std::memory_order_acquire);
+            while (curr != nullptr && _less(curr->key, key))
+            {
+                pred = curr;
+                curr = curr->next.load(std::memory_order_acquire);
+            }
+            return { pred, curr };
+        }
+
+        // checks that the nodes are still adjacent and in the list, pred must be locked
+        static bool _validate(const _link* pred, const _node* curr) noexcept
+        {
+            return !pred->marked.load(std::memory_order_relaxed) &&
+                   pred->next.load(std::memory_order_relaxed) == curr;
+        }
     };
 
 
     // CLASS TEMPLATE
     // Lock-free linearizable list based on Harris-Michael algorithm.
     //
-    template <typename T>
-    class lockfree_list final
+    // A node is removed by setting the lowest bit of its next pointer, which
+    // makes any further CAS on it fail, then by unlinking it from its predecessor.
+    // Traversals complete the unlinking of the marked nodes they encounter.
+    //
+    template <typename T, typename Compare = std::less<T>> // clang-format off
+    requires std::copy_constructible<T> && std::strict_weak_order<Compare, const T&, const T&>
+    class lockfree_list final // clang-format on
     {
     public:
 
-        explicit lockfree_list() noexcept;
-        ~lockfree_list() noexcept;
+        explicit lockfree_list(lockfree::EpochDomain& domain, const Compare& cmp = Compare()) noexcept
+            : _domain(domain), _less(cmp) {}
+
+        ~lockfree_list() noexcept
+        {
+            for (auto n = _ptr(_head.load(std::memory_order_acquire)); n != nullptr;)
+                delete std::exchange(n, _ptr(n->next.load(std::memory_order_relaxed)));
+        }
 
         lockfree_list(const lockfree_list&) = delete;
-        lockfree_list& lockfree_list(const lockfree_list&) = delete;
+        lockfree_list& operator=(const lockfree_list&) = delete;
+
+        // Adds a key to the list.
+        // Returns false if the key was already present.
+        //
+        bool insert(const T& key)
+        {
+            const auto guard = _domain.pin();
+
+            _node* n = nullptr;
+            for (;;)
+            {
+                const auto [prev, curr, found] = _find(key);
+                if (found)
+                {
+                    delete n;
+                    return false;
+                }
 
-        void insert() noexcept;
+                if (n == nullptr)
+                    n = new _node{ key };
+                n->next.store(_link(curr), std::memory_order_relaxed);
 
-        void discard() noexcept;
+                auto expected = _link(curr);
+                if (prev->compare_exchange_strong(expected, _link(n), std::memory_order_release, std::memory_order_relaxed))
+                    return true;
+            }
+        }
 
-        void remove() noexcept;
+        // Removes a key from the list.
+        // Returns false if the key wasn't present.
+        //
+        bool remove(const T& key)
+        {
+            const auto guard = _domain.pin();
+            for (;;)
+            {
+                const auto [prev, curr, found] = _find(key);
+                if (!found)
+                    return false;
 
-        DRAKO_NODISCARD
-            bool contains(const T& value) noexcept;
+                // logical removal, only one thread can mark the node
+                const auto next = curr->next.fetch_or(_marked, std::memory_order_acq_rel);
+                if (next & _marked)
+                    continue; // removed by another thread, look again
+
+                // physical removal, left to the traversals if the predecessor changed
+                auto expected = _link(curr);
+                if (prev->compare_exchange_strong(expected, next, std::memory_order_release, std::memory_order_relaxed))
+                    _domain.retire(curr);
+                else
+                    (void)_find(key);
+                return true;
+            }
+        }
+
+        // Checks whether a key is in the list.
+        //
+        [[nodiscard]] bool contains(const T& key) const
+        {
+            const auto guard = _domain.pin();
+
+            auto curr = _ptr(_head.load(std::memory_order_acquire));
+            for (;;)
+            {
+                if (curr == nullptr)
+                    return false;
+
+                const auto next = curr->next.load(std::memory_order_acquire);
+                if (!_less(curr->key, key))
+                    return !_less(key, curr->key) && !(next & _marked);
+
+                curr = _ptr(next);
+            }
+        }
 
     private:
 
-        std::atomic<T*> _head;
-        std::atomic<T*> _tail;
+        // pointer to the next node, with the removal mark in the lowest bit
+        using _link_type = std::uintptr_t;
+
+        struct _node
+        {
+            const T                 key;
+            std::atomic<_link_type> next{ 0 };
+
+            explicit _node(const T& k) : key(k) {}
+        };
+
+        static_assert(alignof(_node) > 1, "The lowest bit of node addresses must be free.");
+
+        static constexpr const _link_type _marked = 1;
+
+        lockfree::EpochDomain&  _domain;
+        const Compare           _less;
+        std::atomic<_link_type> _head{ 0 };
+
+        struct _position
+        {
+            std::atomic<_link_type>* prev;  // link to curr
+            _node*                   curr;  // first node with a key not less than the one searched
+            bool                     found; // curr holds the key
+        };
+
+        [[nodiscard]] static _node* _ptr(_link_type l) noexcept { return reinterpret_cast<_node*>(l & ~_marked); }
+        [[nodiscard]] static _link_type _link(const _node* n) noexcept { return reinterpret_cast<_link_type>(n); }
+
+        // must be called inside a critical section of the domain
+        _position _find(const T& key)
+        {
+        retry:
+            auto prev = &_head;
+            auto curr = _ptr(prev->load(std::memory_order_acquire));
+            for (;;)
+            {
+                if (curr == nullptr)
+                    return { prev, nullptr, false };
+
+                const auto next = curr->next.load(std::memory_order_acquire);
+                if (next & _marked)
+                {
+                    // help the remover, fails if prev was removed or changed meanwhile
+                    auto expected = _link(curr);
+                    if (!prev->compare_exchange_strong(expected, next & ~_marked, std::memory_order_acq_rel, std::memory_order_relaxed))
+                        goto retry;
+
+                    _domain.retire(curr);
+                    curr = _ptr(next);
+                    continue;
+                }
+
+                if (!_less(curr->key, key))
+                    return { prev, curr, !_less(key, curr->key) };
+
+                prev = &curr->next;
+                curr = _ptr(next);
+            }
+        }
     };
 
 } // namespace drako::concurrency
@@ -0,0 +1,184 @@
+#pragma once
+#ifndef DRAKO_IDLE_STRATEGY_HPP
+#define DRAKO_IDLE_STRATEGY_HPP
+
+/// @file
+/// @brief  Backoff policy for threads that ran out of work.
+/// @author Grassi Edoardo
+
+#include "drako/core/compiler.hpp"
+#include "drako/core/platform.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#if defined(DRAKO_CC_MSVC) || defined(DRAKO_ARCH_X64)
+#include <immintrin.h>
+#endif
+
+namespace drako
+{
+    /// @brief Hints the processor that the calling thread is busy waiting.
+    DRAKO_FORCE_INLINE inline void cpu_relax() noexcept
+    {
+#if defined(DRAKO_CC_MSVC) || defined(DRAKO_ARCH_X64)
+        ::_mm_pause();
+#else
+        std::atomic_signal_fence(std::memory_order::seq_cst);
+#endif
+    }
+
+
+    /// @brief Puts idle threads to sleep without losing wake ups.
+    ///
+    /// An idle thread first spins, then yields its time slice and finally parks
+    /// on an atomic counter until a producer notifies new work. Producers pay
+    /// a single fence and load when nobody is parked.
+    ///
+    /// Protocol for consumers: poll for work with wait_until().
+    /// Protocol for producers: publish the work, then call notify_one().
+    ///
+    class IdleStrategy
+    {
+    public:
+        struct Args
+        {
+            /// @brief Polls performed while spinning, before yielding.
+            std::uint32_t spins = 64;
+
+            /// @brief Polls performed while yielding, before parking.
+            std::uint32_t yields = 16;
+        };
+
+        /// @brief Snapshot of the event counters.
+        struct Stats
+        {
+            std::uint64_t spins;  // polls that failed while spinning
+            std::uint64_t yields; // polls that failed after yielding
+            std::uint64_t parks;  // times a thread went to sleep
+            std::uint64_t wakes;  // notifications sent to parked threads
+        };
+
+        explicit IdleStrategy() noexcept
+            : IdleStrategy{ Args{} }
+        {
+        }
+
+        explicit IdleStrategy(const Args& args) noexcept
+            : _args{ args }
+        {
+        }
+
+        IdleStrategy(const IdleStrategy&) = delete;
+        IdleStrategy& operator=(const IdleStrategy&) = delete;
+
+        /// @brief Blocks the calling thread until a poll succeeds.
+        ///
+        /// @param[in] poll Returns true when the thread has something to do,
+        ///                 must observe the work published before notify_one().
+        ///
+        template <typename Poll>
+        void wait_until(Poll&& poll) noexcept(noexcept(poll()))
+        {
+            std::uint32_t i = 0;
+            for (; i < _args.spins; ++i)
+            {
+                if (poll())
+                    return _count(_stats.spins, i);
+                cpu_relax();
+            }
+            _count(_stats.spins, i);
+
+            for (i = 0; i < _args.yields; ++i)
+            {
+                if (poll())
+                    return _count(_stats.yields, i);
+                std::this_thread::yield();
+            }
+            _count(_stats.yields, i);
+
+            for (;;)
+            {
+                // read the epoch first, a notification after this point prevents the sleep
+                const auto epoch = _epoch.load(std::memory_order::acquire);
+                _sleepers.fetch_add(1, std::memory_order::relaxed);
+
+                // pairs with the fence in notify_one(): either the producer sees
+                // the sleeper or this poll sees the work
+                std::atomic_thread_fence(std::memory_order::seq_cst);
+                if (poll())
+                {
+                    _sleepers.fetch_sub(1, std::memory_order::relaxed);
+                    return;
+                }
+
+                _count(_stats.parks, 1);
+                _epoch.wait(epoch, std::memory_order::acquire);
+                _sleepers.fetch_sub(1, std::memory_order::relaxed);
+
+                if (poll())
+                    return;
+            }
+        }
+
+        /// @brief Wakes a parked thread, if any.
+        ///
+        /// Must be called after the new work has been published.
+        ///
+        void notify_one() noexcept
+        {
+            std::atomic_thread_fence(std::memory_order::seq_cst);
+            if (_sleepers.load(std::memory_order::relaxed) == 0)
+                return;
+
+            _epoch.fetch_add(1, std::memory_order::release);
+            _epoch.notify_one();
+            _count(_stats.wakes, 1);
+        }
+
+        /// @brief Wakes all the parked threads.
+        void notify_all() noexcept
+        {
+            std::atomic_thread_fence(std::memory_order::seq_cst);
+            _epoch.fetch_add(1, std::memory_order::release);
+            _epoch.notify_all();
+            _count(_stats.wakes, 1);
+        }
+
+        /// @brief Counters of the idle events since construction.
+        [[nodiscard]] Stats stats() const noexcept
+        {
+            return { .spins  = _stats.spins.load(std::memory_order::relaxed),
+                     .yields = _stats.yields.load(std::memory_order::relaxed),
+                     .parks  = _stats.parks.load(std::memory_order::relaxed),
+                     .wakes  = _stats.wakes.load(std::memory_order::relaxed) };
+        }
+
+    private:
+        const Args _args;
+
+        alignas(drako::cache_line_size)
+            std::atomic<std::uint32_t> _epoch = 0; // bumped by each notification
+        std::atomic<std::uint32_t> _sleepers  = 0; // threads about to park or parked
+
+        alignas(drako::cache_line_size) struct
+        {
+            std::atomic<std::uint64_t> spins  = 0;
+            std::atomic<std::uint64_t> yields = 0;
+            std::atomic<std::uint64_t> parks  = 0;
+            std::atomic<std::uint64_t> wakes  = 0;
+        } _stats;
+
+        // counters are updated once per idle phase to limit the traffic on their cache line
+        static void _count(std::atomic<std::uint64_t>& counter, std::uint64_t events) noexcept
+        {
+            if (events > 0)
+                counter.fetch_add(events, std::memory_order::relaxed);
+        }
+    };
+
+} // namespace drako
+
+#endif // !DRAKO_IDLE_STRATEGY_HPP
@@ -2,20 +2,117 @@
 #ifndef DRAKO_LOCK_HPP
 #define DRAKO_LOCK_HPP
 
+/// @file
+/// @brief  Busy waiting locks for short critical sections.
+/// @author Grassi Edoardo
+///
+/// Waiters back off with pause instructions between polls, so that the lock
+/// holder is not slowed down by the coherence traffic on the lock cache line.
+/// Each lock counts its contended acquisitions and the pauses of its waiters,
+/// only on the slow path: uncontended acquisitions pay nothing for them.
+
+#include "drako/concurrency/idle_strategy.hpp"
+#include "drako/core/compiler.hpp"
+#include "drako/core/platform.hpp"
+
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <thread>
 
-#include "core/compiler_macros.hpp"
-
 namespace drako::concurrency
 {
+    /// @brief Snapshot of the contention counters of a lock.
+    struct lock_stats
+    {
+        std::uint64_t contended; // acquisitions that had to wait
+        std::uint64_t pauses;    // pause instructions executed by the waiters
+    };
+
+
     // CLASS
-    // Busy waiting lock based on TTAS locking scheme.
+    // Exponential backoff made of pause instructions.
+    // After a while the time slice is yielded instead: when threads outnumber
+    // the cores, the thread that can make progress may not be running.
+    class backoff final
+    {
+    public:
+        static constexpr const std::uint32_t max_pauses = 1024;
+        static constexpr const std::uint64_t yield_after = 4 * max_pauses;
+
+        // Pauses for the current delay, then doubles it up to the max.
+        //
+        DRAKO_FORCE_INLINE void pause() noexcept
+        {
+            _wait(_pauses);
+            _pauses = std::min(_pauses * 2, max_pauses);
+        }
+
+        // Pauses for a delay proportional to the number of threads ahead of the caller.
+        //
+        DRAKO_FORCE_INLINE void pause(std::uint32_t waiters_ahead) noexcept
+        {
+            _wait(std::min(waiters_ahead * _proportional_pauses, max_pauses));
+        }
+
+        // Total number of pauses executed.
+        //
+        [[nodiscard]] std::uint64_t total() const noexcept { return _total; }
+
+    private:
+        static constexpr const std::uint32_t _proportional_pauses = 32; // rough length of a critical section
+
+        std::uint32_t _pauses = 1;
+        std::uint64_t _total  = 0;
+
+        DRAKO_FORCE_INLINE void _wait(std::uint32_t pauses) noexcept
+        {
+            if (_total >= yield_after)
+                return std::this_thread::yield();
+
+            for (std::uint32_t i = 0; i < pauses; ++i)
+                cpu_relax();
+            _total += pauses;
+        }
+    };
+
+
+    namespace _detail
+    {
+        // contention counters, updated once per contended acquisition
+        class _lock_counters
+        {
+        public:
+            void count(const backoff& b) noexcept
+            {
+                _contended.fetch_add(1, std::memory_order_relaxed);
+                _pauses.fetch_add(b.total(), std::memory_order_relaxed);
+            }
+
+            [[nodiscard]] lock_stats stats() const noexcept
+            {
+                return { .contended = _contended.load(std::memory_order_relaxed),
+                         .pauses    = _pauses.load(std::memory_order_relaxed) };
+            }
+
+        private:
+            std::atomic<std::uint64_t> _contended{ 0 };
+            std::atomic<std::uint64_t> _pauses{ 0 };
+        };
+    } // namespace _detail
+
+
+    // CLASS
+    // Busy waiting lock based on TTAS locking scheme, with exponential backoff.
+    // Cheapest when uncontended, but all the waiters poll the same cache line.
     class spin_lock final
     {
     public:
 
-        DRAKO_FORCE_INLINE explicit constexpr spin_lock() noexcept = default;
+        explicit constexpr spin_lock() noexcept = default;
 
         spin_lock(const spin_lock&) = delete;
         spin_lock& operator=(const spin_lock&) = delete;
@@ -25,25 +122,28 @@ namespace drako::concurrency
         //
         DRAKO_FORCE_INLINE void lock() noexcept
         {
+            if (_lock.exchange(false, std::memory_order_acquire))
+                return;
+
+            backoff b;
             for (;;)
             {
                 // spin on cached memory to avoid memory bus contention
-                while (!_lock.load(std::memory_order_acquire));
+                while (!_lock.load(std::memory_order_relaxed))
+                    b.pause();
 
                 // try acquisition
-                if (_lock.exchange(false, std::memory_order_acq_rel))
-                {
-                    return;
-                }
+                if (_lock.exchange(false, std::memory_order_acquire))
+                    return _counters.count(b);
             }
         }
 
         // Tries once to acquire the lock.
         //
-        DRAKO_NODISCARD DRAKO_FORCE_INLINE bool try_lock() noexcept
+        [[nodiscard]] DRAKO_FORCE_INLINE bool try_lock() noexcept
         {
-            // set locked state and return previous
-            return _lock.exchange(false, std::memory_order_acq_rel);
+            // fail without writing when the lock is taken
+            return _lock.load(std::memory_order_relaxed) && _lock.exchange(false, std::memory_order_acquire);
         }
 
         // Releases the lock.
@@ -55,70 +155,381 @@ namespace drako::concurrency
             _lock.store(true, std::memory_order_release);
         }
 
+        // Contention counters since construction.
+        //
+        [[nodiscard]] lock_stats stats() const noexcept { return _counters.stats(); }
+
     private:
 
         // true = unlocked, false = locked
-        std::atomic<bool> _lock{ true };
+        std::atomic<bool>       _lock{ true };
+        _detail::_lock_counters _counters;
     };
 
 
     // CLASS
-    // Busy waiting lock that supports multiple acquisitions from the same thread.
-    class reentrant_spin_lock final
+    // Busy waiting lock that grants the acquisitions in FIFO order.
+    // Waiters back off proportionally to their distance from the head of the line,
+    // so only the next one polls often.
+    class ticket_lock final
     {
     public:
 
-        explicit constexpr reentrant_spin_lock() noexcept = default;
+        explicit ticket_lock() noexcept = default;
+
+        ticket_lock(const ticket_lock&) = delete;
+        ticket_lock& operator=(const ticket_lock&) = delete;
 
         // Blocks until current execution context acquires the lock.
-        // 
-        inline void lock() noexcept
+        //
+        DRAKO_FORCE_INLINE void lock() noexcept
+        {
+            const auto ticket = _next.fetch_add(1, std::memory_order_relaxed);
+
+            auto serving = _serving.load(std::memory_order_acquire);
+            if (serving == ticket)
+                return;
+
+            backoff b;
+            do
+            {
+                b.pause(ticket - serving);
+                serving = _serving.load(std::memory_order_acquire);
+            } while (serving != ticket);
+            _counters.count(b);
+        }
+
+        // Tries once to acquire the lock.
+        //
+        [[nodiscard]] DRAKO_FORCE_INLINE bool try_lock() noexcept
+        {
+            auto serving = _serving.load(std::memory_order_relaxed);
+            return _next.compare_exchange_strong(serving, serving + 1, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        // Releases the lock.
+        // Current execution context must hold the lock, otherwise behaviour is undefined.
+        //
+        DRAKO_FORCE_INLINE void unlock() noexcept
         {
-            auto id = std::this_thread::get_id();
-            if (_owner.load(std::memory_order_acquire) == id)
+            // only the holder writes the counter
+            _serving.store(_serving.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        // Contention counters since construction.
+        //
+        [[nodiscard]] lock_stats stats() const noexcept { return _counters.stats(); }
+
+    private:
+
+        alignas(drako::cache_line_size)
+            std::atomic<std::uint32_t> _next{ 0 }; // ticket of the next thread that asks for the lock
+        _detail::_lock_counters _counters;
+
+        alignas(drako::cache_line_size)
+            std::atomic<std::uint32_t> _serving{ 0 }; // ticket of the thread holding the lock
+    };
+
+
+    // CLASS
+    // Busy waiting queue lock by Mellor-Crummey and Scott.
+    // Each waiter spins on a flag in its own node, so a release only touches
+    // the cache of the next waiter: throughput holds with many contending threads.
+    class mcs_lock final
+    {
+    public:
+
+        // Queue entry of a thread, must outlive the critical section.
+        //
+        struct alignas(drako::cache_line_size) node
+        {
+            std::atomic<node*> next{ nullptr };
+            std::atomic<bool>  locked{ false };
+        };
+
+        // Holds the lock for the lifetime of the object.
+        //
+        class guard final
+        {
+        public:
+            explicit guard(mcs_lock& l) noexcept
+                : _lock{ l }
             {
-                ++_counter;
+                _lock.lock(_node);
             }
-            for (;;)
+
+            ~guard() noexcept { _lock.unlock(_node); }
+
+            guard(const guard&) = delete;
+            guard& operator=(const guard&) = delete;
+
+        private:
+            mcs_lock& _lock;
+            node      _node;
+        };
+
+        explicit mcs_lock() noexcept = default;
+
+        mcs_lock(const mcs_lock&) = delete;
+        mcs_lock& operator=(const mcs_lock&) = delete;
+
+        // Blocks until current execution context acquires the lock.
+        //
+        DRAKO_FORCE_INLINE void lock(node& n) noexcept
+        {
+            n.next.store(nullptr, std::memory_order_relaxed);
+            n.locked.store(true, std::memory_order_relaxed);
+
+            const auto prev = _tail.exchange(&n, std::memory_order_acq_rel);
+            if (prev == nullptr)
+                return;
+
+            prev->next.store(&n, std::memory_order_release);
+
+            backoff b;
+            while (n.locked.load(std::memory_order_acquire))
+                b.pause();
+            _counters.count(b);
+        }
+
+        // Tries once to acquire the lock.
+        //
+        [[nodiscard]] DRAKO_FORCE_INLINE bool try_lock(node& n) noexcept
+        {
+            n.next.store(nullptr, std::memory_order_relaxed);
+            node* expected = nullptr;
+            return _tail.compare_exchange_strong(expected, &n, std::memory_order_acq_rel, std::memory_order_relaxed);
+        }
+
+        // Releases the lock, passing it to the next waiter.
+        // The node must be the one used to acquire the lock.
+        //
+        DRAKO_FORCE_INLINE void unlock(node& n) noexcept
+        {
+            auto next = n.next.load(std::memory_order_acquire);
+            if (next == nullptr)
             {
-                while (_owner.load() != std::thread::id());
+                auto expected = &n;
+                if (_tail.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel, std::memory_order_relaxed))
+                    return;
+
+                // a waiter swapped the tail but didn't link its node yet
+                while ((next = n.next.load(std::memory_order_acquire)) == nullptr)
+                    cpu_relax();
+            }
+            next->locked.store(false, std::memory_order_release);
+        }
+
+        // Contention counters since construction.
+        //
+        [[nodiscard]] lock_stats stats() const noexcept { return _counters.stats(); }
+
+    private:
 
-                if (_owner.exchange(id, std::memory_order_acq_rel) == std::thread::id())
+        alignas(drako::cache_line_size)
+            std::atomic<node*> _tail{ nullptr }; // last thread in the queue, null when unlocked
+        _detail::_lock_counters _counters;
+    };
+
+
+    // CLASS
+    // Busy waiting reader-writer lock for read-mostly data.
+    // Readers register on one of several counters, each on its own cache line,
+    // so concurrent readers don't contend with each other. A writer first blocks
+    // new readers, then waits for all the counters to drain: writes are expensive.
+    // Satisfies the SharedLockable requirements.
+    class rw_spin_lock final
+    {
+    public:
+
+        static constexpr const std::size_t stripes = 16;
+
+        explicit rw_spin_lock() noexcept = default;
+
+        rw_spin_lock(const rw_spin_lock&) = delete;
+        rw_spin_lock& operator=(const rw_spin_lock&) = delete;
+
+        // Blocks until current execution context acquires exclusive ownership.
+        //
+        void lock() noexcept
+        {
+            backoff b;
+            bool    contended = false;
+
+            // block new readers and other writers
+            while (_writer.exchange(true, std::memory_order_seq_cst))
+            {
+                contended = true;
+                while (_writer.load(std::memory_order_relaxed))
+                    b.pause();
+            }
+
+            // wait for the readers that got in before
+            for (const auto& s : _readers)
+                while (s.count.load(std::memory_order_acquire) != 0)
                 {
-                    return;
+                    contended = true;
+                    b.pause();
                 }
-            }
+
+            if (contended)
+                _counters.count(b);
         }
 
-        DRAKO_NODISCARD inline bool try_lock() noexcept
+        // Tries once to acquire exclusive ownership.
+        //
+        [[nodiscard]] bool try_lock() noexcept
         {
-            
+            if (_writer.load(std::memory_order_relaxed) || _writer.exchange(true, std::memory_order_seq_cst))
+                return false;
+
+            for (const auto& s : _readers)
+                if (s.count.load(std::memory_order_acquire) != 0)
+                {
+                    _writer.store(false, std::memory_order_release);
+                    return false;
+                }
+            return true;
         }
 
-        // Releases the lock.
-        // Current execution context must hold the lock, otherwise behaviour is undefined.
+        // Releases exclusive ownership.
         //
-        inline void unlock() noexcept
+        void unlock() noexcept
+        {
+            _writer.store(false, std::memory_order_release);
+        }
+
+        // Blocks until current execution context acquires shared ownership.
+        // Shared ownership must be released by the same thread.
+        //
+        void lock_shared() noexcept
         {
-            --_counter;
-            if (_counter == 0)
+            if (try_lock_shared())
+                return;
+
+            backoff b;
+            do
             {
-                _owner.store(std::thread::id(), std::memory_order_release);
-            }
+                while (_writer.load(std::memory_order_relaxed))
+                    b.pause();
+            } while (!try_lock_shared());
+            _counters.count(b);
+        }
+
+        // Tries once to acquire shared ownership.
+        //
+        [[nodiscard]] bool try_lock_shared() noexcept
+        {
+            auto& s = _readers[_stripe()].count;
+
+            // pairs with the exchange in lock(): either the writer sees this reader
+            // or this reader sees the writer
+            s.fetch_add(1, std::memory_order_seq_cst);
+            if (!_writer.load(std::memory_order_seq_cst))
+                return true;
+
+            s.fetch_sub(1, std::memory_order_release);
+            return false;
+        }
+
+        // Releases shared ownership.
+        //
+        void unlock_shared() noexcept
+        {
+            _readers[_stripe()].count.fetch_sub(1, std::memory_order_release);
         }
 
+        // Contention counters since construction.
+        //
+        [[nodiscard]] lock_stats stats() const noexcept { return _counters.stats(); }
+
     private:
 
-        std::atomic<std::thread::id>    _owner{};
-        uint32_t                        _counter{ 0 };
+        struct alignas(drako::cache_line_size) _stripe_counter
+        {
+            std::atomic<std::uint32_t> count{ 0 };
+        };
+
+        alignas(drako::cache_line_size)
+            std::atomic<bool> _writer{ false };
+        _detail::_lock_counters _counters;
+
+        std::array<_stripe_counter, stripes> _readers;
+
+        // threads are assigned to the counters in round robin
+        [[nodiscard]] static std::size_t _stripe() noexcept
+        {
+            static std::atomic<std::size_t> next{ 0 };
+            thread_local const std::size_t   stripe = next.fetch_add(1, std::memory_order_relaxed) % stripes;
+            return stripe;
+        }
     };
 
 
-    class read_write_lock final
+    // CLASS
+    // Busy waiting lock that supports multiple acquisitions from the same thread.
+    class reentrant_spin_lock final
     {
     public:
 
+        explicit constexpr reentrant_spin_lock() noexcept = default;
+
+        // Blocks until current execution context acquires the lock.
+        //
+        inline void lock() noexcept
+        {
+            const auto id = std::this_thread::get_id();
+            if (_owner.load(std::memory_order_relaxed) == id)
+            {
+                ++_counter; // already held by this thread
+                return;
+            }
+
+            backoff b;
+            for (auto expected = std::thread::id();
+                 !_owner.compare_exchange_weak(expected, id, std::memory_order_acquire, std::memory_order_relaxed);
+                 expected = std::thread::id())
+            {
+                while (_owner.load(std::memory_order_relaxed) != std::thread::id())
+                    b.pause();
+            }
+            _counter = 1;
+        }
+
+        [[nodiscard]] inline bool try_lock() noexcept
+        {
+            const auto id = std::this_thread::get_id();
+            if (_owner.load(std::memory_order_relaxed) == id)
+            {
+                ++_counter;
+                return true;
+            }
+
+            auto expected = std::thread::id();
+            if (_owner.compare_exchange_strong(expected, id, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                _counter = 1;
+                return true;
+            }
+            return false;
+        }
+
+        // Releases the lock.
+        // Current execution context must hold the lock, otherwise behaviour is undefined.
+        //
+        inline void unlock() noexcept
+        {
+            assert(_owner.load(std::memory_order_relaxed) == std::this_thread::get_id());
+            assert(_counter > 0);
+
+            if (--_counter == 0)
+                _owner.store(std::thread::id(), std::memory_order_release);
+        }
+
     private:
+
+        std::atomic<std::thread::id>    _owner{};
+        std::uint32_t                   _counter{ 0 }; // only accessed by the owner
     };
 
 
@@ -128,40 +539,46 @@ namespace drako::concurrency
     {
     public:
 
-        DRAKO_FORCE_INLINE explicit spin_semaphore(uint16_t thread_count) noexcept
+        DRAKO_FORCE_INLINE explicit spin_semaphore(std::uint16_t thread_count) noexcept
             : _capacity(thread_count)
         {
-            // TODO: assert _capacity != 0
+            assert(_capacity != 0);
         }
 
         DRAKO_FORCE_INLINE void lock() noexcept
         {
+            backoff b;
             for (;;)
             {
-                while (_counter.load(std::memory_order_acquire) > _capacity);
-
-                if (_counter.fetch_add(1, std::memory_order_acq_rel) <= _capacity)
-                {
+                while (_counter.load(std::memory_order_relaxed) >= _capacity)
+                    b.pause();
 
-                }
+                if (try_lock())
+                    return;
             }
         }
 
-        DRAKO_NODISCARD DRAKO_FORCE_INLINE bool try_lock() noexcept
+        [[nodiscard]] DRAKO_FORCE_INLINE bool try_lock() noexcept
         {
-
+            auto count = _counter.load(std::memory_order_relaxed);
+            while (count < _capacity)
+            {
+                if (_counter.compare_exchange_weak(count, count + 1, std::memory_order_acquire, std::memory_order_relaxed))
+                    return true;
+            }
+            return false;
         }
 
         DRAKO_FORCE_INLINE void unlock() noexcept
         {
-
+            _counter.fetch_sub(1, std::memory_order_release);
         }
 
 
     private:
 
-        const uint16_t          _capacity;
-        std::atomic<uint16_t>   _counter{ 0 };
+        const std::uint16_t          _capacity;
+        std::atomic<std::uint16_t>   _counter{ 0 };
     };
 
 } // namespace drako::concurrency
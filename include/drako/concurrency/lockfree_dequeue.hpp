@@ -2,19 +2,66 @@
 #ifndef DRAKO_LOCKFREE_DEQUEUE_HPP
 #define DRAKO_LOCKFREE_DEQUEUE_HPP
 
+/// @file
+/// @brief  Work-stealing double ended queue.
+/// @author Grassi Edoardo
+///
+/// Bounded variant of the Chase-Lev deque, with the memory orderings from
+/// "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al. 2013).
+
+#include "drako/core/platform.hpp"
+
 #include <atomic>
+#include <bit>
+#include <cassert>
+#include <cstdint>
 #include <memory>
+#include <type_traits>
 
 namespace drako::lockfree
 {
-    template <typename T, typename Al = std::allocator<T>> // clang-format off
-    requires std::atomic<std::size_t>::is_always_lock_free
+    /// @brief Single owner, multiple thieves double ended queue.
+    ///
+    /// The owner thread inserts and removes elements at the bottom of the queue (LIFO),
+    /// while any other thread can steal elements from the top (FIFO).
+    ///
+    /// @tparam T  Type of the stored elements.
+    /// @tparam Al Allocator for the backing buffer.
+    ///
+    template <typename T, typename Al = std::allocator<std::atomic<T>>> // clang-format off
+    requires std::is_trivially_copyable_v<T> && std::atomic<std::int64_t>::is_always_lock_free
     class DEQueue // clang-format on
     {
-        static_assert(ATOMIC_LONG_LOCK_FREE == 2, "Not lockfree.");
+        static_assert(std::atomic<T>::is_always_lock_free, "Not lockfree.");
+
+        using _al_traits = std::allocator_traits<Al>;
 
     public:
-        explicit DEQueue(std::size_t capacity);
+        using value_type     = T;
+        using size_type      = std::size_t;
+        using allocator_type = Al;
+
+        /// @brief Constructs a queue with specified capacity.
+        ///
+        /// @param[in] capacity Max number of elements, rounded up to a power of 2.
+        ///
+        explicit DEQueue(size_type capacity, const Al& alloc = Al())
+            : _alloc{ alloc }
+            , _mask{ std::bit_ceil(capacity) - 1 }
+            , _data{ _al_traits::allocate(_alloc, _mask + 1) }
+            , _top{ 0 }
+            , _bottom{ 0 }
+        {
+            assert(capacity > 0);
+            for (size_type i = 0; i <= _mask; ++i)
+                _al_traits::construct(_alloc, _data + i);
+        }
+
+        ~DEQueue() noexcept
+        {
+            assert(_data != nullptr);
+            _al_traits::deallocate(_alloc, _data, _mask + 1);
+        }
 
         DEQueue(const DEQueue&) = delete;
         DEQueue& operator=(const DEQueue&) = delete;
@@ -23,48 +70,101 @@ namespace drako::lockfree
         DEQueue& operator=(DEQueue&&) = delete;
 
 
-        bool enque(const T& value) noexcept(std::is_nothrow_copy_constructible_v<T>)
+        /// @brief Inserts an element at the bottom of the queue.
+        ///
+        /// @return Returns true if the operation succeeded, false if the queue is full.
+        ///
+        /// @note Can only be called by the owner thread.
+        ///
+        [[nodiscard]] bool enque(const T& value) noexcept
         {
-            const auto old_head = _head.load();
-            const auto old_tail = _tail.load();
-            const auto size     = old_head - old_tail;
-            if (size >= _size) // no space left in the buffer
+            const auto b = _bottom.load(std::memory_order::relaxed);
+            const auto t = _top.load(std::memory_order::acquire);
+            if (b - t > static_cast<std::int64_t>(_mask)) // no space left in the buffer
                 [[unlikely]] return false;
 
-            _data[old_head] = value;
-            _head.store(old_head + 1);
+            _data[b & _mask].store(value, std::memory_order::relaxed);
+            _bottom.store(b + 1, std::memory_order::release);
+            return true;
         }
 
-        bool deque(T& value) noexcept
+        /// @brief Removes the most recently inserted element.
+        ///
+        /// @return Returns true if the operation succeeded, false if the queue is empty.
+        ///
+        /// @note Can only be called by the owner thread.
+        ///
+        [[nodiscard]] bool deque(T& value) noexcept
         {
-            const auto bottom = _head.load();
-            const auto old_top = _tail.load();
+            const auto b = _bottom.load(std::memory_order::relaxed) - 1;
+            _bottom.store(b, std::memory_order::relaxed);
+            std::atomic_thread_fence(std::memory_order::seq_cst);
+            auto t = _top.load(std::memory_order::relaxed);
 
+            if (t > b) // queue was already empty, restore bottom
+            {
+                _bottom.store(b + 1, std::memory_order::relaxed);
+                return false;
+            }
+
+            value = _data[b & _mask].load(std::memory_order::relaxed);
+            if (t != b) // more than one element left, no race with thieves
+                return true;
+
+            // last element: race against concurrent thieves
+            const auto won = _top.compare_exchange_strong(t, t + 1,
+                std::memory_order::seq_cst, std::memory_order::relaxed);
+            _bottom.store(b + 1, std::memory_order::relaxed);
+            return won;
         }
 
-        bool steal(T& value) noexcept
+        /// @brief Removes the least recently inserted element.
+        ///
+        /// @return Returns true if the operation succeeded, false if the queue
+        ///         is empty or another thread won the race for the element.
+        ///
+        /// @note Can be called by any thread.
+        ///
+        [[nodiscard]] bool steal(T& value) noexcept
         {
-            const auto old_tail = _tail.load();
-            const auto old_head = _head.load();
-            const auto size     = old_head - old_tail;
-            if (size <= 0) // no item to steal
+            auto t = _top.load(std::memory_order::acquire);
+            std::atomic_thread_fence(std::memory_order::seq_cst);
+            const auto b = _bottom.load(std::memory_order::acquire);
+
+            if (t >= b) // no item to steal
                 return false;
-            const auto v = _data[old_tail];
-            if (_tail.compare_exchange_strong(old_tail, old_tail + 1))
-            {
-                value = v;
-                return true;
-            }
-            return false;
+
+            value = _data[t & _mask].load(std::memory_order::relaxed);
+            return _top.compare_exchange_strong(t, t + 1,
+                std::memory_order::seq_cst, std::memory_order::relaxed);
         }
 
+        /// @brief Checks whether the queue is empty.
+        [[nodiscard]] bool empty() const noexcept { return size() == 0; }
+
+        /// @brief Approximate number of elements in the queue.
+        [[nodiscard]] size_type size() const noexcept
+        {
+            const auto b = _bottom.load(std::memory_order::relaxed);
+            const auto t = _top.load(std::memory_order::relaxed);
+            return (b > t) ? static_cast<size_type>(b - t) : 0;
+        }
+
+        /// @brief Capacity of the queue.
+        [[nodiscard]] constexpr size_type capacity() const noexcept { return _mask + 1; }
+
     private:
-        const std::size_t        _size;
-        std::atomic<std::size_t> _head;
-        std::atomic<std::size_t> _tail;
-        T                        _data[100];
+        Al               _alloc;
+        const size_type  _mask;
+        std::atomic<T>*  _data;
+
+        alignas(drako::cache_line_size)
+            std::atomic<std::int64_t> _top; // next index to be stolen
+
+        alignas(drako::cache_line_size)
+            std::atomic<std::int64_t> _bottom; // next index to be written by the owner
     };
 
 } // namespace drako::lockfree
 
-#endif // !DRAKO_LOCKFREE_DEQUEUE_HPP
\ No newline at end of file
+#endif // !DRAKO_LOCKFREE_DEQUEUE_HPP
@@ -0,0 +1,389 @@
+#pragma once
+#ifndef DRAKO_LOCKFREE_EPOCH_HPP
+#define DRAKO_LOCKFREE_EPOCH_HPP
+
+/// @file
+/// @brief  Epoch-based memory reclamation for lock-free containers.
+/// @author Grassi Edoardo
+///
+/// Threads access the shared nodes of a container inside critical sections,
+/// each one tagged with the global epoch observed on entry. Unlinked nodes are
+/// retired with the epoch of their removal and freed only after the global
+/// epoch advanced twice: by then every thread that could still reference them
+/// has left its critical section. The epoch advances only when all the threads
+/// inside a critical section observed the current one.
+
+#include "drako/concurrency/idle_strategy.hpp"
+#include "drako/core/platform.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace drako::lockfree
+{
+    class EpochDomain;
+
+    namespace _detail
+    {
+        // domains alive in the process, looked up by the threads that exit
+        struct _epoch_registry
+        {
+            std::mutex                 lock;
+            std::vector<std::uint64_t> live; // guarded by lock
+            std::uint64_t              next_id = 1;
+        };
+
+        inline _epoch_registry& _registry() noexcept
+        {
+            static _epoch_registry r;
+            return r;
+        }
+
+        // records owned by the current thread, given back to their domains on thread exit
+        struct _epoch_thread_cache
+        {
+            struct entry
+            {
+                std::uint64_t      domain;
+                std::atomic<bool>* in_use; // flag of the record owned by the thread
+                void*              record;
+            };
+
+            std::vector<entry> entries;
+
+            ~_epoch_thread_cache() noexcept
+            {
+                auto&                  r = _registry();
+                const std::scoped_lock guard{ r.lock };
+                for (const auto& e : entries)
+                    if (std::find(std::begin(r.live), std::end(r.live), e.domain) != std::end(r.live))
+                        e.in_use->store(false, std::memory_order::release);
+            }
+        };
+
+        inline _epoch_thread_cache& _thread_cache() noexcept
+        {
+            thread_local _epoch_thread_cache c;
+            return c;
+        }
+    } // namespace _detail
+
+
+    /// @brief Reclamation domain shared by a set of lock-free containers.
+    ///
+    /// Each thread registers with the domain on first use and keeps three bags
+    /// of retired objects, one per live epoch. Garbage is bounded per thread:
+    /// a thread that exceeds the limit waits for the other threads to leave
+    /// their critical sections, so memory doesn't grow behind a stalled reader.
+    ///
+    class EpochDomain
+    {
+        struct _record;
+
+    public:
+        struct Args
+        {
+            /// @brief Retired objects between two attempts to advance the epoch.
+            std::size_t collect_threshold = 64;
+
+            /// @brief Max number of objects retired by a thread and not freed yet.
+            std::size_t max_garbage = 4096;
+        };
+
+        /// @brief Critical section of the owner thread, ends on destruction.
+        ///
+        /// Objects reachable from a container while the guard is alive
+        /// are not freed until the guard is destroyed.
+        ///
+        class Guard
+        {
+        public:
+            Guard(Guard&& other) noexcept
+                : _domain{ std::exchange(other._domain, nullptr) }, _owner{ other._owner } {}
+
+            Guard& operator=(Guard&&) = delete;
+
+            Guard(const Guard&) = delete;
+            Guard& operator=(const Guard&) = delete;
+
+            ~Guard() noexcept
+            {
+                if (_domain)
+                    _domain->_unpin(*_owner);
+            }
+
+        private:
+            friend class EpochDomain;
+
+            explicit Guard(EpochDomain& d, _record& r) noexcept
+                : _domain{ &d }, _owner{ &r } {}
+
+            EpochDomain* _domain;
+            _record*     _owner; // record of the thread that entered the critical section
+        };
+
+        explicit EpochDomain()
+            : EpochDomain{ Args{} }
+        {
+        }
+
+        explicit EpochDomain(const Args& args)
+            : _args{ args }
+        {
+            assert(args.collect_threshold > 0);
+            assert(args.max_garbage >= args.collect_threshold);
+
+            auto&                  r = _detail::_registry();
+            const std::scoped_lock guard{ r.lock };
+            _id = r.next_id++;
+            r.live.push_back(_id);
+        }
+
+        /// @brief Frees all the retired objects.
+        ///
+        /// @note No thread may be inside a critical section of the domain.
+        ///
+        ~EpochDomain() noexcept
+        {
+            {
+                auto&                  r = _detail::_registry();
+                const std::scoped_lock guard{ r.lock };
+                r.live.erase(std::find(std::begin(r.live), std::end(r.live), _id));
+            }
+
+            for (auto rec = _records.load(std::memory_order::acquire); rec != nullptr;)
+            {
+                assert(!(rec->state.load(std::memory_order::relaxed) & _pinned));
+                for (auto& b : rec->bags)
+                    _free(b);
+
+                delete std::exchange(rec, rec->next);
+            }
+        }
+
+        EpochDomain(const EpochDomain&) = delete;
+        EpochDomain& operator=(const EpochDomain&) = delete;
+
+        /// @brief Enters a critical section on the calling thread.
+        ///
+        /// Critical sections can be nested, only the outermost one is tracked.
+        ///
+        [[nodiscard]] Guard pin()
+        {
+            auto& r = _local();
+            if (r.nesting++ == 0)
+            {
+                auto epoch = _epoch.load(std::memory_order::relaxed);
+                for (;;)
+                {
+                    // either the advancing thread sees this thread pinned, or this thread
+                    // sees the new epoch; the exchange also extends the release sequence
+                    // of the last unpin, so objects read before it can be freed safely
+                    r.state.exchange((epoch << 1) | _pinned, std::memory_order::seq_cst);
+
+                    const auto current = _epoch.load(std::memory_order::seq_cst);
+                    if (current == epoch)
+                        break;
+                    epoch = current;
+                }
+            }
+            return Guard{ *this, r };
+        }
+
+        /// @brief Checks whether the calling thread is inside a critical section.
+        [[nodiscard]] bool is_pinned()
+        {
+            return _local().nesting > 0;
+        }
+
+        /// @brief Schedules the deletion of an object that is no longer reachable.
+        ///
+        /// The object must have been unlinked from the container before this call.
+        ///
+        template <typename T>
+        void retire(T* p)
+        {
+            retire(p, [](void* q) { delete static_cast<T*>(q); });
+        }
+
+        /// @brief Schedules the release of a memory block that is no longer reachable.
+        ///
+        /// @param[in] p       Pointer to the block.
+        /// @param[in] deleter Function that releases the block.
+        ///
+        void retire(void* p, void (*deleter)(void*))
+        {
+            assert(p);
+            assert(deleter);
+
+            auto&      r     = _local();
+            const auto epoch = _epoch.load(std::memory_order::acquire);
+
+            auto& b = r.bags[epoch % std::size(r.bags)];
+            if (b.epoch != epoch) // the bag holds objects retired three epochs ago or more
+            {
+                r.garbage -= std::size(b.items);
+                _free(b);
+                b.epoch = epoch;
+            }
+            b.items.push_back({ p, deleter });
+            ++r.garbage;
+
+            if (++r.retired % _args.collect_threshold == 0)
+                _collect(r);
+
+            // wait for the other threads to leave their critical sections, unless the
+            // garbage belongs to the critical section of the calling thread itself
+            for (std::uint32_t i = 0; r.garbage >= _args.max_garbage && r.nesting == 0; ++i)
+            {
+                _collect(r);
+                if (i > 64)
+                    std::this_thread::yield();
+                else
+                    cpu_relax();
+            }
+        }
+
+        /// @brief Frees the objects retired by the calling thread that are no longer reachable.
+        void collect()
+        {
+            _collect(_local());
+        }
+
+        /// @brief Current global epoch.
+        [[nodiscard]] std::uint64_t epoch() const noexcept
+        {
+            return _epoch.load(std::memory_order::relaxed);
+        }
+
+        /// @brief Number of objects retired by the calling thread and not freed yet.
+        [[nodiscard]] std::size_t pending()
+        {
+            return _local().garbage;
+        }
+
+    private:
+        struct _retired
+        {
+            void* p;
+            void (*deleter)(void*);
+        };
+
+        struct _bag
+        {
+            std::uint64_t         epoch = 0;
+            std::vector<_retired> items;
+        };
+
+        struct alignas(drako::cache_line_size) _record
+        {
+            std::atomic<std::uint64_t> state  = 0; // epoch observed on entry, shifted, and pinned bit
+            std::atomic<bool>          in_use = true;
+            _record*                   next   = nullptr; // immutable once the record is published
+
+            // owner only
+            std::uint32_t       nesting = 0;
+            std::size_t         garbage = 0;
+            std::size_t         retired = 0;
+            std::array<_bag, 3> bags; // objects retired in each of the live epochs
+        };
+
+        static constexpr const std::uint64_t _pinned = 1;
+
+        const Args    _args;
+        std::uint64_t _id;
+
+        alignas(drako::cache_line_size)
+            std::atomic<std::uint64_t> _epoch = 2; // objects retired in epoch e are freed from epoch e + 2
+        std::atomic<_record*> _records = nullptr;   // all the records ever created, never shrinks
+
+        // record of the calling thread, registered on first use
+        _record& _local()
+        {
+            auto& cache = _detail::_thread_cache();
+            for (const auto& e : cache.entries)
+                if (e.domain == _id)
+                    return *static_cast<_record*>(e.record);
+
+            // reuse the record of a thread that exited, or create a new one
+            _record* r = nullptr;
+            for (auto it = _records.load(std::memory_order::acquire); it != nullptr && !r; it = it->next)
+                if (!it->in_use.load(std::memory_order::relaxed) && !it->in_use.exchange(true, std::memory_order::acquire))
+                    r = it;
+
+            if (!r)
+            {
+                r       = new _record{};
+                r->next = _records.load(std::memory_order::relaxed);
+                while (!_records.compare_exchange_weak(r->next, r, std::memory_order::release, std::memory_order::relaxed))
+                    ;
+            }
+
+            // forget the records of the domains destroyed in the meantime
+            {
+                auto&                  reg = _detail::_registry();
+                const std::scoped_lock guard{ reg.lock };
+                std::erase_if(cache.entries, [&](const auto& e) {
+                    return std::find(std::begin(reg.live), std::end(reg.live), e.domain) == std::end(reg.live);
+                });
+            }
+            cache.entries.push_back({ _id, &r->in_use, r });
+            return *r;
+        }
+
+        void _unpin(_record& r) noexcept
+        {
+            assert(r.nesting > 0);
+            if (--r.nesting == 0)
+                r.state.store(0, std::memory_order::release);
+        }
+
+        // advances the global epoch if all the pinned threads observed the current one
+        void _try_advance() noexcept
+        {
+            const auto epoch = _epoch.load(std::memory_order::seq_cst);
+
+            // synchronizes with the unpinning of the threads that observed older epochs
+            for (auto r = _records.load(std::memory_order::acquire); r != nullptr; r = r->next)
+            {
+                const auto state = r->state.load(std::memory_order::seq_cst);
+                if ((state & _pinned) && (state >> 1) != epoch)
+                    return;
+            }
+
+            // fails only if another thread advanced the epoch first
+            auto expected = epoch;
+            _epoch.compare_exchange_strong(expected, epoch + 1, std::memory_order::seq_cst, std::memory_order::relaxed);
+        }
+
+        void _collect(_record& r) noexcept
+        {
+            _try_advance();
+            const auto epoch = _epoch.load(std::memory_order::acquire);
+            for (auto& b : r.bags)
+                if (b.epoch + 2 <= epoch && !std::empty(b.items))
+                {
+                    r.garbage -= std::size(b.items);
+                    _free(b);
+                }
+        }
+
+        static void _free(_bag& b) noexcept
+        {
+            for (const auto& item : b.items)
+                item.deleter(item.p);
+            b.items.clear();
+        }
+    };
+
+} // namespace drako::lockfree
+
+#endif // !DRAKO_LOCKFREE_EPOCH_HPP
@@ -2,23 +2,39 @@
 // \author  Grassi Edoardo
 //
 
+#pragma once
 #ifndef DRAKO_LOCKFREE_LINKED_STACK_HPP
 #define DRAKO_LOCKFREE_LINKED_STACK_HPP
 
-#include <atomic>
+#include "drako/concurrency/lockfree_epoch.hpp"
 
-#include "drako/core/drako_compiler.hpp"
-#include "drako/core/lockfree_pool_allocator.hpp"
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace drako::lockfree
 {
-    template <typename Ty>
-    class linked_stack final
+    /// @brief Thread-safe unbounded stack (Treiber stack).
+    ///
+    /// Nodes removed by a thread may still be read by the others, so they are
+    /// retired to an epoch domain instead of being deleted right away. This also
+    /// prevents the ABA problem: a node address can't be reused while any thread
+    /// that loaded it is still inside its critical section.
+    ///
+    template <typename Ty> // clang-format off
+    requires std::is_nothrow_move_constructible_v<Ty>
+    class linked_stack final // clang-format on
     {
     public:
 
-        explicit linked_stack(const size_t size) noexcept : allocator(size) {}
-        ~linked_stack() noexcept = default;
+        explicit linked_stack(EpochDomain& domain) noexcept : _domain(domain) {}
+
+        ~linked_stack() noexcept
+        {
+            for (auto n = _head.load(std::memory_order_acquire); n != nullptr;)
+                delete std::exchange(n, n->next);
+        }
 
         linked_stack(linked_stack const&) = delete;
         linked_stack& operator=(linked_stack const&) = delete;
@@ -27,91 +43,64 @@ namespace drako::lockfree
         linked_stack& operator=(linked_stack &&) = delete;
 
 
-        DRAKO_NODISCARD bool is_empty() const noexcept;
-
-        bool push(Ty const& data) noexcept;
+        [[nodiscard]] bool is_empty() const noexcept;
 
-        bool pop(Ty& result) noexcept;
+        // Returns false if the allocation of the node failed.
+        bool push(Ty const& data) noexcept(std::is_nothrow_copy_constructible_v<Ty>);
 
-        bool push_unsafe(Ty const& data) noexcept;
-
-        bool peek_unsafe(Ty& result) noexcept;
-
-        bool pop_unsafe(Ty& result) noexcept;
+        // Returns false if the stack is empty.
+        bool pop(Ty& result);
 
     private:
 
         struct node final
         {
-            const Ty data;
+            Ty data;
             node* next;
 
-            explicit node(Ty const& data_) noexcept : data(data_) {}
+            explicit node(Ty const& data_) noexcept(std::is_nothrow_copy_constructible_v<Ty>) : data(data_), next(nullptr) {}
         };
 
-        std::atomic<Ty*> head = nullptr;
-        memory::lockfree_object_pool<node> allocator;
+        std::atomic<node*> _head = nullptr;
+        EpochDomain&       _domain;
     };
 
-    template<typename Ty>
+    template <typename Ty> requires std::is_nothrow_move_constructible_v<Ty>
     inline bool linked_stack<Ty>::is_empty() const noexcept
     {
-        return this->head.load(std::memory_order_relaxed) == nullptr;
+        return _head.load(std::memory_order_relaxed) == nullptr;
     }
 
-    template<typename Ty>
-    inline bool linked_stack<Ty>::push(Ty const& data) noexcept
+    template <typename Ty> requires std::is_nothrow_move_constructible_v<Ty>
+    inline bool linked_stack<Ty>::push(Ty const& data) noexcept(std::is_nothrow_copy_constructible_v<Ty>)
     {
-        node* new_node = new (this->allocator.allocate(sizeof(Ty))) node(data);
+        node* new_node = new (std::nothrow) node(data);
         if (new_node == nullptr) { return false; }
 
-        new_node.next = this->head.load();
-        while (!this->head.compare_exchange_weak(new_node.next, new_node));
+        // the node isn't dereferenced by other threads before being published
+        new_node->next = _head.load(std::memory_order_relaxed);
+        while (!_head.compare_exchange_weak(new_node->next, new_node, std::memory_order_release, std::memory_order_relaxed));
         return true;
     }
 
-    template<typename Ty>
-    inline bool linked_stack<Ty>::pop(Ty& result) noexcept
+    template <typename Ty> requires std::is_nothrow_move_constructible_v<Ty>
+    inline bool linked_stack<Ty>::pop(Ty& result)
     {
-        node* old_head = this->head.load();
-        do
+        node* old_head;
         {
-            if (old_head == nullptr) { return false; }
+            // old_head->next can be read safely until the guard is released
+            const auto guard = _domain.pin();
+            old_head = _head.load(std::memory_order_acquire);
+            do
+            {
+                if (old_head == nullptr) { return false; }
+            }
+            while (!_head.compare_exchange_weak(old_head, old_head->next, std::memory_order_acquire, std::memory_order_acquire));
         }
-        while (!head.compare_exchange_weak(old_head, old_head->next));
-
-        result = old_head;
-        this->allocator.deallocate(old_head);
-        return true;
-    }
 
-    template<typename Ty>
-    inline bool linked_stack<Ty>::push_unsafe(Ty const& data) noexcept
-    {
-        node* new_node = new (this->allocator.allocate(sizeof(Ty))) node(data);
-        if (new_node == nullptr) { return false; }
-
-        new_node.next = this->head.load(std::memory_order_relaxed);
-        this->head.store(new_node, std::memory_order_relaxed);
-        return true;
-    }
-
-    template<typename Ty>
-    inline bool linked_stack<Ty>::peek_unsafe(Ty& result) noexcept
-    {
-        auto curr_head = this->head.load(std::memory_order_relaxed);
-        if (curr_head == nullptr) { return false; }
-        result = curr_head;
-        return true;
-    }
-
-    template<typename Ty>
-    inline bool linked_stack<Ty>::pop_unsafe(Ty& result) noexcept
-    {
-        auto curr_head = this->head.load(std::memory_order_relaxed);
-        if (curr_head == nullptr) { return false; }
-        this->head = curr_head.next;
-        result = curr_head;
+        // only the winner of the CAS accesses the data
+        result = std::move(old_head->data);
+        _domain.retire(old_head);
         return true;
     }
 }
@@ -1,46 +1,68 @@
 /// @file
 /// @brief       Data structure with FIFO paradigm designed for concurrency.
 /// @author      Grassi Edoardo
-/// @date        Last update: 16-05-2019
+///
+/// Bounded ring with a sequence number in each slot, from the MPMC queue
+/// of Dmitry Vyukov. Producers and consumers claim slots with a CAS on their
+/// own index, then the slot sequence hands the element over without locks.
 
 #pragma once
 #ifndef DRAKO_LOCKFREE_MRMWQUEUE_HPP
 #define DRAKO_LOCKFREE_MRMWQUEUE_HPP
 
-#include "drako/concurrency/lockfree_pool_allocator.hpp"
+#include "drako/core/platform.hpp"
 
+#include <algorithm>
 #include <atomic>
+#include <bit>
 #include <cassert>
-#include <limits>
-#include <optional>
-#include <tuple>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
 
 namespace drako::lockfree
 {
     /// @brief Thread-safe linearizable container with FIFO policy and bounded capacity.
-    template <typename T>
-    class MRMWQueue
+    ///
+    /// Any number of threads can insert and remove elements concurrently.
+    /// Operations never block: they fail when the queue is full or empty.
+    ///
+    /// @tparam T Type of the stored elements.
+    ///
+    template <typename T> // clang-format off
+    requires std::is_nothrow_move_constructible_v<T> && std::atomic<std::size_t>::is_always_lock_free
+    class MRMWQueue // clang-format on
     {
-        using node_id = uint32_t;
-        struct stamped_ref final
-        {
-            std::uint16_t counter;
-            std::uint16_t index;
-        };
-
-        static constexpr const auto node_id_mask = (std::numeric_limits<node_id>::max() >> 1);
-
-        static_assert(std::atomic<T*>::is_always_lock_free, "Can't guarantee atomicity");
-
     public:
-        using allocator = lockfree_object_pool<T>;
+        using value_type = T;
+        using size_type  = std::size_t;
 
         /// @brief     Constructor.
-        /// @param[in] capacity Max number of objects that can be stored inside the queue.
-        explicit MRMWQueue(const std::size_t capacity) noexcept(noexcept(allocator(capacity)))
-            : _alloc{ capacity }
+        /// @param[in] capacity Max number of objects that can be stored inside the queue,
+        ///                     rounded up to a power of 2.
+        explicit MRMWQueue(const size_type capacity)
+            : _mask{ std::bit_ceil(std::max<size_type>(capacity, 2)) - 1 }
+            , _cells{ std::make_unique<_cell[]>(_mask + 1) }
+            , _head{ 0 }
+            , _tail{ 0 }
         {
             assert(capacity > 0);
+            for (size_type i = 0; i <= _mask; ++i)
+                _cells[i].sequence.store(i, std::memory_order::relaxed);
+        }
+
+        ~MRMWQueue() noexcept
+        {
+            // destroy the elements that were never removed
+            if constexpr (!std::is_trivially_destructible_v<T>)
+            {
+                const auto tail = _tail.load(std::memory_order::acquire);
+                for (auto pos = _head.load(std::memory_order::acquire); pos != tail; ++pos)
+                    std::destroy_at(_cells[pos & _mask].value());
+            }
         }
 
         MRMWQueue(const MRMWQueue&) noexcept = delete;
@@ -50,85 +72,206 @@ namespace drako::lockfree
         MRMWQueue& operator=(MRMWQueue&&) noexcept = delete;
 
 
-        /// @brief   Number of objects that the queue can hold.
+        /// @brief Number of objects that the queue can hold.
+        [[nodiscard]] constexpr size_type capacity() const noexcept { return _mask + 1; }
+
+        /// @brief Approximate number of objects in the queue.
+        [[nodiscard]] size_type size() const noexcept
+        {
+            const auto tail = _tail.load(std::memory_order::relaxed);
+            const auto head = _head.load(std::memory_order::relaxed);
+            return (tail > head) ? (tail - head) : 0;
+        }
+
+        /// @brief Checks whether the queue is empty.
+        [[nodiscard]] bool empty() const noexcept { return size() == 0; }
+
+        /// @brief Adds an object to the tail of the queue.
         ///
-        [[nodiscard]] constexpr size_t capacity() const noexcept
+        /// @return Returns true if the operation succeeded, false if the queue is full.
+        ///
+        template <typename... Args>
+        [[nodiscard]] bool try_emplace(Args&&... args) noexcept(std::is_nothrow_constructible_v<T, Args...>)
         {
-            return _alloc.capacity();
+            auto pos = _tail.load(std::memory_order::relaxed);
+            for (;;)
+            {
+                auto&      cell = _cells[pos & _mask];
+                const auto seq  = cell.sequence.load(std::memory_order::acquire);
+                const auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+
+                if (diff == 0) // slot is free, try to claim it
+                {
+                    if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order::relaxed))
+                    {
+                        std::construct_at(cell.value(), std::forward<Args>(args)...);
+                        cell.sequence.store(pos + 1, std::memory_order::release);
+                        return true;
+                    }
+                }
+                else if (diff < 0) // slot still holds the element of the previous round
+                    return false;
+                else // another producer claimed the slot
+                    pos = _tail.load(std::memory_order::relaxed);
+            }
         }
 
         /// @brief Adds an object to the tail of the queue.
         ///
-        /// @param[in] value     Object to enqueue.
+        /// @return Returns true if the operation succeeded, false if the queue is full.
+        ///
+        [[nodiscard]] bool try_push(const T& value) noexcept(std::is_nothrow_copy_constructible_v<T>)
+        {
+            return try_emplace(value);
+        }
+
+        /// @brief Adds an object to the tail of the queue.
         ///
-        /// @return Returns true if the operation succeeded, false otherwise.
+        /// @return Returns true if the operation succeeded, false if the queue is full.
         ///
-        [[nodiscard]] bool enque(const T& value) noexcept
+        [[nodiscard]] bool try_push(T&& value) noexcept
         {
-            node* new_node = new (_alloc.allocate(sizeof(node))) node(value);
-            if (new_node == nullptr) // pool is out of nodes
-                return false;
+            return try_emplace(std::move(value));
+        }
 
+        /// @brief Removes an object from the head of the queue.
+        ///
+        /// @return Returns true if the operation succeeded, false if the queue is empty.
+        ///
+        [[nodiscard]] bool try_pop(T& value) noexcept(std::is_nothrow_move_assignable_v<T>)
+        {
+            auto pos = _head.load(std::memory_order::relaxed);
             for (;;)
             {
-                auto last = _tail.load();
-                auto next = last->next.load();
+                auto&      cell = _cells[pos & _mask];
+                const auto seq  = cell.sequence.load(std::memory_order::acquire);
+                const auto diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
 
-                // try append on the tail
-                if (last->next.compare_exchange_weak(next, new_node))
+                if (diff == 0) // slot is full, try to claim it
                 {
-                    // update tail hint if no other thread already did
-                    _tail.compare_exchange_strong(last, new_node);
-                    return true;
+                    if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order::relaxed))
+                    {
+                        _take(cell, value, pos);
+                        return true;
+                    }
                 }
+                else if (diff < 0) // slot not yet written
+                    return false;
+                else // another consumer claimed the slot
+                    pos = _head.load(std::memory_order::relaxed);
             }
         }
 
-        /// @brief Removes an object from the head of the queue.
+        /// @brief Adds a sequence of objects to the tail of the queue.
         ///
-        /// @param[out] result   Dequeued object.
+        /// Objects are inserted in order and occupy consecutive positions,
+        /// claimed with a single atomic operation.
         ///
-        /// @return Returns true if the operation succeeded, false otherwise.
+        /// @return Number of objects inserted, a prefix of @p values.
         ///
-        [[nodiscard]] bool deque(T& value) noexcept
+        [[nodiscard]] size_type try_push_n(std::span<const T> values) noexcept(std::is_nothrow_copy_constructible_v<T>)
         {
-            _node* const first = _head.load();
+            if (std::empty(values))
+                return 0;
+
+            auto pos = _tail.load(std::memory_order::relaxed);
             for (;;)
             {
-                _node* const next = first->next.load();
+                // count the free slots starting from the tail
+                size_type count = 0;
+                while (count < std::size(values) &&
+                       _cells[(pos + count) & _mask].sequence.load(std::memory_order::acquire) == pos + count)
+                    ++count;
 
-                if (next == nullptr) // only sentinel node in the queue
+                if (count == 0)
                 {
-                    return std::tuple(false, T());
+                    const auto seq = _cells[pos & _mask].sequence.load(std::memory_order::acquire);
+                    if (static_cast<std::ptrdiff_t>(seq - pos) < 0) // full
+                        return 0;
+                    pos = _tail.load(std::memory_order::relaxed);
+                    continue;
                 }
-                else
+
+                if (_tail.compare_exchange_weak(pos, pos + count, std::memory_order::relaxed))
                 {
-                    if (_head.compare_exchange_strong(first, next))
+                    for (size_type i = 0; i < count; ++i)
                     {
-                        value = first->value;
-                        // TODO: free 'first' node
-                        return true;
+                        auto& cell = _cells[(pos + i) & _mask];
+                        std::construct_at(cell.value(), values[i]);
+                        cell.sequence.store(pos + i + 1, std::memory_order::release);
                     }
-                    // else CAS reloads new value of head in first
+                    return count;
+                }
+            }
+        }
+
+        /// @brief Removes a sequence of objects from the head of the queue.
+        ///
+        /// Objects are removed in order from consecutive positions,
+        /// claimed with a single atomic operation.
+        ///
+        /// @return Number of objects removed, stored in a prefix of @p values.
+        ///
+        [[nodiscard]] size_type try_pop_n(std::span<T> values) noexcept(std::is_nothrow_move_assignable_v<T>)
+        {
+            if (std::empty(values))
+                return 0;
+
+            auto pos = _head.load(std::memory_order::relaxed);
+            for (;;)
+            {
+                // count the full slots starting from the head
+                size_type count = 0;
+                while (count < std::size(values) &&
+                       _cells[(pos + count) & _mask].sequence.load(std::memory_order::acquire) == pos + count + 1)
+                    ++count;
+
+                if (count == 0)
+                {
+                    const auto seq = _cells[pos & _mask].sequence.load(std::memory_order::acquire);
+                    if (static_cast<std::ptrdiff_t>(seq - (pos + 1)) < 0) // empty
+                        return 0;
+                    pos = _head.load(std::memory_order::relaxed);
+                    continue;
+                }
+
+                if (_head.compare_exchange_weak(pos, pos + count, std::memory_order::relaxed))
+                {
+                    for (size_type i = 0; i < count; ++i)
+                        _take(_cells[(pos + i) & _mask], values[i], pos + i);
+                    return count;
                 }
             }
         }
 
     private:
-        struct _node final
+        struct _cell
         {
-            const T             value; // Object stored.
-            std::atomic<_node*> next;  // Pointer to the next node in the queue.
+            std::atomic<size_type> sequence; // position of the next operation allowed on the slot
+            alignas(T) std::byte storage[sizeof(T)];
 
-            explicit _node(const T& value)
-                : value(value), next{ nullptr } {}
+            [[nodiscard]] T* value() noexcept { return std::launder(reinterpret_cast<T*>(storage)); }
         };
 
-        allocator                _alloc;          // lockfree allocator for the queue nodes
-        std::atomic<stamped_ref> _head = nullptr; // pointer to first node
-        std::atomic<stamped_ref> _tail = nullptr; // pointer to last node
+        const size_type                _mask;
+        const std::unique_ptr<_cell[]> _cells;
+
+        alignas(drako::cache_line_size)
+            std::atomic<size_type> _head; // next position to be read
+
+        alignas(drako::cache_line_size)
+            std::atomic<size_type> _tail; // next position to be written
+
+        // moves the element out of a claimed slot and releases it for the next round
+        void _take(_cell& cell, T& value, size_type pos) noexcept(std::is_nothrow_move_assignable_v<T>)
+        {
+            const auto p = cell.value();
+            value        = std::move(*p);
+            std::destroy_at(p);
+            cell.sequence.store(pos + _mask + 1, std::memory_order::release);
+        }
     };
 
 } // namespace drako::lockfree
 
-#endif // !DRAKO_LOCKFREE_MRMWQUEUE_HPP
\ No newline at end of file
+#endif // !DRAKO_LOCKFREE_MRMWQUEUE_HPP
@@ -8,11 +8,14 @@
 #define DRAKO_LOCKFREE_POOL_ALLOCATOR_HPP
 
 #include "drako/core/compiler.hpp"
-#include "drako/core/memory/memory_core.hpp"
 
 #include <atomic>
 #include <bit>
 #include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
 #include <new>     // std::bad_alloc
 #include <numeric> // std::iota
 #include <type_traits>
@@ -45,21 +48,23 @@ namespace drako::lockfree
         StaticPool(StaticPool&&) = delete;
         StaticPool& operator=(StaticPool&&) = delete;
 
-        [[nodiscard]] DRAKO_ALLOCATOR T* DRAKO_RESTRICT allocate(std::size_t n)
+        [[nodiscard]] DRAKO_ALLOCATOR T* allocate(std::size_t n)
         {
             assert(n == 1); // we can only allocate single objects
 
-            for (auto head = _head.load();;)
+            for (auto head = _head.load(std::memory_order::acquire);;)
             {
                 const auto block = block_index(head);
                 if (block == empty_pool_value) // no free blocks left
                     throw std::bad_alloc{};
 
+                // the tag changes at every update of the head, a stale next_block fails the CAS
                 const auto next_tag   = aba_tag(head) + 1;
-                const auto next_block = _list[head].load();
+                const auto next_block = _list[block].load(std::memory_order::relaxed);
 
                 const auto new_head = compose_index_and_tag(next_block, next_tag);
-                if (_head.compare_exchange_strong(head, new_head))
+                if (_head.compare_exchange_weak(head, new_head,
+                        std::memory_order::acq_rel, std::memory_order::acquire))
                     return reinterpret_cast<T*>(_pool + block);
             }
         }
@@ -68,13 +73,16 @@ namespace drako::lockfree
         {
             assert(n == 1); // we can only deallocate single objects
             assert(p);
-            assert((p >= _pool) && p < (_pool + Size));
+            const auto b = reinterpret_cast<_block*>(p);
+            assert((b >= _pool) && b < (_pool + Size));
 
-            const auto block = static_cast<std::size_t>(std::distance(_pool, p));
-            for (auto head = _head.load();;)
+            const auto block = static_cast<std::uint32_t>(b - _pool);
+            for (auto head = _head.load(std::memory_order::relaxed);;)
             { // try to push our block as the new head of the free list
-                _list[block] = head;
-                if (_head.compare_exchange_strong(head, block))
+                _list[block].store(block_index(head), std::memory_order::relaxed);
+                const auto new_head = compose_index_and_tag(block, aba_tag(head) + 1);
+                if (_head.compare_exchange_weak(head, new_head,
+                        std::memory_order::release, std::memory_order::relaxed))
                     return;
                 // else the new head value gets loaded by CAS instruction
             }
@@ -106,7 +114,7 @@ namespace drako::lockfree
 
         [[nodiscard]] static std::uint64_t compose_index_and_tag(std::uint32_t index, std::uint32_t tag)
         {
-            return static_cast<std::uint64_t>(index) & (static_cast<std::uint64_t>(tag) << 32);
+            return static_cast<std::uint64_t>(index) | (static_cast<std::uint64_t>(tag) << 32);
         }
 
 #if defined(DRKAPI_DEBUG)
@@ -1,82 +1,174 @@
 /// @file
 /// @brief   Thread-safe priority queue templates.
 /// @author  Grassi Edoardo
-/// @date    Last edited on 15/05/2019
 
 #pragma once
 #ifndef DRAKO_LOCKFREE_PRIORITY_QUEUE
 #define DRAKO_LOCKFREE_PRIORITY_QUEUE
 
-#include <atomic>
-#include <optional>
+#include "drako/concurrency/lockfree_dequeue.hpp"
 
-#include "drako/core/compiler.hpp"
-#include "drako/concurrency/lockfree_pool_allocator.hpp"
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
 
-namespace drako::concurrency::lockfree
+namespace drako::lockfree
 {
-    template <typename T, typename TPriority>
-    class priority_queue final
+    /// @brief Single owner, multiple thieves queue with a fixed number of priority levels.
+    ///
+    /// Each level is a bounded work-stealing queue, whose indices grow monotonically
+    /// so that recycled slots are never mistaken for old ones (no ABA).
+    /// Level 0 has the highest priority.
+    ///
+    /// The owner drains higher levels first, except once every @p fairness removals,
+    /// when it scans from a lower level chosen in rotation: lower levels keep
+    /// progressing under constant high priority load, at a bounded rate.
+    /// Thieves always take from the highest non-empty level.
+    ///
+    /// @tparam T      Type of the stored elements.
+    /// @tparam Levels Number of priority levels.
+    /// @tparam Al     Allocator for the backing buffers.
+    ///
+    template <typename T, std::size_t Levels, typename Al = std::allocator<std::atomic<T>>> // clang-format off
+    requires (Levels > 0)
+    class PriorityDEQueue // clang-format on
     {
+        using _level = DEQueue<T, Al>;
+
     public:
+        using value_type     = T;
+        using size_type      = std::size_t;
+        using allocator_type = Al;
+
+        /// @brief Number of priority levels.
+        static constexpr const size_type levels = Levels;
 
-        DRAKO_NODISCARD bool push(const T& in, const TPriority p) noexcept
+        /// @brief Constructs a queue with specified capacity.
+        ///
+        /// @param[in] capacity Max number of elements of each level, rounded up to a power of 2.
+        /// @param[in] fairness Removals between two visits of the lower levels.
+        ///
+        explicit PriorityDEQueue(size_type capacity, std::uint32_t fairness = 32, const Al& alloc = Al())
+            : PriorityDEQueue{ std::make_index_sequence<Levels>{}, capacity, fairness, alloc }
         {
-            queue_node* new_node = this->pool_allocator.construct(in, p);
-            if (new_node == nullptr)
-            {
-                return false;
-            }
-            for (;;)
+        }
+
+        PriorityDEQueue(const PriorityDEQueue&) = delete;
+        PriorityDEQueue& operator=(const PriorityDEQueue&) = delete;
+
+
+        /// @brief Inserts an element with the specified priority.
+        ///
+        /// @return Returns true if the operation succeeded, false if the level is full.
+        ///
+        /// @note Can only be called by the owner thread.
+        ///
+        [[nodiscard]] bool enque(const T& value, size_type level) noexcept
+        {
+            assert(level < Levels);
+            return _levels[level].enque(value);
+        }
+
+        /// @brief Removes the most recently inserted element of the highest priority level.
+        ///
+        /// @return Returns true if the operation succeeded, false if the queue is empty.
+        ///
+        /// @note Can only be called by the owner thread.
+        ///
+        [[nodiscard]] bool deque(T& value) noexcept
+        {
+            if constexpr (Levels > 1)
             {
-                auto old_node = this->index[p].load();
-                new_node->next = old_node->next.load();
-                if (this->index[p].compare_exchange_strong(old_node, new_node))
+                if (++_removals >= _fairness) // give a chance to a lower level
                 {
-                    return true;
+                    _removals = 0;
+                    _rotation = (_rotation % (Levels - 1)) + 1;
+                    for (auto i = _rotation; i < Levels; ++i)
+                        if (_levels[i].deque(value))
+                            return true;
                 }
             }
+
+            for (auto& l : _levels)
+                if (l.deque(value))
+                    return true;
+            return false;
         }
 
-        DRAKO_NODISCARD bool pop(T& out) noexcept
+        /// @brief Removes the most recently inserted element of a priority level.
+        ///
+        /// Unlike deque(), it doesn't count towards the visits of the lower levels.
+        ///
+        /// @return Returns true if the operation succeeded, false if the level is empty.
+        ///
+        /// @note Can only be called by the owner thread.
+        ///
+        [[nodiscard]] bool deque(T& value, size_type level) noexcept
         {
-            for (queue_node* old_head;;)
-            {
-                old_head = head_node.load();
-                if (old_head == nullptr)
-                {
+            assert(level < Levels);
+            return _levels[level].deque(value);
+        }
+
+        /// @brief Removes the least recently inserted element of the highest priority level.
+        ///
+        /// @return Returns true if the operation succeeded, false if the queue
+        ///         is empty or another thread won the race for the element.
+        ///
+        /// @note Can be called by any thread.
+        ///
+        [[nodiscard]] bool steal(T& value) noexcept
+        {
+            for (auto& l : _levels)
+                if (l.steal(value))
+                    return true;
+            return false;
+        }
+
+        /// @brief Checks whether all the levels are empty.
+        [[nodiscard]] bool empty() const noexcept
+        {
+            for (const auto& l : _levels)
+                if (!l.empty())
                     return false;
-                }
-                else
-                {
-                    auto old_priority = old_head->priority;
-                    index[old_priority].compare_exchange_strong(old_head, nullptr);
-                    if (head_node.compare_exchange_strong(old_head, old_head->next))
-                    {
-                        out = old_head->value;
-                        return true;
-                    }
-                }
-            }
+            return true;
         }
 
+        /// @brief Approximate number of elements in the queue.
+        [[nodiscard]] size_type size() const noexcept
+        {
+            size_type result = 0;
+            for (const auto& l : _levels)
+                result += l.size();
+            return result;
+        }
+
+        /// @brief Approximate number of elements with the specified priority.
+        [[nodiscard]] size_type size(size_type level) const noexcept
+        {
+            assert(level < Levels);
+            return _levels[level].size();
+        }
+
+        /// @brief Capacity of each priority level.
+        [[nodiscard]] constexpr size_type capacity() const noexcept { return _levels[0].capacity(); }
+
     private:
+        std::array<_level, Levels> _levels;
+        const std::uint32_t        _fairness;
+        std::uint32_t              _removals = 0; // owner only
+        size_type                  _rotation = 0; // last lower level visited, owner only
 
-        struct queue_node final
+        template <std::size_t... Is>
+        explicit PriorityDEQueue(std::index_sequence<Is...>, size_type capacity, std::uint32_t fairness, const Al& alloc)
+            : _levels{ { ((void)Is, _level{ capacity, alloc })... } }, _fairness{ fairness }
         {
-            const T value;
-            const TPriority priority;
-            std::atomic<queue_node*> next = nullptr;
-
-            explicit queue_node(const T& value, const TPriority priority) noexcept
-                : value(value), priority(priority)
-            {}
-        };
-
-        std::atomic<queue_node*> index[10];
-        std::atomic<queue_node*> head_node = nullptr;
-        lockfree_pool_allocator pool_allocator;
+            assert(fairness > 0);
+        }
     };
-}
+
+} // namespace drako::lockfree
 
 #endif // !DRAKO_LOCKFREE_PRIORITY_QUEUE
@@ -7,17 +7,28 @@
 #ifndef DRAKO_LOCKFREE_RINGBUFFER_HPP
 #define DRAKO_LOCKFREE_RINGBUFFER_HPP
 
+#include "drako/core/platform.hpp"
+
+#include <algorithm>
 #include <atomic>
+#include <bit>
 #include <cassert>
 #include <iterator>
 #include <memory> // std::allocator_traits
-#include <new>
 #include <optional>
+#include <span>
+#include <type_traits>
+#include <utility>
 
 namespace drako::lockfree
 {
     /// @brief Single producer, single consumer thread-safe FIFO container.
     ///
+    /// The indices of the producer and of the consumer grow monotonically and
+    /// live on separate cache lines. Each side keeps a private copy of the index
+    /// of the other side, refreshed only when the queue looks full (or empty), so
+    /// in steady state each operation touches only the cache lines of its own side.
+    ///
     template <typename T, typename Al = std::allocator<T>>
     requires std::atomic<std::size_t>::is_always_lock_free class SRSWQueue
     {
@@ -32,48 +43,32 @@ namespace drako::lockfree
         using allocator_type = Al;
 
         constexpr SRSWQueue() noexcept(noexcept(Al()))
-            : _alloc(), _size{ 0 }, _data{ nullptr }, _reader{ 0 }, _writer{ 0 } {}
+            : _alloc(), _mask{ 0 }, _data{ nullptr } {}
 
         /// @brief Constructs a queue with specified capacity.
+        ///
+        /// @param[in] size Max number of elements, rounded up to a power of 2.
+        ///
         explicit SRSWQueue(size_type size, const Al& alloc = Al())
             : _alloc{ alloc }
-            , _size{ size }
-            , _data{ _al_traits::allocate(_alloc, _size) }
-            , _reader{ 0 }
-            , _writer{ 0 }
-        {
-            assert(_size > 0);
-            // vvv not needed because allocate throws on failure
-            //if (_data == nullptr)
-            //    [[unlikely]] throw std::bad_alloc{ "Failed to allocate backing memory." };
-        }
-
-        /*
-        template <input_iterator Iter> // clang-format off
-        explicit SRSWQueue(Iter first, Iter last, const Al& alloc = Al()) // clang-format on
-            : _alloc{ alloc }
-            , _size{ std::distance(first, last) }
-            , _data{ _al_traits::allocate(_alloc, _size) }
-            , _reader{ 0 }
-            , _writer{ std::distance(first, last) }
+            , _mask{ std::bit_ceil(size) - 1 }
+            , _data{ _al_traits::allocate(_alloc, _mask + 1) }
         {
-            assert(_size > 0);
+            assert(size > 0);
             // vvv not needed because allocate throws on failure
             //if (_data == nullptr)
             //    [[unlikely]] throw std::bad_alloc{ "Failed to allocate backing memory." };
-
-            // TODO: end impl
-            for (auto iter = first; iter != last; std::next(iter))
-                _al_traits::construct(_alloc, *iter);
         }
-        */
 
         ~SRSWQueue() noexcept
         {
-            assert(_data != nullptr);
-            for (auto i = _reader.load(); i != _writer.load(); i = _next_index(i))
-                _al_traits::destroy(_alloc, _data + i);
-            _al_traits::deallocate(_alloc, _data, _size);
+            if (_data == nullptr)
+                return;
+
+            const auto writer = _writer.load(std::memory_order::acquire);
+            for (auto i = _reader.load(std::memory_order::acquire); i != writer; ++i)
+                _al_traits::destroy(_alloc, _data + (i & _mask));
+            _al_traits::deallocate(_alloc, _data, _mask + 1);
         }
 
         SRSWQueue(const SRSWQueue&) = delete;
@@ -87,81 +82,124 @@ namespace drako::lockfree
         ///
         /// @param[in] value Source value.
         ///
-        /// @note Thread-safe and wait-free.
+        /// @return Returns false if the queue is full.
+        ///
+        /// @note Thread-safe and wait-free, can only be called by the producer.
         ///
         bool push(const T& value) noexcept requires std::is_copy_constructible_v<T>
         {
-            const auto writer = _writer.load();
-            const auto reader = _reader.load();
-            if (const auto i = _next_index(writer); i != reader)
-            {
-                _al_traits::construct(_alloc, _data + i, value);
-                _writer.store(i);
-                return true;
-            }
-            return false;
+            return emplace(value);
         }
 
         /// @brief Inserts an element in the queue.
         ///
         /// @param[in] value Source value.
         ///
-        /// @note Thread-safe and wait-free.
+        /// @return Returns false if the queue is full.
+        ///
+        /// @note Thread-safe and wait-free, can only be called by the producer.
         ///
         bool push(T&& value) noexcept requires std::is_move_constructible_v<T>
         {
-            const auto writer = _writer.load();
-            const auto reader = _reader.load();
-            if (const auto i = _next_index(writer); i != reader)
-            {
-                _al_traits::construct(_alloc, _data + i, value);
-                _writer.store(i);
-                return true;
-            }
-            return false;
+            return emplace(std::move(value));
         }
 
+        /// @brief Constructs an element in place at the end of the queue.
+        ///
+        /// @return Returns false if the queue is full.
+        ///
+        /// @note Thread-safe and wait-free, can only be called by the producer.
+        ///
         template <typename... Args> // clang-format off
         requires std::is_constructible_v<T, Args...>
         bool emplace(Args&&... args) noexcept // clang-format on
         {
-            const auto writer = _writer.load();
-            const auto reader = _reader.load();
-            if (const auto i = _next_index(writer); i != reader)
-            {
-                _al_traits::construct(_alloc, _data + i, std::forward<Args>(args)...);
-                _writer.store(i);
-                return true;
-            }
-            return false;
+            const auto writer = _writer.load(std::memory_order::relaxed);
+            if (_free(writer) == 0)
+                return false;
+
+            _al_traits::construct(_alloc, _data + (writer & _mask), std::forward<Args>(args)...);
+            _writer.store(writer + 1, std::memory_order::release);
+            return true;
+        }
+
+        /// @brief Inserts a sequence of elements, published to the consumer all at once.
+        ///
+        /// @return Number of elements inserted, a prefix of @p values.
+        ///
+        /// @note Thread-safe and wait-free, can only be called by the producer.
+        ///
+        size_type push_n(std::span<const T> values) noexcept requires std::is_copy_constructible_v<T>
+        {
+            const auto writer = _writer.load(std::memory_order::relaxed);
+            const auto count  = std::min(std::size(values), _free(writer, std::size(values)));
+            for (size_type i = 0; i < count; ++i)
+                _al_traits::construct(_alloc, _data + ((writer + i) & _mask), values[i]);
+
+            if (count > 0)
+                _writer.store(writer + count, std::memory_order::release);
+            return count;
         }
 
         /// @brief Removes an element from the queue.
         ///
         /// @return Value from the queue, or nothing.
         ///
-        /// @note Thread-safe and wait-free.
+        /// @note Thread-safe and wait-free, can only be called by the consumer.
         ///
         [[nodiscard]] std::optional<T> pop() noexcept
-            requires std::is_move_assignable_v<T> ||
-            std::is_copy_assignable_v<T>
+            requires std::is_move_constructible_v<T>
+        {
+            const auto reader = _reader.load(std::memory_order::relaxed);
+            if (_used(reader) == 0)
+                return {};
+
+            const auto slot  = _data + (reader & _mask);
+            auto       value = std::make_optional(std::move(*slot));
+            _al_traits::destroy(_alloc, slot);
+            _reader.store(reader + 1, std::memory_order::release);
+            return value;
+        }
+
+        /// @brief Removes an element from the queue.
+        ///
+        /// @param[out] value Destination of the removed element.
+        ///
+        /// @return Returns false if the queue is empty.
+        ///
+        /// @note Thread-safe and wait-free, can only be called by the consumer.
+        ///
+        [[nodiscard]] bool pop(T& value) noexcept requires std::is_move_assignable_v<T>
         {
-            const auto writer = _writer.load();
-            const auto reader = _reader.load();
-            if (reader != writer)
+            return pop_n({ &value, 1 }) == 1;
+        }
+
+        /// @brief Removes a sequence of elements, released to the producer all at once.
+        ///
+        /// @return Number of elements removed, stored in a prefix of @p values.
+        ///
+        /// @note Thread-safe and wait-free, can only be called by the consumer.
+        ///
+        [[nodiscard]] size_type pop_n(std::span<T> values) noexcept requires std::is_move_assignable_v<T>
+        {
+            const auto reader = _reader.load(std::memory_order::relaxed);
+            const auto count  = std::min(std::size(values), _used(reader, std::size(values)));
+            for (size_type i = 0; i < count; ++i)
             {
-                const auto value = std::make_optional(std::move(_data[reader]));
-                _al_traits::destroy(_alloc, _data + reader);
-                _reader.store(_next_index(reader));
-                return value;
+                const auto slot = _data + ((reader + i) & _mask);
+                values[i]       = std::move(*slot);
+                _al_traits::destroy(_alloc, slot);
             }
-            return {};
+
+            if (count > 0)
+                _reader.store(reader + count, std::memory_order::release);
+            return count;
         }
 
         /// @brief Checks whether the queue is empty.
-        [[nodiscard]] constexpr bool empty() const noexcept
+        [[nodiscard]] bool empty() const noexcept
         {
-            return _reader.load() == _writer.load();
+            return _reader.load(std::memory_order::acquire) == _writer.load(std::memory_order::acquire);
         }
 
 
@@ -169,17 +207,15 @@ namespace drako::lockfree
         //[[nodiscard]] constexpr bool full() const noexcept;
 
         /// @brief Number of element in the queue.
-        [[nodiscard]] constexpr size_type size() const noexcept
+        [[nodiscard]] size_type size() const noexcept
         {
             const auto reader = _reader.load(std::memory_order::acquire);
             const auto writer = _writer.load(std::memory_order::acquire);
-
-            return (writer >= reader) ? writer - reader
-                                      : writer + _size - reader;
+            return (writer > reader) ? writer - reader : 0;
         }
 
         /// @brief Capacity of the queue.
-        [[nodiscard]] constexpr size_type capacity() const noexcept { return _size; }
+        [[nodiscard]] constexpr size_type capacity() const noexcept { return (_data != nullptr) ? _mask + 1 : 0; }
 
         /// @brief Max capacity allowed by the implementation.
         [[nodiscard]] constexpr size_type max_size() const noexcept
@@ -188,19 +224,36 @@ namespace drako::lockfree
         }
 
     private:
+        // read only after construction, shared by both sides
         Al              _alloc;
-        const size_type _size;
+        const size_type _mask;
         T*              _data;
 
-        alignas(std::hardware_destructive_interference_size)
-            std::atomic<size_type> _reader; // index of the most recently read item
+        // written by the consumer
+        alignas(drako::cache_line_size)
+            std::atomic<size_type> _reader = 0; // index of the next item to read
+        size_type _writer_cache        = 0;     // last seen value of _writer, consumer only
 
-        alignas(std::hardware_destructive_interference_size)
-            std::atomic<size_type> _writer; // index of the most recently written item
+        // written by the producer
+        alignas(drako::cache_line_size)
+            std::atomic<size_type> _writer = 0; // index of the next item to write
+        size_type _reader_cache        = 0;     // last seen value of _reader, producer only
+
+        // free slots seen by the producer, refreshes the cached reader only when needed
+        [[nodiscard]] size_type _free(size_type writer, size_type wanted = 1) noexcept
+        {
+            const auto capacity = this->capacity();
+            if (capacity - (writer - _reader_cache) < wanted)
+                _reader_cache = _reader.load(std::memory_order::acquire);
+            return capacity - (writer - _reader_cache);
+        }
 
-        [[nodiscard]] constexpr size_type _next_index(size_type idx) noexcept
+        // full slots seen by the consumer, refreshes the cached writer only when needed
+        [[nodiscard]] size_type _used(size_type reader, size_type wanted = 1) noexcept
         {
-            return (idx != _size) ? idx + 1 : 0;
+            if (_writer_cache - reader < wanted)
+                _writer_cache = _writer.load(std::memory_order::acquire);
+            return _writer_cache - reader;
         }
     };
 
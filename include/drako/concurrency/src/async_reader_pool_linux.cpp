@@ -0,0 +1,562 @@
+#include "drako/concurrency/async_reader_pool.hpp"
+
+#include "drako/core/compiler.hpp"
+#include "drako/core/platform.hpp"
+
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if !defined(DRAKO_PLT_LINUX)
+#error This source file should be included only on Linux builds
+#endif
+
+static_assert(std::is_convertible_v<rio::Handle, int>, "Handles must be file descriptors.");
+
+namespace drako
+{
+    namespace
+    {
+        // tags the completion of the read that waits on the wakeup eventfd
+        constexpr const std::uint64_t _wakeup_tag = std::numeric_limits<std::uint64_t>::max();
+
+        // tags the completions of the attempts to interrupt a read
+        constexpr const std::uint64_t _cancel_tag = _wakeup_tag - 1;
+
+        // IORING_OP_READ was introduced together with this feature, by Linux 5.6
+        constexpr const std::uint32_t _required_features = IORING_FEAT_NODROP | IORING_FEAT_RW_CUR_POS;
+
+        // max length of a single read, as for read(2)
+        constexpr const std::size_t _max_read_size = 0x7ffff000;
+
+        [[nodiscard]] int _setup(unsigned entries, ::io_uring_params& params) noexcept
+        {
+            return static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        }
+
+        [[nodiscard]] int _enter(int ring, unsigned submit, unsigned wait) noexcept
+        {
+            return static_cast<int>(::syscall(__NR_io_uring_enter, ring, submit, wait,
+                wait > 0 ? IORING_ENTER_GETEVENTS : 0u, nullptr, 0));
+        }
+
+        [[nodiscard]] int _register(int ring, unsigned opcode, const void* args, unsigned count) noexcept
+        {
+            return static_cast<int>(::syscall(__NR_io_uring_register, ring, opcode, args, count));
+        }
+
+        [[noreturn]] void _throw_last_error(const char* what)
+        {
+            throw std::system_error{ errno, std::system_category(), what };
+        }
+    } // namespace
+
+
+    struct UringReaderPool::_kernel_ring
+    {
+        explicit _kernel_ring(std::uint32_t entries)
+        {
+            ::io_uring_params params = {};
+
+            fd = _setup(entries, params);
+            if (fd < 0)
+                _throw_last_error("io_uring_setup");
+
+            if ((params.features & _required_features) != _required_features)
+            {
+                ::close(fd);
+                throw std::system_error{ std::make_error_code(std::errc::function_not_supported), "io_uring" };
+            }
+
+            sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(::io_uring_cqe);
+            sqes_size   = params.sq_entries * sizeof(::io_uring_sqe);
+
+            // both rings can live in the same mapping
+            if (params.features & IORING_FEAT_SINGLE_MMAP)
+                sq_map_size = cq_map_size = std::max(sq_map_size, cq_map_size);
+
+            sq_map = ::mmap(nullptr, sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            cq_map = (params.features & IORING_FEAT_SINGLE_MMAP)
+                         ? sq_map
+                         : ::mmap(nullptr, cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            sqes = static_cast<::io_uring_sqe*>(
+                ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+            if (sq_map == MAP_FAILED || cq_map == MAP_FAILED || sqes == MAP_FAILED)
+            {
+                const auto error = errno;
+                _release();
+                throw std::system_error{ error, std::system_category(), "io_uring mmap" };
+            }
+
+            auto* sq  = static_cast<std::byte*>(sq_map);
+            sq_head   = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+            sq_tail   = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            sq_mask   = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            sq_array  = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+            sq_pushed = *sq_tail;
+
+            auto* cq = static_cast<std::byte*>(cq_map);
+            cq_head  = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            cq_tail  = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            cq_mask  = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            cqes     = reinterpret_cast<::io_uring_cqe*>(cq + params.cq_off.cqes);
+        }
+
+        ~_kernel_ring() noexcept { _release(); }
+
+        _kernel_ring(const _kernel_ring&) = delete;
+        _kernel_ring& operator=(const _kernel_ring&) = delete;
+
+        int             fd          = -1;
+        void*           sq_map      = MAP_FAILED;
+        void*           cq_map      = MAP_FAILED;
+        ::io_uring_sqe* sqes        = static_cast<::io_uring_sqe*>(MAP_FAILED);
+        std::size_t     sq_map_size = 0;
+        std::size_t     cq_map_size = 0;
+        std::size_t     sqes_size   = 0;
+
+        unsigned* sq_head;
+        unsigned* sq_tail;
+        unsigned* sq_array;
+        unsigned  sq_mask;
+        unsigned  sq_pushed; // local copy of the tail, published on submission
+
+        unsigned*       cq_head;
+        unsigned*       cq_tail;
+        unsigned        cq_mask;
+        ::io_uring_cqe* cqes;
+
+        // returns a cleared entry at the tail of the submission queue
+        [[nodiscard]] ::io_uring_sqe& push() noexcept
+        {
+            const auto index = sq_pushed++ & sq_mask;
+            sq_array[index]  = index;
+            std::memset(&sqes[index], 0, sizeof(::io_uring_sqe));
+            return sqes[index];
+        }
+
+        // hands the new entries to the kernel, waiting for at least wait completions
+        void enter(unsigned wait) noexcept
+        {
+            std::atomic_ref<unsigned>{ *sq_tail }.store(sq_pushed, std::memory_order::release);
+            for (;;)
+            {
+                // entries refused for lack of resources are handed again on the next call
+                const auto pending = sq_pushed - std::atomic_ref<unsigned>{ *sq_head }.load(std::memory_order::acquire);
+                if (_enter(fd, pending, wait) >= 0 || errno != EINTR)
+                    return;
+            }
+        }
+
+    private:
+        void _release() noexcept
+        {
+            if (sqes != MAP_FAILED)
+                ::munmap(sqes, sqes_size);
+            if (cq_map != MAP_FAILED && cq_map != sq_map)
+                ::munmap(cq_map, cq_map_size);
+            if (sq_map != MAP_FAILED)
+                ::munmap(sq_map, sq_map_size);
+            if (fd >= 0)
+                ::close(fd);
+        }
+    };
+
+
+    struct UringReaderPool::_registration
+    {
+        bool        files; // files or buffers
+        const void* args;  // file descriptors or iovecs, as expected by the kernel
+        unsigned    count;
+
+        std::vector<std::pair<rio::Handle, std::uint32_t>> handles; // sorted, replace the registered files
+        std::vector<std::span<std::byte>>                  buffers; // replace the registered buffers
+
+        bool result = false;
+    };
+
+
+    bool UringReaderPool::supported() noexcept
+    {
+        ::io_uring_params params = {};
+
+        const auto fd = _setup(1, params);
+        if (fd < 0)
+            return false; // missing or disabled, like inside some containers
+
+        ::close(fd);
+        return (params.features & _required_features) == _required_features;
+    }
+
+    UringReaderPool::UringReaderPool(const Args& args)
+        : _ring{ std::make_unique<_kernel_ring>(2 * args.queue_depth + 1) } // reads, their cancellations and the wakeup
+        , _requests{ args.submit_queue_size + args.queue_depth }
+        , _submit_queue{ args.submit_queue_size + args.queue_depth }
+        , _cancel_queue{ args.submit_queue_size + args.queue_depth }
+        , _output_queue{ args.output_queue_size }
+        , _reads(args.queue_depth)
+        , _read_of(args.submit_queue_size + args.queue_depth)
+        , _wakeup{ ::eventfd(0, EFD_CLOEXEC) }
+        , _wakeup_value{ 0 }
+        , _sleeping{ false }
+        , _registration_pending{ nullptr }
+    {
+        assert(args.queue_depth > 0);
+        assert(args.submit_queue_size > 0);
+        assert(args.output_queue_size > 0);
+
+        if (_wakeup < 0)
+            _throw_last_error("eventfd");
+
+        _free_reads.reserve(args.queue_depth);
+        for (auto i = args.queue_depth; i > 0; --i)
+            _free_reads.push_back(i - 1);
+        _short_reads.reserve(args.queue_depth);
+
+        try
+        {
+            _thread = std::thread{ [this]() { _run(); } };
+        }
+        catch (...)
+        {
+            ::close(_wakeup);
+            throw;
+        }
+    }
+
+    UringReaderPool::~UringReaderPool() noexcept
+    {
+        _done.test_and_set(std::memory_order::release);
+
+        const std::uint64_t one = 1;
+        static_cast<void>(::write(_wakeup, &one, sizeof(one)));
+        _thread.join();
+
+        _ring.reset(); // cancels the wakeup read before its buffer goes away
+        ::close(_wakeup);
+    }
+
+    UringReaderPool::RequestID UringReaderPool::submit(const Request* r) noexcept
+    {
+        assert(r);
+        const auto id = _requests.acquire(r);
+        if (id == invalid_request)
+            return id;
+
+        _detail::push(_submit_queue, _detail::_request_table::index(id));
+        _wake();
+        return id;
+    }
+
+    std::size_t UringReaderPool::retrieve(std::span<Completion> out) noexcept
+    {
+        return _detail::retrieve(_output_queue, out);
+    }
+
+    bool UringReaderPool::cancel(RequestID id) noexcept
+    {
+        using _state = _detail::_request_table::State;
+
+        if (_requests.transition(id, _state::queued, _state::cancelled))
+            return true;
+        if (!_requests.transition(id, _state::running, _state::cancelled))
+            return false;
+
+        // the ring thread interrupts the read, which could complete meanwhile
+        _detail::push(_cancel_queue, id);
+        _wake();
+        return true;
+    }
+
+    void UringReaderPool::_wake() noexcept
+    {
+        // pairs with the fence of the ring thread: either it sees the new work or this sees it sleeping
+        std::atomic_thread_fence(std::memory_order::seq_cst);
+        if (_sleeping.load(std::memory_order::relaxed) && _sleeping.exchange(false, std::memory_order::relaxed))
+        {
+            const std::uint64_t one = 1;
+            static_cast<void>(::write(_wakeup, &one, sizeof(one)));
+        }
+    }
+
+    bool UringReaderPool::register_files(std::span<const rio::Handle> files)
+    {
+        std::vector<int> fds(std::begin(files), std::end(files));
+
+        std::vector<std::pair<rio::Handle, std::uint32_t>> handles;
+        handles.reserve(std::size(files));
+        for (std::uint32_t i = 0; i < std::size(files); ++i)
+            handles.emplace_back(files[i], i);
+        std::ranges::sort(handles);
+
+        _registration r{ .files   = true,
+                         .args    = fds.data(),
+                         .count   = static_cast<unsigned>(std::size(fds)),
+                         .handles = std::move(handles),
+                         .buffers = {} };
+
+        _post(r);
+        return r.result;
+    }
+
+    bool UringReaderPool::register_buffers(std::span<const std::span<std::byte>> buffers)
+    {
+        std::vector<::iovec> vectors;
+        vectors.reserve(std::size(buffers));
+        for (const auto& b : buffers)
+            vectors.push_back({ .iov_base = b.data(), .iov_len = b.size_bytes() });
+
+        _registration r{ .files   = false,
+                         .args    = vectors.data(),
+                         .count   = static_cast<unsigned>(std::size(vectors)),
+                         .handles = {},
+                         .buffers = { std::begin(buffers), std::end(buffers) } };
+
+        _post(r);
+        return r.result;
+    }
+
+    void UringReaderPool::_post(_registration& r) noexcept
+    {
+        // one registration at a time
+        for (_registration* expected = nullptr;
+             !_registration_pending.compare_exchange_weak(expected, &r, std::memory_order::acq_rel);
+             expected = nullptr)
+            if (expected != nullptr)
+                _registration_pending.wait(expected, std::memory_order::acquire);
+
+        // completes the wakeup read even if the ring thread isn't sleeping
+        const std::uint64_t one = 1;
+        static_cast<void>(::write(_wakeup, &one, sizeof(one)));
+
+        _registration_pending.wait(&r, std::memory_order::acquire);
+    }
+
+    void UringReaderPool::_apply(_registration& r) noexcept
+    {
+        const auto registered = r.files ? !std::empty(_files) : !std::empty(_buffers);
+        if (registered)
+            static_cast<void>(_register(_ring->fd, r.files ? IORING_UNREGISTER_FILES : IORING_UNREGISTER_BUFFERS, nullptr, 0));
+
+        // pinned pages count against RLIMIT_MEMLOCK
+        r.result = r.count == 0 ||
+                   _register(_ring->fd, r.files ? IORING_REGISTER_FILES : IORING_REGISTER_BUFFERS, r.args, r.count) >= 0;
+        if (!r.result)
+        {
+            r.handles.clear();
+            r.buffers.clear();
+        }
+
+        if (r.files)
+            _files.swap(r.handles);
+        else
+            _buffers.swap(r.buffers);
+    }
+
+    void UringReaderPool::_prepare(std::uint32_t read) noexcept
+    {
+        const auto& [_, request, done] = _reads[read];
+
+        auto& sqe     = _ring->push();
+        auto* address = request->dst.data() + done;
+        sqe.opcode    = IORING_OP_READ;
+        sqe.fd        = request->src;
+        sqe.addr      = reinterpret_cast<std::uintptr_t>(address);
+        sqe.len       = static_cast<std::uint32_t>(std::min(std::size(request->dst) - done, _max_read_size));
+        sqe.off       = request->offset + done;
+        sqe.user_data = read;
+
+        const auto file = std::ranges::lower_bound(_files, request->src, {}, &std::pair<rio::Handle, std::uint32_t>::first);
+        if (file != std::end(_files) && file->first == request->src)
+        {
+            sqe.fd = static_cast<std::int32_t>(file->second);
+            sqe.flags |= IOSQE_FIXED_FILE;
+        }
+
+        for (std::uint16_t i = 0; i < std::size(_buffers); ++i)
+        {
+            const auto& b = _buffers[i];
+            if (address >= b.data() && address + sqe.len <= b.data() + b.size())
+            {
+                sqe.opcode    = IORING_OP_READ_FIXED;
+                sqe.buf_index = i;
+                break;
+            }
+        }
+    }
+
+    void UringReaderPool::_prepare_wakeup() noexcept
+    {
+        auto& sqe     = _ring->push();
+        sqe.opcode    = IORING_OP_READ;
+        sqe.fd        = _wakeup;
+        sqe.addr      = reinterpret_cast<std::uintptr_t>(&_wakeup_value);
+        sqe.len       = sizeof(_wakeup_value);
+        sqe.off       = static_cast<std::uint64_t>(-1); // eventfds aren't seekable
+        sqe.user_data = _wakeup_tag;
+    }
+
+    void UringReaderPool::_prepare_cancel(RequestID id) noexcept
+    {
+        // the read could have completed after the request was cancelled
+        const auto index = _detail::_request_table::index(id);
+        if (_requests.id(index) != id)
+            return;
+
+        auto& sqe     = _ring->push();
+        sqe.opcode    = IORING_OP_ASYNC_CANCEL;
+        sqe.fd        = -1;
+        sqe.addr      = _read_of[index]; // user data of the read
+        sqe.user_data = _cancel_tag;
+    }
+
+    void UringReaderPool::_complete(std::uint32_t read, std::int32_t result) noexcept
+    {
+        auto& r = _reads[read];
+        if (result > 0)
+        {
+            r.done += static_cast<std::size_t>(result);
+            if (r.done < std::size(r.request->dst))
+                return _short_reads.push_back(read);
+        }
+        else if (result == -EINTR || result == -EAGAIN)
+            return _short_reads.push_back(read);
+        else if (result == -ECANCELED)
+            return _finish(read, std::make_error_code(std::errc::operation_canceled));
+        else if (result < 0)
+            return _finish(read, { -result, std::system_category() });
+
+        // completed or reached the end of the file
+        _finish(read, {});
+    }
+
+    void UringReaderPool::_finish(std::uint32_t read, std::error_code error) noexcept
+    {
+        const auto& r = _reads[read];
+        const Completion c{ .id = r.id, .request = r.request, .bytes = r.done, .error = error };
+
+        // the callback can submit again
+        _free_reads.push_back(read);
+        _requests.release(r.id);
+        _detail::deliver(_output_queue, _done, c);
+    }
+
+    void UringReaderPool::_run() noexcept
+    {
+        using _state = _detail::_request_table::State;
+
+        const auto depth = static_cast<std::uint32_t>(std::size(_reads));
+
+        auto armed = false; // the wakeup read is in flight
+        for (;;)
+        {
+            // kernels before 5.13 wait for every request in flight to register,
+            // so the wakeup read must have completed and not be armed again yet
+            if (!armed)
+            {
+                if (auto* r = _registration_pending.load(std::memory_order::acquire))
+                {
+                    _apply(*r);
+                    _registration_pending.store(nullptr, std::memory_order::release);
+                    _registration_pending.notify_all();
+                }
+                _prepare_wakeup();
+                armed = true;
+            }
+
+            const auto done = _done.test(std::memory_order::acquire);
+
+            for (RequestID id; _cancel_queue.try_pop(id);)
+                _prepare_cancel(id);
+
+            // resumed short reads keep their slot
+            std::size_t queued = 0;
+            for (const auto read : _short_reads)
+                if (_requests.cancelled(_reads[read].id))
+                    _finish(read, std::make_error_code(std::errc::operation_canceled));
+                else
+                {
+                    _prepare(read);
+                    ++queued;
+                }
+            _short_reads.clear();
+
+            for (std::uint32_t index; !done && !std::empty(_free_reads) && _submit_queue.try_pop(index);)
+            {
+                const auto id      = _requests.id(index);
+                const auto request = _requests.request(index);
+                if (!_requests.transition(id, _state::queued, _state::running))
+                {
+                    _requests.release(id);
+                    _detail::deliver(_output_queue, _done, { .id = id, .request = request, .error = std::make_error_code(std::errc::operation_canceled) });
+                    continue;
+                }
+
+                const auto read = _free_reads.back();
+                _free_reads.pop_back();
+                _reads[read]    = { id, request, 0 };
+                _read_of[index] = read;
+                if (std::empty(request->dst))
+                    _finish(read, {});
+                else
+                {
+                    _prepare(read);
+                    ++queued;
+                }
+            }
+
+            // reads in flight must land before their buffers can be released
+            if (done && std::size(_free_reads) == depth)
+                return;
+
+            // sleep only when there's nothing new to hand to the kernel
+            auto wait = 0u;
+            if (queued == 0)
+            {
+                _sleeping.store(true, std::memory_order::relaxed);
+                std::atomic_thread_fence(std::memory_order::seq_cst);
+                if (!_cancel_queue.empty() || (!done && !std::empty(_free_reads) && !_submit_queue.empty()))
+                    _sleeping.store(false, std::memory_order::relaxed);
+                else
+                    wait = 1;
+            }
+
+            _ring->enter(wait);
+            _sleeping.store(false, std::memory_order::relaxed);
+
+            // harvest the completions
+            auto       head = *_ring->cq_head;
+            const auto tail = std::atomic_ref<unsigned>{ *_ring->cq_tail }.load(std::memory_order::acquire);
+            for (; head != tail; ++head)
+            {
+                const auto& cqe = _ring->cqes[head & _ring->cq_mask];
+                if (cqe.user_data == _wakeup_tag)
+                    armed = false;
+                else if (cqe.user_data == _cancel_tag)
+                    continue; // the outcome is reported by the read itself
+                else
+                    _complete(static_cast<std::uint32_t>(cqe.user_data), cqe.res);
+            }
+            std::atomic_ref<unsigned>{ *_ring->cq_head }.store(head, std::memory_order::release);
+        }
+    }
+
+} // namespace drako
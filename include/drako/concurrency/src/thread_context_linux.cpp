@@ -0,0 +1,139 @@
+#include "drako/concurrency/thread_context.hpp"
+
+#include "drako/core/platform.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/asan_interface.h>
+#endif
+
+#if !defined(DRAKO_PLT_LINUX)
+#error This source file should be included only on Linux builds
+#endif
+
+#if !defined(_drako_arch_x64)
+#error Architecture currently not supported
+#endif
+
+// Saves the callee-saved state of the running context on its stack,
+// stores the resulting stack pointer in *from and resumes the context at to.
+extern "C" void drako_thread_context_switch(void** from, void* to) noexcept;
+
+// First return address of a new context, calls routine (r12) with args (r13).
+extern "C" void drako_thread_context_entry() noexcept;
+
+asm(R"(
+    .text
+    .p2align 4
+    .globl  drako_thread_context_switch
+    .type   drako_thread_context_switch, @function
+drako_thread_context_switch:
+    pushq   %rbp
+    pushq   %rbx
+    pushq   %r12
+    pushq   %r13
+    pushq   %r14
+    pushq   %r15
+    subq    $16, %rsp
+    stmxcsr (%rsp)
+    fnstcw  4(%rsp)
+    movq    %rsp, (%rdi)
+    movq    %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw   4(%rsp)
+    addq    $16, %rsp
+    popq    %r15
+    popq    %r14
+    popq    %r13
+    popq    %r12
+    popq    %rbx
+    popq    %rbp
+    ret
+    .size   drako_thread_context_switch, .-drako_thread_context_switch
+
+    .p2align 4
+    .globl  drako_thread_context_entry
+    .type   drako_thread_context_entry, @function
+drako_thread_context_entry:
+    movq    %r13, %rdi
+    callq   *%r12
+    ud2
+    .size   drako_thread_context_entry, .-drako_thread_context_entry
+)");
+
+namespace drako
+{
+    // layout of a suspended context, from its saved stack pointer upward
+    struct _saved_frame
+    {
+        std::uint32_t mxcsr;
+        std::uint16_t fpucw;
+        std::uint16_t padding[5];
+        std::uint64_t r15, r14, r13, r12, rbx, rbp;
+        void (*ret)() noexcept;
+    };
+    static_assert(sizeof(_saved_frame) == 72,
+        "Bad class layout: doesn't match the switch routine.");
+
+
+    void thread_context::_create(fiber_routine routine, std::size_t stack_size, void* args) noexcept
+    {
+        assert(routine);
+        assert(stack_size > 0);
+
+        const auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        _stack_size     = ((stack_size + page - 1) / page + 1) * page; // extra guard page
+
+        _stack = ::mmap(nullptr, _stack_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+        if (_stack == MAP_FAILED)
+        {
+            std::exit(EXIT_FAILURE);
+        }
+
+        // stack grows downward, overflows hit the lowest page
+        if (::mprotect(_stack, page, PROT_NONE) != 0)
+        {
+            std::exit(EXIT_FAILURE);
+        }
+
+        // entry routine starts with a 16 bytes aligned stack, as after a call instruction
+        const auto top   = reinterpret_cast<std::uintptr_t>(_stack) + _stack_size;
+        const auto frame = reinterpret_cast<_saved_frame*>((top & ~std::uintptr_t{ 15 }) - sizeof(_saved_frame));
+
+        std::memset(frame, 0, sizeof(_saved_frame));
+        frame->mxcsr = 0x1F80; // default floating point control state
+        frame->fpucw = 0x037F;
+        frame->r12   = reinterpret_cast<std::uint64_t>(routine);
+        frame->r13   = reinterpret_cast<std::uint64_t>(args);
+        frame->ret   = &drako_thread_context_entry;
+        _sp          = frame;
+    }
+
+    void thread_context::_destroy() noexcept
+    {
+        if (_stack != nullptr)
+        {
+            #if defined(__SANITIZE_ADDRESS__)
+            // frames abandoned on the stack leave stale shadow memory behind
+            ::__asan_unpoison_memory_region(_stack, _stack_size);
+            #endif
+            ::munmap(_stack, _stack_size);
+        }
+    }
+
+    void thread_context::_switch(const thread_context& other) noexcept
+    {
+        assert(other._sp != nullptr);
+        drako_thread_context_switch(&_sp, other._sp);
+    }
+
+} // namespace drako
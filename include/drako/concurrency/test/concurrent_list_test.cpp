@@ -0,0 +1,110 @@
+#include "drako/concurrency/concurrent_list.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace drako::concurrency;
+using drako::lockfree::EpochDomain;
+
+template <typename List>
+static void _check_set_semantics()
+{
+    EpochDomain d;
+    List        l{ d };
+
+    EXPECT_FALSE(l.contains(1));
+    EXPECT_TRUE(l.insert(3));
+    EXPECT_TRUE(l.insert(1));
+    EXPECT_TRUE(l.insert(2));
+    EXPECT_FALSE(l.insert(2)); // already present
+
+    for (auto k : { 1, 2, 3 })
+        EXPECT_TRUE(l.contains(k));
+    EXPECT_FALSE(l.contains(0));
+    EXPECT_FALSE(l.contains(4));
+
+    EXPECT_TRUE(l.remove(2));
+    EXPECT_FALSE(l.remove(2)); // already removed
+    EXPECT_FALSE(l.contains(2));
+    EXPECT_TRUE(l.contains(1));
+    EXPECT_TRUE(l.contains(3));
+
+    EXPECT_TRUE(l.insert(2));
+    EXPECT_TRUE(l.contains(2));
+}
+
+// each thread inserts and removes random keys of its own subset, while
+// the others do the same on theirs: in the end the list must match
+// what each thread expects, whatever the interleaving
+template <typename List>
+static void _check_concurrent_updates()
+{
+    constexpr const int threads    = 8;
+    constexpr const int keys       = 256; // per thread
+    constexpr const int operations = 20'000;
+
+    EpochDomain d;
+    List        l{ d };
+
+    std::vector<std::vector<bool>> expected(threads, std::vector<bool>(keys, false));
+    std::vector<std::thread>       workers;
+    for (auto t = 0; t < threads; ++t)
+        workers.emplace_back([&, t]() {
+            std::minstd_rand                   rng{ static_cast<unsigned>(t + 1) };
+            std::uniform_int_distribution<int> key{ 0, keys - 1 };
+            auto&                              mine = expected[t];
+
+            for (auto i = 0; i < operations; ++i)
+            {
+                const auto k     = key(rng);
+                const auto value = k * threads + t; // keys of different threads interleave
+                switch (rng() % 3)
+                {
+                    case 0: EXPECT_EQ(l.insert(value), !mine[k]); mine[k] = true; break;
+                    case 1: EXPECT_EQ(l.remove(value), mine[k]); mine[k] = false; break;
+                    default: EXPECT_EQ(l.contains(value), mine[k]); break;
+                }
+            }
+        });
+    for (auto& w : workers)
+        w.join();
+
+    for (auto t = 0; t < threads; ++t)
+        for (auto k = 0; k < keys; ++k)
+            EXPECT_EQ(l.contains(k * threads + t), expected[t][k]);
+}
+
+GTEST_TEST(LazyList, HasSetSemantics)
+{
+    _check_set_semantics<lazy_list<int>>();
+}
+
+GTEST_TEST(LazyList, SupportsConcurrentUpdates)
+{
+    _check_concurrent_updates<lazy_list<int>>();
+}
+
+GTEST_TEST(LockfreeList, HasSetSemantics)
+{
+    _check_set_semantics<lockfree_list<int>>();
+}
+
+GTEST_TEST(LockfreeList, SupportsConcurrentUpdates)
+{
+    _check_concurrent_updates<lockfree_list<int>>();
+}
+
+GTEST_TEST(LockfreeList, SupportsCustomOrder)
+{
+    EpochDomain                          d;
+    lockfree_list<int, std::greater<int>> l{ d };
+    EXPECT_TRUE(l.insert(1));
+    EXPECT_TRUE(l.insert(5));
+    EXPECT_TRUE(l.remove(1));
+    EXPECT_TRUE(l.contains(5));
+    EXPECT_FALSE(l.contains(1));
+}
@@ -0,0 +1,150 @@
+#include "drako/concurrency/lockfree_epoch.hpp"
+#include "drako/concurrency/lockfree_linked_stack.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+using namespace drako::lockfree;
+
+namespace
+{
+    // counts the live instances
+    struct _tracked
+    {
+        static inline std::atomic<int> alive = 0;
+
+        int value;
+
+        explicit _tracked(int v) noexcept : value{ v } { alive.fetch_add(1); }
+        _tracked(const _tracked& other) noexcept : value{ other.value } { alive.fetch_add(1); }
+        _tracked& operator=(const _tracked&) noexcept = default;
+        ~_tracked() noexcept { alive.fetch_sub(1); }
+    };
+} // namespace
+
+GTEST_TEST(EpochDomain, DefersReclamationWhilePinned)
+{
+    _tracked::alive = 0;
+    EpochDomain d{ { .collect_threshold = 1, .max_garbage = 64 } };
+
+    auto        p = new _tracked{ 0 };
+    std::thread reader;
+    {
+        std::atomic<bool> pinned   = false;
+        std::atomic<bool> released = false;
+        reader                     = std::thread{ [&]() {
+            const auto guard = d.pin();
+            pinned.store(true);
+            while (!released.load())
+                std::this_thread::yield();
+        } };
+        while (!pinned.load())
+            std::this_thread::yield();
+
+        d.retire(p);
+        for (auto i = 0; i < 8; ++i)
+            d.collect();
+        EXPECT_EQ(_tracked::alive, 1); // the reader may still hold a reference
+        EXPECT_EQ(d.pending(), 1);
+
+        released.store(true);
+        reader.join();
+    }
+
+    for (auto i = 0; i < 3; ++i)
+        d.collect();
+    EXPECT_EQ(_tracked::alive, 0);
+    EXPECT_EQ(d.pending(), 0);
+}
+
+GTEST_TEST(EpochDomain, SupportsNestedCriticalSections)
+{
+    EpochDomain d;
+    EXPECT_FALSE(d.is_pinned());
+    {
+        const auto outer = d.pin();
+        {
+            const auto inner = d.pin();
+            EXPECT_TRUE(d.is_pinned());
+        }
+        EXPECT_TRUE(d.is_pinned());
+    }
+    EXPECT_FALSE(d.is_pinned());
+}
+
+GTEST_TEST(EpochDomain, FreesGarbageOnDestruction)
+{
+    _tracked::alive = 0;
+    {
+        EpochDomain d;
+        const auto  guard = d.pin();
+        for (auto i = 0; i < 10; ++i)
+            d.retire(new _tracked{ i });
+        EXPECT_EQ(_tracked::alive, 10);
+    }
+    EXPECT_EQ(_tracked::alive, 0);
+}
+
+GTEST_TEST(EpochDomain, BoundsGarbagePerThread)
+{
+    _tracked::alive = 0;
+    EpochDomain d{ { .collect_threshold = 8, .max_garbage = 32 } };
+
+    std::vector<std::thread> workers;
+    for (auto t = 0; t < 4; ++t)
+        workers.emplace_back([&]() {
+            for (auto i = 0; i < 10'000; ++i)
+            {
+                {
+                    const auto guard = d.pin();
+                }
+                d.retire(new _tracked{ i });
+                EXPECT_LT(d.pending(), 32);
+            }
+        });
+    for (auto& w : workers)
+        w.join();
+
+    EXPECT_LE(_tracked::alive, 4 * 32);
+}
+
+GTEST_TEST(LinkedStack, TransfersAllElements)
+{
+    _tracked::alive = 0;
+    {
+        EpochDomain            d;
+        linked_stack<_tracked> s{ d };
+
+        constexpr const int      threads = 4;
+        constexpr const int      count   = 10'000;
+        std::atomic<std::int64_t> sum     = 0;
+        std::atomic<int>          popped  = 0;
+
+        std::vector<std::thread> workers;
+        for (auto t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&]() {
+                for (auto i = 1; i <= count; ++i)
+                    ASSERT_TRUE(s.push(_tracked{ i }));
+            });
+            workers.emplace_back([&]() {
+                for (_tracked v{ 0 }; popped.load() < threads * count;)
+                    if (s.pop(v))
+                    {
+                        sum.fetch_add(v.value);
+                        popped.fetch_add(1);
+                    }
+            });
+        }
+        for (auto& w : workers)
+            w.join();
+
+        EXPECT_TRUE(s.is_empty());
+        EXPECT_EQ(sum.load(), std::int64_t{ threads } * count * (count + 1) / 2);
+    }
+    EXPECT_EQ(_tracked::alive, 0);
+}
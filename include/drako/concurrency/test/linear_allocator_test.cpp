@@ -0,0 +1,72 @@
+#include "drako/concurrency/lockfree_linear_allocator.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+using namespace drako::concurrency;
+
+GTEST_TEST(LockfreeLinearAllocator, AlignsAllocations)
+{
+    lockfree_linear_allocator a{ 1024 };
+    EXPECT_EQ(a.capacity(), 1024);
+
+    const auto p = a.allocate(1, 1);
+    ASSERT_NE(p, nullptr);
+    for (std::size_t align = 2; align <= 256; align *= 2)
+    {
+        const auto q = a.allocate(3, align);
+        ASSERT_NE(q, nullptr);
+        EXPECT_EQ(reinterpret_cast<std::uintptr_t>(q) % align, 0);
+    }
+    EXPECT_LE(a.size(), a.capacity());
+}
+
+GTEST_TEST(LockfreeLinearAllocator, FailsWhenExhausted)
+{
+    lockfree_linear_allocator a{ 256 };
+    EXPECT_NE(a.allocate(200), nullptr);
+    EXPECT_EQ(a.allocate(100), nullptr); // doesn't move the offset
+    EXPECT_NE(a.allocate(56, 1), nullptr);
+    EXPECT_EQ(a.allocate(1, 1), nullptr);
+
+    a.release();
+    EXPECT_EQ(a.size(), 0);
+    EXPECT_NE(a.allocate(256), nullptr);
+
+    lockfree_linear_allocator empty{ 0 };
+    EXPECT_EQ(empty.allocate(1), nullptr);
+}
+
+GTEST_TEST(LockfreeLinearAllocator, HandsOutDisjointBlocks)
+{
+    constexpr const std::size_t threads = 4;
+    constexpr const std::size_t blocks  = 1000; // per thread
+    constexpr const std::size_t bytes   = 24;
+
+    lockfree_linear_allocator a{ threads * blocks * 32 };
+
+    std::vector<std::vector<std::byte*>> owned(threads);
+    std::vector<std::thread>             workers;
+    for (std::size_t t = 0; t < threads; ++t)
+        workers.emplace_back([&, t]() {
+            for (std::size_t i = 0; i < blocks; ++i)
+            {
+                const auto p = static_cast<std::byte*>(a.allocate(bytes, 8));
+                ASSERT_NE(p, nullptr);
+                std::fill_n(p, bytes, static_cast<std::byte>(t));
+                owned[t].push_back(p);
+            }
+        });
+    for (auto& w : workers)
+        w.join();
+
+    // no block was overwritten by another thread
+    for (std::size_t t = 0; t < threads; ++t)
+        for (const auto p : owned[t])
+            EXPECT_TRUE(std::all_of(p, p + bytes, [t](std::byte b) { return b == static_cast<std::byte>(t); }));
+}
@@ -0,0 +1,191 @@
+#include "drako/concurrency/lock.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+using namespace drako::concurrency;
+
+static constexpr const int _threads    = 8;
+static constexpr const int _iterations = 5'000;
+
+// increments a plain counter from many threads, lost updates reveal a broken lock
+template <typename Lock, typename Acquire>
+static void _check_exclusion(Lock& lock, Acquire&& acquire)
+{
+    std::uint64_t            counter = 0;
+    std::vector<std::thread> workers;
+    for (auto t = 0; t < _threads; ++t)
+        workers.emplace_back([&]() {
+            for (auto i = 0; i < _iterations; ++i)
+                acquire(lock, [&]() { ++counter; });
+        });
+    for (auto& w : workers)
+        w.join();
+
+    EXPECT_EQ(counter, static_cast<std::uint64_t>(_threads) * _iterations);
+}
+
+template <typename Lock>
+static void _check_exclusion(Lock& lock)
+{
+    _check_exclusion(lock, [](Lock& l, auto&& critical_section) {
+        const std::scoped_lock guard{ l };
+        critical_section();
+    });
+}
+
+GTEST_TEST(SpinLock, ProvidesMutualExclusion)
+{
+    spin_lock l;
+    _check_exclusion(l);
+
+    ASSERT_TRUE(l.try_lock());
+    EXPECT_FALSE(l.try_lock());
+    l.unlock();
+}
+
+GTEST_TEST(TicketLock, ProvidesMutualExclusion)
+{
+    ticket_lock l;
+    _check_exclusion(l);
+
+    ASSERT_TRUE(l.try_lock());
+    EXPECT_FALSE(l.try_lock());
+    l.unlock();
+    EXPECT_TRUE(l.try_lock());
+    l.unlock();
+}
+
+GTEST_TEST(McsLock, ProvidesMutualExclusion)
+{
+    mcs_lock l;
+    _check_exclusion(l, [](mcs_lock& l, auto&& critical_section) {
+        const mcs_lock::guard guard{ l };
+        critical_section();
+    });
+
+    mcs_lock::node a, b;
+    ASSERT_TRUE(l.try_lock(a));
+    EXPECT_FALSE(l.try_lock(b));
+    l.unlock(a);
+    EXPECT_TRUE(l.try_lock(b));
+    l.unlock(b);
+}
+
+GTEST_TEST(RwSpinLock, ProvidesMutualExclusion)
+{
+    rw_spin_lock l;
+    _check_exclusion(l);
+}
+
+GTEST_TEST(RwSpinLock, ExcludesWritersFromReaders)
+{
+    rw_spin_lock l;
+
+    ASSERT_TRUE(l.try_lock_shared());
+    ASSERT_TRUE(l.try_lock_shared()); // readers share the lock
+    EXPECT_FALSE(l.try_lock());
+    l.unlock_shared();
+    l.unlock_shared();
+
+    ASSERT_TRUE(l.try_lock());
+    EXPECT_FALSE(l.try_lock_shared());
+    l.unlock();
+    EXPECT_TRUE(l.try_lock_shared());
+    l.unlock_shared();
+}
+
+GTEST_TEST(RwSpinLock, ReadersSeeConsistentWrites)
+{
+    rw_spin_lock               l;
+    std::uint64_t              a = 0, b = 0; // always equal outside of the writer
+    std::atomic<bool>          done = false;
+    std::atomic<std::uint64_t> torn = 0;
+
+    std::vector<std::thread> readers;
+    for (auto t = 0; t < _threads - 1; ++t)
+        readers.emplace_back([&]() {
+            while (!done.load(std::memory_order::relaxed))
+            {
+                const std::shared_lock guard{ l };
+                if (a != b)
+                    torn.fetch_add(1, std::memory_order::relaxed);
+            }
+        });
+
+    for (auto i = 0; i < _iterations; ++i)
+    {
+        const std::scoped_lock guard{ l };
+        ++a;
+        ++b;
+    }
+    done.store(true, std::memory_order::relaxed);
+    for (auto& r : readers)
+        r.join();
+
+    EXPECT_EQ(torn.load(), 0);
+    EXPECT_EQ(a, static_cast<std::uint64_t>(_iterations));
+}
+
+GTEST_TEST(ReentrantSpinLock, SupportsNestedAcquisitions)
+{
+    reentrant_spin_lock l;
+    l.lock();
+    l.lock(); // must not deadlock
+    ASSERT_TRUE(l.try_lock());
+
+    std::thread other{ [&]() { EXPECT_FALSE(l.try_lock()); } };
+    other.join();
+
+    l.unlock();
+    l.unlock();
+    std::thread still_held{ [&]() { EXPECT_FALSE(l.try_lock()); } };
+    still_held.join();
+
+    l.unlock();
+    std::thread released{ [&]() {
+        ASSERT_TRUE(l.try_lock());
+        l.unlock();
+    } };
+    released.join();
+
+    _check_exclusion(l);
+}
+
+GTEST_TEST(SpinSemaphore, LimitsConcurrentOwners)
+{
+    spin_semaphore s{ 2 };
+    ASSERT_TRUE(s.try_lock());
+    ASSERT_TRUE(s.try_lock());
+    EXPECT_FALSE(s.try_lock());
+    s.unlock();
+    EXPECT_TRUE(s.try_lock());
+    s.unlock();
+    s.unlock();
+}
+
+GTEST_TEST(TicketLock, CountsContendedAcquisitions)
+{
+    ticket_lock l;
+    EXPECT_EQ(l.stats().contended, 0);
+
+    l.lock();
+    std::thread waiter{ [&]() {
+        l.lock();
+        l.unlock();
+    } };
+    std::this_thread::sleep_for(std::chrono::milliseconds{ 10 });
+    l.unlock();
+    waiter.join();
+
+    const auto stats = l.stats();
+    EXPECT_EQ(stats.contended, 1);
+    EXPECT_GT(stats.pauses, 0);
+}
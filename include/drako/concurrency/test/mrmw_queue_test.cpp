@@ -0,0 +1,129 @@
+#include "drako/concurrency/lockfree_mrmwqueue.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace drako::lockfree;
+
+GTEST_TEST(MRMWQueue, PreservesFifoOrder)
+{
+    MRMWQueue<int> q{ 8 };
+    ASSERT_EQ(q.capacity(), 8);
+    ASSERT_TRUE(q.empty());
+
+    for (auto i = 0; i < 8; ++i)
+        ASSERT_TRUE(q.try_push(i));
+    EXPECT_FALSE(q.try_push(8)); // full
+    EXPECT_EQ(q.size(), 8);
+
+    for (auto i = 0; i < 8; ++i)
+    {
+        int value;
+        ASSERT_TRUE(q.try_pop(value));
+        EXPECT_EQ(value, i);
+    }
+    int value;
+    EXPECT_FALSE(q.try_pop(value)); // empty
+}
+
+GTEST_TEST(MRMWQueue, TransfersBatches)
+{
+    MRMWQueue<int> q{ 8 };
+
+    const int in[] = { 0, 1, 2, 3, 4, 5 };
+    EXPECT_EQ(q.try_push_n(in), 6);
+    EXPECT_EQ(q.try_push_n(in), 2); // only the free slots are filled
+
+    int out[5];
+    EXPECT_EQ(q.try_pop_n(out), 5);
+    for (auto i = 0; i < 5; ++i)
+        EXPECT_EQ(out[i], i);
+
+    EXPECT_EQ(q.try_pop_n(out), 3);
+    EXPECT_EQ(out[0], 5);
+    EXPECT_EQ(out[1], 0);
+    EXPECT_EQ(out[2], 1);
+    EXPECT_EQ(q.try_pop_n(out), 0);
+}
+
+GTEST_TEST(MRMWQueue, ReleasesRemainingElements)
+{
+    auto shared = std::make_shared<int>(0);
+    {
+        MRMWQueue<std::shared_ptr<int>> q{ 4 };
+        ASSERT_TRUE(q.try_push(shared));
+        ASSERT_TRUE(q.try_push(shared));
+        EXPECT_EQ(shared.use_count(), 3);
+    }
+    EXPECT_EQ(shared.use_count(), 1);
+}
+
+// every producer pushes a disjoint set of values, consumers check that each one is seen once
+static void _stress(std::size_t producers, std::size_t consumers, std::size_t batch)
+{
+    const std::uint32_t per_producer = 50'000;
+    const auto          total        = per_producer * producers;
+
+    MRMWQueue<std::uint32_t>      q{ 1024 };
+    std::vector<std::atomic<int>> seen(total);
+    std::atomic<std::size_t>      popped = 0;
+    std::vector<std::thread>      threads;
+
+    for (std::size_t p = 0; p < producers; ++p)
+        threads.emplace_back([&, p]() {
+            std::vector<std::uint32_t> values(batch);
+            for (std::uint32_t i = 0; i < per_producer;)
+            {
+                const auto count = std::min<std::size_t>(batch, per_producer - i);
+                for (std::size_t j = 0; j < count; ++j)
+                    values[j] = static_cast<std::uint32_t>(p * per_producer + i + j);
+
+                const auto pushed = (batch == 1)
+                    ? static_cast<std::size_t>(q.try_push(values[0]))
+                    : q.try_push_n({ std::data(values), count });
+                if (pushed == 0)
+                    std::this_thread::yield();
+                i += static_cast<std::uint32_t>(pushed);
+            }
+        });
+
+    for (std::size_t c = 0; c < consumers; ++c)
+        threads.emplace_back([&]() {
+            std::vector<std::uint32_t> values(batch);
+            while (popped.load(std::memory_order::relaxed) < total)
+            {
+                const auto count = (batch == 1)
+                    ? static_cast<std::size_t>(q.try_pop(values[0]))
+                    : q.try_pop_n(values);
+                for (std::size_t j = 0; j < count; ++j)
+                    seen[values[j]].fetch_add(1, std::memory_order::relaxed);
+                popped.fetch_add(count, std::memory_order::relaxed);
+            }
+        });
+
+    for (auto& t : threads)
+        t.join();
+
+    EXPECT_TRUE(q.empty());
+    for (const auto& s : seen)
+        ASSERT_EQ(s.load(), 1);
+}
+
+GTEST_TEST(MRMWQueue, StressSingleElement)
+{
+    _stress(1, 1, 1);
+    _stress(4, 4, 1);
+    _stress(8, 2, 1);
+}
+
+GTEST_TEST(MRMWQueue, StressBatches)
+{
+    _stress(1, 1, 16);
+    _stress(4, 4, 16);
+    _stress(2, 8, 7);
+}
@@ -1,54 +1,334 @@
-#include "drako/io/async_reader_pool.hpp"
-#include "drako/io/output_file_handle.hpp"
+#include "drako/concurrency/async_reader_pool.hpp"
 
 #include <gtest/gtest.h>
 #include <rio/input_file_handle.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
-#include <string>
+#include <random>
+#include <span>
 #include <thread>
+#include <vector>
 
-using namespace std::chrono_literals;
+using namespace drako;
 
-GTEST_TEST(AsyncReaderPool, ConcurrentExecution)
+namespace
 {
-    const std::string text[3] = { "aaaaa", "", "" };
-
-    const auto file_count = std::size(text);
-    const auto temp_dir   = std::filesystem::temp_directory_path();
-
-    char filename[L_tmpnam];
-    ASSERT_TRUE(std::tmpnam(filename));
-    try
+    // file filled with a known pattern, removed on destruction
+    class TestFile
     {
-        for (auto i = 0; i < file_count; ++i)
+    public:
+        explicit TestFile(std::size_t size)
+            : _path{ std::filesystem::temp_directory_path() / "drako_reader_pool_test.bin" }
         {
-            const auto test_file_path = temp_dir / (filename + std::to_string(i));
+            std::ofstream out{ _path, std::ios::binary };
+            for (std::size_t i = 0; i < size; ++i)
+                out.put(static_cast<char>(_byte(i)));
+        }
+
+        ~TestFile() { std::filesystem::remove(_path); }
+
+        [[nodiscard]] const std::filesystem::path& path() const noexcept { return _path; }
 
-            std::ofstream{ test_file_path } << text[i];
+        [[nodiscard]] static std::byte _byte(std::size_t offset) noexcept
+        {
+            return static_cast<std::byte>((offset * 7) ^ (offset >> 8));
         }
 
-        AsyncReaderPool pool{ { .workers = 4, .submit_queue_size = 100, .output_queue_size = 100 } };
+    private:
+        std::filesystem::path _path;
+    };
 
-        std::vector<UniqueInputFile> files;
-        for (auto i = 0; i < file_count; ++i)
-            files.emplace_back(temp_dir / (filename + std::to_string(i)));
+    // submits many random ranges of a file, then checks the data of each one
+    void _read_ranges(AsyncReaderPoolInterface& pool, rio::Handle file, std::size_t file_size,
+        std::span<std::byte> memory, std::size_t count)
+    {
+        using Request    = AsyncReaderPoolInterface::Request;
+        using Completion = AsyncReaderPoolInterface::Completion;
 
-        decltype(pool)::Request requests[100];
-        for (const auto& r : requests)
+        std::minstd_rand                 rng{ 42 };
+        std::vector<Request>             requests(count);
+        std::uniform_int_distribution<std::size_t> size_dist{ 1, std::size(memory) / count };
+        for (std::size_t i = 0; i < count; ++i)
         {
-            ASSERT_TRUE(pool.submit(0, std::addressof(r)));
+            const auto size   = size_dist(rng);
+            const auto offset = std::uniform_int_distribution<std::size_t>{ 0, file_size - size }(rng);
+            requests[i]       = { .src = file, .dst = memory.subspan(i * (std::size(memory) / count), size), .offset = offset, .user_data = i };
         }
 
-        std::this_thread::sleep_for(1s);
+        std::size_t submitted = 0;
+        std::size_t completed = 0;
+        std::vector<AsyncReaderPoolInterface::RequestID> ids(count);
+        while (completed < count)
+        {
+            for (; submitted < count; ++submitted)
+                if ((ids[submitted] = pool.submit(&requests[submitted])) == AsyncReaderPoolInterface::invalid_request)
+                    break;
+
+            Completion  batch[8];
+            const auto  n = pool.retrieve(batch);
+            for (const auto& c : std::span{ batch, n })
+            {
+                const auto& r = *c.request;
+                ASSERT_FALSE(c.error);
+                ASSERT_EQ(c.id, ids[r.user_data]);
+                ASSERT_EQ(c.bytes, std::size(r.dst));
+                for (std::size_t i = 0; i < std::size(r.dst); ++i)
+                    ASSERT_EQ(r.dst[i], TestFile::_byte(r.offset + i)) << "at offset " << r.offset + i;
+            }
+            completed += n;
+            if (n == 0)
+                std::this_thread::yield();
+        }
     }
-    catch (const std::exception& e)
+
+    // waits for the completions of the requests
+    void _wait(AsyncReaderPoolInterface& pool, std::span<AsyncReaderPoolInterface::Completion> out)
     {
-        for (auto i = 0; i < file_count; ++i)
+        for (std::size_t completed = 0; completed < std::size(out);)
+            if (const auto n = pool.retrieve(out.subspan(completed)); n > 0)
+                completed += n;
+            else
+                std::this_thread::yield();
+    }
+
+    // submits more requests than the pool can start, then cancels all of them
+    void _cancel_requests(AsyncReaderPoolInterface& pool, rio::Handle file, std::span<std::byte> memory)
+    {
+        using Request    = AsyncReaderPoolInterface::Request;
+        using Completion = AsyncReaderPoolInterface::Completion;
+
+        std::vector<Request> requests(32);
+        std::vector<AsyncReaderPoolInterface::RequestID> ids;
+        for (std::size_t i = 0; i < std::size(requests); ++i)
         {
-            const auto test_file_path = temp_dir / (filename + std::to_string(i));
-            std::filesystem::remove(test_file_path);
+            requests[i] = { .src = file, .dst = memory.subspan(i * (std::size(memory) / 32), std::size(memory) / 32), .offset = 0 };
+            ids.push_back(pool.submit(&requests[i]));
+            ASSERT_NE(ids.back(), AsyncReaderPoolInterface::invalid_request);
         }
+
+        std::size_t cancelled = 0;
+        for (const auto id : ids)
+            if (pool.cancel(id))
+                ++cancelled;
+
+        std::vector<Completion> completions(std::size(requests));
+        _wait(pool, completions);
+
+        std::size_t interrupted = 0;
+        for (const auto& c : completions)
+            if (c.error)
+            {
+                EXPECT_EQ(c.error, std::errc::operation_canceled);
+                ++interrupted;
+            }
+            else
+                EXPECT_EQ(c.bytes, std::size(c.request->dst));
+
+        // a cancelled read in flight can still complete
+        EXPECT_GT(cancelled, 0u);
+        EXPECT_LE(interrupted, cancelled);
+
+        // completed requests can't be cancelled
+        for (const auto id : ids)
+            EXPECT_FALSE(pool.cancel(id));
     }
-}
\ No newline at end of file
+
+} // namespace
+
+GTEST_TEST(AsyncReaderPool, ReadsRanges)
+{
+    const std::size_t     file_size = 1 << 20;
+    const TestFile        file{ file_size };
+    rio::UniqueInputFile  input{ file.path() };
+    std::vector<std::byte> memory(1 << 20);
+
+    AsyncReaderPool pool{ { .workers = 4, .submit_queue_size = 16, .output_queue_size = 16 } };
+    _read_ranges(pool, input.native_handle(), file_size, memory, 256);
+}
+
+GTEST_TEST(AsyncReaderPool, StopsAtEndOfFile)
+{
+    const TestFile       file{ 100 };
+    rio::UniqueInputFile input{ file.path() };
+    std::vector<std::byte> memory(64, std::byte{ 0xff });
+
+    AsyncReaderPool pool{ { .workers = 1 } };
+
+    const AsyncReaderPool::Request request{ .src = input.native_handle(), .dst = memory, .offset = 80 };
+    ASSERT_NE(pool.submit(&request), AsyncReaderPool::invalid_request);
+
+    AsyncReaderPool::Completion c;
+    _wait(pool, { &c, 1 });
+
+    EXPECT_FALSE(c.error);
+    EXPECT_EQ(c.bytes, 20u);
+    EXPECT_EQ(memory[19], TestFile::_byte(99));
+    EXPECT_EQ(memory[20], std::byte{ 0xff }); // past the end of the file
+}
+
+GTEST_TEST(AsyncReaderPool, CancelsQueuedRequests)
+{
+    const TestFile         file{ 1 << 20 };
+    rio::UniqueInputFile   input{ file.path() };
+    std::vector<std::byte> memory(1 << 20);
+
+    AsyncReaderPool pool{ { .workers = 1, .submit_queue_size = 32 } };
+    _cancel_requests(pool, input.native_handle(), memory);
+}
+
+GTEST_TEST(AsyncReaderPool, InvokesCallbacks)
+{
+    const TestFile         file{ 1 << 16 };
+    rio::UniqueInputFile   input{ file.path() };
+    std::vector<std::byte> memory(1 << 16);
+
+    static std::atomic<std::uint64_t> mask;
+    mask = 0;
+
+    const auto callback = [](const AsyncReaderPool::Completion& c) noexcept {
+        if (!c.error && c.bytes == std::size(c.request->dst))
+            mask.fetch_or(std::uint64_t{ 1 } << c.request->user_data, std::memory_order::release);
+    };
+
+    AsyncReaderPool pool{ { .workers = 2 } };
+
+    std::vector<AsyncReaderPool::Request> requests(64);
+    for (std::size_t i = 0; i < std::size(requests); ++i)
+    {
+        requests[i] = { .src = input.native_handle(), .dst = std::span{ memory }.subspan(i * 1024, 1024), .offset = i * 1024, .callback = callback, .user_data = i };
+        ASSERT_NE(pool.submit(&requests[i]), AsyncReaderPool::invalid_request);
+    }
+    while (mask.load(std::memory_order::acquire) != ~std::uint64_t{ 0 })
+        std::this_thread::yield();
+
+    AsyncReaderPool::Completion c;
+    EXPECT_EQ(pool.retrieve({ &c, 1 }), 0u); // nothing was queued
+    EXPECT_EQ(memory[5000], TestFile::_byte(5000));
+}
+
+GTEST_TEST(AsyncReaderPool, CreatesSupportedBackend)
+{
+    const std::size_t      file_size = 1 << 16;
+    const TestFile         file{ file_size };
+    rio::UniqueInputFile   input{ file.path() };
+    std::vector<std::byte> memory(1 << 16);
+
+    const auto pool = make_async_reader_pool({});
+    ASSERT_TRUE(pool);
+    _read_ranges(*pool, input.native_handle(), file_size, memory, 64);
+}
+
+#if defined(DRAKO_PLT_LINUX)
+
+GTEST_TEST(UringReaderPool, ReadsRanges)
+{
+    if (!UringReaderPool::supported())
+        GTEST_SKIP() << "io_uring isn't available.";
+
+    const std::size_t      file_size = 1 << 20;
+    const TestFile         file{ file_size };
+    rio::UniqueInputFile   input{ file.path() };
+    std::vector<std::byte> memory(1 << 20);
+
+    // more requests than reads in flight
+    UringReaderPool pool{ { .queue_depth = 8, .submit_queue_size = 32, .output_queue_size = 32 } };
+    _read_ranges(pool, input.native_handle(), file_size, memory, 512);
+}
+
+GTEST_TEST(UringReaderPool, ReadsRegisteredFilesAndBuffers)
+{
+    if (!UringReaderPool::supported())
+        GTEST_SKIP() << "io_uring isn't available.";
+
+    const std::size_t      file_size = 1 << 18;
+    const TestFile         file{ file_size };
+    rio::UniqueInputFile   input{ file.path() };
+    std::vector<std::byte> memory(1 << 16);
+
+    UringReaderPool pool{ { .queue_depth = 16 } };
+
+    const rio::Handle          files[]   = { input.native_handle() };
+    const std::span<std::byte> buffers[] = { memory };
+    EXPECT_TRUE(pool.register_files(files));
+    static_cast<void>(pool.register_buffers(buffers)); // can exceed the locked memory limit
+    _read_ranges(pool, input.native_handle(), file_size, memory, 128);
+
+    // registrations can be replaced between batches
+    EXPECT_TRUE(pool.register_files({}));
+    _read_ranges(pool, input.native_handle(), file_size, memory, 128);
+}
+
+GTEST_TEST(UringReaderPool, RegistersFromManyThreads)
+{
+    if (!UringReaderPool::supported())
+        GTEST_SKIP() << "io_uring isn't available.";
+
+    const TestFile       file{ 1 << 12 };
+    rio::UniqueInputFile input{ file.path() };
+
+    UringReaderPool pool{ {} };
+
+    // each registration is handed to the ring thread, that is waiting for the wakeup
+    const rio::Handle        files[] = { input.native_handle() };
+    std::atomic<std::size_t> failed  = 0;
+    std::vector<std::thread> threads;
+    for (auto i = 0; i < 4; ++i)
+        threads.emplace_back([&]() {
+            for (auto j = 0; j < 64; ++j)
+                if (!pool.register_files(j % 2 == 0 ? std::span{ files } : std::span<const rio::Handle>{}))
+                    ++failed;
+        });
+    for (auto& t : threads)
+        t.join();
+    EXPECT_EQ(failed, 0u);
+}
+
+GTEST_TEST(UringReaderPool, StopsAtEndOfFile)
+{
+    if (!UringReaderPool::supported())
+        GTEST_SKIP() << "io_uring isn't available.";
+
+    const TestFile         file{ 100 };
+    rio::UniqueInputFile   input{ file.path() };
+    std::vector<std::byte> memory(64, std::byte{ 0xff });
+
+    UringReaderPool pool{ {} };
+
+    const UringReaderPool::Request requests[] = {
+        { .src = input.native_handle(), .dst = memory, .offset = 80 },
+        { .src = input.native_handle(), .dst = {}, .offset = 0 },
+    };
+    ASSERT_NE(pool.submit(&requests[0]), UringReaderPool::invalid_request);
+    ASSERT_NE(pool.submit(&requests[1]), UringReaderPool::invalid_request);
+
+    UringReaderPool::Completion completions[2];
+    _wait(pool, completions);
+
+    for (const auto& c : completions)
+    {
+        EXPECT_FALSE(c.error);
+        EXPECT_EQ(c.bytes, c.request == &requests[0] ? 20u : 0u);
+    }
+    EXPECT_EQ(memory[19], TestFile::_byte(99));
+    EXPECT_EQ(memory[20], std::byte{ 0xff }); // past the end of the file
+}
+
+GTEST_TEST(UringReaderPool, CancelsRequests)
+{
+    if (!UringReaderPool::supported())
+        GTEST_SKIP() << "io_uring isn't available.";
+
+    const TestFile         file{ 1 << 20 };
+    rio::UniqueInputFile   input{ file.path() };
+    std::vector<std::byte> memory(1 << 20);
+
+    UringReaderPool pool{ { .queue_depth = 2, .submit_queue_size = 32 } };
+    _cancel_requests(pool, input.native_handle(), memory);
+}
+
+#endif
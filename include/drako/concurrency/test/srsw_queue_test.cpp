@@ -0,0 +1,97 @@
+#include "drako/concurrency/lockfree_ringbuffer.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace drako::lockfree;
+
+GTEST_TEST(SRSWQueue, PreservesFifoOrder)
+{
+    SRSWQueue<int> q{ 4 };
+    ASSERT_EQ(q.capacity(), 4);
+
+    for (auto i = 0; i < 4; ++i)
+        ASSERT_TRUE(q.push(i));
+    EXPECT_FALSE(q.push(4)); // full
+    EXPECT_EQ(q.size(), 4);
+
+    for (auto i = 0; i < 4; ++i)
+    {
+        const auto value = q.pop();
+        ASSERT_TRUE(value);
+        EXPECT_EQ(*value, i);
+    }
+    EXPECT_FALSE(q.pop());
+    EXPECT_TRUE(q.empty());
+}
+
+GTEST_TEST(SRSWQueue, TransfersBatches)
+{
+    SRSWQueue<int> q{ 8 };
+
+    const int in[] = { 0, 1, 2, 3, 4, 5 };
+    EXPECT_EQ(q.push_n(in), 6);
+    EXPECT_EQ(q.push_n(in), 2); // only the free slots are filled
+
+    int out[5];
+    EXPECT_EQ(q.pop_n(out), 5);
+    for (auto i = 0; i < 5; ++i)
+        EXPECT_EQ(out[i], i);
+
+    EXPECT_EQ(q.pop_n(out), 3);
+    EXPECT_EQ(out[0], 5);
+    EXPECT_EQ(out[1], 0);
+    EXPECT_EQ(out[2], 1);
+    EXPECT_EQ(q.pop_n(out), 0);
+}
+
+GTEST_TEST(SRSWQueue, ReleasesRemainingElements)
+{
+    auto shared = std::make_shared<int>(0);
+    {
+        SRSWQueue<std::shared_ptr<int>> q{ 4 };
+        ASSERT_TRUE(q.push(shared));
+        ASSERT_TRUE(q.push(shared));
+
+        std::shared_ptr<int> out;
+        ASSERT_TRUE(q.pop(out));
+        EXPECT_EQ(shared.use_count(), 3);
+    }
+    EXPECT_EQ(shared.use_count(), 1);
+}
+
+GTEST_TEST(SRSWQueue, StressProducerConsumer)
+{
+    const std::uint64_t count = 1'000'000;
+
+    SRSWQueue<std::uint64_t> q{ 256 };
+    std::thread              producer{ [&]() {
+        std::uint64_t values[16];
+        for (std::uint64_t i = 0; i < count;)
+        {
+            const auto n = std::min<std::uint64_t>(std::size(values), count - i);
+            for (std::uint64_t j = 0; j < n; ++j)
+                values[j] = i + j;
+            const auto pushed = q.push_n({ values, static_cast<std::size_t>(n) });
+            if (pushed == 0)
+                std::this_thread::yield(); // lets the consumer run when they share a core
+            i += pushed;
+        }
+    } };
+
+    std::uint64_t expected = 0;
+    std::uint64_t values[7];
+    while (expected < count)
+    {
+        const auto n = q.pop_n(values);
+        if (n == 0)
+            std::this_thread::yield();
+        for (std::size_t j = 0; j < n; ++j)
+            ASSERT_EQ(values[j], expected++);
+    }
+    producer.join();
+}
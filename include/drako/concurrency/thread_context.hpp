@@ -4,6 +4,9 @@
 
 #include "drako/core/platform.hpp"
 
+#include <cstddef>
+#include <cstdlib>
+
 #if defined(DRAKO_PLT_WIN32)
 #include <Windows.h>
 #endif
@@ -12,38 +15,70 @@ namespace drako
 {
     // CLASS
     // Execution context that can be run on a thread.
+    //
+    // On Linux the context switch is implemented by hand for the x86-64 SysV ABI,
+    // and each context owns an mmap'ed stack whose lowest page is a guard page.
+    //
     class thread_context final
     {
     public:
 
-        using fiber_routine = void(DRAKO_API_STDCALL)(void*) noexcept;
+        // Entry point of a context, must never return.
+        using fiber_routine = void(DRAKO_API_STDCALL*)(void*) noexcept;
+
+        // Default stack size of a new context.
+        static constexpr const std::size_t default_stack_size = 64 * 1024;
 
-        explicit thread_context(fiber_routine routine) noexcept
+        // @brief   Binds a context to the calling thread.
+        //
+        // Required to switch from the calling thread to other contexts.
+        //
+        explicit thread_context() noexcept
         {
             #if defined(DRAKO_PLT_WIN32)
             {
-                _address = ::CreateFiber(0/*default stack size*/, routine, nullptr);
+                _address = ::ConvertThreadToFiber(nullptr);
                 if (_address == nullptr)
                 {
                     std::exit(EXIT_FAILURE);
                 }
+                _args = nullptr;
+                _thread = true;
+            }
+            #elif defined(DRAKO_PLT_LINUX)
+            {
+                // registers are saved on the first switch
+                _sp = nullptr;
+                _stack = nullptr;
+                _stack_size = 0;
             }
             #else
             #error Platform currently not supported
             #endif
         }
 
+        explicit thread_context(fiber_routine routine, void* args = nullptr) noexcept
+            : thread_context(routine, default_stack_size, args)
+        {
+        }
+
         // @brief   Creates a fiber object.
         //
-        explicit thread_context(fiber_routine start_routine, size_t stack_size) noexcept
+        explicit thread_context(fiber_routine start_routine, size_t stack_size, void* args = nullptr) noexcept
         {
             #if defined(DRAKO_PLT_WIN32)
             {
-                _address = ::CreateFiber(stack_size, start_routine, nullptr);
+                _address = ::CreateFiber(stack_size, start_routine, args);
                 if (_address == nullptr)
                 {
                     std::exit(EXIT_FAILURE);
                 }
+                _args = args;
+                _thread = false;
+            }
+            #elif defined(DRAKO_PLT_LINUX)
+            {
+                _create(start_routine, stack_size, args);
             }
             #else
             #error Platform currently not supported
@@ -54,9 +89,15 @@ namespace drako
         {
             #if defined(DRAKO_PLT_WIN32)
 
-            if (_address != nullptr)
+            if (_thread)
+                ::ConvertFiberToThread();
+            else if (_address != nullptr)
                 ::DeleteFiber(_address);
 
+            #elif defined(DRAKO_PLT_LINUX)
+
+            _destroy();
+
             #else
             #error Platform currently not supported
             #endif
@@ -68,12 +109,18 @@ namespace drako
         thread_context(thread_context&&) noexcept;
         thread_context& operator=(thread_context&&) noexcept;
 
+        // @brief   Suspends this context, which must be the running one, and resumes another.
+        //
         void switch_context(const thread_context& other) noexcept
         {
             #if defined(DRAKO_PLT_WIN32)
 
             ::SwitchToFiber(other._address);
 
+            #elif defined(DRAKO_PLT_LINUX)
+
+            _switch(other);
+
             #else
             #error Platform currently not supported
             #endif
@@ -81,10 +128,24 @@ namespace drako
 
     private:
 
+        #if defined(DRAKO_PLT_WIN32)
+
         void* _address;
         void* _args;
+        bool  _thread; // converted from a thread
+
+        #elif defined(DRAKO_PLT_LINUX)
+
+        void*       _sp;         // saved stack pointer while suspended
+        void*       _stack;      // base of the mapped stack, including the guard page
+        std::size_t _stack_size; // size of the mapped stack
+
+        void _create(fiber_routine routine, std::size_t stack_size, void* args) noexcept;
+        void _destroy() noexcept;
+        void _switch(const thread_context& other) noexcept;
+
+        #endif
     };
 }
 
 #endif // !DRAKO_FIBER_HPP
-
@@ -31,8 +31,8 @@
 #endif
 
 
-#if defined(_drako_compiler_msvc)
-#define _drako_flexible_array_member // MSVC extension uses syntax 'int array[]'
+#if defined(_drako_compiler_msvc) || defined(_drako_compiler_gcc)
+#define _drako_flexible_array_member // MSVC, GCC and Clang extension uses syntax 'int array[]'
 #else
 #error Compiler extension 'flexible array member' is not available.
 #endif
@@ -44,9 +44,12 @@
 #if defined(DRAKO_CC_MSVC)
 #define DRAKO_API_CDECL __cdecl
 
-#elif defined(DRAKO_CC_GCC)
+#elif defined(DRAKO_CC_GCC) && defined(__i386__)
 #define DRAKO_API_CDECL __attribute__((cdecl))
 
+#elif defined(DRAKO_CC_GCC) // x64 targets have a single calling convention
+#define DRAKO_API_CDECL
+
 #else
 #pragma message("Calling convention CDECL not supported with current compiler.")
 #define DRAKO_API_CDECL
@@ -57,9 +60,12 @@
 #if defined(DRAKO_CC_MSVC)
 #define DRAKO_API_STDCALL __stdcall
 
-#elif defined(DRAKO_CC_GCC)
+#elif defined(DRAKO_CC_GCC) && defined(__i386__)
 #define DRAKO_API_STDCALL __attribute__((stdcall))
 
+#elif defined(DRAKO_CC_GCC) // x64 targets have a single calling convention
+#define DRAKO_API_STDCALL
+
 #else
 #pragma message("Calling convention STDCALL not supported with current compiler.")
 #define DRAKO_API_STDCALL
@@ -154,6 +160,20 @@
 #endif
 
 
+// MACRO: function attribute.
+// Prevents the compiler from inlining the function.
+#if defined(DRAKO_CC_MSVC)
+#define DRAKO_NOINLINE __declspec(noinline)
+
+#elif defined(DRAKO_CC_GCC)
+#define DRAKO_NOINLINE __attribute__((noinline))
+
+#else
+#pragma message("Attribute DRAKO_NOINLINE not supported with current compiler.")
+#define DRAKO_NOINLINE
+#endif
+
+
 // MACRO: function attribute.
 // Declares that the function does not interfere with the global memory state
 // except through the pointers in its parameter list.
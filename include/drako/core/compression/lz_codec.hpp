@@ -0,0 +1,284 @@
+#pragma once
+#ifndef DRAKO_LZ_CODEC_HPP
+#define DRAKO_LZ_CODEC_HPP
+
+/// @file
+/// @brief  Byte-oriented LZ77 codec for packaged data.
+/// @author Grassi Edoardo
+///
+/// Data is split in blocks of 64 KiB, compressed independently, so that
+/// decoding needs no state from other blocks and never reads past its input.
+/// Each block starts with a 32 bits little endian header: the low 31 bits
+/// are the size of the payload, the high bit marks a block stored verbatim
+/// because it didn't shrink.
+///
+/// The payload of a compressed block is a sequence of tokens, in the same
+/// spirit as LZ4: the high nibble of a token is the number of literals that
+/// follow, the low nibble the length of the match minus 4, and both extend
+/// with bytes of 255 when saturated. A match is encoded as the 16 bits little
+/// endian distance from the current position. The last sequence of a block
+/// only has literals. Decoding favours speed over ratio, as the data is
+/// decompressed at load time.
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+
+namespace drako::lz
+{
+    /// @brief Size of the uncompressed blocks, except the last one.
+    constexpr const std::size_t block_size = 64 * 1024;
+
+    /// @brief Upper bound of the compressed size of some data.
+    [[nodiscard]] constexpr std::size_t max_compressed_size(std::size_t size) noexcept
+    {
+        // blocks that don't shrink are stored verbatim
+        return size + 4 * ((size + block_size - 1) / block_size);
+    }
+
+
+    namespace _detail
+    {
+        constexpr const std::size_t   _min_match   = 4;
+        constexpr const std::size_t   _header_size = 4;
+        constexpr const std::uint32_t _stored_bit  = std::uint32_t{ 1 } << 31;
+        constexpr const int           _hash_bits   = 14;
+
+        [[nodiscard]] inline std::uint32_t _load_u32(const std::byte* p) noexcept
+        {
+            return static_cast<std::uint32_t>(p[0]) | static_cast<std::uint32_t>(p[1]) << 8 |
+                   static_cast<std::uint32_t>(p[2]) << 16 | static_cast<std::uint32_t>(p[3]) << 24;
+        }
+
+        inline void _store_u32(std::byte* p, std::uint32_t v) noexcept
+        {
+            for (auto i = 0; i < 4; ++i)
+                p[i] = static_cast<std::byte>(v >> (8 * i));
+        }
+
+        [[nodiscard]] inline std::uint32_t _hash(const std::byte* p) noexcept
+        {
+            // Knuth's multiplicative hash of the next 4 bytes
+            return (_load_u32(p) * 2654435761u) >> (32 - _hash_bits);
+        }
+
+        // writes the extension bytes of a length that saturated its nibble
+        [[nodiscard]] inline std::byte* _put_length(std::byte* out, std::size_t length) noexcept
+        {
+            for (; length >= 255; length -= 255)
+                *out++ = std::byte{ 255 };
+            *out++ = static_cast<std::byte>(length);
+            return out;
+        }
+
+        [[nodiscard]] inline std::byte* _put_sequence(std::byte* out,
+            const std::byte* literals, std::size_t literal_count, std::size_t offset, std::size_t match) noexcept
+        {
+            auto& token = *out++;
+            token       = static_cast<std::byte>(std::min<std::size_t>(literal_count, 15) << 4);
+            if (literal_count >= 15)
+                out = _put_length(out, literal_count - 15);
+            std::memcpy(out, literals, literal_count);
+            out += literal_count;
+
+            if (match == 0) // last sequence
+                return out;
+
+            *out++ = static_cast<std::byte>(offset);
+            *out++ = static_cast<std::byte>(offset >> 8);
+            token |= static_cast<std::byte>(std::min<std::size_t>(match - _min_match, 15));
+            if (match - _min_match >= 15)
+                out = _put_length(out, match - _min_match - 15);
+            return out;
+        }
+
+        // compresses a single block, returns 0 if the payload wouldn't shrink
+        [[nodiscard]] inline std::size_t _compress_block(
+            std::span<const std::byte> src, std::byte* dst, std::array<std::uint32_t, 1 << _hash_bits>& table) noexcept
+        {
+            const auto* const begin    = src.data();
+            const auto* const end      = begin + std::size(src);
+            const auto        capacity = std::size(src) - 1; // the payload must shrink
+            auto*             out      = dst;
+
+            table.fill(0);
+            const auto* anchor = begin;
+            if (std::size(src) >= _min_match)
+            {
+                // matches stop before the last bytes, so that the decoder can copy them as literals
+                const auto* const match_end = end - std::min<std::size_t>(std::size(src), 5);
+                for (const auto* p = begin; p + _min_match <= match_end;)
+                {
+                    const auto  h         = _hash(p);
+                    const auto* candidate = begin + table[h];
+                    table[h]              = static_cast<std::uint32_t>(p - begin);
+
+                    if (candidate >= p || _load_u32(candidate) != _load_u32(p))
+                    {
+                        ++p;
+                        continue;
+                    }
+
+                    auto match = _min_match;
+                    while (p + match < match_end && candidate[match] == p[match])
+                        ++match;
+
+                    // worst case size of the sequence, including the literals still to encode
+                    const auto literal_count = static_cast<std::size_t>(p - anchor);
+                    if (static_cast<std::size_t>(out - dst) + 1 + literal_count / 255 + 1 + literal_count + 2 + match / 255 + 1 > capacity)
+                        return 0;
+
+                    out    = _put_sequence(out, anchor, literal_count, static_cast<std::size_t>(p - candidate), match);
+                    p     += match;
+                    anchor = p;
+                }
+            }
+
+            const auto literal_count = static_cast<std::size_t>(end - anchor);
+            if (static_cast<std::size_t>(out - dst) + 1 + literal_count / 255 + 1 + literal_count > capacity)
+                return 0;
+            out = _put_sequence(out, anchor, literal_count, 0, 0);
+            return static_cast<std::size_t>(out - dst);
+        }
+
+        // reads the extension bytes of a length that saturated its nibble
+        [[nodiscard]] inline bool _get_length(const std::byte*& in, const std::byte* end, std::size_t& length) noexcept
+        {
+            for (;;)
+            {
+                if (in == end)
+                    return false;
+                const auto b = static_cast<std::size_t>(*in++);
+                length += b;
+                if (b != 255)
+                    return true;
+            }
+        }
+
+        [[nodiscard]] inline bool _decompress_block(std::span<const std::byte> src, std::span<std::byte> dst) noexcept
+        {
+            const auto* in     = src.data();
+            const auto* in_end = in + std::size(src);
+            auto*       out    = dst.data();
+            auto* const begin  = dst.data();
+            auto* const end    = begin + std::size(dst);
+
+            while (in != in_end)
+            {
+                const auto token = static_cast<std::size_t>(*in++);
+
+                auto literal_count = token >> 4;
+                if (literal_count == 15 && !_get_length(in, in_end, literal_count))
+                    return false;
+                if (literal_count > static_cast<std::size_t>(in_end - in) || literal_count > static_cast<std::size_t>(end - out))
+                    return false;
+                std::memcpy(out, in, literal_count);
+                in += literal_count;
+                out += literal_count;
+
+                if (in == in_end) // last sequence
+                    break;
+
+                if (in_end - in < 2)
+                    return false;
+                const auto offset = static_cast<std::size_t>(in[0]) | static_cast<std::size_t>(in[1]) << 8;
+                in += 2;
+
+                auto match = token & 15;
+                if (match == 15 && !_get_length(in, in_end, match))
+                    return false;
+                match += _min_match;
+
+                if (offset == 0 || offset > static_cast<std::size_t>(out - begin) || match > static_cast<std::size_t>(end - out))
+                    return false;
+
+                const auto* from = out - offset;
+                if (offset >= match)
+                    std::memcpy(out, from, match);
+                else
+                    for (std::size_t i = 0; i < match; ++i) // overlapping copy repeats the pattern
+                        out[i] = from[i];
+                out += match;
+            }
+            return out == end;
+        }
+    } // namespace _detail
+
+
+    /// @brief Compresses some data.
+    ///
+    /// @param[in]  src Data to compress.
+    /// @param[out] dst Destination buffer, of at least max_compressed_size() bytes.
+    ///
+    /// @return Size of the compressed data as bytes.
+    ///
+    [[nodiscard]] inline std::size_t compress(std::span<const std::byte> src, std::span<std::byte> dst) noexcept
+    {
+        using namespace _detail;
+
+        auto table = std::make_unique_for_overwrite<std::array<std::uint32_t, 1 << _hash_bits>>();
+
+        std::size_t written = 0;
+        for (std::size_t offset = 0; offset < std::size(src); offset += block_size)
+        {
+            const auto block = src.subspan(offset, std::min(block_size, std::size(src) - offset));
+            auto*      out   = dst.data() + written;
+
+            auto size = _compress_block(block, out + _header_size, *table);
+            if (size == 0)
+            {
+                std::memcpy(out + _header_size, block.data(), std::size(block));
+                size = std::size(block);
+                _store_u32(out, static_cast<std::uint32_t>(size) | _stored_bit);
+            }
+            else
+                _store_u32(out, static_cast<std::uint32_t>(size));
+            written += _header_size + size;
+        }
+        return written;
+    }
+
+    /// @brief Decompresses some data.
+    ///
+    /// @param[in]  src Compressed data.
+    /// @param[out] dst Destination buffer, exactly as large as the uncompressed data.
+    ///
+    /// @return Returns false if the data is corrupted or doesn't match the size of the destination.
+    ///
+    [[nodiscard]] inline bool decompress(std::span<const std::byte> src, std::span<std::byte> dst) noexcept
+    {
+        using namespace _detail;
+
+        std::size_t read = 0;
+        for (std::size_t offset = 0; offset < std::size(dst); offset += block_size)
+        {
+            if (std::size(src) - read < _header_size)
+                return false;
+            const auto header = _load_u32(src.data() + read);
+            const auto size   = static_cast<std::size_t>(header & ~_stored_bit);
+            read += _header_size;
+            if (std::size(src) - read < size)
+                return false;
+
+            const auto payload = src.subspan(read, size);
+            const auto block   = dst.subspan(offset, std::min(block_size, std::size(dst) - offset));
+            if (header & _stored_bit)
+            {
+                if (size != std::size(block))
+                    return false;
+                std::memcpy(block.data(), payload.data(), size);
+            }
+            else if (!_decompress_block(payload, block))
+                return false;
+            read += size;
+        }
+        return read == std::size(src);
+    }
+
+} // namespace drako::lz
+
+#endif // !DRAKO_LZ_CODEC_HPP
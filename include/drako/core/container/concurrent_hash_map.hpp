@@ -0,0 +1,394 @@
+#pragma once
+#ifndef DRAKO_CONCURRENT_HASH_MAP_HPP
+#define DRAKO_CONCURRENT_HASH_MAP_HPP
+
+/// @file
+/// @brief  Open addressing hash map with lock-free lookups.
+/// @author Grassi Edoardo
+///
+/// Slots are grouped in blocks of 16, each with a control byte per slot that
+/// holds 7 bits of the hash of its key, so a single SIMD comparison filters
+/// the candidates of a whole group. Groups are probed linearly.
+///
+/// Each group counts the keys that were placed past it by a full probe. Lookups
+/// stop at the first group with a zero count, so removed slots are simply freed:
+/// there are no tombstones and removals don't degrade lookups over time.
+///
+/// Readers take no locks: each slot has a sequence number, odd while a writer is
+/// updating it, which readers check before and after copying the slot. Writers
+/// serialize on a lock selected by the home group of the key.
+
+#include "drako/core/compiler.hpp"
+#include "drako/core/platform.hpp"
+#include "drako/core/typed_handle.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(_drako_arch_x64) && !defined(__SANITIZE_THREAD__)
+#include <emmintrin.h>
+#define _drako_hash_map_sse2
+#endif
+
+namespace drako
+{
+    /// @brief Default hash function of the concurrent containers.
+    ///
+    /// Typed ids hash their integer key, other types use std::hash when available
+    /// or their object representation otherwise (e.g. uuid::Uuid). The result is
+    /// always mixed, since ids are often sequential.
+    ///
+    template <typename K>
+    struct DefaultHash
+    {
+        [[nodiscard]] std::size_t operator()(const K& k) const noexcept
+        {
+            if constexpr (requires { { k.key() } -> std::unsigned_integral; })
+                return _mix(static_cast<std::uint64_t>(k.key()));
+            else if constexpr (std::is_default_constructible_v<std::hash<K>>)
+                return _mix(static_cast<std::uint64_t>(std::hash<K>{}(k)));
+            else
+            {
+                static_assert(std::has_unique_object_representations_v<K>, "Provide a hash function for the key type.");
+
+                // FNV-1a over the bytes of the object
+                std::uint64_t h = 0xcbf29ce484222325;
+                for (const auto b : std::bit_cast<std::array<std::byte, sizeof(K)>>(k))
+                    h = (h ^ static_cast<std::uint64_t>(b)) * 0x100000001b3;
+                return _mix(h);
+            }
+        }
+
+    private:
+        // finalizer of MurmurHash3
+        [[nodiscard]] static constexpr std::size_t _mix(std::uint64_t h) noexcept
+        {
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccd;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53;
+            h ^= h >> 33;
+            return static_cast<std::size_t>(h);
+        }
+    };
+
+
+    /// @brief Thread-safe hash map with lock-free lookups and bounded capacity.
+    ///
+    /// Optimized for read-mostly tables such as id to index mappings: lookups
+    /// never block and never write shared memory, insertions and removals of
+    /// keys with different home groups proceed in parallel.
+    ///
+    /// @tparam K    Type of the keys.
+    /// @tparam V    Type of the mapped values.
+    /// @tparam Hash Hash function of the keys.
+    /// @tparam Eq   Equality comparison of the keys.
+    ///
+    template <typename K, typename V, typename Hash = DefaultHash<K>, typename Eq = std::equal_to<K>> // clang-format off
+    requires std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>
+    class ConcurrentHashMap // clang-format on
+    {
+    public:
+        using key_type    = K;
+        using mapped_type = V;
+        using size_type   = std::size_t;
+
+        /// @brief Constructor.
+        ///
+        /// @param[in] capacity Max number of elements the map can hold.
+        ///
+        explicit ConcurrentHashMap(size_type capacity, const Hash& hash = Hash(), const Eq& eq = Eq())
+            : _mask{ std::bit_ceil(std::max<size_type>((capacity * 8 / 7 + _group_size - 1) / _group_size, 1)) - 1 }
+            , _groups{ std::make_unique<_group[]>(_mask + 1) }
+            , _max_size{ capacity }
+            , _hash{ hash }
+            , _eq{ eq }
+        {
+        }
+
+        ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+        ConcurrentHashMap& operator=(const ConcurrentHashMap&) = delete;
+
+        /// @brief Max number of elements the map can hold.
+        [[nodiscard]] size_type capacity() const noexcept { return _max_size; }
+
+        /// @brief Approximate number of elements.
+        [[nodiscard]] size_type size() const noexcept { return _size.load(std::memory_order::relaxed); }
+
+        /// @brief Checks whether the map is empty.
+        [[nodiscard]] bool empty() const noexcept { return size() == 0; }
+
+        /// @brief Finds the value mapped to a key.
+        ///
+        /// @return Returns a copy of the value, or nothing if the key is not in the map.
+        ///
+        [[nodiscard]] std::optional<V> find(const K& key) const noexcept
+        {
+            const auto h = _hash(key);
+            _entry     e;
+            if (_find(key, h, nullptr, &e))
+                return e.value;
+            return std::nullopt;
+        }
+
+        /// @brief Checks whether a key is in the map.
+        [[nodiscard]] bool contains(const K& key) const noexcept
+        {
+            return find(key).has_value();
+        }
+
+        /// @brief Inserts a key if not already present.
+        ///
+        /// @return Returns true if the key was inserted, false if it was already present.
+        ///
+        /// @throw std::length_error if the map is full.
+        ///
+        bool insert(const K& key, const V& value)
+        {
+            const auto             h = _hash(key);
+            const std::scoped_lock guard{ _stripe(h) };
+
+            if (_find(key, h, nullptr, nullptr))
+                return false;
+
+            _insert(key, value, h);
+            return true;
+        }
+
+        /// @brief Inserts a key or replaces the value mapped to it.
+        ///
+        /// @return Returns true if the key was inserted, false if the value was replaced.
+        ///
+        /// @throw std::length_error if the map is full.
+        ///
+        bool insert_or_assign(const K& key, const V& value)
+        {
+            const auto             h = _hash(key);
+            const std::scoped_lock guard{ _stripe(h) };
+
+            if (_slot_ref found; _find(key, h, &found, nullptr))
+            {
+                _write(*found.group, found.index, { key, value });
+                return false;
+            }
+
+            _insert(key, value, h);
+            return true;
+        }
+
+        /// @brief Removes a key.
+        ///
+        /// @return Returns true if the key was removed, false if it wasn't in the map.
+        ///
+        bool erase(const K& key) noexcept
+        {
+            const auto             h = _hash(key);
+            const std::scoped_lock guard{ _stripe(h) };
+
+            _slot_ref found;
+            if (!_find(key, h, &found, nullptr))
+                return false;
+
+            // readers that already matched the slot may still return the old value
+            found.group->control[found.index].store(_empty, std::memory_order::release);
+            _release_path(h, found.group);
+            _size.fetch_sub(1, std::memory_order::relaxed);
+            return true;
+        }
+
+    private:
+        static constexpr const size_type    _group_size = 16;
+        static constexpr const std::uint8_t _empty      = 0x80;
+        static constexpr const std::uint8_t _busy       = 0xfe; // claimed by a writer
+        static constexpr const size_type    _stripes    = 64;
+
+        struct _entry
+        {
+            K key;
+            V value;
+        };
+
+        // the entry is stored as relaxed atomic words, so that readers can copy it while it's updated
+        static constexpr const size_type _words = (sizeof(_entry) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+        struct alignas(drako::cache_line_size) _group
+        {
+            _group() noexcept
+            {
+                for (auto& c : control)
+                    c.store(_empty, std::memory_order::relaxed);
+            }
+
+            alignas(_group_size) std::array<std::atomic<std::uint8_t>, _group_size> control;
+            std::atomic<std::uint32_t>                                          overflow{ 0 }; // keys probed past this group
+            std::array<std::atomic<std::uint32_t>, _group_size>                  sequence{};
+            std::array<std::array<std::atomic<std::uint64_t>, _words>, _group_size> slots{};
+        };
+
+        static_assert(sizeof(std::atomic<std::uint8_t>) == 1);
+
+        struct _slot_ref
+        {
+            _group*   group;
+            size_type index;
+        };
+
+        const size_type                 _mask; // number of groups - 1
+        const std::unique_ptr<_group[]> _groups;
+        const size_type                 _max_size;
+        [[no_unique_address]] Hash      _hash;
+        [[no_unique_address]] Eq        _eq;
+
+        alignas(drako::cache_line_size)
+            std::atomic<size_type> _size = 0;
+        std::array<std::mutex, _stripes> _locks;
+
+        [[nodiscard]] static std::uint8_t _tag(size_type h) noexcept
+        {
+            return static_cast<std::uint8_t>(h >> (sizeof(size_type) * 8 - 7)); // top 7 bits
+        }
+
+        [[nodiscard]] size_type _home(size_type h) const noexcept { return h & _mask; }
+
+        [[nodiscard]] std::mutex& _stripe(size_type h) noexcept { return _locks[_home(h) % _stripes]; }
+
+        // bit i is set if the control byte of slot i equals the value
+        [[nodiscard]] static std::uint32_t _match(const _group& g, std::uint8_t value) noexcept
+        {
+#if defined(_drako_hash_map_sse2)
+            const auto control = ::_mm_load_si128(reinterpret_cast<const __m128i*>(std::data(g.control)));
+            const auto equal   = ::_mm_cmpeq_epi8(control, ::_mm_set1_epi8(static_cast<char>(value)));
+            return static_cast<std::uint32_t>(::_mm_movemask_epi8(equal));
+#else
+            std::uint32_t mask = 0;
+            for (size_type i = 0; i < _group_size; ++i)
+                if (g.control[i].load(std::memory_order::relaxed) == value)
+                    mask |= 1u << i;
+            return mask;
+#endif
+        }
+
+        // copies the entry of a slot, fails if a writer is updating it
+        [[nodiscard]] static bool _read(const _group& g, size_type i, _entry& e) noexcept
+        {
+            const auto before = g.sequence[i].load(std::memory_order::acquire);
+            if (before & 1)
+                return false;
+
+            std::array<std::uint64_t, _words> buffer;
+            for (size_type w = 0; w < _words; ++w)
+                buffer[w] = g.slots[i][w].load(std::memory_order::relaxed);
+
+            std::atomic_thread_fence(std::memory_order::acquire);
+            if (g.sequence[i].load(std::memory_order::relaxed) != before)
+                return false;
+
+            std::memcpy(static_cast<void*>(&e), std::data(buffer), sizeof(_entry));
+            return true;
+        }
+
+        // stores the entry of a slot, the caller owns the slot
+        static void _write(_group& g, size_type i, const _entry& e) noexcept
+        {
+            std::array<std::uint64_t, _words> buffer{};
+            std::memcpy(std::data(buffer), &e, sizeof(_entry));
+
+            const auto sequence = g.sequence[i].load(std::memory_order::relaxed);
+            g.sequence[i].store(sequence + 1, std::memory_order::relaxed);
+            std::atomic_thread_fence(std::memory_order::release);
+
+            for (size_type w = 0; w < _words; ++w)
+                g.slots[i][w].store(buffer[w], std::memory_order::relaxed);
+
+            g.sequence[i].store(sequence + 2, std::memory_order::release);
+        }
+
+        // looks for a key, the slot and the entry are optionally returned
+        bool _find(const K& key, size_type h, _slot_ref* slot, _entry* entry) const noexcept
+        {
+            const auto tag = _tag(h);
+            for (size_type n = 0, g = _home(h); n <= _mask; ++n, g = (g + 1) & _mask)
+            {
+                auto& group = _groups[g];
+                for (auto m = _match(group, tag); m != 0; m &= m - 1)
+                {
+                    const auto i = static_cast<size_type>(std::countr_zero(m));
+
+                    _entry e;
+                    while (!_read(group, i, e)) // a writer is updating the slot, wait
+                        std::atomic_signal_fence(std::memory_order::seq_cst);
+
+                    if (group.control[i].load(std::memory_order::acquire) == tag && _eq(e.key, key))
+                    {
+                        if (slot)
+                            *slot = { &group, i };
+                        if (entry)
+                            *entry = e;
+                        return true;
+                    }
+                }
+
+                if (group.overflow.load(std::memory_order::acquire) == 0)
+                    return false; // no key with an earlier home group was placed further
+            }
+            return false;
+        }
+
+        // places a key known to be absent, the caller holds the stripe of the key
+        void _insert(const K& key, const V& value, size_type h)
+        {
+            if (_size.fetch_add(1, std::memory_order::relaxed) >= _max_size)
+            {
+                _size.fetch_sub(1, std::memory_order::relaxed);
+                throw std::length_error{ "ConcurrentHashMap capacity exceeded." };
+            }
+
+            // the load factor is at most 7/8, so a free slot is always found
+            for (size_type g = _home(h);; g = (g + 1) & _mask)
+            {
+                auto& group = _groups[g];
+                for (auto m = _match(group, _empty); m != 0; m &= m - 1)
+                {
+                    const auto i = static_cast<size_type>(std::countr_zero(m));
+
+                    // slots are shared with the writers of the other stripes
+                    auto expected = _empty;
+                    if (!group.control[i].compare_exchange_strong(expected, _busy, std::memory_order::acquire, std::memory_order::relaxed))
+                        continue;
+
+                    _write(group, i, { key, value });
+
+                    // make the slot reachable before it can be matched
+                    for (auto p = _home(h); p != g; p = (p + 1) & _mask)
+                        _groups[p].overflow.fetch_add(1, std::memory_order::release);
+
+                    group.control[i].store(_tag(h), std::memory_order::release);
+                    return;
+                }
+            }
+        }
+
+        // undoes the overflow counts of a removed key
+        void _release_path(size_type h, const _group* placed) noexcept
+        {
+            for (auto p = _home(h); &_groups[p] != placed; p = (p + 1) & _mask)
+                _groups[p].overflow.fetch_sub(1, std::memory_order::release);
+        }
+    };
+
+} // namespace drako
+
+#endif // !DRAKO_CONCURRENT_HASH_MAP_HPP
@@ -8,6 +8,7 @@
 
 #include "drako/core/platform.hpp"
 
+#include <algorithm>
 #include <charconv>
 #include <cstdint>
 #include <stdexcept>
@@ -9,6 +9,8 @@
 
 #include "drako/core/compiler.hpp"
 
+#include <cstddef>
+
 #if defined(DRAKO_CC_MSVC)
 
 /// @brief Defined when Windows is the target platform.
@@ -34,6 +36,17 @@
 #endif // DRKAPI_CC_MSC
 
 
+#if defined(DRAKO_CC_GCC) && defined(__linux__)
+
+/// @brief Defined when Linux is the target platform.
+#define _drako_platform_Linux __linux__
+
+/// @brief [[deprecated]] Use '_drako_platform_Linux' instead.
+#define DRAKO_PLT_LINUX _drako_platform_Linux
+
+#endif
+
+
 #if defined(DRAKO_CC_MSVC) && defined(_M_X86)
 #define DRAKO_ARCH_X86
 #endif
@@ -49,6 +62,17 @@
 #endif
 
 
+#if defined(DRAKO_CC_GCC) && defined(__x86_64__)
+
+/// @brief Defined when Intel x64 is the target architecture.
+#define _drako_arch_x64
+
+/// @brief [[deprecated]] Use _drako_arch_x64 instead.
+#define DRAKO_ARCH_X64
+
+#endif
+
+
 #if defined(_drako_arch_x86) || defined(_drako_arch_x64)
 
 /// @brief Defined when Intel is the target architecture.
@@ -60,4 +84,16 @@
 #endif
 
 
+namespace drako
+{
+    /// @brief Size in bytes of a cache line of the target architecture.
+    ///
+    /// Separates data written by different threads. Unlike std::hardware_destructive_interference_size
+    /// it doesn't change with the tuning flags, so it's safe to use in the layout of shared types.
+    ///
+    inline constexpr std::size_t cache_line_size = 64;
+
+} // namespace drako
+
+
 #endif // !DRAKO_PLATFORM_HPP
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include "drako/core/container/concurrent_hash_map.hpp"
+#include "drako/core/typed_handle.hpp"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace drako;
+
+namespace
+{
+    DRAKO_DEFINE_TYPED_ID(EntityID, std::uint32_t);
+
+    // same layout of a 128 bits uuid, without std::hash support
+    struct _uuid
+    {
+        std::array<std::uint8_t, 16> bytes;
+
+        friend bool operator==(const _uuid&, const _uuid&) noexcept = default;
+    };
+} // namespace
+
+GTEST_TEST(ConcurrentHashMap, MapsKeysToValues)
+{
+    ConcurrentHashMap<std::uint64_t, int> m{ 100 };
+    EXPECT_TRUE(m.empty());
+    EXPECT_FALSE(m.find(1).has_value());
+
+    EXPECT_TRUE(m.insert(1, 10));
+    EXPECT_TRUE(m.insert(2, 20));
+    EXPECT_FALSE(m.insert(1, 11)); // already present
+    EXPECT_EQ(m.find(1), 10);
+    EXPECT_EQ(m.find(2), 20);
+    EXPECT_EQ(m.size(), 2);
+
+    EXPECT_FALSE(m.insert_or_assign(1, 12));
+    EXPECT_EQ(m.find(1), 12);
+
+    EXPECT_TRUE(m.erase(1));
+    EXPECT_FALSE(m.erase(1));
+    EXPECT_FALSE(m.contains(1));
+    EXPECT_TRUE(m.contains(2));
+    EXPECT_EQ(m.size(), 1);
+}
+
+GTEST_TEST(ConcurrentHashMap, SupportsTypedIdsAndUuids)
+{
+    ConcurrentHashMap<EntityID, std::uint32_t> ids{ 16 };
+    EXPECT_TRUE(ids.insert(EntityID{ 7 }, 3));
+    EXPECT_EQ(ids.find(EntityID{ 7 }), 3u);
+    EXPECT_FALSE(ids.contains(EntityID{ 8 }));
+
+    ConcurrentHashMap<_uuid, std::uint32_t> uuids{ 16 };
+    const _uuid                             a{ { 1, 2, 3 } }, b{ { 3, 2, 1 } };
+    EXPECT_TRUE(uuids.insert(a, 1));
+    EXPECT_TRUE(uuids.insert(b, 2));
+    EXPECT_EQ(uuids.find(a), 1u);
+    EXPECT_EQ(uuids.find(b), 2u);
+}
+
+GTEST_TEST(ConcurrentHashMap, ReusesErasedSlots)
+{
+    // no tombstones: the map can be filled again after removals, without growing
+    ConcurrentHashMap<std::uint32_t, std::uint32_t> m{ 1000 };
+    for (std::uint32_t round = 0; round < 20; ++round)
+    {
+        for (std::uint32_t i = 0; i < 1000; ++i)
+            ASSERT_TRUE(m.insert(round * 1000 + i, i));
+        EXPECT_THROW(m.insert(~0u, 0), std::length_error);
+
+        for (std::uint32_t i = 0; i < 1000; ++i)
+            ASSERT_EQ(m.find(round * 1000 + i), i);
+        for (std::uint32_t i = 0; i < 1000; ++i)
+            ASSERT_TRUE(m.erase(round * 1000 + i));
+        EXPECT_TRUE(m.empty());
+    }
+}
+
+GTEST_TEST(ConcurrentHashMap, SupportsConcurrentReadersAndWriters)
+{
+    constexpr const std::uint32_t writers = 4;
+    constexpr const std::uint32_t keys    = 4096; // per writer
+    constexpr const std::uint32_t rounds  = 4;
+
+    ConcurrentHashMap<std::uint32_t, std::uint64_t> m{ writers * keys };
+
+    // stable keys are always present, readers must never miss them
+    for (std::uint32_t k = 0; k < keys; ++k)
+        ASSERT_TRUE(m.insert(1'000'000 + k, std::uint64_t{ k } * 3));
+
+    std::atomic<bool>          done   = false;
+    std::atomic<std::uint64_t> misses = 0, torn = 0;
+
+    std::vector<std::thread> threads;
+    for (std::uint32_t r = 0; r < 2; ++r)
+        threads.emplace_back([&]() {
+            while (!done.load(std::memory_order::relaxed))
+                for (std::uint32_t k = 0; k < keys; k += 7)
+                {
+                    const auto v = m.find(1'000'000 + k);
+                    if (!v)
+                        misses.fetch_add(1);
+                    else if (*v != std::uint64_t{ k } * 3)
+                        torn.fetch_add(1);
+                }
+        });
+
+    std::vector<std::thread> updates;
+    for (std::uint32_t w = 0; w < writers; ++w)
+        updates.emplace_back([&, w]() {
+            for (std::uint32_t round = 0; round < rounds; ++round)
+            {
+                for (std::uint32_t k = w; k < writers * keys / 2; k += writers)
+                    EXPECT_TRUE(m.insert(k, k));
+                for (std::uint32_t k = w; k < writers * keys / 2; k += writers)
+                    EXPECT_EQ(m.find(k), k);
+                for (std::uint32_t k = w; k < writers * keys / 2; k += writers)
+                    EXPECT_TRUE(m.erase(k));
+            }
+            // values are rewritten while readers copy them
+            for (std::uint32_t k = w; k < keys; k += writers)
+                EXPECT_FALSE(m.insert_or_assign(1'000'000 + k, std::uint64_t{ k } * 3));
+        });
+    for (auto& u : updates)
+        u.join();
+
+    done.store(true);
+    for (auto& t : threads)
+        t.join();
+
+    EXPECT_EQ(misses.load(), 0);
+    EXPECT_EQ(torn.load(), 0);
+    EXPECT_EQ(m.size(), keys);
+}
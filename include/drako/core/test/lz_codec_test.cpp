@@ -0,0 +1,87 @@
+#include "drako/core/compression/lz_codec.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <random>
+#include <vector>
+
+using namespace drako;
+
+namespace
+{
+    // compresses and decompresses some data, returns the compressed size
+    std::size_t _round_trip(const std::vector<std::byte>& data)
+    {
+        std::vector<std::byte> packed(lz::max_compressed_size(std::size(data)));
+        const auto             size = lz::compress(data, packed);
+        EXPECT_LE(size, std::size(packed));
+        packed.resize(size);
+
+        std::vector<std::byte> unpacked(std::size(data));
+        EXPECT_TRUE(lz::decompress(packed, unpacked));
+        EXPECT_EQ(unpacked, data);
+        return size;
+    }
+
+    // text-like data with many repetitions
+    std::vector<std::byte> _redundant(std::size_t size)
+    {
+        std::minstd_rand       rng{ 7 };
+        std::vector<std::byte> data;
+        data.reserve(size);
+        while (std::size(data) < size)
+        {
+            const auto word = std::uniform_int_distribution<int>{ 0, 63 }(rng);
+            for (auto i = 0; i < 3 + word % 9 && std::size(data) < size; ++i)
+                data.push_back(static_cast<std::byte>('a' + (word * 7 + i) % 26));
+        }
+        return data;
+    }
+} // namespace
+
+GTEST_TEST(LzCodec, CompressesRedundantData)
+{
+    const auto data = _redundant(3 * lz::block_size + 1234);
+    EXPECT_LT(_round_trip(data), std::size(data) / 2);
+}
+
+GTEST_TEST(LzCodec, StoresIncompressibleData)
+{
+    std::minstd_rand       rng{ 42 };
+    std::vector<std::byte> data(lz::block_size + 100);
+    for (auto& b : data)
+        b = static_cast<std::byte>(rng());
+    EXPECT_EQ(_round_trip(data), lz::max_compressed_size(std::size(data)));
+}
+
+GTEST_TEST(LzCodec, HandlesEdgeSizes)
+{
+    for (const std::size_t size : { 0, 1, 4, 5, 16, 255, 256, 300, 65535, 65536, 65537 })
+    {
+        // long runs need overlapping matches and extended lengths
+        std::vector<std::byte> run(size, std::byte{ 'x' });
+        _round_trip(run);
+        _round_trip(_redundant(size));
+    }
+}
+
+GTEST_TEST(LzCodec, RejectsCorruptedData)
+{
+    const auto             data = _redundant(10'000);
+    std::vector<std::byte> packed(lz::max_compressed_size(std::size(data)));
+    packed.resize(lz::compress(data, packed));
+
+    std::vector<std::byte> unpacked(std::size(data));
+    EXPECT_FALSE(lz::decompress(std::span{ packed }.first(std::size(packed) - 1), unpacked));
+    EXPECT_FALSE(lz::decompress(packed, std::span{ unpacked }.first(std::size(unpacked) - 1)));
+
+    // corrupted payloads must never write out of bounds
+    std::minstd_rand rng{ 1 };
+    for (auto i = 0; i < 1000; ++i)
+    {
+        auto copy = packed;
+        copy[4 + rng() % (std::size(copy) - 4)] = static_cast<std::byte>(rng());
+        static_cast<void>(lz::decompress(copy, unpacked));
+    }
+}
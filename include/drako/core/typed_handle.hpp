@@ -57,8 +57,11 @@ namespace drako
         constexpr BasicTypedID(const BasicTypedID&) noexcept = default;
         constexpr BasicTypedID& operator=(const BasicTypedID&) noexcept = default;
 
-        //[[nodiscard]] friend bool operator==(const _this, const _this) noexcept = default;
-        //[[nodiscard]] friend bool operator!=(const _this, const _this) noexcept = default;
+        [[nodiscard]] friend constexpr bool operator==(const BasicTypedID&, const BasicTypedID&) noexcept = default;
+
+        /// @brief Underlying integer value, for hashing and serialization.
+        [[nodiscard]] constexpr Int key() const noexcept { return _key; }
+
         //[[nodiscard]] friend bool operator<(const _this, const _this) noexcept  = default;
         //[[nodiscard]] friend bool operator>(const _this, const _this) noexcept  = default;
         //[[nodiscard]] friend bool operator<=(const _this, const _this) noexcept = default;
@@ -6,6 +6,7 @@
 #include "drako/devel/asset_types.hpp"
 
 #include <cassert>
+#include <cstring>
 #include <memory>
 #include <span>
 
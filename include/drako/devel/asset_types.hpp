@@ -41,7 +41,8 @@ namespace drako
 
     enum class AssetStorageFlags : std::uint8_t
     {
-        uncompressed
+        uncompressed,
+        lz_blocks // compressed with the block codec of drako::lz
     };
 
     enum class AssetFormatFlags : std::uint8_t
@@ -115,6 +116,16 @@ namespace drako
     static_assert(alignof(AssetLoadInfo) <= sizeof(AssetLoadInfo),
         "Bad class layout: required external padding bits.");
 
+    inline std::size_t AssetLoadInfo::package_offset_bytes() const noexcept { return _package_offset; }
+
+    inline std::size_t AssetLoadInfo::unpacked_size_bytes() const noexcept { return _unpacked_size_bytes; }
+
+    inline std::size_t AssetLoadInfo::packed_size_bytes() const noexcept { return _packed_size_bytes; }
+
+    inline AssetStorageFlags AssetLoadInfo::storage_flags() const noexcept { return _storage_flags; }
+
+    inline AssetFormatFlags AssetLoadInfo::format_flags() const noexcept { return _format_flags; }
+
 
 
     /// @brief Metadata descriptor of an asset bundle.
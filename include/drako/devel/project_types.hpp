@@ -3,6 +3,7 @@
 #define DRAKO_PROJECT_TYPES_HPP
 
 #include "drako/core/drako_api_defs.hpp"
+#include "drako/devel/asset_bundle_manifest.hpp"
 #include "drako/devel/asset_types.hpp"
 //#include "drako/file_formats/dson/dson.hpp"
 
@@ -214,6 +215,17 @@ namespace drako::editor
 
 
 
+    /// @brief Options of the bundle packer.
+    struct BundlePackArgs
+    {
+        /// @brief Stores the assets compressed with the block codec of drako::lz.
+        ///
+        /// Assets that don't shrink are always stored uncompressed.
+        ///
+        bool compress = false;
+    };
+
+
     /// @brief Project database object.
     class ProjectDatabase
     {
@@ -225,7 +237,11 @@ namespace drako::editor
         /// @param info  Asset import manifest.
         void insert_asset(const std::filesystem::path& asset, const AssetImportInfo& info);
 
-        void package_as_single_bundle(const std::filesystem::path& where);
+        /// @brief Writes the data of all the assets in a single bundle storage file.
+        /// @param where Path of the storage file.
+        /// @param args  Packer options.
+        /// @return Manifest that locates the assets inside the storage.
+        AssetBundleManifest package_as_single_bundle(const std::filesystem::path& where, const BundlePackArgs& args = {});
 
     private:
         /// @brief Database-like table of available assets.
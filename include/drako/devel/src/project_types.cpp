@@ -1,5 +1,6 @@
 #include "drako/devel/project_types.hpp"
 
+#include "drako/core/compression/lz_codec.hpp"
 #include "drako/devel/asset_bundle_manifest.hpp"
 #include "drako/devel/mesh_importers.hpp"
 #include "drako/devel/project_utils.hpp"
@@ -11,6 +12,10 @@
 #include <filesystem>
 #include <fstream>
 #include <iosfwd>
+#include <limits>
+#include <memory>
+#include <span>
+#include <stdexcept>
 
 namespace drako::editor
 {
@@ -187,7 +192,7 @@ namespace drako::editor
         _assets.paths.push_back(src);
     }
 
-    void ProjectDatabase::package_as_single_bundle(const _fs::path& where)
+    AssetBundleManifest ProjectDatabase::package_as_single_bundle(const _fs::path& where, const BundlePackArgs& args)
     {
         if (_fs::exists(where))
             throw std::invalid_argument{ "File already exists." };
@@ -195,18 +200,46 @@ namespace drako::editor
         std::ofstream package{ where, std::ios_base::binary };
         package.exceptions(std::ios_base::failbit | std::ios_base::badbit);
 
-        const auto max_size = std::max_element(
-            _assets.sizes.cbegin(), _assets.sizes.cend());
-        auto staging_buffer = std::make_unique<char[]>(*max_size);
+        const auto max_size = std::size(_assets.sizes) == 0 ? 0
+            : *std::max_element(_assets.sizes.cbegin(), _assets.sizes.cend());
+        auto staging_buffer = std::make_unique<std::byte[]>(max_size);
+        auto packed_buffer  = std::make_unique<std::byte[]>(args.compress ? lz::max_compressed_size(max_size) : 0);
 
-        for (auto i = 0; i < std::size(_assets.ids); ++i)
+        AssetBundleManifest manifest;
+        manifest.ids.reserve(std::size(_assets.ids));
+        manifest.infos.reserve(std::size(_assets.ids));
+
+        std::size_t offset = 0;
+        for (std::size_t i = 0; i < std::size(_assets.ids); ++i)
         {
             std::ifstream binary{ _assets.paths[i], std::ios_base::binary };
             binary.exceptions(std::ios_base::failbit | std::ios_base::badbit);
 
-            binary.read(staging_buffer.get(), _assets.sizes[i]);
-            package.write(staging_buffer.get(), _assets.sizes[i]);
+            const auto size = _assets.sizes[i];
+            binary.read(reinterpret_cast<char*>(staging_buffer.get()), size);
+
+            std::span<const std::byte> stored{ staging_buffer.get(), size };
+            auto                       flags = AssetStorageFlags::uncompressed;
+            if (args.compress)
+            {
+                const auto packed_size = lz::compress(stored, { packed_buffer.get(), lz::max_compressed_size(size) });
+                if (packed_size < size) // the runtime skips decompression of the assets that didn't shrink
+                {
+                    stored = { packed_buffer.get(), packed_size };
+                    flags  = AssetStorageFlags::lz_blocks;
+                }
+            }
+            if (offset + std::size(stored) > std::numeric_limits<std::uint32_t>::max())
+                throw std::length_error{ "Bundle exceeds the max size of a package." };
+            package.write(reinterpret_cast<const char*>(std::data(stored)), std::size(stored));
+
+            manifest.ids.push_back(_assets.ids[i]);
+            manifest.infos.emplace_back(static_cast<std::uint32_t>(offset),
+                static_cast<std::uint32_t>(std::size(stored)), static_cast<std::uint32_t>(size),
+                flags, AssetFormatFlags{});
+            offset += std::size(stored);
         }
+        return manifest;
     }
 
     /*const dson::DOM& operator>>(const dson::DOM& is, AssetImportInfo& ext)
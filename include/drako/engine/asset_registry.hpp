@@ -0,0 +1,154 @@
+#pragma once
+#ifndef DRAKO_ASSET_REGISTRY_HPP
+#define DRAKO_ASSET_REGISTRY_HPP
+
+/// @file
+/// @brief  Table of the assets known to the runtime.
+/// @author Grassi Edoardo
+///
+/// Each asset gets a stable slot when registered, and its state is stored
+/// as one column per field. A hash index maps the asset ids to their slots,
+/// so lookups take constant time however many assets are registered.
+///
+/// Handles pair a slot with its generation, which is bumped every time the
+/// asset is unloaded, so a handle taken before an unload can't reach the
+/// data of a later load.
+
+#include "drako/core/container/concurrent_hash_map.hpp"
+#include "drako/core/typed_handle.hpp"
+#include "drako/devel/asset_types.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace drako::engine
+{
+    /// @brief Handle of a loaded asset, which expires when the asset is unloaded.
+    DRAKO_DEFINE_TYPED_ID(AssetHandle, std::uint64_t);
+
+
+    /// @brief Loading state of a registered asset.
+    enum class AssetState : std::uint8_t
+    {
+        unloaded,
+        pending, // data is being read
+        loaded
+    };
+
+
+    class AssetRegistry
+    {
+    public:
+        using Slot = std::uint32_t;
+
+        /// @brief Value that never identifies a slot.
+        static constexpr const Slot invalid_slot = std::numeric_limits<Slot>::max();
+
+        /// @brief Constructor.
+        ///
+        /// @param[in] capacity Max number of assets that can be registered.
+        ///
+        explicit AssetRegistry(std::size_t capacity)
+            : _index{ capacity }
+        {
+            ids.reserve(capacity);
+            meta.reserve(capacity);
+            bundles.reserve(capacity);
+            refcount.reserve(capacity);
+            states.reserve(capacity);
+            generations.reserve(capacity);
+            data.reserve(capacity);
+            views.reserve(capacity);
+        }
+
+        AssetRegistry(const AssetRegistry&) = delete;
+        AssetRegistry& operator=(const AssetRegistry&) = delete;
+
+        /// @brief Registers an asset stored in a bundle.
+        ///
+        /// @return Slot assigned to the asset.
+        ///
+        /// @throw std::invalid_argument Thrown if the asset is already registered.
+        /// @throw std::length_error     Thrown if the registry is full.
+        ///
+        Slot insert(const AssetID& id, const AssetLoadInfo& info, std::uint32_t bundle)
+        {
+            const auto slot = static_cast<Slot>(std::size(ids));
+            if (!_index.insert(id, slot))
+                throw std::invalid_argument{ "Asset is already registered." };
+
+            ids.push_back(id);
+            meta.push_back(info);
+            bundles.push_back(bundle);
+            refcount.push_back(0);
+            states.push_back(AssetState::unloaded);
+            generations.push_back(1);
+            data.emplace_back();
+            views.emplace_back();
+            return slot;
+        }
+
+        /// @brief Number of registered assets.
+        [[nodiscard]] std::size_t size() const noexcept { return std::size(ids); }
+
+        /// @brief Slot of an asset, or invalid_slot if it isn't registered.
+        [[nodiscard]] Slot find(const AssetID& id) const noexcept
+        {
+            return _index.find(id).value_or(invalid_slot);
+        }
+
+        /// @brief Slot of a handle, or invalid_slot if the handle expired.
+        [[nodiscard]] Slot find(AssetHandle h) const noexcept
+        {
+            const auto slot = static_cast<Slot>(h.key());
+            if (slot >= size() || generations[slot] != static_cast<std::uint32_t>(h.key() >> 32))
+                return invalid_slot;
+            return slot;
+        }
+
+        /// @brief Handle of the current generation of a slot.
+        [[nodiscard]] AssetHandle handle(Slot slot) const noexcept
+        {
+            assert(slot < size());
+            return AssetHandle{ (std::uint64_t{ generations[slot] } << 32) | slot };
+        }
+
+        /// @brief Drops the data of a slot and expires its handles.
+        void reset(Slot slot) noexcept
+        {
+            assert(slot < size());
+            assert(refcount[slot] == 0);
+
+            states[slot] = AssetState::unloaded;
+            data[slot].reset();
+            views[slot] = {};
+
+            // generation 0 would let handle 0 be valid
+            if (++generations[slot] == 0)
+                generations[slot] = 1;
+        }
+
+        // vvv one column per field, indexed by slot vvv
+
+        std::vector<AssetID>                      ids;
+        std::vector<AssetLoadInfo>                meta;
+        std::vector<std::uint32_t>                bundles; // index of the bundle that stores each asset
+        std::vector<std::uint32_t>                refcount;
+        std::vector<AssetState>                   states;
+        std::vector<std::uint32_t>                generations;
+        std::vector<std::shared_ptr<std::byte[]>> data;  // buffer of the read, when the storage isn't mapped
+        std::vector<std::span<const std::byte>>   views; // data of the loaded assets
+
+    private:
+        ConcurrentHashMap<AssetID, Slot> _index;
+    };
+
+} // namespace drako::engine
+
+#endif // !DRAKO_ASSET_REGISTRY_HPP
@@ -7,21 +7,50 @@
 #    include "drako/core/memory/unsync_pool_allocator.hpp"
 #    include "drako/devel/asset_types.hpp"
 #    include "drako/devel/asset_utils.hpp"
+#    include "drako/engine/asset_registry.hpp"
 #    include "drako/graphics/mesh_types.hpp"
+#    include "drako/system/mapped_file.hpp"
 
 #    include <rio/input_file_handle.hpp>
 
+#    include <atomic>
 #    include <cassert>
+#    include <chrono>
 #    include <filesystem>
 #    include <functional>
+#    include <memory>
+#    include <span>
+#    include <utility>
 #    include <vector>
 
+namespace drako::jobs
+{
+    class Scheduler;
+}
+
 namespace drako::engine
 {
+    /// @brief Urgency of the assets of a load request.
+    enum class AssetLoadPriority : std::uint8_t
+    {
+        blocking, // the frame can't be presented without them
+        visible,  // needed by what the camera sees
+        prefetch  // could be needed soon, streamed with the spare bandwidth
+    };
+
+
+    /// @brief Identifier of a load request, which can be cancelled until it completes.
+    DRAKO_DEFINE_TYPED_ID(AssetRequestID, std::uint64_t);
+
+
     struct AssetLoadRequest
     {
         std::span<const AssetID> assets;
         std::function<void()>    callback;
+        AssetLoadPriority        priority = AssetLoadPriority::visible;
+
+        /// @brief Time by which the assets are needed, orders the reads of the same priority.
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
     };
 
 
@@ -45,12 +74,45 @@ namespace drako::engine
 
             /// @brief Directory where asset bundles manifests are located.
             std::filesystem::path bundle_meta_directory;
+
+            /// @brief Serves the assets straight from memory mappings of the bundle
+            ///        storage files, instead of copying each one in its own buffer.
+            bool map_bundle_storage = true;
+
+            /// @brief Largest read that merges the adjacent assets of a bundle, as bytes.
+            std::size_t max_read_size = 1 << 20;
+
+            /// @brief Scheduler whose workers decompress the compressed assets.
+            ///
+            /// Without a scheduler the assets are decompressed by update().
+            ///
+            jobs::Scheduler* scheduler = nullptr;
+
+            /// @brief Bytes that the reads submitted by each update can request.
+            ///
+            /// Blocking loads are never held back, but count towards the budget.
+            /// A read larger than the budget is submitted only if it's the first of the update.
+            ///
+            std::size_t frame_read_budget = 16 << 20;
+
+            /// @brief Max reads of prefetch requests in flight, so that the reader
+            ///        always has room for the assets that are needed now.
+            std::size_t max_prefetch_reads = 16;
+
+            /// @brief Reader that serves the reads of the storage files that aren't mapped.
+            ///
+            /// Without a reader the runtime creates the most efficient one of the platform.
+            /// The reader must outlive the runtime, which retrieves all its completions.
+            ///
+            AsyncReaderPoolInterface* reader = nullptr;
         };
 
         //using bundle_loaded_callback = void(*)();
 
         explicit AssetSystemRuntime(const BundlesArgs&, const ConfigArgs&);
 
+        ~AssetSystemRuntime() noexcept;
+
         AssetSystemRuntime(const AssetSystemRuntime&) = delete;
         AssetSystemRuntime& operator=(const AssetSystemRuntime&) = delete;
 
@@ -67,12 +129,57 @@ namespace drako::engine
         //void unload_bundle(const AssetBundleID id) noexcept;
 
         void load_asset(const AssetID) noexcept;
-        void load_asset(const AssetLoadRequest&) noexcept;
+
+        /// @brief Queues the load of a batch of assets.
+        ///
+        /// The callback is invoked by update() once every asset of the batch is in memory.
+        /// Reads are submitted by priority, and by deadline between requests of the same
+        /// priority. Prefetch reads are submitted only when no other read is waiting.
+        ///
+        /// @return Identifier of the request.
+        ///
+        AssetRequestID load_asset(const AssetLoadRequest&) noexcept;
+
+        /// @brief Cancels a load request that hasn't completed yet.
+        ///
+        /// Releases the assets of the request, whose callback is never invoked.
+        /// Reads that no request needs anymore are dropped, or cancelled if submitted.
+        ///
+        /// @return Returns false if the request already completed, then its assets
+        ///         are released by unload_asset().
+        ///
+        bool cancel_load(const AssetRequestID) noexcept;
 
         void unload_asset(const AssetID) noexcept;
         //void unload_asset(std::span<const AssetID>) noexcept;
 
+        /// @brief Data of a loaded asset.
+        ///
+        /// The view is valid until the asset is unloaded. With mapped bundle
+        /// storage it points inside the mapping, so no copy is ever made.
+        ///
+        /// @return Returns an empty view if the asset isn't loaded or its read failed.
+        ///
+        [[nodiscard]] std::span<const std::byte> asset_data(const AssetID) const noexcept;
+
+        /// @brief Data of a loaded asset.
+        ///
+        /// @return Returns an empty view if the handle expired.
+        ///
+        [[nodiscard]] std::span<const std::byte> asset_data(const AssetHandle) const noexcept;
+
+        /// @brief Handle of a loaded asset, which expires when the asset is unloaded.
+        ///
+        /// @return Returns an invalid handle if the asset isn't loaded.
+        ///
+        [[nodiscard]] AssetHandle asset_handle(const AssetID) const noexcept;
+
         /// @brief Executes pending asynchronous requests.
+        ///
+        /// Submits the reads of the new requests and completes the ones
+        /// that landed, without ever waiting for the I/O. Compressed assets
+        /// land once their decompression job completed.
+        ///
         void update();
 
 #    if !defined(DRAKO_RUNTIME_ONLY)
@@ -95,9 +202,10 @@ namespace drako::engine
     private:
         using _request_id = std::uint32_t;
 
-        const ConfigArgs _config;
+        // registers the assets of the bundle manifests
+        explicit AssetSystemRuntime(const BundlesArgs&, const ConfigArgs&, std::vector<AssetBundleManifest>&&);
 
-        //AsyncReaderPool _io_service;
+        const ConfigArgs _config;
 
         // TODO: vvv those needs to be threadsafe vvv
         std::vector<AssetBundleID> _bundle_load_list; // load requests
@@ -105,11 +213,13 @@ namespace drako::engine
         // TODO: ^^^ those needs to be threadsafe ^^^
 
         // TODO: vvv those needs to be threadsafe vvv
-        std::vector<AssetID>          _asset_load_list; // load requests
-        std::vector<AssetID>          _asset_dump_list; // unload requests
-        std::vector<AssetLoadRequest> _asset_load_requests;
+        std::vector<AssetID>                                     _asset_load_list; // load requests
+        std::vector<AssetID>                                     _asset_dump_list; // unload requests
+        std::vector<std::pair<AssetRequestID, AssetLoadRequest>> _asset_load_requests;
         // TODO: ^^^ those needs to be threadsafe ^^^
 
+        std::uint64_t _last_request = 0;
+
         struct _pending_bundle_request
         {
             _request_id          request;
@@ -121,26 +231,53 @@ namespace drako::engine
         //std::vector<AssetBundleID>            _load_in_flight; // loading operation in flight
         //std::vector<_pending_bundle_request*> _load_requests;  // associated request
 
-        struct _pending_asset_request
+        struct _batch_request_handle
         {
-            _request_id          id;
-            AssetID              asset;
-            std::span<std::byte> data;
-            std::uint32_t        refcount;
+            AssetRequestID                   id;
+            std::function<void()>            callback;
+            std::uint32_t                    counter; // assets that haven't landed yet
+            std::vector<AssetRegistry::Slot> assets;  // references taken by the request
         };
+        std::vector<_batch_request_handle> _batches;
+        std::vector<std::uint32_t>         _free_batches;
 
-        struct _pending_assets_table
+        // single read of adjacent assets of a bundle
+        struct _pending_read
         {
-            std::vector<AssetID>                ids;
-            std::vector<_pending_asset_request> requests;
-        } _pending_assets;
+            AsyncReaderPoolInterface::Request     request; // must stay alive until completed
+            AsyncReaderPoolInterface::RequestID   id;      // invalid until submitted
+            std::shared_ptr<std::byte[]>          buffer;
+            std::vector<AssetRegistry::Slot>      assets; // assets covered by the read, by offset
+            AssetLoadPriority                     priority;
+            std::chrono::steady_clock::time_point deadline;
+        };
+        std::vector<std::unique_ptr<_pending_read>> _reads; // stable addresses for the reader
+        std::vector<std::uint32_t>                  _free_reads;
+        std::vector<std::uint32_t>                  _unsubmitted_reads; // waiting for room in the reader or bandwidth
+        std::size_t                                 _reads_in_flight          = 0;
+        std::size_t                                 _prefetch_reads_in_flight = 0;
+
+        // asset to read, with the most urgent request that needs it
+        struct _read_target
+        {
+            AssetRegistry::Slot                   asset;
+            AssetLoadPriority                     priority;
+            std::chrono::steady_clock::time_point deadline;
+        };
 
-        struct _batch_request_handle
+        // decompression of a compressed asset, executed by a job
+        struct _pending_unpack
         {
-            std::function<void()>               callback;
-            std::uint32_t                       counter;
-            std::vector<_pending_asset_request> handles;
+            AssetRegistry::Slot          asset;
+            std::shared_ptr<std::byte[]> source; // read that holds the packed data, null if mapped
+            std::span<const std::byte>   packed;
+            std::shared_ptr<std::byte[]> buffer; // unpacked data
+            bool                         failed;
+            std::atomic<bool>            done;
         };
+        std::vector<std::unique_ptr<_pending_unpack>> _unpacks; // stable addresses for the jobs
+        std::vector<std::uint32_t>                    _free_unpacks;
+        std::vector<std::uint32_t>                    _unpacks_in_flight;
 
         //Pool<_batch_request_handle>   _batch_handles_pool;   // local allocator
         //Pool<_pending_bundle_request> _bundle_requests_pool; // local allocator for requests
@@ -148,7 +285,9 @@ namespace drako::engine
         struct _available_bundles_table
         {
             std::vector<AssetBundleID>        ids;
-            std::vector<rio::UniqueInputFile> sources;
+            std::vector<rio::UniqueInputFile> sources;  // storage files, opened when they aren't mapped
+            std::vector<sys::MappedFile>      mappings; // storage files, mapped while referenced
+            std::vector<std::uint32_t>        mapped;   // loaded assets that view each mapping
             std::vector<std::size_t>          sizes;
             std::vector<std::string>          names;
         } _available_bundles;
@@ -160,33 +299,54 @@ namespace drako::engine
             std::vector<std::uint16_t>       refcount;
         } _loaded_bundles;
 
-        struct _loaded_assets_table
-        {
-            std::vector<AssetID>                      ids;
-            std::vector<std::unique_ptr<std::byte[]>> data;
-            std::vector<std::uint16_t>                refcount;
-        } _loaded_assets;
+        AssetRegistry                           _assets;
+        std::vector<std::vector<std::uint32_t>> _waiting_batches; // batches that wait for each pending asset, by slot
+        std::vector<std::uint32_t>              _asset_reads;     // read that covers each pending asset, by slot
 
-        struct _available_assets_table
-        {
-            std::vector<AssetID>                      ids;
-            std::vector<std::unique_ptr<std::byte[]>> data;
-            std::vector<std::uint32_t>                refcount;
-            std::vector<AssetLoadInfo>                meta;
-        } _assets;
+        // destroyed first, so that no read is still writing in the buffers
+        std::unique_ptr<AsyncReaderPoolInterface> _own_io_service;
+        AsyncReaderPoolInterface*                 _io_service = nullptr; // owned or given by the config
 
         void _handle_bundle_requests();
         void _handle_asset_requests();
 
+        // merges the ranges of adjacent assets of the same priority in reads
+        void _schedule_reads(std::vector<_read_target>& targets);
+
+        // raises the priority of the read of a pending asset, if it isn't submitted yet
+        void _promote_read(const _read_target&) noexcept;
+
+        // submits the most urgent reads, until the reader is full or the budget is spent
+        void _submit_reads() noexcept;
+
+        // drops or cancels a read if none of its assets is referenced anymore
+        void _drop_read_if_unused(std::uint32_t read) noexcept;
+
+        // attaches the data of a completed read to its assets
+        void _complete_read(const AsyncReaderPoolInterface::Completion&);
+
+        // decompresses the stored data of an asset, on the scheduler if there's one
+        void _unpack(AssetRegistry::Slot asset, std::shared_ptr<std::byte[]> source, std::span<const std::byte> packed, AssetLoadPriority);
+
+        // attaches the data of the completed decompressions to their assets
+        void _complete_unpacks();
+
+        // notifies the batches that wait for an asset
+        void _land(AssetRegistry::Slot asset);
+
+        // releases a batch whose assets all landed and invokes its callback
+        void _complete_batch(std::uint32_t batch);
+
         // check whether an asset is in memory
-        [[nodiscard]] bool _loaded(const AssetID) noexcept;
+        [[nodiscard]] bool _loaded(const AssetID) const noexcept;
 
-        // check whether an asset is scheduled for a load operation
-        [[nodiscard]] bool _pending(const AssetID) noexcept;
+        void _dec_ref_count(AssetRegistry::Slot asset) noexcept;
 
-        void _inc_ref_count(const AssetID) noexcept;
+        // maps the storage of a bundle, or adds a reference to the existing mapping
+        [[nodiscard]] const sys::MappedFile& _map_bundle(std::size_t bundle);
 
-        void _dec_ref_count(const AssetID) noexcept;
+        // drops a reference to the mapping of a bundle storage
+        void _unmap_bundle(std::size_t bundle) noexcept;
     };
 
     /*
@@ -215,12 +375,14 @@ namespace drako::engine
         _asset_dump_list.push_back(a);
     }
 
-    inline void AssetSystemRuntime::load_asset(const AssetLoadRequest& r) noexcept
+    inline AssetRequestID AssetSystemRuntime::load_asset(const AssetLoadRequest& r) noexcept
     {
         for (const auto& a : r.assets)
             assert(a);
 
-        _asset_load_requests.push_back(r);
+        const AssetRequestID id{ ++_last_request };
+        _asset_load_requests.emplace_back(id, r);
+        return id;
     }
 
 } // namespace drako::engine
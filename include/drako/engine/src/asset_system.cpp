@@ -1,51 +1,119 @@
 #include "drako/engine/asset_system.hpp"
 
+#include "drako/core/compression/lz_codec.hpp"
 #include "drako/devel/asset_bundle_manifest.hpp"
-#include "drako/devel/project_utils.hpp"
+#include "drako/jobs/job_system.hpp"
+#include "drako/system/mapped_file.hpp"
 
 #include <rio/input_file_handle.hpp>
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 namespace drako::engine
 {
-    // convert a list of IDs to a list of indices
-    [[nodiscard]] std::vector<std::size_t> _id_to_index(
-        const std::vector<AssetID>& table, const std::vector<AssetID>& assets)
+    // completions are drained only by update(), so the reads in flight must fit the output queue
+    constexpr const AsyncReaderArgs _io_args{ .workers = 4, .submit_queue_size = 128, .output_queue_size = 128 };
+
+    // index of the read of an asset that isn't being read
+    constexpr const std::uint32_t _no_read = std::numeric_limits<std::uint32_t>::max();
+
+    // reads the manifests of the bundles
+    [[nodiscard]] std::vector<AssetBundleManifest> _read_manifests(
+        const AssetSystemRuntime::BundlesArgs& bundles, const AssetSystemRuntime::ConfigArgs& config)
+    {
+        std::vector<AssetBundleManifest> manifests(std::size(bundles.ids));
+        for (std::size_t b = 0; b < std::size(bundles.ids); ++b)
+        {
+            std::ifstream file{ config.bundle_meta_directory / manifest_filename(bundles.ids[b]), std::ios::binary };
+            file.exceptions(std::ios_base::failbit | std::ios_base::badbit);
+            file >> manifests[b];
+        }
+        return manifests;
+    }
+
+    // total number of assets stored in the bundles
+    [[nodiscard]] std::size_t _count_assets(const std::vector<AssetBundleManifest>& manifests) noexcept
     {
-        std::vector<std::size_t> indices;
-        indices.reserve(std::size(assets));
+        std::size_t count = 0;
+        for (const auto& m : manifests)
+            count += std::size(m.ids);
+        return count;
+    }
 
-        for (const auto& a : assets)
+
+    bool AssetSystemRuntime::_loaded(const AssetID id) const noexcept
+    {
+        const auto slot = _assets.find(id);
+        return slot != AssetRegistry::invalid_slot && _assets.states[slot] == AssetState::loaded;
+    }
+
+    void AssetSystemRuntime::_dec_ref_count(AssetRegistry::Slot asset) noexcept
+    {
+        auto& t = _assets;
+        assert(t.refcount[asset] > 0); // asset isn't loaded
+        if (--t.refcount[asset] > 0)
+            return;
+
+        // pending assets are dropped when they land, their read is dropped if nobody needs it
+        if (t.states[asset] != AssetState::loaded)
         {
-            const auto it = std::find(std::cbegin(table), std::cend(table), a);
-            assert(it != std::cend(table));
-            indices.push_back(std::distance(std::cbegin(table), it));
+            if (_asset_reads[asset] != _no_read)
+                _drop_read_if_unused(_asset_reads[asset]);
+            return;
         }
-        return indices;
+
+        // the last asset of a read releases its buffer
+        if (_config.map_bundle_storage)
+            _unmap_bundle(t.bundles[asset]);
+        t.reset(asset);
     }
 
+    const sys::MappedFile& AssetSystemRuntime::_map_bundle(std::size_t bundle)
+    {
+        auto& t = _available_bundles;
+        if (t.mapped[bundle] == 0)
+            t.mappings[bundle] = sys::MappedFile{ _config.bundle_data_directory / storage_filename(t.ids[bundle]) };
+        ++t.mapped[bundle];
+        return t.mappings[bundle];
+    }
+
+    void AssetSystemRuntime::_unmap_bundle(std::size_t bundle) noexcept
+    {
+        auto& t = _available_bundles;
+        assert(t.mapped[bundle] > 0);
+        if (--t.mapped[bundle] == 0)
+            t.mappings[bundle] = sys::MappedFile{};
+    }
 
-    bool AssetSystemRuntime::_loaded(const AssetID id) noexcept
+    std::span<const std::byte> AssetSystemRuntime::asset_data(const AssetID id) const noexcept
     {
-        const auto& t = _loaded_assets.ids;
-        return std::find(std::cbegin(t), std::cend(t), id) != std::cend(t);
+        const auto slot = _assets.find(id);
+        return slot != AssetRegistry::invalid_slot ? _assets.views[slot] : std::span<const std::byte>{};
     }
 
-    bool AssetSystemRuntime::_pending(const AssetID id) noexcept
+    std::span<const std::byte> AssetSystemRuntime::asset_data(const AssetHandle h) const noexcept
     {
-        const auto& t = _pending_assets.ids;
-        return std::find(std::cbegin(t), std::cend(t), id) != std::cend(t);
+        const auto slot = _assets.find(h);
+        return slot != AssetRegistry::invalid_slot ? _assets.views[slot] : std::span<const std::byte>{};
     }
 
-    void AssetSystemRuntime::_inc_ref_count(const AssetID id) noexcept
+    AssetHandle AssetSystemRuntime::asset_handle(const AssetID id) const noexcept
     {
-        auto&      t     = _loaded_assets;
-        const auto it    = std::find(std::cbegin(t.ids), std::cend(t.ids), id);
-        const auto index = std::distance(std::cbegin(t.ids), it);
-        ++t.refcount[index];
+        const auto slot = _assets.find(id);
+        if (slot == AssetRegistry::invalid_slot || _assets.states[slot] != AssetState::loaded)
+            return AssetHandle{};
+        return _assets.handle(slot);
     }
 
 
@@ -115,55 +183,445 @@ namespace drako::engine
 
     void AssetSystemRuntime::_handle_asset_requests()
     {
-        for (const auto& request : _asset_load_requests)
+        // complete the reads that landed since the last update
+        if (_io_service)
+        {
+            std::array<AsyncReaderPoolInterface::Completion, 32> completions;
+            while (const auto n = _io_service->retrieve(completions))
+                for (const auto& c : std::span{ completions }.first(n))
+                    _complete_read(c);
+        }
+
+        // single assets are handled as a batch without callback, that can't be cancelled
+        const auto assets = std::exchange(_asset_load_list, {});
+        if (!std::empty(assets))
+            _asset_load_requests.emplace_back(AssetRequestID{}, AssetLoadRequest{ .assets = assets, .callback = nullptr });
+
+        // callbacks can queue new requests
+        const auto requests = std::exchange(_asset_load_requests, {});
+
+        std::vector<_read_target> assets_to_read;
+        std::vector<_read_target> assets_to_promote;
+        for (const auto& [id, request] : requests)
         {
-            std::vector<AssetID> assets_to_load;
+            std::uint32_t batch;
+            if (std::empty(_free_batches))
+            {
+                batch = static_cast<std::uint32_t>(std::size(_batches));
+                _batches.emplace_back();
+            }
+            else
+            {
+                batch = _free_batches.back();
+                _free_batches.pop_back();
+            }
+            _batches[batch].id       = id;
+            _batches[batch].callback = request.callback;
+            _batches[batch].counter  = 0;
+
+            // the first reference to an asset schedules its load
+            std::vector<AssetRegistry::Slot> assets_to_load;
             for (const auto& asset : request.assets)
             {
-                if (_loaded(asset))
-                    _inc_ref_count(asset);
-                else
+                const auto slot = _assets.find(asset);
+                assert(slot != AssetRegistry::invalid_slot); // asset isn't stored in any bundle
+
+                if (_assets.states[slot] == AssetState::pending)
                 {
-                    if (_pending(asset))
-                        _inc_ref_count(asset);
+                    // a batch waits only once for each asset
+                    auto& waiting = _waiting_batches[slot];
+                    if (std::find(std::cbegin(waiting), std::cend(waiting), batch) == std::cend(waiting))
+                    {
+                        waiting.push_back(batch);
+                        ++_batches[batch].counter;
+                    }
+                    assets_to_promote.push_back({ slot, request.priority, request.deadline });
+                }
+                else if (_assets.states[slot] == AssetState::unloaded)
+                {
+                    assets_to_load.push_back(slot);
+                    _assets.states[slot] = AssetState::pending;
+                    _waiting_batches[slot].push_back(batch);
+                    ++_batches[batch].counter;
+                }
+                ++_assets.refcount[slot];
+                _batches[batch].assets.push_back(slot);
+            }
+
+            if (_batches[batch].counter == 0)
+                _complete_batch(batch);
+
+            if (_config.map_bundle_storage)
+            {
+                // hint all the ranges before the first page fault
+                for (const auto& i : assets_to_load)
+                {
+                    const auto& meta    = _assets.meta[i];
+                    const auto& mapping = _map_bundle(_assets.bundles[i]);
+                    assert(meta.package_offset_bytes() + meta.packed_size_bytes() <= mapping.size());
+
+                    mapping.prefetch(meta.package_offset_bytes(), meta.packed_size_bytes());
+                    if (meta.storage_flags() == AssetStorageFlags::uncompressed)
+                        _assets.views[i] = mapping.bytes().subspan(meta.package_offset_bytes(), meta.packed_size_bytes());
+                }
+
+                // the pages are faulted in by the consumer, or by the decompression
+                for (const auto& i : assets_to_load)
+                {
+                    const auto& meta = _assets.meta[i];
+                    if (meta.storage_flags() == AssetStorageFlags::uncompressed)
+                        _land(i);
                     else
-                        assets_to_load.push_back(asset);
+                        _unpack(i, nullptr, _available_bundles.mappings[_assets.bundles[i]].bytes().subspan(meta.package_offset_bytes(), meta.packed_size_bytes()), request.priority);
                 }
             }
+            else
+                for (const auto& i : assets_to_load)
+                    assets_to_read.push_back({ i, request.priority, request.deadline });
+        }
+
+        if (!std::empty(assets_to_read))
+            _schedule_reads(assets_to_read);
+
+        // assets requested again can be needed sooner than their read was scheduled for
+        if (_io_service)
+        {
+            for (const auto& target : assets_to_promote)
+                _promote_read(target);
+            _submit_reads();
+        }
+
+        _complete_unpacks();
+
+        for (const auto& asset : _asset_dump_list)
+        {
+            const auto slot = _assets.find(asset);
+            assert(slot != AssetRegistry::invalid_slot); // asset isn't stored in any bundle
+            _dec_ref_count(slot);
+        }
+        _asset_dump_list.clear();
+    }
 
-            if (!std::empty(assets_to_load))
+    void AssetSystemRuntime::_schedule_reads(std::vector<_read_target>& targets)
+    {
+        const auto& bundles = _assets.bundles;
+        const auto& meta    = _assets.meta;
+
+        // adjacent assets of a bundle are contiguous in its storage
+        std::ranges::sort(targets, {}, [&](const auto& t) {
+            return std::tuple{ t.priority, bundles[t.asset], meta[t.asset].package_offset_bytes() };
+        });
+
+        for (std::size_t first = 0; first < std::size(targets);)
+        {
+            const auto priority = targets[first].priority;
+            const auto bundle   = bundles[targets[first].asset];
+            const auto begin    = meta[targets[first].asset].package_offset_bytes();
+            auto       end      = begin + meta[targets[first].asset].packed_size_bytes();
+            auto       deadline = targets[first].deadline;
+
+            // prefetched assets never delay the read of the more urgent ones
+            auto last = first + 1;
+            for (; last < std::size(targets); ++last)
             {
-                // set up a batch handle
-                //auto batch      = _batch_handles_pool.allocate(1);
-                //batch->callback = request.callback;
-                //batch->counter  = std::size(assets_to_load);
-                //batch->handles.reserve(std::size(assets_to_load));
+                const auto& m = meta[targets[last].asset];
+                if (targets[last].priority != priority || bundles[targets[last].asset] != bundle || m.package_offset_bytes() != end ||
+                    m.package_offset_bytes() + m.packed_size_bytes() - begin > _config.max_read_size)
+                    break;
+                end      = m.package_offset_bytes() + m.packed_size_bytes();
+                deadline = std::min(deadline, targets[last].deadline);
+            }
 
-                const auto indices = _id_to_index(_loaded_assets.ids, assets_to_load);
+            std::uint32_t r;
+            if (std::empty(_free_reads))
+            {
+                r = static_cast<std::uint32_t>(std::size(_reads));
+                _reads.push_back(std::make_unique<_pending_read>());
+            }
+            else
+            {
+                r = _free_reads.back();
+                _free_reads.pop_back();
+            }
 
-                for (const auto& i : indices)
-                    assert(!_assets.data[i]); // asset is not loaded
+            auto& read   = *_reads[r];
+            read.buffer  = std::make_shared_for_overwrite<std::byte[]>(end - begin);
+            read.request = {
+                .src       = _available_bundles.sources[bundle].native_handle(),
+                .dst       = { read.buffer.get(), end - begin },
+                .offset    = begin,
+                .user_data = r
+            };
+            read.id       = AsyncReaderPoolInterface::invalid_request;
+            read.priority = priority;
+            read.deadline = deadline;
+            read.assets.clear();
+            for (auto i = first; i < last; ++i)
+            {
+                read.assets.push_back(targets[i].asset);
+                _asset_reads[targets[i].asset] = r;
+            }
+            _unsubmitted_reads.push_back(r);
 
-//#pragma omp parallel for
-                for (const auto& i : indices)
-                {
-                    const auto& path = _config.asset_data_directory /
-                                       editor::guid_to_datafile(_assets.ids[i]);
-                    rio::UniqueInputFile file{ path };
+            first = last;
+        }
+    }
 
-                    const auto& meta = _assets.meta[i];
-                    _assets.data[i]  = std::make_unique_for_overwrite<std::byte[]>(meta.packed_size_bytes());
+    void AssetSystemRuntime::_promote_read(const _read_target& target) noexcept
+    {
+        const auto r = _asset_reads[target.asset];
+        if (r == _no_read) // being decompressed
+            return;
+
+        auto& read = *_reads[r];
+        if (read.id != AsyncReaderPoolInterface::invalid_request)
+            return;
+        read.priority = std::min(read.priority, target.priority);
+        read.deadline = std::min(read.deadline, target.deadline);
+    }
 
-                    rio::read_exact(file, { _assets.data[i].get(), meta.packed_size_bytes() });
-                    _assets.refcount[i] = 1;
-                }
+    void AssetSystemRuntime::_submit_reads() noexcept
+    {
+        // most urgent first, reads that are just as urgent keep their order
+        std::ranges::stable_sort(_unsubmitted_reads, {}, [this](auto r) {
+            return std::pair{ _reads[r]->priority, _reads[r]->deadline };
+        });
+
+        auto        budget    = _config.frame_read_budget;
+        std::size_t submitted = 0;
+        for (; submitted < std::size(_unsubmitted_reads) && _reads_in_flight < _io_args.output_queue_size; ++submitted)
+        {
+            auto&      read  = *_reads[_unsubmitted_reads[submitted]];
+            const auto bytes = std::size(read.request.dst);
+
+            // the rest is retried on the next update
+            if (read.priority != AssetLoadPriority::blocking && bytes > budget && submitted > 0)
+                break;
+            if (read.priority == AssetLoadPriority::prefetch && _prefetch_reads_in_flight >= _config.max_prefetch_reads)
+                break;
+
+            read.id = _io_service->submit(&read.request);
+            if (read.id == AsyncReaderPoolInterface::invalid_request)
+                break;
+
+            ++_reads_in_flight;
+            if (read.priority == AssetLoadPriority::prefetch)
+                ++_prefetch_reads_in_flight;
+            budget -= std::min(budget, bytes);
+        }
+        _unsubmitted_reads.erase(std::begin(_unsubmitted_reads), std::begin(_unsubmitted_reads) + submitted);
+    }
+
+    void AssetSystemRuntime::_drop_read_if_unused(std::uint32_t r) noexcept
+    {
+        auto& read = *_reads[r];
+        for (const auto i : read.assets)
+            if (_assets.refcount[i] > 0)
+                return;
+
+        // the completion lands the assets, which are dropped
+        if (read.id != AsyncReaderPoolInterface::invalid_request)
+        {
+            _io_service->cancel(read.id);
+            return;
+        }
+
+        for (const auto i : read.assets)
+        {
+            assert(std::empty(_waiting_batches[i])); // batches hold a reference to their assets
+            _asset_reads[i] = _no_read;
+            _assets.reset(i);
+        }
+        std::erase(_unsubmitted_reads, r);
+        read.buffer.reset();
+        read.assets.clear();
+        _free_reads.push_back(r);
+    }
+
+    void AssetSystemRuntime::_complete_read(const AsyncReaderPoolInterface::Completion& c)
+    {
+        const auto r    = static_cast<std::uint32_t>(c.request->user_data);
+        auto&      read = *_reads[r];
+        --_reads_in_flight;
+        if (read.priority == AssetLoadPriority::prefetch)
+            --_prefetch_reads_in_flight;
+        for (const auto i : read.assets)
+            _asset_reads[i] = _no_read;
+
+        // assets requested again after the cancellation are read again, as they're needed now
+        const auto cancelled = c.error == std::errc::operation_canceled;
+        std::vector<_read_target> again;
+
+        // failed assets land without data, so that their batches still complete
+        const auto failed = c.error || c.bytes != std::size(read.request.dst);
+        for (const auto i : read.assets)
+        {
+            if (cancelled && _assets.refcount[i] > 0)
+            {
+                again.push_back({ i, std::min(read.priority, AssetLoadPriority::visible), read.deadline });
+                continue;
+            }
+            if (failed)
+            {
+                _land(i);
+                continue;
+            }
+
+            const auto&                      meta = _assets.meta[i];
+            const std::span<const std::byte> stored{ read.buffer.get() + (meta.package_offset_bytes() - read.request.offset), meta.packed_size_bytes() };
+            if (meta.storage_flags() == AssetStorageFlags::uncompressed)
+            {
+                _assets.data[i]  = read.buffer;
+                _assets.views[i] = stored;
+                _land(i);
+            }
+            else
+                _unpack(i, read.buffer, stored, read.priority);
+        }
+
+        read.buffer.reset();
+        read.assets.clear();
+        _free_reads.push_back(r);
+
+        if (!std::empty(again))
+            _schedule_reads(again);
+    }
+
+    void AssetSystemRuntime::_unpack(AssetRegistry::Slot asset,
+        std::shared_ptr<std::byte[]> source, std::span<const std::byte> packed, AssetLoadPriority priority)
+    {
+        assert(_assets.meta[asset].storage_flags() == AssetStorageFlags::lz_blocks);
+
+        std::uint32_t r;
+        if (std::empty(_free_unpacks))
+        {
+            r = static_cast<std::uint32_t>(std::size(_unpacks));
+            _unpacks.push_back(std::make_unique<_pending_unpack>());
+        }
+        else
+        {
+            r = _free_unpacks.back();
+            _free_unpacks.pop_back();
+        }
+
+        auto& unpack  = *_unpacks[r];
+        unpack.asset  = asset;
+        unpack.source = std::move(source);
+        unpack.packed = packed;
+        unpack.buffer = std::make_shared_for_overwrite<std::byte[]>(_assets.meta[asset].unpacked_size_bytes());
+        unpack.failed = false;
+        unpack.done.store(false, std::memory_order_relaxed);
+        _unpacks_in_flight.push_back(r);
+
+        const auto size = _assets.meta[asset].unpacked_size_bytes();
+        const auto job  = [u = &unpack, size]() {
+            u->failed = !lz::decompress(u->packed, { u->buffer.get(), size });
+            u->done.store(true, std::memory_order_release);
+        };
+        if (_config.scheduler) // blocking assets must land within the frame
+            _config.scheduler->submit(job, priority == AssetLoadPriority::blocking ? jobs::JobPriority::frame : jobs::JobPriority::background);
+        else
+            job();
+    }
+
+    void AssetSystemRuntime::_complete_unpacks()
+    {
+        const auto done = std::ranges::partition(_unpacks_in_flight, [this](auto r) {
+            return !_unpacks[r]->done.load(std::memory_order_acquire);
+        });
+        const std::vector<std::uint32_t> completed(std::begin(done), std::end(done));
+        _unpacks_in_flight.erase(std::begin(done), std::end(done));
+
+        // corrupted assets land without data, like failed reads
+        for (const auto r : completed)
+        {
+            auto&      unpack = *_unpacks[r];
+            const auto i      = unpack.asset;
+            if (!unpack.failed)
+            {
+                _assets.data[i]  = std::move(unpack.buffer);
+                _assets.views[i] = { _assets.data[i].get(), _assets.meta[i].unpacked_size_bytes() };
             }
+            unpack.buffer.reset();
+            unpack.source.reset();
+            _free_unpacks.push_back(r);
+            _land(i);
         }
     }
 
+    void AssetSystemRuntime::_land(AssetRegistry::Slot asset)
+    {
+        assert(_assets.states[asset] == AssetState::pending);
+
+        // assets unloaded meanwhile don't keep the data alive
+        if (_assets.refcount[asset] > 0)
+            _assets.states[asset] = AssetState::loaded;
+        else
+        {
+            if (_config.map_bundle_storage)
+                _unmap_bundle(_assets.bundles[asset]);
+            _assets.reset(asset);
+        }
+
+        const auto batches = std::exchange(_waiting_batches[asset], {});
+        for (const auto b : batches)
+            if (--_batches[b].counter == 0)
+                _complete_batch(b);
+    }
+
+    void AssetSystemRuntime::_complete_batch(std::uint32_t b)
+    {
+        auto&      batch    = _batches[b];
+        const auto callback = std::move(batch.callback);
+        batch.id            = AssetRequestID{};
+        batch.callback      = nullptr;
+        batch.assets.clear();
+        _free_batches.push_back(b);
+        if (callback)
+            callback();
+    }
+
+    bool AssetSystemRuntime::cancel_load(const AssetRequestID id) noexcept
+    {
+        if (!id)
+            return false;
+
+        // not handled by update() yet
+        const auto queued = std::ranges::find(_asset_load_requests, id, [](const auto& r) { return r.first; });
+        if (queued != std::end(_asset_load_requests))
+        {
+            _asset_load_requests.erase(queued);
+            return true;
+        }
+
+        const auto found = std::ranges::find(_batches, id, &_batch_request_handle::id);
+        if (found == std::end(_batches))
+            return false;
+
+        const auto b      = static_cast<std::uint32_t>(found - std::begin(_batches));
+        const auto assets = std::exchange(found->assets, {});
+        found->id         = AssetRequestID{};
+        found->callback   = nullptr;
+        found->counter    = 0;
+        _free_batches.push_back(b);
+
+        // the batch stops waiting before its references are released
+        for (const auto i : assets)
+            std::erase(_waiting_batches[i], b);
+        for (const auto i : assets)
+            _dec_ref_count(i);
+        return true;
+    }
+
     AssetSystemRuntime::AssetSystemRuntime(const BundlesArgs& bundles, const ConfigArgs& config)
+        : AssetSystemRuntime{ bundles, config, _read_manifests(bundles, config) }
+    {
+    }
+
+    AssetSystemRuntime::AssetSystemRuntime(
+        const BundlesArgs& bundles, const ConfigArgs& config, std::vector<AssetBundleManifest>&& manifests)
         : _config{ config }
-    //, _io_service{ { .workers = 4, .submit_queue_size = 100, .output_queue_size = 100 } }
+        , _assets{ _count_assets(manifests) }
     //, _asset_requests_pool{ 100 }
     //, _bundle_requests_pool{ 100 }
     {
@@ -194,17 +652,53 @@ namespace drako::engine
 
         _available_bundles.ids   = bundles.ids;
         _available_bundles.names = bundles.names;
+        _available_bundles.mappings.resize(std::size(bundles.ids));
+        _available_bundles.mapped.resize(std::size(bundles.ids));
         //_available_bundles.ids.reserve(std::size(bundles.ids));
         //_available_bundles.sources.reserve(std::size(bundles.ids));
-        for (const auto& id : bundles.ids)
+        for (std::uint32_t b = 0; b < std::size(bundles.ids); ++b)
         {
-            const auto path = manifest_filename(id);
+            const auto& manifest = manifests[b];
+            for (std::size_t i = 0; i < std::size(manifest.ids); ++i)
+                _assets.insert(manifest.ids[i], manifest.infos[i], b);
+
+            const auto path = config.bundle_data_directory / storage_filename(bundles.ids[b]);
             const auto size = static_cast<std::size_t>(_fs::file_size(path));
-            _available_bundles.sources.emplace_back(path);
+            if (!config.map_bundle_storage)
+                _available_bundles.sources.emplace_back(path);
             _available_bundles.sizes.push_back(size);
         }
         //_available_bundles.sources.shrink_to_fit();
         //_available_bundles.sizes.shrink_to_fit();
+        _waiting_batches.resize(_assets.size());
+        _asset_reads.resize(_assets.size(), _no_read);
+
+        // mapped storage is paged in on access and needs no reader
+        if (!config.map_bundle_storage)
+        {
+            if (!config.reader)
+                _own_io_service = make_async_reader_pool(_io_args);
+            _io_service = config.reader ? config.reader : _own_io_service.get();
+        }
+    }
+
+    AssetSystemRuntime::~AssetSystemRuntime() noexcept
+    {
+        // a reader that isn't owned keeps running, so its reads must land in the buffers first
+        if (_io_service && !_own_io_service)
+        {
+            std::array<AsyncReaderPoolInterface::Completion, 32> completions;
+            while (_reads_in_flight > 0)
+                if (const auto n = _io_service->retrieve(completions))
+                    _reads_in_flight -= n;
+                else
+                    std::this_thread::yield();
+        }
+
+        // the jobs write in the records and buffers owned by the runtime
+        for (const auto r : _unpacks_in_flight)
+            while (!_unpacks[r]->done.load(std::memory_order_acquire))
+                std::this_thread::yield();
     }
 
     void AssetSystemRuntime::update()
@@ -217,9 +711,9 @@ namespace drako::engine
     {
         std::cout << "[available_bundles]\n[id]\t\t[name]\t\t[size(bytes)]\n";
         const auto& t = _available_bundles;
-        for (auto i = 0; i < std::size(t.ids); ++i)
-            std::cout << t.ids[i] << '\t\t'
-                      << t.names[i] << '\t\t'
+        for (std::size_t i = 0; i < std::size(t.ids); ++i)
+            std::cout << t.ids[i] << "\t\t"
+                      << t.names[i] << "\t\t"
                       << t.sizes[i] << '\n';
     }
 
@@ -227,24 +721,24 @@ namespace drako::engine
     {
         std::cout << "[loaded_bundles]\n[id]\t\t[references]\n";
         const auto& t = _loaded_bundles;
-        for (auto i = 0; i < std::size(t.ids); ++i)
-            std::cout << t.ids[i] << '\t\t'
+        for (std::size_t i = 0; i < std::size(t.ids); ++i)
+            std::cout << t.ids[i] << "\t\t"
                       << t.refcount[i] << '\n';
     }
 
     void AssetSystemRuntime::debug_print_assets()
     {
         std::cout << "Loaded assets (ID | refcount):\n";
-        const auto& t = _loaded_assets;
-        for (auto i = 0; i < std::size(t.ids); ++i)
-            std::cout << t.ids[i] << ' ' << t.refcount[i] << '\n';
+        const auto& t = _assets;
+        for (std::size_t i = 0; i < std::size(t.ids); ++i)
+            if (t.states[i] == AssetState::loaded)
+                std::cout << t.ids[i] << ' ' << t.refcount[i] << '\n';
     }
 
     [[nodiscard]] bool AssetSystemRuntime::debug_check_asset_loaded(std::span<const AssetID> s) noexcept
     {
-        const auto& ids = _loaded_assets.ids;
         for (const auto& asset : s)
-            if (std::find(std::cbegin(ids), std::cend(ids), asset) == std::cend(ids))
+            if (!_loaded(asset))
                 return false;
         return true;
     }
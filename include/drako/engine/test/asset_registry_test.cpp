@@ -0,0 +1,82 @@
+#include "drako/engine/asset_registry.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+using namespace drako;
+using namespace drako::engine;
+
+namespace
+{
+    [[nodiscard]] AssetID _asset_id(std::uint32_t n)
+    {
+        char text[37];
+        std::snprintf(text, sizeof(text), "%08x-0000-4000-8000-000000000002", static_cast<unsigned>(n));
+        return AssetID{ std::string{ text } };
+    }
+} // namespace
+
+
+GTEST_TEST(AssetRegistry, FindsRegisteredAssets)
+{
+    AssetRegistry registry{ 8 };
+    const auto    a = registry.insert(_asset_id(1), AssetLoadInfo{ 0, 100 }, 0);
+    const auto    b = registry.insert(_asset_id(2), AssetLoadInfo{ 100, 50 }, 0);
+
+    EXPECT_EQ(registry.size(), 2u);
+    EXPECT_EQ(registry.find(_asset_id(1)), a);
+    EXPECT_EQ(registry.find(_asset_id(2)), b);
+    EXPECT_EQ(registry.find(_asset_id(3)), AssetRegistry::invalid_slot);
+    EXPECT_EQ(registry.states[a], AssetState::unloaded);
+}
+
+GTEST_TEST(AssetRegistry, ExpiresHandlesOnReset)
+{
+    AssetRegistry registry{ 8 };
+    const auto    slot = registry.insert(_asset_id(1), AssetLoadInfo{ 0, 100 }, 0);
+
+    const auto before = registry.handle(slot);
+    EXPECT_TRUE(before);
+    EXPECT_EQ(registry.find(before), slot);
+
+    registry.reset(slot);
+    EXPECT_EQ(registry.find(before), AssetRegistry::invalid_slot);
+
+    const auto after = registry.handle(slot);
+    EXPECT_NE(after, before);
+    EXPECT_EQ(registry.find(after), slot);
+
+    // handles of slots that were never registered don't resolve
+    EXPECT_EQ(registry.find(AssetHandle{ (std::uint64_t{ 1 } << 32) | 5 }), AssetRegistry::invalid_slot);
+}
+
+GTEST_TEST(AssetRegistry, SkipsGenerationZeroOnWrap)
+{
+    AssetRegistry registry{ 8 };
+    const auto    slot = registry.insert(_asset_id(1), AssetLoadInfo{ 0, 100 }, 0);
+
+    registry.generations[slot] = std::numeric_limits<std::uint32_t>::max();
+    const auto last            = registry.handle(slot);
+
+    registry.reset(slot);
+    EXPECT_EQ(registry.generations[slot], 1u);
+    EXPECT_EQ(registry.find(last), AssetRegistry::invalid_slot);
+
+    // handle 0 stays invalid, even for the first slot
+    EXPECT_TRUE(registry.handle(slot));
+    EXPECT_EQ(registry.find(AssetHandle{}), AssetRegistry::invalid_slot);
+}
+
+GTEST_TEST(AssetRegistry, RejectsDuplicateAssets)
+{
+    AssetRegistry registry{ 8 };
+    registry.insert(_asset_id(1), AssetLoadInfo{ 0, 100 }, 0);
+
+    EXPECT_THROW(registry.insert(_asset_id(1), AssetLoadInfo{ 100, 100 }, 1), std::invalid_argument);
+    EXPECT_EQ(registry.size(), 1u);
+}
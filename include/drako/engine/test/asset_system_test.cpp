@@ -0,0 +1,763 @@
+#include "drako/engine/asset_system.hpp"
+
+#include "drako/concurrency/async_reader_pool.hpp"
+#include "drako/core/compression/lz_codec.hpp"
+#include "drako/devel/asset_bundle_manifest.hpp"
+#include "drako/devel/asset_types.hpp"
+#include "drako/devel/project_types.hpp"
+#include "drako/jobs/job_system.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace drako;
+using namespace drako::engine;
+
+namespace
+{
+    constexpr const std::uint32_t _asset_size = 100;
+
+    [[nodiscard]] uuid::Uuid _uuid(std::uint32_t n)
+    {
+        char text[37];
+        std::snprintf(text, sizeof(text), "%08x-0000-4000-8000-000000000001", static_cast<unsigned>(n));
+        return uuid::Uuid{ std::string{ text } };
+    }
+
+    // bundle of assets stored back to back, removed on destruction
+    class TestBundle
+    {
+    public:
+        explicit TestBundle(std::uint32_t count, bool compress = false)
+            : _directory{ std::filesystem::temp_directory_path() / "drako_asset_system_test" }
+            , _id{ _uuid(0xb0) }
+            , _count{ count }
+            , _compress{ compress }
+        {
+            std::filesystem::create_directories(_directory);
+            _write_storage(std::byte{ 0 });
+
+            AssetBundleManifest manifest;
+            manifest.ids   = ids;
+            manifest.infos = infos;
+            std::ofstream meta{ _directory / manifest_filename(_id), std::ios::binary };
+            meta << manifest;
+        }
+
+        // replaces the storage file with a new one with the same layout and masked bytes,
+        // while the existing mappings still view the old file
+        void replace_storage(std::byte mask)
+        {
+            const auto size = std::size(storage);
+            std::filesystem::remove(_directory / storage_filename(_id));
+            _write_storage(mask);
+            EXPECT_EQ(std::size(storage), size);
+        }
+
+        ~TestBundle() { std::filesystem::remove_all(_directory); }
+
+        [[nodiscard]] AssetSystemRuntime::BundlesArgs bundles() const { return { .ids = { _id }, .names = { "test" } }; }
+
+        // assets served from a mapping of the storage file, without a reader
+        [[nodiscard]] AssetSystemRuntime::ConfigArgs mapped_config() const
+        {
+            return { .asset_data_directory  = _directory,
+                     .bundle_data_directory = _directory,
+                     .bundle_meta_directory = _directory,
+                     .map_bundle_storage    = true };
+        }
+
+        // reads served by the reader, one asset per read unless the max read size is raised
+        [[nodiscard]] AssetSystemRuntime::ConfigArgs config(AsyncReaderPoolInterface& reader) const
+        {
+            return { .asset_data_directory  = _directory,
+                     .bundle_data_directory = _directory,
+                     .bundle_meta_directory = _directory,
+                     .map_bundle_storage    = false,
+                     .max_read_size         = _asset_size,
+                     .reader                = &reader };
+        }
+
+        [[nodiscard]] static std::byte _byte(std::uint32_t asset) noexcept { return static_cast<std::byte>(asset + 1); }
+
+        std::vector<AssetID>       ids;
+        std::vector<AssetLoadInfo> infos;
+        std::vector<std::byte>     storage;
+
+    private:
+        std::filesystem::path _directory;
+        AssetBundleID         _id;
+        std::uint32_t         _count;
+        bool                  _compress;
+
+        void _write_storage(std::byte mask)
+        {
+            ids.clear();
+            infos.clear();
+            storage.clear();
+
+            std::vector<std::byte> packed(lz::max_compressed_size(_asset_size));
+            for (std::uint32_t i = 0; i < _count; ++i)
+            {
+                const auto offset = static_cast<std::uint32_t>(std::size(storage));
+                ids.push_back(_uuid(i + 1));
+
+                const std::vector<std::byte> data(_asset_size, _byte(i) ^ mask);
+                if (_compress)
+                {
+                    const auto size = static_cast<std::uint32_t>(lz::compress(data, packed));
+                    infos.emplace_back(offset, size, _asset_size, AssetStorageFlags::lz_blocks, AssetFormatFlags{});
+                    storage.insert(std::end(storage), std::begin(packed), std::begin(packed) + size);
+                }
+                else
+                {
+                    infos.emplace_back(offset, _asset_size);
+                    storage.insert(std::end(storage), std::begin(data), std::end(data));
+                }
+            }
+
+            std::ofstream file{ _directory / storage_filename(_id), std::ios::binary };
+            file.write(reinterpret_cast<const char*>(storage.data()), static_cast<std::streamsize>(std::size(storage)));
+        }
+    };
+
+    // reader whose requests complete only when the test says so, from a copy of the storage;
+    // the runtime waits for its reads on destruction, so tests complete them all instead of returning early
+    class ManualReader final : public AsyncReaderPoolInterface
+    {
+    public:
+        explicit ManualReader(const std::vector<std::byte>& storage)
+            : _storage{ storage } {}
+
+        [[nodiscard]] RequestID submit(const Request* r) noexcept override
+        {
+            pending.push_back({ ++_last, r });
+            return _last;
+        }
+
+        [[nodiscard]] std::size_t retrieve(std::span<Completion> out) noexcept override
+        {
+            const auto n = std::min(std::size(out), std::size(_completed));
+            std::copy_n(std::begin(_completed), n, std::begin(out));
+            _completed.erase(std::begin(_completed), std::begin(_completed) + n);
+            return n;
+        }
+
+        bool cancel(RequestID id) noexcept override
+        {
+            const auto found = std::ranges::find(pending, id, &std::pair<RequestID, const Request*>::first);
+            if (found == std::end(pending))
+                return false;
+            cancelled.push_back(id);
+            return true;
+        }
+
+        // completes the oldest pending request, as cancelled if it was
+        void complete(bool fail = false)
+        {
+            ASSERT_FALSE(std::empty(pending));
+            const auto [id, r] = pending.front();
+            pending.erase(std::begin(pending));
+
+            if (std::ranges::find(cancelled, id) != std::end(cancelled))
+                _completed.push_back({ .id = id, .request = r, .error = std::make_error_code(std::errc::operation_canceled) });
+            else if (fail)
+                _completed.push_back({ .id = id, .request = r, .error = std::make_error_code(std::errc::io_error) });
+            else
+            {
+                std::memcpy(r->dst.data(), _storage.data() + r->offset, r->dst.size_bytes());
+                _completed.push_back({ .id = id, .request = r, .bytes = r->dst.size_bytes() });
+            }
+        }
+
+        void complete_all()
+        {
+            while (!std::empty(pending))
+                complete();
+        }
+
+        // asset at the start of the range of a pending request
+        [[nodiscard]] std::size_t first_asset(std::size_t request) const noexcept
+        {
+            if (request >= std::size(pending))
+                return std::numeric_limits<std::size_t>::max();
+            return pending[request].second->offset / _asset_size;
+        }
+
+        std::vector<std::pair<RequestID, const Request*>> pending; // by submission
+        std::vector<RequestID>                            cancelled;
+
+    private:
+        const std::vector<std::byte>& _storage;
+        std::vector<Completion>       _completed;
+        RequestID                     _last = invalid_request;
+    };
+
+    // checks that an asset landed with its own bytes, masked if read after the storage was replaced
+    void _expect_loaded(const AssetSystemRuntime& runtime, const TestBundle& bundle, std::uint32_t asset, std::byte mask = std::byte{ 0 })
+    {
+        const auto data = runtime.asset_data(bundle.ids[asset]);
+        ASSERT_EQ(std::size(data), _asset_size);
+        EXPECT_TRUE(std::ranges::all_of(data, [=](auto b) { return b == (TestBundle::_byte(asset) ^ mask); }));
+    }
+
+    // decompression jobs complete on the workers, and land with a later update
+    void _update_until(AssetSystemRuntime& runtime, const bool& called)
+    {
+        for (auto i = 0; i < 10'000 && !called; ++i)
+        {
+            runtime.update();
+            std::this_thread::yield();
+        }
+    }
+
+    // project with some asset files, removed on destruction
+    class TestProject
+    {
+    public:
+        explicit TestProject()
+            : root{ std::filesystem::temp_directory_path() / "drako_asset_pack_test" }
+        {
+            std::filesystem::remove_all(root);
+            std::filesystem::create_directories(root);
+        }
+
+        ~TestProject() { std::filesystem::remove_all(root); }
+
+        // writes an asset file and adds it to the database
+        void insert(editor::ProjectDatabase& db, const std::vector<std::byte>& data)
+        {
+            const auto id   = _uuid(static_cast<std::uint32_t>(std::size(assets) + 1));
+            const auto path = root / ("asset_" + std::to_string(std::size(assets)));
+            std::ofstream{ path, std::ios::binary }.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(std::size(data)));
+
+            db.insert_asset(path, { .id = id, .path = path, .name = path.filename().string() });
+            ids.push_back(id);
+            assets.push_back(data);
+        }
+
+        std::filesystem::path               root;
+        std::vector<AssetID>                ids;
+        std::vector<std::vector<std::byte>> assets;
+    };
+
+    [[nodiscard]] std::vector<std::byte> _repeated(std::size_t size, std::uint8_t period)
+    {
+        std::vector<std::byte> data(size);
+        for (std::size_t i = 0; i < size; ++i)
+            data[i] = static_cast<std::byte>(i % period);
+        return data;
+    }
+
+    [[nodiscard]] std::vector<std::byte> _random(std::size_t size)
+    {
+        std::mt19937           rng{ 42 };
+        std::vector<std::byte> data(size);
+        for (auto& b : data)
+            b = static_cast<std::byte>(rng());
+        return data;
+    }
+
+    [[nodiscard]] std::vector<std::byte> _read_file(const std::filesystem::path& p)
+    {
+        std::ifstream          file{ p, std::ios::binary };
+        std::vector<std::byte> data(std::filesystem::file_size(p));
+        file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(std::size(data)));
+        return data;
+    }
+} // namespace
+
+
+GTEST_TEST(AssetSystemRuntime, SubmitsReadsByPriorityAndDeadline)
+{
+    const TestBundle   bundle{ 16 };
+    ManualReader       reader{ bundle.storage };
+    AssetSystemRuntime runtime{ bundle.bundles(), bundle.config(reader) };
+
+    const auto now = std::chrono::steady_clock::now();
+
+    const AssetID prefetch[] = { bundle.ids[0] };
+    const AssetID later[]    = { bundle.ids[4] };
+    const AssetID sooner[]   = { bundle.ids[8] };
+    const AssetID blocking[] = { bundle.ids[12] };
+    runtime.load_asset({ .assets = prefetch, .callback = {}, .priority = AssetLoadPriority::prefetch });
+    runtime.load_asset({ .assets = later, .callback = {}, .deadline = now + std::chrono::seconds{ 2 } });
+    runtime.load_asset({ .assets = sooner, .callback = {}, .deadline = now + std::chrono::seconds{ 1 } });
+    runtime.load_asset({ .assets = blocking, .callback = {}, .priority = AssetLoadPriority::blocking });
+    runtime.update();
+
+    EXPECT_EQ(std::size(reader.pending), 4u);
+    EXPECT_EQ(reader.first_asset(0), 12u);
+    EXPECT_EQ(reader.first_asset(1), 8u);
+    EXPECT_EQ(reader.first_asset(2), 4u);
+    EXPECT_EQ(reader.first_asset(3), 0u);
+
+    reader.complete_all();
+    runtime.update();
+    for (const auto asset : { 0u, 4u, 8u, 12u })
+        _expect_loaded(runtime, bundle, asset);
+}
+
+GTEST_TEST(AssetSystemRuntime, HoldsBackReadsOverBudget)
+{
+    const TestBundle bundle{ 16 };
+    ManualReader     reader{ bundle.storage };
+
+    auto config              = bundle.config(reader);
+    config.frame_read_budget = 3 * _asset_size / 2;
+    AssetSystemRuntime runtime{ bundle.bundles(), config };
+
+    // assets that aren't adjacent get a read each
+    const AssetID visible[]  = { bundle.ids[0], bundle.ids[2], bundle.ids[4] };
+    const AssetID blocking[] = { bundle.ids[6], bundle.ids[8], bundle.ids[10] };
+    runtime.load_asset({ .assets = visible, .callback = {} });
+    runtime.load_asset({ .assets = blocking, .callback = {}, .priority = AssetLoadPriority::blocking });
+
+    // blocking reads are never held back, even past the budget
+    runtime.update();
+    EXPECT_EQ(std::size(reader.pending), 3u);
+    for (std::size_t i = 0; i < 3; ++i)
+        EXPECT_GE(reader.first_asset(i), 6u);
+
+    // then a single read fits the budget of each update
+    for (auto submitted = 4u; submitted <= 6; ++submitted)
+    {
+        runtime.update();
+        EXPECT_EQ(std::size(reader.pending), submitted);
+    }
+
+    reader.complete_all();
+    runtime.update();
+    for (const auto asset : { 0u, 2u, 4u, 6u, 8u, 10u })
+        _expect_loaded(runtime, bundle, asset);
+}
+
+GTEST_TEST(AssetSystemRuntime, CancelDropsUnsubmittedReads)
+{
+    const TestBundle bundle{ 16 };
+    ManualReader     reader{ bundle.storage };
+
+    auto config              = bundle.config(reader);
+    config.frame_read_budget = _asset_size;
+    AssetSystemRuntime runtime{ bundle.bundles(), config };
+
+    auto          called   = false;
+    const AssetID assets[] = { bundle.ids[0], bundle.ids[2], bundle.ids[4] };
+    const auto    id       = runtime.load_asset({ .assets = assets, .callback = [&]() { called = true; } });
+    runtime.update();
+    EXPECT_EQ(std::size(reader.pending), 1u);
+
+    EXPECT_TRUE(runtime.cancel_load(id));
+    EXPECT_FALSE(runtime.cancel_load(id));
+
+    // the submitted read is cancelled, the others are never submitted
+    EXPECT_EQ(std::size(reader.cancelled), 1u);
+    for (auto i = 0; i < 4; ++i)
+        runtime.update();
+    EXPECT_EQ(std::size(reader.pending), 1u);
+
+    reader.complete_all();
+    runtime.update();
+    EXPECT_FALSE(called);
+    for (const auto& asset : assets)
+    {
+        EXPECT_TRUE(std::empty(runtime.asset_data(asset)));
+        EXPECT_FALSE(runtime.asset_handle(asset));
+    }
+}
+
+GTEST_TEST(AssetSystemRuntime, LoadsAssetsRequestedAgainAfterCancel)
+{
+    const TestBundle   bundle{ 16 };
+    ManualReader       reader{ bundle.storage };
+    AssetSystemRuntime runtime{ bundle.bundles(), bundle.config(reader) };
+
+    auto          cancelled_called = false;
+    auto          called           = false;
+    const AssetID assets[]         = { bundle.ids[3] };
+
+    const auto id = runtime.load_asset({ .assets = assets, .callback = [&]() { cancelled_called = true; } });
+    runtime.update();
+    EXPECT_EQ(std::size(reader.pending), 1u);
+    EXPECT_TRUE(runtime.cancel_load(id));
+
+    // requested again while the cancellation of the read is still in flight
+    runtime.load_asset({ .assets = assets, .callback = [&]() { called = true; } });
+    runtime.update();
+    reader.complete();
+    runtime.update();
+
+    EXPECT_EQ(std::size(reader.pending), 1u);
+    EXPECT_FALSE(called);
+    reader.complete();
+    runtime.update();
+
+    EXPECT_TRUE(called);
+    EXPECT_FALSE(cancelled_called);
+    _expect_loaded(runtime, bundle, 3);
+}
+
+GTEST_TEST(AssetSystemRuntime, MergesAdjacentAssetsSharedByBatches)
+{
+    const TestBundle bundle{ 16 };
+    ManualReader     reader{ bundle.storage };
+
+    auto config          = bundle.config(reader);
+    config.max_read_size = 4 * _asset_size;
+    AssetSystemRuntime runtime{ bundle.bundles(), config };
+
+    auto          first_called  = false;
+    auto          second_called = false;
+    const AssetID first[]       = { bundle.ids[0], bundle.ids[1], bundle.ids[2] };
+    const AssetID second[]      = { bundle.ids[2], bundle.ids[3], bundle.ids[8] };
+    runtime.load_asset({ .assets = first, .callback = [&]() { first_called = true; } });
+    runtime.load_asset({ .assets = second, .callback = [&]() { second_called = true; } });
+    runtime.update();
+
+    // the shared asset is read once, in the same read of its neighbours
+    EXPECT_EQ(std::size(reader.pending), 2u);
+    EXPECT_EQ(reader.first_asset(0), 0u);
+    EXPECT_EQ(reader.pending[0].second->dst.size(), 4 * _asset_size);
+    EXPECT_EQ(reader.first_asset(1), 8u);
+
+    reader.complete();
+    runtime.update();
+    EXPECT_TRUE(first_called);
+    EXPECT_FALSE(second_called);
+
+    reader.complete();
+    runtime.update();
+    EXPECT_TRUE(second_called);
+    for (const auto asset : { 0u, 1u, 2u, 3u, 8u })
+        _expect_loaded(runtime, bundle, asset);
+
+    // the shared asset stays loaded until both batches release it
+    runtime.unload_asset(bundle.ids[2]);
+    runtime.update();
+    _expect_loaded(runtime, bundle, 2);
+    runtime.unload_asset(bundle.ids[2]);
+    runtime.update();
+    EXPECT_TRUE(std::empty(runtime.asset_data(bundle.ids[2])));
+}
+
+GTEST_TEST(AssetSystemRuntime, CompletesBatchesOfFailedReads)
+{
+    const TestBundle bundle{ 16 };
+    ManualReader     reader{ bundle.storage };
+
+    auto config          = bundle.config(reader);
+    config.max_read_size = 2 * _asset_size;
+    AssetSystemRuntime runtime{ bundle.bundles(), config };
+
+    auto          first_called  = false;
+    auto          second_called = false;
+    const AssetID first[]       = { bundle.ids[0], bundle.ids[1] };
+    const AssetID second[]      = { bundle.ids[1] };
+    runtime.load_asset({ .assets = first, .callback = [&]() { first_called = true; } });
+    runtime.load_asset({ .assets = second, .callback = [&]() { second_called = true; } });
+    runtime.update();
+    EXPECT_EQ(std::size(reader.pending), 1u);
+
+    reader.complete(true);
+    runtime.update();
+    EXPECT_TRUE(first_called);
+    EXPECT_TRUE(second_called);
+    for (const auto& asset : first)
+        EXPECT_TRUE(std::empty(runtime.asset_data(asset)));
+}
+
+GTEST_TEST(AssetSystemRuntime, DecompressesAssetsOnUpdate)
+{
+    const TestBundle bundle{ 8, true };
+    for (const auto& info : bundle.infos)
+    {
+        ASSERT_EQ(info.storage_flags(), AssetStorageFlags::lz_blocks);
+        ASSERT_LT(info.packed_size_bytes(), info.unpacked_size_bytes());
+    }
+
+    ManualReader       reader{ bundle.storage };
+    AssetSystemRuntime runtime{ bundle.bundles(), bundle.config(reader) };
+
+    auto          called   = false;
+    const AssetID assets[] = { bundle.ids[0], bundle.ids[3], bundle.ids[7] };
+    runtime.load_asset({ .assets = assets, .callback = [&]() { called = true; } });
+    runtime.update();
+    EXPECT_FALSE(std::empty(reader.pending));
+
+    // without a scheduler the data is unpacked by the update that completes the read
+    reader.complete_all();
+    runtime.update();
+    EXPECT_TRUE(called);
+    for (const auto asset : { 0u, 3u, 7u })
+        _expect_loaded(runtime, bundle, asset);
+}
+
+GTEST_TEST(AssetSystemRuntime, DecompressesAssetsOnTheScheduler)
+{
+    const TestBundle bundle{ 8, true };
+    ManualReader     reader{ bundle.storage };
+    jobs::Scheduler  scheduler{ { .workers = 1 } };
+
+    auto config      = bundle.config(reader);
+    config.scheduler = &scheduler;
+    AssetSystemRuntime runtime{ bundle.bundles(), config };
+
+    auto          visible_called  = false;
+    auto          blocking_called = false;
+    const AssetID visible[]       = { bundle.ids[1], bundle.ids[2] };
+    const AssetID blocking[]      = { bundle.ids[5] };
+    runtime.load_asset({ .assets = visible, .callback = [&]() { visible_called = true; } });
+    runtime.load_asset({ .assets = blocking, .callback = [&]() { blocking_called = true; }, .priority = AssetLoadPriority::blocking });
+    runtime.update();
+
+    reader.complete_all();
+    _update_until(runtime, visible_called);
+    _update_until(runtime, blocking_called);
+    EXPECT_TRUE(visible_called);
+    EXPECT_TRUE(blocking_called);
+    for (const auto asset : { 1u, 2u, 5u })
+        _expect_loaded(runtime, bundle, asset);
+}
+
+GTEST_TEST(AssetSystemRuntime, LandsCorruptedAssetsWithoutData)
+{
+    const TestBundle bundle{ 4, true };
+
+    // a block header larger than the stored data
+    auto corrupted = bundle.storage;
+    std::fill_n(std::begin(corrupted) + static_cast<std::ptrdiff_t>(bundle.infos[1].package_offset_bytes()), 4, std::byte{ 0xff });
+
+    ManualReader       reader{ corrupted };
+    AssetSystemRuntime runtime{ bundle.bundles(), bundle.config(reader) };
+
+    auto          called   = false;
+    const AssetID assets[] = { bundle.ids[0], bundle.ids[1] };
+    runtime.load_asset({ .assets = assets, .callback = [&]() { called = true; } });
+    runtime.update();
+    reader.complete_all();
+    runtime.update();
+
+    EXPECT_TRUE(called);
+    _expect_loaded(runtime, bundle, 0);
+    EXPECT_TRUE(std::empty(runtime.asset_data(bundle.ids[1])));
+}
+
+GTEST_TEST(AssetSystemRuntime, ServesMappedAssetsInPlace)
+{
+    const TestBundle   bundle{ 8 };
+    AssetSystemRuntime runtime{ bundle.bundles(), bundle.mapped_config() };
+
+    // uncompressed assets land within the update that handles the request
+    auto          called   = false;
+    const AssetID assets[] = { bundle.ids[0], bundle.ids[1], bundle.ids[5] };
+    runtime.load_asset({ .assets = assets, .callback = [&]() { called = true; } });
+    runtime.update();
+    EXPECT_TRUE(called);
+    for (const auto asset : { 0u, 1u, 5u })
+        _expect_loaded(runtime, bundle, asset);
+
+    // the views point inside the same mapping of the storage
+    const auto first = runtime.asset_data(bundle.ids[0]).data();
+    EXPECT_EQ(runtime.asset_data(bundle.ids[1]).data(), first + bundle.infos[1].package_offset_bytes());
+    EXPECT_EQ(runtime.asset_data(bundle.ids[5]).data(), first + bundle.infos[5].package_offset_bytes());
+    EXPECT_EQ(runtime.asset_data(runtime.asset_handle(bundle.ids[5])).data(), runtime.asset_data(bundle.ids[5]).data());
+
+    for (const auto& asset : assets)
+        runtime.unload_asset(asset);
+    runtime.update();
+    for (const auto& asset : assets)
+    {
+        EXPECT_TRUE(std::empty(runtime.asset_data(asset)));
+        EXPECT_FALSE(runtime.asset_handle(asset));
+    }
+}
+
+GTEST_TEST(AssetSystemRuntime, KeepsMappingUntilLastAssetIsUnloaded)
+{
+    TestBundle         bundle{ 8 };
+    AssetSystemRuntime runtime{ bundle.bundles(), bundle.mapped_config() };
+
+    const AssetID first[] = { bundle.ids[0], bundle.ids[1] };
+    runtime.load_asset({ .assets = first, .callback = {} });
+    runtime.update();
+    const auto view = runtime.asset_data(bundle.ids[1]);
+
+    runtime.unload_asset(bundle.ids[0]);
+    runtime.update();
+    EXPECT_TRUE(std::empty(runtime.asset_data(bundle.ids[0])));
+    EXPECT_EQ(runtime.asset_data(bundle.ids[1]).data(), view.data());
+    _expect_loaded(runtime, bundle, 1);
+
+    // a loaded asset still references the mapping, that keeps viewing the old file
+    const auto mask = std::byte{ 0xff };
+    bundle.replace_storage(mask);
+    const AssetID second[] = { bundle.ids[2] };
+    runtime.load_asset({ .assets = second, .callback = {} });
+    runtime.update();
+    EXPECT_EQ(runtime.asset_data(bundle.ids[2]).data(), view.data() + _asset_size);
+    _expect_loaded(runtime, bundle, 2);
+
+    // once every asset is unloaded the storage is mapped again
+    runtime.unload_asset(bundle.ids[1]);
+    runtime.unload_asset(bundle.ids[2]);
+    runtime.update();
+    runtime.load_asset({ .assets = second, .callback = {} });
+    runtime.update();
+    _expect_loaded(runtime, bundle, 2, mask);
+}
+
+GTEST_TEST(AssetSystemRuntime, DecompressesMappedAssets)
+{
+    TestBundle         bundle{ 4, true };
+    AssetSystemRuntime runtime{ bundle.bundles(), bundle.mapped_config() };
+
+    auto          called   = false;
+    const AssetID assets[] = { bundle.ids[1], bundle.ids[2] };
+    runtime.load_asset({ .assets = assets, .callback = [&]() { called = true; } });
+    runtime.update();
+    EXPECT_TRUE(called);
+    _expect_loaded(runtime, bundle, 1);
+    _expect_loaded(runtime, bundle, 2);
+
+    // the unpacked data doesn't reference the mapping
+    runtime.unload_asset(bundle.ids[1]);
+    runtime.unload_asset(bundle.ids[2]);
+    runtime.update();
+    const auto mask = std::byte{ 0x0f };
+    bundle.replace_storage(mask);
+    runtime.load_asset({ .assets = assets, .callback = {} });
+    runtime.update();
+    _expect_loaded(runtime, bundle, 1, mask);
+}
+
+GTEST_TEST(AssetSystemRuntime, DropsCancelledMappedCompressedAssets)
+{
+    TestBundle      bundle{ 4, true };
+    jobs::Scheduler scheduler{ { .workers = 1 } };
+
+    auto config      = bundle.mapped_config();
+    config.scheduler = &scheduler;
+    AssetSystemRuntime runtime{ bundle.bundles(), config };
+
+    // the only worker is held, so the decompression is still queued when the request is cancelled
+    std::atomic<bool> open = false;
+    scheduler.submit([&]() {
+        while (!open.load(std::memory_order::acquire))
+            std::this_thread::yield();
+    }, jobs::JobPriority::background);
+
+    auto          called   = false;
+    const AssetID assets[] = { bundle.ids[1] };
+    const auto    id       = runtime.load_asset({ .assets = assets, .callback = [&]() { called = true; } });
+    runtime.update();
+    EXPECT_TRUE(runtime.cancel_load(id));
+
+    // jobs submitted from outside the workers run in order, so this one runs after the decompression
+    std::atomic<bool> unpacked = false;
+    scheduler.submit([&]() { unpacked.store(true, std::memory_order::release); }, jobs::JobPriority::background);
+    open.store(true, std::memory_order::release);
+    while (!unpacked.load(std::memory_order::acquire))
+        std::this_thread::yield();
+
+    runtime.update();
+    EXPECT_FALSE(called);
+    EXPECT_TRUE(std::empty(runtime.asset_data(bundle.ids[1])));
+    EXPECT_FALSE(runtime.asset_handle(bundle.ids[1]));
+
+    // the cancelled asset released the mapping when it landed
+    const auto mask = std::byte{ 0xf0 };
+    bundle.replace_storage(mask);
+    runtime.load_asset({ .assets = assets, .callback = [&]() { called = true; } });
+    _update_until(runtime, called);
+    EXPECT_TRUE(called);
+    _expect_loaded(runtime, bundle, 1, mask);
+}
+
+GTEST_TEST(ProjectDatabase, PacksCompressedBundle)
+{
+    TestProject             project;
+    editor::ProjectContext  context{ project.root };
+    editor::ProjectDatabase db{ context };
+    project.insert(db, _repeated(200'000, 7)); // spans many blocks of the codec
+    project.insert(db, _random(5'000));
+    project.insert(db, _repeated(1'000, 3));
+
+    const AssetBundleID id{ _uuid(0xb1) };
+    const auto          where    = project.root / storage_filename(id);
+    const auto          manifest = db.package_as_single_bundle(where, { .compress = true });
+    ASSERT_EQ(manifest.ids, project.ids);
+    ASSERT_EQ(std::size(manifest.infos), 3u);
+
+    // assets are stored back to back
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < std::size(manifest.infos); ++i)
+    {
+        const auto& info = manifest.infos[i];
+        EXPECT_EQ(info.package_offset_bytes(), offset);
+        EXPECT_EQ(info.unpacked_size_bytes(), std::size(project.assets[i]));
+        offset += info.packed_size_bytes();
+    }
+    EXPECT_EQ(std::filesystem::file_size(where), offset);
+
+    // assets that don't shrink are stored as they are
+    EXPECT_EQ(manifest.infos[0].storage_flags(), AssetStorageFlags::lz_blocks);
+    EXPECT_LT(manifest.infos[0].packed_size_bytes(), manifest.infos[0].unpacked_size_bytes());
+    EXPECT_EQ(manifest.infos[1].storage_flags(), AssetStorageFlags::uncompressed);
+    EXPECT_EQ(manifest.infos[1].packed_size_bytes(), manifest.infos[1].unpacked_size_bytes());
+    EXPECT_EQ(manifest.infos[2].storage_flags(), AssetStorageFlags::lz_blocks);
+
+    const auto storage = _read_file(where);
+    const auto stored  = std::span{ storage }.subspan(manifest.infos[1].package_offset_bytes(), manifest.infos[1].packed_size_bytes());
+    EXPECT_TRUE(std::ranges::equal(stored, project.assets[1]));
+}
+
+GTEST_TEST(ProjectDatabase, LoadsPackedCompressedBundle)
+{
+    TestProject             project;
+    editor::ProjectContext  context{ project.root };
+    editor::ProjectDatabase db{ context };
+    project.insert(db, _repeated(70'000, 5));
+    project.insert(db, _random(3'000));
+    project.insert(db, _repeated(500, 11));
+
+    const AssetBundleID id{ _uuid(0xb2) };
+    const auto          manifest = db.package_as_single_bundle(project.root / storage_filename(id), { .compress = true });
+    std::ofstream{ project.root / manifest_filename(id), std::ios::binary } << manifest;
+
+    const auto   storage = _read_file(project.root / storage_filename(id));
+    ManualReader reader{ storage };
+
+    const AssetSystemRuntime::ConfigArgs config{ .asset_data_directory  = project.root,
+                                                 .bundle_data_directory = project.root,
+                                                 .bundle_meta_directory = project.root,
+                                                 .map_bundle_storage    = false,
+                                                 .reader                = &reader };
+    AssetSystemRuntime runtime{ { .ids = { id }, .names = { "packed" } }, config };
+
+    auto called = false;
+    runtime.load_asset({ .assets = project.ids, .callback = [&]() { called = true; } });
+    runtime.update();
+    reader.complete_all();
+    runtime.update();
+
+    EXPECT_TRUE(called);
+    for (std::size_t i = 0; i < std::size(project.ids); ++i)
+        EXPECT_TRUE(std::ranges::equal(runtime.asset_data(project.ids[i]), project.assets[i]));
+}
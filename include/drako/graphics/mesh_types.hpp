@@ -94,9 +94,9 @@ namespace drako
         explicit Mesh(const MeshMetaInfo& meta,
             std::span<const std::byte>    verts,
             std::span<const std::byte>    index) noexcept
-            : _meta{ meta }
-            , _verts{ std::cbegin(verts), std::cend(verts) }
+            : _verts{ std::cbegin(verts), std::cend(verts) }
             , _index{ std::cbegin(index), std::cend(index) }
+            , _meta{ meta }
         {}
 
         Mesh(const Mesh&) noexcept = default;
@@ -2,10 +2,18 @@
 #ifndef DRAKO_JOBS_API_HPP
 #define DRAKO_JOBS_API_HPP
 
+#include "drako/core/platform.hpp"
+
 #include <atomic>
+#include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <functional>
+#include <new>
+#include <span>
 #include <thread>
+#include <type_traits>
+#include <utility>
 
 namespace drako::jobs
 {
@@ -16,44 +24,85 @@ namespace drako::jobs
 
     // Signature of a function that can be schedule for execution in the job_unit system.
     using JobRoutine  = void (*)(const JobArgs);
-    using JobPriority = uint32_t;
     using JobHandle   = uintptr_t;
 
 
-    /// @brief Standalone unit of work that can be scheduled.
-    using Job = std::function<void()>;
+    /// @brief Ready lane of a job, workers drain higher lanes first.
+    enum class JobPriority : std::uint8_t
+    {
+        critical   = 0, // on the critical path of the frame
+        frame      = 1, // must complete within the frame
+        background = 2, // can span multiple frames, like streaming and decompression
+    };
+
+    /// @brief Number of distinct job priorities.
+    inline constexpr const std::size_t job_priority_levels = 3;
+
 
-    /*
-    class alignas(std::hardware_destructive_interference_size) Job
+    /// @brief Standalone unit of work that can be scheduled.
+    ///
+    /// The callable object is embedded in the job record together with a static
+    /// trampoline, so a job never allocates and fills exactly one cache line.
+    /// The captured state must be trivially copyable, since jobs are copied
+    /// and released without running constructors or destructors.
+    ///
+    class alignas(drako::cache_line_size) Job
     {
+        using _trampoline = void (*)(void*);
+
     public:
-        template <typename... Args, void(JobFunction)(Args...)>
-        explicit constexpr Job(Args... args) noexcept
+        /// @brief Max size in bytes of the state captured by a job.
+        static constexpr const std::size_t max_size =
+            drako::cache_line_size - sizeof(_trampoline);
+
+        /// @brief Constructs a job that invokes a callable object.
+        ///
+        /// @note Fails to compile if the callable object doesn't fit in the job record.
+        ///
+        template <typename Fn> // clang-format off
+        requires (!std::is_same_v<std::remove_cvref_t<Fn>, Job>) && std::is_invocable_v<std::decay_t<Fn>&>
+        Job(Fn&& fn) noexcept // clang-format on
         {
-            static_assert(sizeof(Args...) <= sizeof(_args) "Not enough space to embed arguments locally.");
+            using _callable = std::decay_t<Fn>;
+            static_assert(sizeof(_callable) <= sizeof(_args),
+                "Not enough space to embed arguments locally.");
+            static_assert(alignof(_callable) <= alignof(std::max_align_t),
+                "Alignment of the arguments not supported.");
+            static_assert(std::is_trivially_copyable_v<_callable> && std::is_trivially_destructible_v<_callable>,
+                "Arguments must be trivially copyable and destructible.");
 
-            _args = std::make_tuple(args);
-            _call = &_wrap<Args..., JobFunction>;
+            ::new (static_cast<void*>(_args)) _callable(std::forward<Fn>(fn));
+            _call = &_wrap<_callable>;
+        }
+
+        /// @brief Constructs a job that invokes a function with a copy of the arguments.
+        template <typename... Params, typename... Args> // clang-format off
+        requires (sizeof...(Args) > 0)
+        explicit Job(void (*fn)(Params...), Args&&... args) noexcept // clang-format on
+            : Job{ [fn, ... a = std::forward<Args>(args)]() { fn(a...); } }
+        {
         }
 
+        /// @brief Executes the job.
+        void operator()() noexcept { _call(_args); }
+
     private:
-        std::byte  _args[std::hardware_constructive_interference_size - (sizeof(JobRoutine) + sizeof(JobChain*))];
-        JobChain*  _dependencies;
-        JobRoutine _call;
+        alignas(std::max_align_t) std::byte _args[max_size];
+        _trampoline _call;
 
-        // unified wrapper for scheduled job_unit function.
-        template <typename... Args, void(JobFunction)(Args...)>
-        static void _wrap(const JobArgs args) noexcept
+        // unified wrapper for scheduled job functions
+        template <typename Fn>
+        static void _wrap(void* args) noexcept
         {
-            auto unpacked_args = static_cast<std::tuple<Args...>>(args.packed_args);
-            std::apply(JobFunction, unpacked_args);
+            std::invoke(*std::launder(static_cast<Fn*>(args)));
         }
     };
-    static_assert(sizeof(Job) == std::hardware_constructive_interference_size,
+    static_assert(sizeof(Job) == drako::cache_line_size,
         "Bad class layout: cache page size not mantained.");
-    static_assert(alignof(Job) >= std::hardware_destructive_interference_size,
+    static_assert(alignof(Job) >= drako::cache_line_size,
         "Bad class layout: cache page alignment not mantained.");
-        */
+    static_assert(std::is_trivially_copyable_v<Job>,
+        "Bad class layout: jobs must be copied without side effects.");
 
 
     // Runtime state of a job_unit instance.
@@ -66,21 +115,57 @@ namespace drako::jobs
 
     // Runtime scheduler dependencies of a job_unit instance.
     //
+    // Counts the predecessors that still have to complete before the job can run,
+    // and lists the successors that must be released once the job completes.
+    //
     class JobChain
     {
-        explicit constexpr JobChain(uint32_t counter) noexcept
-            : _counter(counter), _dependencies()
+    public:
+        /// @brief Max number of successors of a single job.
+        static constexpr const std::size_t max_successors = 8;
+
+        explicit constexpr JobChain(std::uint32_t counter) noexcept
+            : _counter{ counter }, _size{ 0 }, _successors{}
         {
         }
 
-        constexpr JobChain(const JobChain&) noexcept;
-        constexpr JobChain& operator=(const JobChain&) noexcept;
+        JobChain(const JobChain&) = delete;
+        JobChain& operator=(const JobChain&) = delete;
 
-        void set_dependency(const JobHandle h) noexcept;
+        /// @brief Adds a successor that is released when the job completes.
+        ///
+        /// @return Returns false if the list of successors is full.
+        ///
+        [[nodiscard]] bool set_dependency(const JobHandle h) noexcept
+        {
+            if (_size == max_successors)
+                return false;
+            _successors[_size++] = h;
+            return true;
+        }
+
+        /// @brief Registers an additional predecessor.
+        void acquire() noexcept { _counter.fetch_add(1, std::memory_order::relaxed); }
+
+        /// @brief Registers the completion of a predecessor.
+        ///
+        /// @return Returns true if it was the last predecessor.
+        ///
+        [[nodiscard]] bool release() noexcept
+        {
+            return _counter.fetch_sub(1, std::memory_order::acq_rel) == 1;
+        }
+
+        /// @brief Successors of the job.
+        [[nodiscard]] std::span<const JobHandle> successors() const noexcept
+        {
+            return { _successors, _size };
+        }
 
     private:
-        std::atomic<uint32_t> _counter = 0;
-        JobHandle             _dependencies[8];
+        std::atomic<std::uint32_t> _counter; // unfinished predecessors
+        std::uint32_t              _size;
+        JobHandle                  _successors[max_successors];
     };
 
 
@@ -89,21 +174,89 @@ namespace drako::jobs
     {
     };
 
+
+    /// @brief Intrusive node of the list of entities suspended on an Event.
     struct Waiter
     {
+        using Callback = void (*)(Waiter*) noexcept;
+
+        Callback resume = nullptr; // invoked when the event is signalled
+        Waiter*  next   = nullptr;
     };
 
+
     // Synchronizes the execution of different jobs.
     //
+    // The event is signalled once its counter drops to zero,
+    // at that point all the registered waiters are resumed.
+    //
+    // The event is reported ready only by the last write of signal(),
+    // so a waiter can destroy it as soon as it observes it ready.
+    //
     class Event
     {
-        explicit constexpr Event(std::int32_t count) noexcept;
+    public:
+        /// @brief Constructs an event that requires a number of signals.
+        explicit Event(std::int32_t count) noexcept
+            : _counter{ count }, _waiters{ (count > 0) ? nullptr : _closed() }
+        {
+            assert(count >= 0);
+        }
+
+        Event(const Event&) = delete;
+        Event& operator=(const Event&) = delete;
 
-        void signal() noexcept;
+        /// @brief Decrements the counter, resuming the waiters when it reaches zero.
+        void signal() noexcept
+        {
+            const auto prev = _counter.fetch_sub(1, std::memory_order::acq_rel);
+            assert(prev > 0); // signalled too many times
+            if (prev != 1)
+                return;
+
+            // publishes the signal, no member can be touched after this point
+            auto w = _waiters.exchange(_closed(), std::memory_order::acq_rel);
+            while (w)
+            {
+                const auto next = w->next; // resume can release the waiter
+                w->resume(w);
+                w = next;
+            }
+        }
+
+        /// @brief Checks whether the event has been signalled.
+        [[nodiscard]] bool ready() const noexcept
+        {
+            return _waiters.load(std::memory_order::acquire) == _closed();
+        }
+
+        /// @brief Registers a waiter to be resumed when the event is signalled.
+        ///
+        /// @return Returns false if the event was already signalled,
+        ///         in which case the waiter isn't registered.
+        ///
+        [[nodiscard]] bool enlist(Waiter* w) noexcept
+        {
+            assert(w && w->resume);
+            auto head = _waiters.load(std::memory_order::acquire);
+            do
+            {
+                if (head == _closed())
+                    return false;
+                w->next = head;
+            } while (!_waiters.compare_exchange_weak(head, w,
+                std::memory_order::release, std::memory_order::acquire));
+            return true;
+        }
 
     private:
         std::atomic<std::int32_t> _counter;
-        Waiter                    _waiters[10];
+        std::atomic<Waiter*>      _waiters; // resumed on signal
+
+        inline static Waiter _sentinel{};
+
+        // marks the list of an event that has already been signalled
+        [[nodiscard]] static Waiter* _closed() noexcept { return &_sentinel; }
     };
 } // namespace drako::jobs
 
@@ -7,192 +7,447 @@
 // @author  Grassi Edoardo
 //
 
+#include "drako/concurrency/idle_strategy.hpp"
 #include "drako/concurrency/lockfree_dequeue.hpp"
-#include "drako/concurrency/lockfree_pool_allocator.hpp"
-#include "drako/concurrency/lockfree_ringbuffer.hpp"
+#include "drako/concurrency/lockfree_linear_allocator.hpp"
+#include "drako/concurrency/lockfree_mrmwqueue.hpp"
+#include "drako/concurrency/lockfree_priority_queue.hpp"
+#include "drako/concurrency/thread_context.hpp"
+#include "drako/core/platform.hpp"
 #include "drako/jobs/job_api.hpp"
+#include "drako/jobs/job_trace.hpp"
+#include "drako/system/system_info.hpp"
 
+#include <array>
 #include <atomic>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <stdexcept>
 #include <thread>
+#include <type_traits>
+#include <vector>
 
 namespace drako::jobs
 {
     using WorkerHandle = std::uint32_t;
 
-
-    /// @brief Executes units of work from a service queue.
-    class Worker
+    namespace this_worker
     {
-    public:
-        explicit Worker(std::size_t stack_size, std::size_t heap_size) noexcept;
-        ~Worker() noexcept;
-
-        Worker(Worker const&) = delete;
-        Worker& operator=(Worker const&) = delete;
-
-        // Removes a job_unit from the local work queue.
-        bool steal() noexcept;
-
-
-    private:
-        //local_queue          _work_queue;
-        //local_allocator_type _local_heap;
-        std::atomic_flag _done;
+        /// @brief Allocates memory that lives until the end of the frame.
+        ///
+        /// Uses the frame arena of the worker executing the calling job, or
+        /// the shared arena of its scheduler when that one is exhausted.
+        /// The memory is freed by Scheduler::reset_frame().
+        ///
+        /// @pre Called by a job of a scheduler.
+        ///
+        /// @retval nullptr Both arenas are exhausted.
+        ///
+        [[nodiscard]] void* frame_alloc(std::size_t bytes, std::size_t align = alignof(std::max_align_t)) noexcept;
+
+        /// @brief Allocates an uninitialized array that lives until the end of the frame.
+        ///
+        /// @retval nullptr Both arenas are exhausted.
+        ///
+        template <typename T> // clang-format off
+        requires std::is_trivially_default_constructible_v<T> && std::is_trivially_destructible_v<T>
+        [[nodiscard]] T* frame_alloc(std::size_t count) noexcept // clang-format on
+        {
+            assert(count > 0);
+            if (count > SIZE_MAX / sizeof(T))
+                return nullptr;
+            return static_cast<T*>(frame_alloc(count * sizeof(T), alignof(T)));
+        }
+    } // namespace this_worker
 
-        void execute() noexcept;
-    };
 
     /// @brief Distributes jobs between a pool of workers.
+    ///
+    /// Each worker owns a work-stealing queue: jobs submitted from inside a job
+    /// are pushed on the local queue of the executing worker, while jobs submitted
+    /// from external threads go through a shared lock-free injection queue.
+    /// Idle workers steal from the local queues of randomly selected victims.
+    ///
+    /// Every queue has a lane for each JobPriority: workers drain higher lanes
+    /// first, and visit the lower ones at a bounded rate to avoid starvation.
+    /// Each lane is drained from both the local and the shared queue before
+    /// moving to a lower one.
+    ///
+    /// Workers that run out of jobs spin, yield and finally park until a new
+    /// submission wakes one of them up.
+    ///
+    /// Job records are recycled through per-worker caches, so steady state
+    /// submissions don't touch the heap.
+    ///
+    /// Workers execute jobs on pooled fibers: a job that waits for an event
+    /// suspends its fiber and the worker moves to another fiber of the pool,
+    /// so it keeps executing ready jobs instead of blocking.
+    ///
+    /// Each worker owns a linear arena for the transient allocations of the
+    /// frame, backed by a lock-free arena shared by the whole scheduler.
+    /// Both are freed at once by reset_frame().
+    ///
+    /// Execution, steal, park and dependency events are recorded by the
+    /// trace module when it's compiled in, see job_trace.hpp.
+    ///
     class Scheduler
     {
     public:
-        explicit Scheduler()
-            : _waiters{}, _events{}
-        {
-            for (auto i = 0; i < std::size(_workers); ++i)
-                _workers[i] = std::thread{ _run, std::ref(_queues[i]), std::ref(_done) };
-        }
+        /// @brief Max number of events a single job can wait for.
+        static constexpr const std::size_t max_event_predecessors = 4;
 
-        Scheduler(const Scheduler&) = delete;
-        Scheduler& operator=(const Scheduler&) = delete;
-
-        // @brief   Schedules a job_unit.
-        //
-        void kick(const Job& j) noexcept
+        struct Args
         {
-            schedule(j);
-        }
+            /// @brief Number of worker threads (0 selects the hardware concurrency).
+            std::size_t workers = 0;
 
-        // @brief   Schedules a job_unit.
-        //
-        // Schedules a standalone job_unit, if possible on the hinted worker.
-        //
-        void kick(const Job& j, WorkerHandle hint) noexcept;
+            /// @brief Capacity of each priority lane of the local queue of each worker.
+            std::size_t queue_size = 4096;
 
-        // Schedules a group of standalone jobs.
-        void kick_parallel(const Job jobs[], std::size_t count) noexcept;
+            /// @brief Capacity of each priority lane of the queue shared by external threads.
+            std::size_t shared_queue_size = 16384;
 
-        void kick_sequential() noexcept;
+            /// @brief Jobs taken by a thread between two visits of the lower priority lanes.
+            std::uint32_t fairness = 32;
 
-        // @brief   Waits for another job_unit to terminate.
-        //
-        // Suspends executing job_unit until another job_unit completes.
-        //
-        void wait_for(JobState* context, const JobHandle h) noexcept;
+            /// @brief Number of pooled fibers (0 disables the suspension of jobs).
+            std::size_t fibers = 128;
 
-        // @brief   Waits for a job_unit to terminate.
-        //
-        // Suspends the executing until one of the specified jobs completes.
-        //
-        void wait_for_any(const JobHandle ctx, const JobHandle jobs[], std::size_t count) noexcept;
+            /// @brief Stack size of each fiber.
+            std::size_t fiber_stack_size = thread_context::default_stack_size;
 
-        // @brief   Waits for a group of job_unit to terminate.
-        //
-        // Suspends the executing job_unit until all the specified jobs completes.
-        //
-        void wait_for_all(const JobHandle ctx, const JobHandle jobs[], std::size_t count) noexcept;
+            /// @brief Backoff of the workers that ran out of jobs.
+            IdleStrategy::Args idle = {};
 
+            /// @brief Byte size of the frame arena of each worker.
+            std::size_t frame_arena_size = 256 * 1024;
 
+            /// @brief Byte size of the frame arena shared by all threads, used when
+            ///        the arena of a worker is exhausted or by external threads.
+            std::size_t shared_frame_arena_size = 1024 * 1024;
 
-        void submit(const Job& j) noexcept;
-        void submit(const Job& j, Event& signal) noexcept;
-        void submit(Event& wait, const Job& j) noexcept;
-        void submit(Event& wait, const Job& j, Event& signal) noexcept;
+            /// @brief Binds each worker to a distinct physical core.
+            ///
+            /// Workers are spread over the physical cores grouped by NUMA node, and
+            /// only share a core when they outnumber them. With 0 workers, one worker
+            /// per physical core is created. Idle workers steal from the workers
+            /// of their own node first, and frame arenas are placed in node memory.
+            ///
+            bool pin_workers = false;
+        };
 
+        explicit Scheduler();
+        explicit Scheduler(const Args& args);
+        ~Scheduler() noexcept;
 
-        void create_event(std::int32_t init) noexcept;
-        void destroy_event() noexcept;
+        Scheduler(const Scheduler&) = delete;
+        Scheduler& operator=(const Scheduler&) = delete;
+
+        // @brief   Schedules a job_unit.
+        //
+        void kick(const Job& j) { submit(j); }
+
+        /// @brief Waits for an event to be signalled.
+        ///
+        /// A job running on a worker is suspended until the event is signalled,
+        /// while the worker moves on to other jobs. Other threads, or workers
+        /// that ran out of fibers, execute other jobs while waiting.
+        ///
+        void wait_for(Event& e) noexcept;
+
+        /// @brief Waits for any of the events to be signalled.
+        ///
+        /// The calling thread executes other jobs while waiting.
+        ///
+        /// @return Index of the first signalled event.
+        ///
+        std::size_t wait_for_any(Event* const events[], std::size_t count) noexcept;
+
+        /// @brief Waits for all the events to be signalled.
+        void wait_for_all(Event* const events[], std::size_t count) noexcept;
+
+
+        /// @brief Schedules a standalone job.
+        void submit(const Job& j, JobPriority p = JobPriority::frame);
+
+        /// @brief Schedules a job that signals an event on completion.
+        void submit(const Job& j, Event& signal, JobPriority p = JobPriority::frame);
+
+        /// @brief Schedules a job that starts after an event is signalled.
+        void submit(Event& wait, const Job& j, JobPriority p = JobPriority::frame);
+
+        /// @brief Schedules a job that starts after an event is signalled
+        ///        and signals another event on completion.
+        void submit(Event& wait, const Job& j, Event& signal, JobPriority p = JobPriority::frame);
+
+
+        /// @brief Creates a job that is not eligible for execution until submitted.
+        ///
+        /// The returned handle is valid until the job is submitted.
+        ///
+        [[nodiscard]] JobHandle create(const Job& j, JobPriority p = JobPriority::frame);
+
+        /// @brief Creates a job that signals an event on completion.
+        [[nodiscard]] JobHandle create(const Job& j, Event& signal, JobPriority p = JobPriority::frame);
+
+        /// @brief Declares that a job can start only after another one completed.
+        ///
+        /// @param[in] first Predecessor job, not yet submitted.
+        /// @param[in] then  Successor job, not yet submitted.
+        ///
+        /// @throw std::length_error if @p first already has JobChain::max_successors successors.
+        ///
+        void precede(JobHandle first, JobHandle then);
+
+        /// @brief Declares that a job can start only after an event is signalled.
+        ///
+        /// @param[in] wait Event to wait for.
+        /// @param[in] then Successor job, not yet submitted.
+        ///
+        /// @throw std::length_error if @p then already waits for max_event_predecessors events.
+        ///
+        void precede(Event& wait, JobHandle then);
+
+        /// @brief Makes a created job eligible for execution.
+        ///
+        /// The job is pushed to a ready queue as soon as all its predecessors completed.
+        ///
+        void submit(JobHandle h) noexcept;
+
+        /// @brief Checks whether the calling thread is a worker of this scheduler.
+        [[nodiscard]] bool is_worker_thread() const noexcept;
+
+        /// @brief Checks whether the local queue of the calling worker holds jobs
+        ///        that haven't been stolen yet.
+        ///
+        /// Always false on threads that aren't workers of this scheduler.
+        ///
+        [[nodiscard]] bool local_work_pending() const noexcept;
+
+        /// @brief Number of worker threads.
+        [[nodiscard]] std::size_t size() const noexcept { return std::size(_workers); }
+
+        /// @brief Counters of the idle events of the workers.
+        [[nodiscard]] IdleStrategy::Stats idle_stats() const noexcept { return _parking.stats(); }
+
+
+        /// @brief Allocates memory that lives until the end of the frame.
+        ///
+        /// Workers of this scheduler allocate from their own arena, other threads
+        /// and workers whose arena is exhausted from the shared one.
+        ///
+        /// @retval nullptr Both arenas are exhausted.
+        ///
+        [[nodiscard]] void* frame_alloc(std::size_t bytes, std::size_t align = alignof(std::max_align_t)) noexcept;
+
+        /// @brief Frees all the memory allocated with frame_alloc().
+        ///
+        /// Workers reset their arena lazily, at their first allocation after the call.
+        ///
+        /// @pre The memory allocated since the previous call is not used anymore.
+        ///
+        void reset_frame() noexcept;
+
+        /// @brief Bytes taken from the shared frame arena since the last reset.
+        ///
+        /// Nonzero values in steady state mean that the arenas of the workers are too small.
+        ///
+        [[nodiscard]] std::size_t shared_frame_usage() const noexcept { return _shared_arena.size(); }
 
     private:
-        struct alignas(std::hardware_destructive_interference_size) _work
+        friend void* this_worker::frame_alloc(std::size_t, std::size_t) noexcept;
+
+        struct _work;
+
+        // node that enlists a job in the waiters of one of the events it depends on
+        struct _event_link : Waiter
+        {
+            explicit _event_link() noexcept
+                : Waiter{ .resume = &Scheduler::_resume } {}
+
+            _work* work = nullptr;
+        };
+
+        struct _work
         {
-            Job    job;
-            Event* signal = nullptr;
+            explicit _work(Scheduler& s, const Job& j, Event* e, JobPriority p)
+                : owner{ s }, job{ j }, chain{ 1 }, signal{ e }, priority{ p } {}
+
+            Scheduler&  owner;
+            Job         job;
+            JobChain    chain;  // counts the submission as an implicit predecessor
+            Event*      signal; // signalled on completion
+            JobPriority priority;
+
+            // each event keeps its own waiter list, so each dependency needs a distinct node
+            std::uint8_t                                    event_count = 0;
+            std::array<_event_link, max_event_predecessors> events;
         };
-        //static_assert(sizeof(_work) <= std::hardware_constructive_interference_size,
-        //    "Bad class layout: can't fit inside a single cache page.");
-        static_assert(sizeof(_work) >= std::hardware_constructive_interference_size,
-            "Bad class layout: wasted space inside cache page.");
-        static_assert(alignof(_work) >= std::hardware_destructive_interference_size,
-            "Bad class layout: cache page alignment not mantained.");
-
-        struct _waiter
+
+        struct _fiber : Waiter
         {
-            Job                 job;
-            std::atomic_int32_t count;
+            explicit _fiber(Scheduler& s, std::size_t stack_size)
+                : Waiter{ .resume = &Scheduler::_resume_fiber }, owner{ s }, context{ &Scheduler::_fiber_main, stack_size, this } {}
+
+            Scheduler&     owner;
+            thread_context context;
         };
-        using _queue = lockfree::SRSWQueue<_work>;
 
-        struct _event
+        // deferred to the fiber that is resumed, so that the suspended one is
+        // published only after its registers have been saved
+        struct _switch_action
         {
-            std::atomic_int32_t counter;
+            _fiber* recycle = nullptr; // returns to the pool
+            _fiber* suspend = nullptr; // waits for the event
+            Event*  event   = nullptr;
         };
 
-        lockfree::StaticPool<_waiter, 100> _waiters;
-        lockfree::StaticPool<Event, 100>   _events;
-        std::thread                        _workers[4];
-        lockfree::SRSWQueue<_work>         _queues[4];
-        std::atomic_flag                   _done;
+        using _queue = lockfree::PriorityDEQueue<_work*, job_priority_levels>;
+        using _lanes = std::array<std::unique_ptr<lockfree::MRMWQueue<_work*>>, job_priority_levels>;
+
+        using _shared_frame_arena = concurrency::lockfree_linear_allocator;
 
-        void schedule(const Job& j) noexcept;
+        // bounds the records cached by each worker, the excess is shared through _spare
+        static constexpr const std::size_t _cache_size = 256;
 
-        _waiter* _make_waiter(const Job& j, std::int32_t counter) noexcept
+        // linear allocator touched only by the owning worker, so it needs no atomics
+        struct _frame_arena
         {
-            using _alty = std::allocator_traits<decltype(_waiters)>;
-            auto p      = _alty::allocate(_waiters, 1);
-            _alty::construct(_waiters, p, j, counter);
-            return p;
-        }
+            std::unique_ptr<std::byte[]> buffer;
+            std::size_t                  capacity = 0;
+            std::size_t                  offset   = 0; // first byte of unallocated memory
+            std::uint64_t                frame    = 0; // frame of the allocations, older ones are reset
+
+            [[nodiscard]] void* allocate(std::size_t bytes, std::size_t align) noexcept;
+        };
 
-        void decrement(_waiter* w) noexcept
+        struct alignas(drako::cache_line_size) _worker
         {
-            assert(w);
-            if (const auto prev = w->count.fetch_sub(1); prev == 1)
-            {
-                schedule(w->job);
-                std::allocator_traits<decltype(_waiters)>::destroy(_waiters, w);
-            }
-        }
+            explicit _worker(Scheduler& s, std::size_t queue_size, std::uint32_t fairness, std::uint_fast32_t seed)
+                : owner{ s }, queue{ queue_size, fairness }, rng{ seed } {}
+
+            Scheduler&       owner;
+            _queue           queue; // local work, stolen by other workers
+            std::minstd_rand rng;          // victim selection
+            _frame_arena     arena;        // transient allocations of the running jobs
+            std::uint32_t    removals = 0; // drives the visits of the lower lanes
+
+            std::optional<sys::native_cpu_core> cpu;      // processor the worker is bound to
+            std::uint32_t                       node = 0; // NUMA node of the processor
+
+            std::vector<_work*>           cache;   // released records, reused by local submissions
+            std::optional<thread_context> root;    // context of the worker thread
+            _fiber*                       current; // fiber running on the worker
+            _switch_action                action;  // pending after a switch
+        };
 
-        //void decrement()
+        std::vector<std::unique_ptr<_worker>> _locals;
+        std::vector<std::thread>              _workers;
+        _lanes                                _global;              // work submitted from external threads
+        const std::uint32_t                   _fairness;            // removals between two visits of the lower lanes
+        std::atomic<std::uint32_t>            _global_removals = 0; // visits of the lower lanes by external threads
+        std::mutex                            _global_lock;         // guards _spare, _idle and _resumed
+        std::vector<_work*>                   _spare;               // released records shared between threads
+        std::vector<std::unique_ptr<_fiber>>  _fibers;
+        std::vector<_fiber*>                  _idle;    // fibers ready to run the scheduling loop
+        std::deque<_fiber*>                   _resumed; // suspended fibers whose event was signalled
+        std::atomic<std::size_t>              _resumed_count = 0; // lock free hint of the size of _resumed
+        IdleStrategy                          _parking; // workers sleep here when out of jobs
+        std::atomic_flag                      _done;
+        bool                                  _node_stealing = false; // workers span multiple NUMA nodes
+        std::atomic<std::uint64_t>            _frame = 0;    // incremented by each reset of the arenas
+        _shared_frame_arena                   _shared_arena; // frame allocations that don't fit a worker arena
+
+        // worker state of the calling thread, never cached across a fiber switch
+        [[nodiscard]] static _worker*& _this_worker() noexcept;
+
+        // scheduler of the job executed by a thread that isn't one of its workers
+        [[nodiscard]] static Scheduler*& _this_helped() noexcept;
+
+        [[nodiscard]] _work* _allocate(const Job& j, Event* signal, JobPriority p);
+        void _recycle(_work* w) noexcept;
+
+        void _schedule(_work* w) noexcept;
+
+        [[nodiscard]] _work* _find_work(_worker* local) noexcept;
+        [[nodiscard]] _work* _steal(std::minstd_rand& rng, const _worker* thief) noexcept;
+        [[nodiscard]] _fiber* _pop_idle() noexcept;
+        [[nodiscard]] _fiber* _pop_resumed() noexcept;
+        [[nodiscard]] bool    _work_available() const noexcept;
+
+        void _release(_work* w) noexcept;
+        void _execute(_work* w) noexcept;
+        void _help() noexcept;
+
+        void _loop() noexcept;
+        void _switch(_worker& local, _fiber* next, const _switch_action& a) noexcept;
+        void _complete_switch() noexcept;
+
+        static void _resume(Waiter* w) noexcept;
+        static void _resume_fiber(Waiter* w) noexcept;
+        static void DRAKO_API_STDCALL _fiber_main(void* args) noexcept;
+
+        [[nodiscard]] static _work* _from_handle(JobHandle h) noexcept
+        {
+            assert(h);
+            return reinterpret_cast<_work*>(h);
+        }
 
-        static void _run(_queue& q, std::atomic_flag& done) noexcept
+        // jobs are identified by their record in traces, it's unique while the job is alive
+        [[nodiscard]] static std::uint64_t _trace_id(const void* p) noexcept
         {
-            while (!done.test(std::memory_order::acquire))
-            {
-                while (const auto item = q.pop())
-                {
-                    const auto& work = item.value();
-                    std::invoke(work.job);
-
-                    if (work.signal)
-                    {
-                        // TODO: send signal to waiters
-                    }
-                }
-            }
+            return reinterpret_cast<std::uintptr_t>(p);
         }
+
+        void _run(std::size_t index) noexcept;
     };
 
 
-    inline void Scheduler::submit(const Job& j) noexcept
+    inline void Scheduler::submit(const Job& j, JobPriority p)
+    {
+        submit(create(j, p));
+    }
+
+    inline void Scheduler::submit(const Job& j, Event& signal, JobPriority p)
     {
-        const _work w{ .job = j };
-        const auto  worker = 0;
-        assert(_queues[worker].push(w));
+        submit(create(j, signal, p));
     }
 
-    inline void Scheduler::submit(const Job& j, Event& signal) noexcept
+    inline void Scheduler::submit(Event& wait, const Job& j, JobPriority p)
     {
-        const _work w{ .job = j, .signal = std::addressof(signal) };
-        const auto  worker = 0;
-        assert(_queues[worker].push(w));
+        const auto h = create(j, p);
+        precede(wait, h);
+        submit(h);
     }
 
-    //inline void Scheduler::submit(Event& wait, const Job& j) noexcept
+    inline void Scheduler::submit(Event& wait, const Job& j, Event& signal, JobPriority p)
+    {
+        const auto h = create(j, signal, p);
+        precede(wait, h);
+        submit(h);
+    }
 
+    inline JobHandle Scheduler::create(const Job& j, JobPriority p)
+    {
+        return reinterpret_cast<JobHandle>(_allocate(j, nullptr, p));
+    }
+
+    inline JobHandle Scheduler::create(const Job& j, Event& signal, JobPriority p)
+    {
+        return reinterpret_cast<JobHandle>(_allocate(j, &signal, p));
+    }
+
+    inline void Scheduler::submit(JobHandle h) noexcept
+    {
+        _release(_from_handle(h));
+    }
 
 } // namespace drako::jobs
 
-#endif // !DRAKO_JOB_SYSTEM_HPP
\ No newline at end of file
+#endif // !DRAKO_JOB_SYSTEM_HPP
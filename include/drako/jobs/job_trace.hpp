@@ -0,0 +1,131 @@
+#pragma once
+#ifndef DRAKO_JOBS_TRACE_HPP
+#define DRAKO_JOBS_TRACE_HPP
+
+/// @file
+/// @brief  Low overhead recording of the scheduler activity.
+/// @author Grassi Edoardo
+///
+/// Each thread appends events to its own ring buffer, so recording takes no
+/// locks and never allocates after the first event of a thread. Buffers are
+/// exported on demand in the Chrome trace event format, which can be opened
+/// by chrome://tracing and Perfetto.
+///
+/// Tracing is compiled in when DRAKO_JOBS_TRACING is nonzero. Otherwise all
+/// recording sites compile to nothing and the export writes an empty trace.
+
+#include "drako/core/compiler.hpp"
+#include "drako/core/platform.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iosfwd>
+#include <string_view>
+
+#if !defined(DRAKO_JOBS_TRACING)
+#define DRAKO_JOBS_TRACING 0
+#endif
+
+#if DRAKO_JOBS_TRACING
+#if defined(DRAKO_CC_MSVC) && defined(DRAKO_ARCH_X64)
+#include <intrin.h>
+#elif (defined(DRAKO_CC_GCC) || defined(DRAKO_CC_CLANG)) && defined(DRAKO_ARCH_X64)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+#endif
+
+namespace drako::jobs::trace
+{
+    /// @brief Kind of a recorded event.
+    enum class EventType : std::uint8_t
+    {
+        job_begin,   // a thread starts a job, id: job, arg: priority
+        job_end,     // a job completed, id: job
+        job_suspend, // the innermost job of the thread waits on its fiber, id: fiber
+        job_resume,  // a suspended fiber continues, possibly on another thread, id: fiber
+        release,     // a completed job or signalled event released a dependent job, id: released job
+        steal,       // a job was taken from another worker, id: job, arg: victim worker
+        park,        // the thread ran out of jobs and starts waiting
+        unpark,      // the thread found work or was woken up
+    };
+
+    /// @brief Tracing is compiled in.
+    inline constexpr const bool compiled = DRAKO_JOBS_TRACING != 0;
+
+    /// @brief Default capacity of the buffer of each thread, in events.
+    inline constexpr const std::size_t default_buffer_size = 16384;
+
+
+    /// @brief Starts recording events.
+    ///
+    /// Discards the events recorded before the call. Threads that record their
+    /// first event after the call keep the last @p buffer_size events.
+    ///
+    void start(std::size_t buffer_size = default_buffer_size);
+
+    /// @brief Stops recording events, the recorded ones can still be exported.
+    void stop() noexcept;
+
+    /// @brief Checks whether events are being recorded.
+    [[nodiscard]] bool is_recording() noexcept;
+
+    /// @brief Names the calling thread in the exported traces.
+    ///
+    /// Named threads are exported even when they recorded no event.
+    ///
+    void name_this_thread(std::string_view name);
+
+    /// @brief Writes the recorded events as a Chrome trace JSON document,
+    ///        then discards them.
+    ///
+    /// Can be called while recording: events written concurrently may be
+    /// left out of the current export.
+    ///
+    void write(std::ostream& out);
+
+    /// @brief Writes the recorded events to a Chrome trace JSON file, then discards them.
+    ///
+    /// @throw std::runtime_error if the file can't be written.
+    ///
+    void flush(const std::filesystem::path& file);
+
+
+    namespace _detail
+    {
+        extern std::atomic<bool> recording;
+
+        // appends an event to the buffer of the calling thread
+        DRAKO_NOINLINE void record(EventType type, std::uint64_t id, std::uint64_t arg) noexcept;
+
+        [[nodiscard]] inline std::uint64_t timestamp() noexcept
+        {
+#if DRAKO_JOBS_TRACING && defined(DRAKO_ARCH_X64)
+            return __rdtsc();
+#elif DRAKO_JOBS_TRACING
+            return static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#else
+            return 0;
+#endif
+        }
+    } // namespace _detail
+
+    /// @brief Records an event when recording is active.
+    inline void record(EventType type, std::uint64_t id = 0, std::uint64_t arg = 0) noexcept
+    {
+        if (_detail::recording.load(std::memory_order::relaxed))
+            [[unlikely]] _detail::record(type, id, arg);
+    }
+
+} // namespace drako::jobs::trace
+
+#if DRAKO_JOBS_TRACING
+#define DRAKO_JOBS_TRACE(...) ::drako::jobs::trace::record(__VA_ARGS__)
+#else
+#define DRAKO_JOBS_TRACE(...) static_cast<void>(0)
+#endif
+
+#endif // !DRAKO_JOBS_TRACE_HPP
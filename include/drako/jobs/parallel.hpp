@@ -0,0 +1,196 @@
+#pragma once
+#ifndef DRAKO_JOBS_PARALLEL_HPP
+#define DRAKO_JOBS_PARALLEL_HPP
+
+/// @file
+/// @brief  Data parallel algorithms built on the job scheduler.
+/// @author Grassi Edoardo
+///
+/// Ranges are split lazily: a job halves its range only while the local queue
+/// of its worker is empty, that is when the previously spawned halves have been
+/// stolen by idle workers. The remaining work is processed in grain sized pieces,
+/// so the number of jobs follows the actual demand instead of the range size.
+
+#include "drako/jobs/job_api.hpp"
+#include "drako/jobs/job_system.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <type_traits>
+
+namespace drako::jobs
+{
+    namespace _detail
+    {
+        // state shared by all the jobs of a parallel algorithm, lives on the caller stack
+        struct _parallel_state
+        {
+            explicit _parallel_state(Scheduler& s, std::size_t g) noexcept
+                : scheduler{ s }, grain{ std::max<std::size_t>(g, 1) }, pending{ 1 }, done{ 1 } {}
+
+            Scheduler&               scheduler;
+            const std::size_t        grain;   // min number of indices processed by a job
+            std::atomic<std::size_t> pending; // running jobs, including the root one
+            Event                    done;    // signalled when the last job completes
+
+            void complete() noexcept
+            {
+                if (pending.fetch_sub(1, std::memory_order::acq_rel) == 1)
+                    done.signal();
+            }
+        };
+
+        // processes [first, last) in grain sized pieces, spawning halves of the range on demand
+        template <typename State, std::integral I, typename Piece>
+        void _split(State* state, I first, I last, Piece&& piece) noexcept
+        {
+            auto& s = state->scheduler;
+            while (first != last)
+            {
+                const auto count = static_cast<std::size_t>(last - first);
+                if (count > state->grain && !s.local_work_pending())
+                {
+                    const auto mid = static_cast<I>(first + static_cast<I>(count / 2));
+                    state->pending.fetch_add(1, std::memory_order::relaxed);
+                    s.submit(Job{ [state, mid, last]() { State::run(state, mid, last); } });
+                    last = mid;
+                    continue;
+                }
+
+                const auto end = static_cast<I>(first + static_cast<I>(std::min(count, state->grain)));
+                piece(first, end);
+                first = end;
+            }
+        }
+
+        // executes the root job on the calling worker, or hands it to the workers
+        template <typename State, std::integral I>
+        void _start(State& state, I first, I last) noexcept
+        {
+            auto& s = state.scheduler;
+            if (s.is_worker_thread())
+                State::run(&state, first, last);
+            else
+                s.submit(Job{ [p = &state, first, last]() { State::run(p, first, last); } });
+
+            s.wait_for(state.done); // the calling thread executes other jobs meanwhile
+        }
+
+        template <std::integral I, typename Fn>
+        struct _for_state : _parallel_state
+        {
+            explicit _for_state(Scheduler& s, std::size_t g, const Fn& f) noexcept
+                : _parallel_state{ s, g }, fn{ f } {}
+
+            const Fn& fn;
+
+            static void run(_for_state* state, I first, I last) noexcept
+            {
+                _split(state, first, last, [state](I b, I e) {
+                    if constexpr (std::is_invocable_v<const Fn&, I, I>)
+                        std::invoke(state->fn, b, e);
+                    else
+                        for (auto i = b; i != e; ++i)
+                            std::invoke(state->fn, i);
+                });
+                state->complete();
+            }
+        };
+
+        template <std::integral I, typename T, typename Map, typename Reduce>
+        struct _reduce_state : _parallel_state
+        {
+            explicit _reduce_state(Scheduler& s, std::size_t g, const T& init, const Map& m, const Reduce& r)
+                : _parallel_state{ s, g }, identity{ init }, result{ init }, map{ m }, reduce{ r } {}
+
+            const T       identity;
+            T             result; // guarded by lock
+            std::mutex    lock;
+            const Map&    map;
+            const Reduce& reduce;
+
+            static void run(_reduce_state* state, I first, I last) noexcept
+            {
+                // partial results are merged once per job
+                T partial = state->identity;
+                _split(state, first, last, [state, &partial](I b, I e) {
+                    partial = std::invoke(state->reduce, std::move(partial), std::invoke(state->map, b, e));
+                });
+                {
+                    const std::scoped_lock guard{ state->lock };
+                    state->result = std::invoke(state->reduce, std::move(state->result), std::move(partial));
+                }
+                state->complete();
+            }
+        };
+    } // namespace _detail
+
+
+    /// @brief Invokes a function over a range of indices using the workers of a scheduler.
+    ///
+    /// The function is invoked either once per index, as fn(i), or once per
+    /// contiguous subrange, as fn(begin, end), when it accepts two indices.
+    /// The calling thread executes other jobs until the whole range is processed.
+    ///
+    /// @param[in] s     Scheduler that executes the jobs.
+    /// @param[in] first First index of the range.
+    /// @param[in] last  One past the last index of the range.
+    /// @param[in] grain Min number of indices processed by a single job.
+    /// @param[in] fn    Function invoked concurrently from multiple threads.
+    ///
+    template <std::integral I, typename Fn> // clang-format off
+    requires std::is_invocable_v<const Fn&, I, I> || std::is_invocable_v<const Fn&, I>
+    void parallel_for(Scheduler& s, I first, I last, std::size_t grain, const Fn& fn) // clang-format on
+    {
+        assert(first <= last);
+        if (first == last)
+            return;
+
+        _detail::_for_state<I, Fn> state{ s, grain, fn };
+        if (static_cast<std::size_t>(last - first) <= state.grain) // not worth splitting
+            _detail::_for_state<I, Fn>::run(&state, first, last);
+        else
+            _detail::_start(state, first, last);
+    }
+
+    /// @brief Reduces a range of indices using the workers of a scheduler.
+    ///
+    /// Each job maps the contiguous subranges it processes, as map(begin, end),
+    /// and combines the partial results with reduce(a, b). Partial results are
+    /// combined in no particular order, so reduce must be associative and commutative.
+    ///
+    /// @param[in] s        Scheduler that executes the jobs.
+    /// @param[in] first    First index of the range.
+    /// @param[in] last     One past the last index of the range.
+    /// @param[in] grain    Min number of indices processed by a single job.
+    /// @param[in] identity Identity element of the reduction.
+    /// @param[in] map      Computes the partial result of a subrange.
+    /// @param[in] reduce   Combines two partial results.
+    ///
+    /// @return Result of the reduction.
+    ///
+    template <std::integral I, typename T, typename Map, typename Reduce> // clang-format off
+    requires std::is_invocable_r_v<T, const Map&, I, I> && std::is_invocable_r_v<T, const Reduce&, T, T>
+    [[nodiscard]] T parallel_reduce(Scheduler& s, I first, I last, std::size_t grain,
+        const T& identity, const Map& map, const Reduce& reduce) // clang-format on
+    {
+        assert(first <= last);
+        if (first == last)
+            return identity;
+
+        _detail::_reduce_state<I, T, Map, Reduce> state{ s, grain, identity, map, reduce };
+        if (static_cast<std::size_t>(last - first) <= state.grain) // not worth splitting
+            return std::invoke(reduce, identity, std::invoke(map, first, last));
+
+        _detail::_start(state, first, last);
+        return std::move(state.result);
+    }
+
+} // namespace drako::jobs
+
+#endif // !DRAKO_JOBS_PARALLEL_HPP
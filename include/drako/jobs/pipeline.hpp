@@ -0,0 +1,486 @@
+#pragma once
+#ifndef DRAKO_JOBS_PIPELINE_HPP
+#define DRAKO_JOBS_PIPELINE_HPP
+
+/// @file
+/// @brief  Streaming pipelines of typed stages built on the job scheduler.
+/// @author Grassi Edoardo
+///
+/// A source produces items that flow through a chain of stages, the output of
+/// each stage being the input of the next one. Stages are either parallel,
+/// processing many items at once, or serial, processing one item at a time.
+///
+/// The number of items in flight is limited by a fixed amount of tokens: the
+/// source is invoked only while a token is available, and the last stage gives
+/// the token back. This bounds both the memory used by the pipeline and the
+/// queues between the stages, so a slow stage throttles the source instead of
+/// accumulating items. No thread is dedicated to the pipeline: stages run as
+/// jobs and are scheduled only when they have input to process.
+
+#include "drako/concurrency/lockfree_mrmwqueue.hpp"
+#include "drako/concurrency/lockfree_ringbuffer.hpp"
+#include "drako/jobs/job_api.hpp"
+#include "drako/jobs/job_system.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace drako::pipeline
+{
+    /// @brief Execution policy of a stage.
+    enum class Mode : std::uint8_t
+    {
+        parallel,            // items are processed concurrently, in no particular order
+        serial_out_of_order, // one item at a time, in the order they reach the stage
+        serial_in_order,     // one item at a time, in the order they were produced by the source
+    };
+
+    /// @brief Configuration of a pipeline.
+    struct Args
+    {
+        std::size_t       tokens   = 16;                            // max number of items in flight
+        jobs::JobPriority priority = jobs::JobPriority::background; // priority of the jobs that run the stages
+    };
+
+    /// @brief Step of a pipeline, transforms each item with a function.
+    template <Mode M, typename Fn>
+    struct Stage
+    {
+        Fn fn;
+    };
+
+    /// @brief Creates a stage that executes a function with the given policy.
+    ///
+    /// The function receives the items by rvalue reference. It must not throw,
+    /// and with a parallel policy it is invoked concurrently from multiple threads.
+    ///
+    template <Mode M, typename Fn>
+    [[nodiscard]] constexpr Stage<M, std::decay_t<Fn>> stage(Fn&& fn)
+    {
+        return { std::forward<Fn>(fn) };
+    }
+
+
+    namespace _detail
+    {
+        // serializes the execution of a stage: the thread that enters schedules
+        // the only job that processes the stage, which leaves once out of input
+        class _stage_gate
+        {
+        public:
+            [[nodiscard]] bool try_enter() noexcept
+            {
+                return !_busy.exchange(true, std::memory_order::seq_cst);
+            }
+
+            void leave() noexcept { _busy.store(false, std::memory_order::seq_cst); }
+
+        private:
+            std::atomic<bool> _busy = false;
+        };
+
+        // state shared by the source and the stages, lives inside the pipeline
+        struct _pipeline_state
+        {
+            explicit _pipeline_state(jobs::Scheduler& s, const Args& a, const jobs::Job& p) noexcept
+                : scheduler{ s }
+                , tokens{ std::max<std::size_t>(a.tokens, 1) }
+                , priority{ a.priority }
+                , in_flight{ 0 }
+                , active{ 1 }
+                , pull{ p }
+                , done{ 1 } {}
+
+            jobs::Scheduler&         scheduler;
+            const std::size_t        tokens;
+            const jobs::JobPriority  priority;
+            std::atomic<std::size_t> in_flight;   // items produced and not yet consumed by the last stage
+            std::atomic<std::size_t> active;      // scheduled jobs, plus the source until exhausted
+            _stage_gate              source_gate; // closed for good once the source is exhausted
+            const jobs::Job          pull;        // invokes the source while tokens are available
+            jobs::Event              done;        // signalled when no work is left
+
+            // the pipeline can't be destroyed while one of its jobs is scheduled
+            void submit(const jobs::Job& j)
+            {
+                active.fetch_add(1, std::memory_order::relaxed);
+                scheduler.submit(j, priority);
+            }
+
+            void release() noexcept
+            {
+                if (active.fetch_sub(1, std::memory_order::acq_rel) == 1)
+                    done.signal();
+            }
+
+            // gives back the token of an item that went through the whole pipeline
+            void consume() noexcept
+            {
+                in_flight.fetch_sub(1, std::memory_order::seq_cst);
+                if (source_gate.try_enter())
+                    submit(pull);
+            }
+        };
+
+        // item waiting in the queue of a stage, tagged with its position in the stream
+        template <typename T>
+        struct _item
+        {
+            std::uint64_t    sequence = 0;
+            std::optional<T> value;
+        };
+
+        // the queue can hold all the tokens, but a slot is reused only after the
+        // thread that popped its previous element is done, which may still be running
+        template <typename T>
+        void _push(lockfree::MRMWQueue<_item<T>>& queue, T&& item, std::uint64_t sequence) noexcept
+        {
+            while (!queue.try_emplace(sequence, std::move(item)))
+                std::this_thread::yield();
+        }
+
+        // a pushed element is visible once the producers of the previous slots are done
+        template <typename T>
+        void _pop(lockfree::MRMWQueue<_item<T>>& queue, _item<T>& item) noexcept
+        {
+            while (!queue.try_pop(item))
+                std::this_thread::yield();
+        }
+
+        // placeholder after the last stage, which consumes the items
+        struct _end
+        {
+            explicit _end(_pipeline_state&) noexcept {}
+        };
+
+        // stage that processes items of type In, after a stage with policy Up
+        template <typename In, Mode Up, typename S, typename... Rest>
+        class _node;
+
+        template <typename In, Mode Up, typename... Rest>
+        struct _next_node
+        {
+            using type = _node<In, Up, Rest...>;
+        };
+
+        template <typename In, Mode Up>
+        struct _next_node<In, Up>
+        {
+            using type = _end;
+        };
+
+        // invokes the function of a stage and forwards its result to the next one
+        template <typename In, Mode M, typename Fn, typename... Rest>
+        class _link
+        {
+            static_assert(std::is_invocable_v<Fn&, In&&>, "Stage can't be invoked with the output of the previous one.");
+
+            using _out = std::invoke_result_t<Fn&, In&&>;
+            static_assert((sizeof...(Rest) == 0) == std::is_void_v<_out>,
+                "Only the last stage of a pipeline must return void.");
+
+        protected:
+            explicit _link(_pipeline_state& state, Fn&& fn, Rest&&... rest)
+                : _state{ state }, _fn{ std::move(fn) }, _next{ state, std::move(rest)... } {}
+
+            void _process(In&& item, std::uint64_t sequence) noexcept
+            {
+                if constexpr (sizeof...(Rest) == 0)
+                {
+                    std::invoke(_fn, std::move(item));
+                    _state.consume();
+                }
+                else
+                    _next.push(std::invoke(_fn, std::move(item)), sequence);
+            }
+
+            _pipeline_state& _state;
+
+        private:
+            using _next_type = typename _next_node<std::conditional_t<std::is_void_v<_out>, _end, _out>, M, Rest...>::type;
+
+            Fn                               _fn;
+            [[no_unique_address]] _next_type _next;
+        };
+
+        template <typename In, Mode Up, typename Fn, typename... Rest>
+        class _node<In, Up, Stage<Mode::parallel, Fn>, Rest...>
+            : _link<In, Mode::parallel, Fn, Rest...>
+        {
+            using _base = _link<In, Mode::parallel, Fn, Rest...>;
+
+        public:
+            explicit _node(_pipeline_state& state, Stage<Mode::parallel, Fn>&& s, Rest&&... rest)
+                : _base{ state, std::move(s.fn), std::move(rest)... }, _queue{ state.tokens } {}
+
+            // each item is handed to its own job
+            void push(In&& item, std::uint64_t sequence)
+            {
+                _push(_queue, std::move(item), sequence);
+                this->_state.submit(jobs::Job{ [this]() {
+                    _run();
+                    this->_state.release();
+                } });
+            }
+
+        private:
+            lockfree::MRMWQueue<_item<In>> _queue;
+
+            void _run() noexcept
+            {
+                _item<In> item;
+                _pop(_queue, item);
+                this->_process(std::move(*item.value), item.sequence);
+            }
+        };
+
+        template <typename In, Mode Up, typename Fn, typename... Rest>
+        class _node<In, Up, Stage<Mode::serial_out_of_order, Fn>, Rest...>
+            : _link<In, Mode::serial_out_of_order, Fn, Rest...>
+        {
+            using _base = _link<In, Mode::serial_out_of_order, Fn, Rest...>;
+
+            // a serial producer allows a single producer queue
+            using _queue_type = std::conditional_t<Up == Mode::parallel,
+                lockfree::MRMWQueue<_item<In>>, lockfree::SRSWQueue<_item<In>>>;
+
+        public:
+            explicit _node(_pipeline_state& state, Stage<Mode::serial_out_of_order, Fn>&& s, Rest&&... rest)
+                : _base{ state, std::move(s.fn), std::move(rest)... }, _queue{ state.tokens }, _pending{ 0 } {}
+
+            void push(In&& item, std::uint64_t sequence)
+            {
+                if constexpr (Up == Mode::parallel)
+                    _push(_queue, std::move(item), sequence);
+                else
+                {
+                    [[maybe_unused]] const auto pushed = _queue.emplace(sequence, std::move(item));
+                    assert(pushed); // the queue can hold all the tokens
+                }
+
+                if (_pending.fetch_add(1, std::memory_order::acq_rel) == 0)
+                    this->_state.submit(jobs::Job{ [this]() {
+                        _drain();
+                        this->_state.release();
+                    } });
+            }
+
+        private:
+            _queue_type              _queue;
+            std::atomic<std::size_t> _pending; // pushed items not yet processed
+
+            void _drain() noexcept
+            {
+                do
+                {
+                    _item<In> item;
+                    if constexpr (Up == Mode::parallel)
+                        _pop(_queue, item);
+                    else
+                    {
+                        [[maybe_unused]] const auto popped = _queue.pop(item);
+                        assert(popped);
+                    }
+                    this->_process(std::move(*item.value), item.sequence);
+                } while (_pending.fetch_sub(1, std::memory_order::acq_rel) != 1);
+            }
+        };
+
+        template <typename In, Mode Up, typename Fn, typename... Rest>
+        class _node<In, Up, Stage<Mode::serial_in_order, Fn>, Rest...>
+            : _link<In, Mode::serial_in_order, Fn, Rest...>
+        {
+            using _base = _link<In, Mode::serial_in_order, Fn, Rest...>;
+
+            struct _slot
+            {
+                std::atomic<bool> ready = false;
+                std::optional<In> value;
+            };
+
+        public:
+            explicit _node(_pipeline_state& state, Stage<Mode::serial_in_order, Fn>&& s, Rest&&... rest)
+                : _base{ state, std::move(s.fn), std::move(rest)... }
+                , _mask{ std::bit_ceil(state.tokens) - 1 }
+                , _slots{ std::make_unique<_slot[]>(_mask + 1) }
+                , _next{ 0 } {}
+
+            // items are reordered in a window as large as the tokens: the ones that
+            // didn't pass the stage yet are all in flight, so they never collide
+            void push(In&& item, std::uint64_t sequence)
+            {
+                auto& slot = _slots[sequence & _mask];
+                assert(!slot.ready.load(std::memory_order::acquire));
+                slot.value.emplace(std::move(item));
+                slot.ready.store(true, std::memory_order::seq_cst);
+
+                if (_gate.try_enter())
+                    this->_state.submit(jobs::Job{ [this]() {
+                        _drain();
+                        this->_state.release();
+                    } });
+            }
+
+        private:
+            const std::size_t        _mask;
+            std::unique_ptr<_slot[]> _slots;
+            std::uint64_t            _next; // sequence of the next item to process, guarded by the gate
+            _stage_gate              _gate;
+
+            void _drain() noexcept
+            {
+                for (;;)
+                {
+                    auto* head = &_slots[_next & _mask];
+                    while (head->ready.load(std::memory_order::acquire))
+                    {
+                        In item = std::move(*head->value);
+                        head->value.reset();
+                        head->ready.store(false, std::memory_order::release);
+                        this->_process(std::move(item), _next++);
+                        head = &_slots[_next & _mask];
+                    }
+
+                    // the item could have arrived after the last check
+                    _gate.leave();
+                    if (!head->ready.load(std::memory_order::seq_cst) || !_gate.try_enter())
+                        return;
+                }
+            }
+        };
+    } // namespace _detail
+
+
+    /// @brief Chain of stages that processes the items produced by a source.
+    ///
+    /// The source is invoked serially, as source(), and returns an empty optional
+    /// once exhausted. Each stage receives the output of the previous one, and the
+    /// last stage must return void. At most Args::tokens items are in flight, so
+    /// the source is suspended while the stages are busy.
+    ///
+    /// @tparam Source Callable object that returns std::optional of the items.
+    /// @tparam Stages Instances of Stage, created with pipeline::stage().
+    ///
+    template <typename Source, typename... Stages> // clang-format off
+    requires (sizeof...(Stages) > 0) && std::is_invocable_v<Source&>
+    class Pipeline // clang-format on
+    {
+        using _value = typename std::invoke_result_t<Source&>::value_type;
+
+        static_assert(std::is_same_v<std::invoke_result_t<Source&>, std::optional<_value>>,
+            "Source must return an optional.");
+
+    public:
+        /// @brief Constructor.
+        /// @param[in] s      Scheduler that executes the stages.
+        /// @param[in] args   Configuration of the pipeline.
+        /// @param[in] source Function that produces the items.
+        /// @param[in] stages Stages that process the items.
+        explicit Pipeline(jobs::Scheduler& s, const Args& args, Source source, Stages... stages)
+            : _state{ s, args, jobs::Job{ [this]() {
+                _pull();
+                _state.release();
+            } } }
+            , _source{ std::move(source) }
+            , _sequence{ 0 }
+            , _first{ _state, std::move(stages)... }
+            , _started{ false }
+        {
+        }
+
+        /// @brief Destructor, waits for the items in flight when started.
+        ~Pipeline() noexcept
+        {
+            if (_started)
+                wait();
+        }
+
+        Pipeline(const Pipeline&) = delete;
+        Pipeline& operator=(const Pipeline&) = delete;
+
+        /// @brief Starts producing items, returns without waiting for them.
+        void start()
+        {
+            assert(!_started);
+            _started = true;
+
+            [[maybe_unused]] const auto entered = _state.source_gate.try_enter();
+            assert(entered);
+            _state.submit(_state.pull);
+        }
+
+        /// @brief Checks whether the source is exhausted and all its items have been processed.
+        [[nodiscard]] bool done() const noexcept { return _state.done.ready(); }
+
+        /// @brief Waits until all the items have been processed.
+        ///
+        /// The calling thread executes other jobs meanwhile.
+        ///
+        void wait() noexcept
+        {
+            assert(_started);
+            _state.scheduler.wait_for(_state.done);
+        }
+
+    private:
+        _detail::_pipeline_state                                 _state;
+        Source                                                   _source;
+        std::uint64_t                                            _sequence; // guarded by the source gate
+        _detail::_node<_value, Mode::serial_in_order, Stages...> _first;
+        bool                                                     _started;
+
+        void _pull() noexcept
+        {
+            for (;;)
+            {
+                while (_state.in_flight.load(std::memory_order::seq_cst) < _state.tokens)
+                {
+                    auto item = std::invoke(_source);
+                    if (!item)
+                    {
+                        _state.release(); // the gate stays closed, no more items
+                        return;
+                    }
+                    _state.in_flight.fetch_add(1, std::memory_order::relaxed);
+                    _first.push(std::move(*item), _sequence++);
+                }
+
+                // a token could have been returned after the last check
+                _state.source_gate.leave();
+                if (_state.in_flight.load(std::memory_order::seq_cst) >= _state.tokens || !_state.source_gate.try_enter())
+                    return;
+            }
+        }
+    };
+
+    /// @brief Processes all the items of a source with a chain of stages.
+    ///
+    /// The calling thread executes other jobs until the source is exhausted and
+    /// the last item left the pipeline.
+    ///
+    /// @param[in] s      Scheduler that executes the stages.
+    /// @param[in] args   Configuration of the pipeline.
+    /// @param[in] source Function that produces the items.
+    /// @param[in] stages Stages that process the items.
+    ///
+    template <typename Source, typename... Stages>
+    void run(jobs::Scheduler& s, const Args& args, Source source, Stages... stages)
+    {
+        Pipeline<Source, Stages...> p{ s, args, std::move(source), std::move(stages)... };
+        p.start();
+        p.wait();
+    }
+
+} // namespace drako::pipeline
+
+#endif // !DRAKO_JOBS_PIPELINE_HPP
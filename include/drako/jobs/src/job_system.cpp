@@ -0,0 +1,622 @@
+#include "drako/jobs/job_system.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace drako::jobs
+{
+    namespace
+    {
+        // orders the processors so that consecutive workers take distinct physical
+        // cores grouped by node, and hardware threads of busy cores come last
+        [[nodiscard]] std::vector<sys::cpu_topology_entry> _worker_placement(std::vector<sys::cpu_topology_entry> cpus)
+        {
+            std::vector<std::pair<std::size_t, sys::cpu_topology_entry>> ranked; // rank inside the physical core
+            ranked.reserve(std::size(cpus));
+            for (const auto& cpu : cpus)
+            {
+                const auto siblings = std::count_if(std::begin(ranked), std::end(ranked),
+                    [&](const auto& other) { return other.second.physical_core == cpu.physical_core; });
+                ranked.emplace_back(static_cast<std::size_t>(siblings), cpu);
+            }
+
+            std::stable_sort(std::begin(ranked), std::end(ranked), [](const auto& a, const auto& b) {
+                if (a.first != b.first)
+                    return a.first < b.first;
+                if (a.second.node.guid != b.second.node.guid)
+                    return a.second.node.guid < b.second.node.guid;
+                return a.second.physical_core < b.second.physical_core;
+            });
+
+            cpus.clear();
+            for (const auto& [_, cpu] : ranked)
+                cpus.push_back(cpu);
+            return cpus;
+        }
+    } // namespace
+
+    DRAKO_NOINLINE Scheduler::_worker*& Scheduler::_this_worker() noexcept
+    {
+        // a suspended job can be resumed on a different thread, so the address
+        // of the thread local storage must be recomputed after each switch
+        static thread_local _worker* local = nullptr;
+        return local;
+    }
+
+    DRAKO_NOINLINE Scheduler*& Scheduler::_this_helped() noexcept
+    {
+        static thread_local Scheduler* helped = nullptr;
+        return helped;
+    }
+
+
+    Scheduler::Scheduler()
+        : Scheduler{ Args{} }
+    {
+    }
+
+    Scheduler::Scheduler(const Args& args)
+        : _fairness{ args.fairness }, _parking{ args.idle }, _shared_arena{ args.shared_frame_arena_size }
+    {
+        assert(args.queue_size > 0);
+        assert(args.fairness > 0);
+        assert(args.shared_queue_size > 0);
+
+        for (auto& lane : _global)
+            lane = std::make_unique<lockfree::MRMWQueue<_work*>>(args.shared_queue_size);
+
+        std::vector<sys::cpu_topology_entry> placement;
+        if (args.pin_workers)
+            placement = _worker_placement(sys::cpu_topology());
+
+        auto count = args.workers;
+        if (count == 0 && !std::empty(placement)) // one worker per physical core
+        {
+            std::vector<std::uint32_t> cores;
+            for (const auto& cpu : placement)
+                cores.push_back(cpu.physical_core);
+            std::sort(std::begin(cores), std::end(cores));
+            count = static_cast<std::size_t>(std::unique(std::begin(cores), std::end(cores)) - std::begin(cores));
+        }
+        if (count == 0)
+            count = std::max(std::thread::hardware_concurrency(), 1u);
+
+        std::random_device seeds{};
+        _locals.reserve(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            _locals.push_back(std::make_unique<_worker>(*this, args.queue_size, args.fairness, seeds()));
+            _locals.back()->cache.reserve(_cache_size);
+            _locals.back()->arena.capacity = args.frame_arena_size; // allocated by the worker
+
+            if (!std::empty(placement))
+            {
+                const auto& cpu      = placement[i % std::size(placement)];
+                _locals.back()->cpu  = cpu.core;
+                _locals.back()->node = cpu.node.guid;
+                _node_stealing |= (cpu.node.guid != placement.front().node.guid);
+            }
+        }
+
+        _fibers.reserve(args.fibers);
+        _idle.reserve(args.fibers);
+        for (std::size_t i = 0; i < args.fibers; ++i)
+        {
+            _fibers.push_back(std::make_unique<_fiber>(*this, args.fiber_stack_size));
+            _idle.push_back(_fibers.back().get());
+        }
+
+        // create background threads only after all the queues are in place
+        _workers.reserve(count);
+        for (std::size_t i = 0; i < count; ++i)
+            _workers.emplace_back(&Scheduler::_run, this, i);
+    }
+
+    Scheduler::~Scheduler() noexcept
+    {
+        _done.test_and_set(std::memory_order::release);
+        _parking.notify_all();
+        for (auto& w : _workers)
+            w.join();
+
+        constexpr std::align_val_t align{ alignof(_work) };
+
+        // release the work that was never picked up
+        for (const auto& lane : _global)
+            for (_work* w; lane->try_pop(w);)
+            {
+                std::destroy_at(w);
+                ::operator delete(w, align);
+            }
+        for (auto w : _spare)
+            ::operator delete(w, align);
+        for (const auto& local : _locals)
+            for (auto w : local->cache)
+                ::operator delete(w, align);
+    }
+
+    void Scheduler::precede(JobHandle first, JobHandle then)
+    {
+        const auto successor = _from_handle(then);
+        if (!_from_handle(first)->chain.set_dependency(then))
+            throw std::length_error{ "Too many successors for a single job." };
+        successor->chain.acquire();
+    }
+
+    void Scheduler::precede(Event& wait, JobHandle then)
+    {
+        const auto successor = _from_handle(then);
+        if (successor->event_count == max_event_predecessors)
+            throw std::length_error{ "Too many events for a single job." };
+
+        auto& link = successor->events[successor->event_count++];
+        link.work  = successor;
+        successor->chain.acquire();
+        if (!wait.enlist(&link)) // already signalled, drop the dependency
+            static_cast<void>(successor->chain.release()); // submission still pending
+    }
+
+    void Scheduler::wait_for(Event& e) noexcept
+    {
+        if (e.ready())
+            return;
+
+        // suspend the running fiber and move to another one
+        if (const auto local = _this_worker(); local && (&local->owner == this) && local->current)
+            if (const auto next = _pop_idle())
+            {
+                const auto self = local->current;
+                DRAKO_JOBS_TRACE(trace::EventType::job_suspend, _trace_id(self));
+                _switch(*local, next, { .suspend = self, .event = &e });
+                DRAKO_JOBS_TRACE(trace::EventType::job_resume, _trace_id(self));
+                return; // resumed after the event has been signalled
+            }
+
+        while (!e.ready())
+            _help();
+    }
+
+    std::size_t Scheduler::wait_for_any(Event* const events[], std::size_t count) noexcept
+    {
+        assert(count > 0);
+        for (;;)
+        {
+            for (std::size_t i = 0; i < count; ++i)
+                if (events[i]->ready())
+                    return i;
+            _help();
+        }
+    }
+
+    void Scheduler::wait_for_all(Event* const events[], std::size_t count) noexcept
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            wait_for(*events[i]);
+    }
+
+    Scheduler::_work* Scheduler::_allocate(const Job& j, Event* signal, JobPriority p)
+    {
+        void* storage = nullptr;
+        if (const auto local = _this_worker(); local && (&local->owner == this))
+        {
+            auto& cache = local->cache;
+            if (std::empty(cache)) // refill half of the cache with a single lock
+            {
+                const std::scoped_lock lock{ _global_lock };
+                const auto             count = std::min(std::size(_spare), _cache_size / 2);
+                cache.insert(std::end(cache), std::end(_spare) - count, std::end(_spare));
+                _spare.resize(std::size(_spare) - count);
+            }
+            if (!std::empty(cache))
+            {
+                storage = cache.back();
+                cache.pop_back();
+            }
+        }
+        else
+        {
+            const std::scoped_lock lock{ _global_lock };
+            if (!std::empty(_spare))
+            {
+                storage = _spare.back();
+                _spare.pop_back();
+            }
+        }
+
+        if (storage == nullptr)
+            storage = ::operator new(sizeof(_work), std::align_val_t{ alignof(_work) });
+        return ::new (storage) _work{ *this, j, signal, p };
+    }
+
+    void Scheduler::_recycle(_work* w) noexcept
+    {
+        assert(w);
+        std::destroy_at(w);
+
+        if (const auto local = _this_worker(); local && (&local->owner == this))
+        {
+            auto& cache = local->cache;
+            if (std::size(cache) == _cache_size) // spill half of the cache with a single lock
+            {
+                const std::scoped_lock lock{ _global_lock };
+                _spare.insert(std::end(_spare), std::end(cache) - _cache_size / 2, std::end(cache));
+                cache.resize(_cache_size / 2);
+            }
+            cache.push_back(w);
+            return;
+        }
+
+        const std::scoped_lock lock{ _global_lock };
+        _spare.push_back(w);
+    }
+
+    void* Scheduler::_frame_arena::allocate(std::size_t bytes, std::size_t align) noexcept
+    {
+        const auto base  = reinterpret_cast<std::uintptr_t>(buffer.get());
+        const auto first = ((base + offset + align - 1) & ~(align - 1)) - base;
+        if (first > capacity || bytes > capacity - first)
+            return nullptr;
+
+        offset = first + bytes;
+        return buffer.get() + first;
+    }
+
+    void* Scheduler::frame_alloc(std::size_t bytes, std::size_t align) noexcept
+    {
+        assert(bytes > 0);
+        assert(std::has_single_bit(align));
+
+        if (const auto local = _this_worker(); local && (&local->owner == this))
+        {
+            auto&      arena = local->arena;
+            const auto frame = _frame.load(std::memory_order::relaxed);
+            if (arena.frame != frame) // first allocation since the last reset
+            {
+                arena.offset = 0;
+                arena.frame  = frame;
+            }
+            if (const auto p = arena.allocate(bytes, align))
+                return p;
+        }
+        return _shared_arena.allocate(bytes, align);
+    }
+
+    void Scheduler::reset_frame() noexcept
+    {
+        _frame.fetch_add(1, std::memory_order::relaxed);
+        _shared_arena.release();
+    }
+
+    void* this_worker::frame_alloc(std::size_t bytes, std::size_t align) noexcept
+    {
+        // a job of another scheduler helped by a worker still allocates from its own scheduler
+        if (const auto helped = Scheduler::_this_helped())
+            return helped->frame_alloc(bytes, align);
+
+        const auto local = Scheduler::_this_worker();
+        assert(local && "Frame allocations require a running job.");
+        return local ? local->owner.frame_alloc(bytes, align) : nullptr;
+    }
+
+    bool Scheduler::is_worker_thread() const noexcept
+    {
+        const auto local = _this_worker();
+        return local && (&local->owner == this);
+    }
+
+    bool Scheduler::local_work_pending() const noexcept
+    {
+        const auto local = _this_worker();
+        return local && (&local->owner == this) && !local->queue.empty();
+    }
+
+    void Scheduler::_schedule(_work* w) noexcept
+    {
+        assert(w);
+
+        // jobs spawned by a job of this scheduler stay on the local queue
+        if (const auto local = _this_worker(); local && (&local->owner == this))
+            if (local->queue.enque(w, static_cast<std::size_t>(w->priority)))
+                return _parking.notify_one(); // let a parked worker steal it
+
+        // when the shared queue is full the caller executes jobs to make room
+        auto& lane = *_global[static_cast<std::size_t>(w->priority)];
+        while (!lane.try_push(w))
+            _help();
+        _parking.notify_one();
+    }
+
+    Scheduler::_fiber* Scheduler::_pop_idle() noexcept
+    {
+        const std::scoped_lock lock{ _global_lock };
+        if (std::empty(_idle))
+            return nullptr;
+
+        const auto f = _idle.back();
+        _idle.pop_back();
+        return f;
+    }
+
+    Scheduler::_fiber* Scheduler::_pop_resumed() noexcept
+    {
+        if (_resumed_count.load(std::memory_order::relaxed) == 0)
+            return nullptr; // avoid locking when there's nothing to pop
+
+        const std::scoped_lock lock{ _global_lock };
+        if (std::empty(_resumed))
+            return nullptr;
+
+        const auto f = _resumed.front();
+        _resumed.pop_front();
+        _resumed_count.store(std::size(_resumed), std::memory_order::relaxed);
+        return f;
+    }
+
+    bool Scheduler::_work_available() const noexcept
+    {
+        if (_resumed_count.load(std::memory_order::relaxed) > 0)
+            return true;
+
+        for (const auto& lane : _global)
+            if (!lane->empty())
+                return true;
+
+        for (const auto& local : _locals)
+            if (!local->queue.empty())
+                return true;
+        return false;
+    }
+
+    Scheduler::_work* Scheduler::_steal(std::minstd_rand& rng, const _worker* thief) noexcept
+    {
+        const auto count = std::size(_locals);
+        if (count < 2 && thief)
+            return nullptr;
+
+        // start from a random victim then sweep all the others once, when the
+        // workers span multiple nodes the ones on the node of the thief go first
+        const auto first  = std::uniform_int_distribution<std::size_t>{ 0, count - 1 }(rng);
+        const auto passes = (thief && _node_stealing) ? 2 : 1;
+        for (auto pass = 0; pass < passes; ++pass)
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                auto& victim = *_locals[(first + i) % count];
+                if (&victim == thief)
+                    continue;
+                if (passes > 1 && (victim.node == thief->node) != (pass == 0))
+                    continue;
+
+                _work* w;
+                if (victim.queue.steal(w))
+                {
+                    DRAKO_JOBS_TRACE(trace::EventType::steal, _trace_id(w), (first + i) % count);
+                    return w;
+                }
+            }
+        return nullptr;
+    }
+
+    Scheduler::_work* Scheduler::_find_work(_worker* local) noexcept
+    {
+        // higher lanes first, lower ones at a bounded rate
+        auto       first = std::size_t{ 0 };
+        const auto count = local ? ++local->removals : _global_removals.fetch_add(1, std::memory_order::relaxed) + 1;
+        if (count % _fairness == 0)
+            first = 1 + (count / _fairness) % (job_priority_levels - 1);
+
+        // each lane is drained from both sources before the lower ones, so that
+        // external submissions never wait behind lower priority local work
+        for (auto i = 0u; i < job_priority_levels; ++i)
+        {
+            // after the lower lanes, wrap around to the higher ones
+            const auto lane = (first + i) % job_priority_levels;
+
+            _work* w;
+            if (local && local->queue.deque(w, lane))
+                return w;
+            if (_global[lane]->try_pop(w))
+                return w;
+        }
+
+        if (local)
+            return _steal(local->rng, local);
+
+        // external threads that help while waiting can steal as well
+        static thread_local std::minstd_rand rng{ std::random_device{}() };
+        return _steal(rng, nullptr);
+    }
+
+    void Scheduler::_release(_work* w) noexcept
+    {
+        assert(w);
+        if (w->chain.release()) // all predecessors completed
+            _schedule(w);
+    }
+
+    void Scheduler::_resume(Waiter* w) noexcept
+    {
+        const auto work = static_cast<_event_link*>(w)->work;
+        DRAKO_JOBS_TRACE(trace::EventType::release, _trace_id(work));
+        work->owner._release(work);
+    }
+
+    void Scheduler::_resume_fiber(Waiter* w) noexcept
+    {
+        const auto fiber = static_cast<_fiber*>(w);
+        auto&      s     = fiber->owner;
+
+        {
+            const std::scoped_lock lock{ s._global_lock };
+            s._resumed.push_back(fiber);
+            s._resumed_count.store(std::size(s._resumed), std::memory_order::relaxed);
+        }
+        s._parking.notify_one();
+    }
+
+    void Scheduler::_execute(_work* w) noexcept
+    {
+        assert(w);
+        DRAKO_JOBS_TRACE(trace::EventType::job_begin, _trace_id(w), static_cast<std::uint64_t>(w->priority));
+        w->job();
+
+        for (const auto successor : w->chain.successors())
+        {
+            DRAKO_JOBS_TRACE(trace::EventType::release, _trace_id(_from_handle(successor)));
+            _release(_from_handle(successor));
+        }
+        if (w->signal)
+            w->signal->signal();
+
+        // after the releases, so that the trace links them to this job
+        DRAKO_JOBS_TRACE(trace::EventType::job_end, _trace_id(w));
+        _recycle(w);
+    }
+
+    void Scheduler::_help() noexcept
+    {
+        // only the workers of this scheduler can pop from a local queue
+        auto local = _this_worker();
+        if (local && (&local->owner != this))
+            local = nullptr;
+
+        if (const auto w = _find_work(local))
+        {
+            if (local)
+                return _execute(w);
+
+            // lets the job find this scheduler, helps can nest through jobs of other schedulers
+            const auto outer = std::exchange(_this_helped(), this);
+            _execute(w);
+            _this_helped() = outer;
+        }
+        else
+            std::this_thread::yield();
+    }
+
+    void Scheduler::_switch(_worker& local, _fiber* next, const _switch_action& a) noexcept
+    {
+        assert(next);
+        const auto self = local.current;
+        local.action    = a;
+        local.current   = next;
+
+        // the helped scheduler belongs to the suspended job, not to the thread
+        const auto helped = std::exchange(_this_helped(), nullptr);
+        if (self)
+            self->context.switch_context(next->context);
+        else
+            local.root->switch_context(next->context);
+
+        // back on this fiber, possibly on another worker
+        _this_helped() = helped;
+        _complete_switch();
+    }
+
+    void Scheduler::_complete_switch() noexcept
+    {
+        auto&      local = *_this_worker();
+        const auto a     = std::exchange(local.action, {});
+
+        if (a.recycle)
+        {
+            const std::scoped_lock lock{ _global_lock };
+            _idle.push_back(a.recycle);
+        }
+        if (a.suspend && !a.event->enlist(a.suspend))
+            _resume_fiber(a.suspend); // signalled in the meantime, ready to run again
+    }
+
+    void Scheduler::_loop() noexcept
+    {
+        for (;;)
+        {
+            // reload worker state at each iteration since the fiber may migrate
+            auto& local = *_this_worker();
+
+            if (const auto f = _pop_resumed()) // continue a suspended job
+            {
+                if (local.current)
+                    _switch(local, f, { .recycle = local.current });
+                else
+                    _switch(local, f, {});
+                continue;
+            }
+
+            if (const auto w = _find_work(&local))
+            {
+                _execute(w);
+                continue;
+            }
+
+            // leave only after all the outstanding work has been drained
+            if (_done.test(std::memory_order::acquire))
+                return;
+
+            DRAKO_JOBS_TRACE(trace::EventType::park);
+            _parking.wait_until([this]() noexcept {
+                return _work_available() || _done.test(std::memory_order::acquire);
+            });
+            DRAKO_JOBS_TRACE(trace::EventType::unpark);
+        }
+    }
+
+    void DRAKO_API_STDCALL Scheduler::_fiber_main(void* args) noexcept
+    {
+        const auto self = static_cast<_fiber*>(args);
+        auto&      s    = self->owner;
+
+        s._complete_switch();
+        for (;;)
+        {
+            s._loop();
+
+            // park in the pool and give control back to the worker thread,
+            // another worker can still pick this fiber and continue the loop
+            auto& local = *s._this_worker();
+            local.action  = { .recycle = self };
+            local.current = nullptr;
+            self->context.switch_context(*local.root);
+            s._complete_switch();
+        }
+    }
+
+    void Scheduler::_run(std::size_t index) noexcept
+    {
+        auto& local     = *_locals[index];
+        _this_worker()  = &local;
+        local.current   = nullptr;
+        local.root.emplace();
+
+        if (local.cpu)
+            static_cast<void>(sys::pin_current_thread(*local.cpu)); // best effort, runs unbound otherwise
+        if constexpr (trace::compiled)
+            trace::name_this_thread("worker " + std::to_string(index));
+
+        // allocated after pinning, so that its pages are first touched on the node of the
+        // worker, and without throwing: jobs fall back to the shared arena on failure
+        auto& arena = local.arena;
+        if (arena.capacity > 0)
+            arena.buffer.reset(new (std::nothrow) std::byte[arena.capacity]);
+        if (!arena.buffer)
+            arena.capacity = 0;
+
+        if (const auto f = _pop_idle())
+            _switch(local, f, {}); // back here once the scheduler is done
+        else
+            _loop(); // fibers disabled, jobs can't be suspended
+
+        local.root.reset();
+        _this_worker() = nullptr;
+    }
+
+} // namespace drako::jobs
@@ -0,0 +1,420 @@
+#include "drako/jobs/job_trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace drako::jobs::trace
+{
+    namespace _detail
+    {
+        std::atomic<bool> recording = false;
+    } // namespace _detail
+
+#if DRAKO_JOBS_TRACING
+
+    namespace
+    {
+        // event stored as words, so that exports can read buffers that are being written
+        struct _slot
+        {
+            std::array<std::atomic<std::uint64_t>, 4> words; // timestamp, id, arg, type
+        };
+
+        struct _event
+        {
+            std::uint64_t timestamp;
+            std::uint64_t id;
+            std::uint64_t arg;
+            EventType     type;
+            std::uint32_t tid;
+        };
+
+        // ring buffer written only by its thread, the oldest events are overwritten
+        struct _buffer
+        {
+            explicit _buffer(std::size_t size, std::uint32_t t, std::string n)
+                : slots{ std::make_unique<_slot[]>(size) }, capacity{ size }, tid{ t }, name{ std::move(n) } {}
+
+            const std::unique_ptr<_slot[]> slots;
+            const std::size_t              capacity;
+            std::atomic<std::uint64_t>     head = 0; // events written since creation
+
+            // guarded by the registry lock
+            const std::uint32_t tid;
+            std::string         name;
+            std::uint64_t       first   = 0;     // events before this one were discarded
+            bool                retired = false; // the thread exited
+        };
+
+        struct _registry
+        {
+            std::mutex                            lock;
+            std::vector<std::unique_ptr<_buffer>> buffers;
+            std::size_t                           buffer_size = default_buffer_size;
+            std::uint32_t                         next_tid    = 1;
+
+            // matches the timestamps with the steady clock, for the conversion to microseconds
+            std::uint64_t                         origin_ticks = 0;
+            std::chrono::steady_clock::time_point origin_time;
+        };
+
+        [[nodiscard]] _registry& _this_registry()
+        {
+            static _registry r;
+            return r;
+        }
+
+        // releases the buffer of a thread on exit, its events can still be exported
+        struct _thread_state
+        {
+            _buffer*    buffer = nullptr;
+            std::string name;
+
+            ~_thread_state()
+            {
+                if (buffer == nullptr)
+                    return;
+
+                auto&                  r = _this_registry();
+                const std::scoped_lock guard{ r.lock };
+                buffer->retired = true;
+            }
+        };
+
+        // fibers migrate between threads, so the address must be recomputed at each call
+        DRAKO_NOINLINE _thread_state& _this_thread() noexcept
+        {
+            static thread_local _thread_state state;
+            return state;
+        }
+
+        [[nodiscard]] _buffer* _create_buffer(_thread_state& state)
+        {
+            auto&                  r = _this_registry();
+            const std::scoped_lock guard{ r.lock };
+
+            const auto tid  = r.next_tid++;
+            auto       name = std::empty(state.name) ? "thread " + std::to_string(tid) : state.name;
+            r.buffers.push_back(std::make_unique<_buffer>(r.buffer_size, tid, std::move(name)));
+            return r.buffers.back().get();
+        }
+
+        // drops the buffers of the exited threads whose events have been exported
+        void _remove_retired(_registry& r)
+        {
+            std::erase_if(r.buffers, [](const auto& b) {
+                return b->retired && b->first == b->head.load(std::memory_order::acquire);
+            });
+        }
+
+        // copies the events that weren't overwritten while reading
+        void _read(_buffer& b, std::vector<_event>& events)
+        {
+            const auto last  = b.head.load(std::memory_order::acquire);
+            const auto first = std::max(b.first, last > b.capacity ? last - b.capacity : 0);
+            const auto size  = std::size(events);
+            for (auto i = first; i < last; ++i)
+            {
+                const auto& s = b.slots[i % b.capacity];
+                events.push_back({ s.words[0].load(std::memory_order::relaxed),
+                    s.words[1].load(std::memory_order::relaxed),
+                    s.words[2].load(std::memory_order::relaxed),
+                    static_cast<EventType>(s.words[3].load(std::memory_order::relaxed)),
+                    b.tid });
+            }
+
+            // the writer may have lapped the reader meanwhile
+            std::atomic_thread_fence(std::memory_order::acquire);
+            const auto now = b.head.load(std::memory_order::relaxed);
+            if (now > b.capacity && now - b.capacity > first)
+            {
+                const auto lost = std::min(now - b.capacity - first, last - first);
+                events.erase(std::begin(events) + static_cast<std::ptrdiff_t>(size),
+                    std::begin(events) + static_cast<std::ptrdiff_t>(size + lost));
+            }
+            b.first = last;
+        }
+
+        [[nodiscard]] const char* _priority_name(std::uint64_t p) noexcept
+        {
+            constexpr const char* names[] = { "critical job", "frame job", "background job" };
+            return p < std::size(names) ? names[p] : "job";
+        }
+
+        void _write_escaped(std::ostream& out, std::string_view s)
+        {
+            out << '"';
+            for (const auto c : s)
+            {
+                if (c == '"' || c == '\\')
+                    out << '\\' << c;
+                else if (static_cast<unsigned char>(c) < 0x20)
+                    out << ' ';
+                else
+                    out << c;
+            }
+            out << '"';
+        }
+    } // namespace
+
+    void start(std::size_t buffer_size)
+    {
+        auto&                  r = _this_registry();
+        const std::scoped_lock guard{ r.lock };
+
+        r.buffer_size = std::max<std::size_t>(buffer_size, 1);
+        for (const auto& b : r.buffers)
+            b->first = b->head.load(std::memory_order::acquire);
+        _remove_retired(r);
+
+        r.origin_ticks = _detail::timestamp();
+        r.origin_time  = std::chrono::steady_clock::now();
+        _detail::recording.store(true, std::memory_order::relaxed);
+    }
+
+    void stop() noexcept
+    {
+        _detail::recording.store(false, std::memory_order::relaxed);
+    }
+
+    bool is_recording() noexcept
+    {
+        return _detail::recording.load(std::memory_order::relaxed);
+    }
+
+    void name_this_thread(std::string_view name)
+    {
+        auto& state = _this_thread();
+        state.name  = name;
+        if (state.buffer)
+        {
+            auto&                  r = _this_registry();
+            const std::scoped_lock guard{ r.lock };
+            state.buffer->name = name;
+            return;
+        }
+
+        // registered now, so that the thread is exported even if it records no event
+        try
+        {
+            state.buffer = _create_buffer(state);
+        }
+        catch (...) // out of memory, the thread is registered by its first event
+        {
+        }
+    }
+
+    void _detail::record(EventType type, std::uint64_t id, std::uint64_t arg) noexcept
+    {
+        const auto timestamp = _detail::timestamp();
+
+        auto& state = _this_thread();
+        if (state.buffer == nullptr)
+        {
+            try
+            {
+                state.buffer = _create_buffer(state);
+            }
+            catch (...) // out of memory, the thread doesn't appear in the trace
+            {
+                return;
+            }
+        }
+
+        auto&      b    = *state.buffer;
+        const auto head = b.head.load(std::memory_order::relaxed);
+        auto&      s    = b.slots[head % b.capacity];
+        s.words[0].store(timestamp, std::memory_order::relaxed);
+        s.words[1].store(id, std::memory_order::relaxed);
+        s.words[2].store(arg, std::memory_order::relaxed);
+        s.words[3].store(static_cast<std::uint64_t>(type), std::memory_order::relaxed);
+        b.head.store(head + 1, std::memory_order::release);
+    }
+
+    void write(std::ostream& out)
+    {
+        std::vector<_event>                            events;
+        std::vector<std::pair<std::uint32_t, std::string>> threads;
+        double                                         ticks_per_us = 1;
+        std::uint64_t                                  origin       = 0;
+        {
+            auto&                  r = _this_registry();
+            const std::scoped_lock guard{ r.lock };
+            for (const auto& b : r.buffers)
+            {
+                _read(*b, events);
+                threads.emplace_back(b->tid, b->name);
+            }
+            _remove_retired(r);
+
+            const auto ticks = _detail::timestamp() - r.origin_ticks;
+            const auto us    = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - r.origin_time);
+            if (ticks > 0 && us.count() > 0)
+                ticks_per_us = static_cast<double>(ticks) / us.count();
+            origin = r.origin_ticks;
+        }
+        std::stable_sort(std::begin(events), std::end(events),
+            [](const auto& a, const auto& b) { return a.timestamp < b.timestamp; });
+
+        const auto time = [&](std::uint64_t t) { return static_cast<double>(t - std::min(t, origin)) / ticks_per_us; };
+
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        auto separator = "\n";
+        const auto begin_event = [&](const char* name, const char* phase, std::uint32_t tid, double ts) -> std::ostream& {
+            out << separator << "{\"name\":\"" << name << "\",\"ph\":\"" << phase
+                << "\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << ts;
+            separator = ",\n";
+            return out;
+        };
+
+        for (const auto& [tid, name] : threads)
+        {
+            out << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":";
+            _write_escaped(out, name);
+            out << "}}";
+            separator = ",\n";
+        }
+
+        struct _open_slice
+        {
+            std::uint32_t tid;
+            std::uint64_t timestamp;
+            std::uint64_t priority;
+        };
+        std::unordered_map<std::uint64_t, _open_slice>                 running;   // job slices
+        std::unordered_map<std::uint32_t, std::vector<std::uint64_t>> nested;    // jobs running on each thread
+        std::unordered_map<std::uint64_t, std::uint64_t>              suspended; // jobs waiting on each fiber
+        std::unordered_map<std::uint64_t, std::vector<std::uint64_t>> incoming;  // flows to jobs not started yet
+        std::unordered_map<std::uint32_t, std::uint64_t>              parked;    // idle slices
+        std::uint64_t                                                 flows = 0;
+
+        // closes the slice of a job, a suspended job opens a new one when resumed
+        const auto close = [&](std::uint64_t job, std::uint64_t timestamp, bool suspend) {
+            const auto it = running.find(job);
+            if (it == std::end(running))
+                return;
+
+            const auto& s = it->second;
+            begin_event(_priority_name(s.priority), "X", s.tid, time(s.timestamp))
+                << ",\"cat\":\"job\",\"dur\":" << time(timestamp) - time(s.timestamp)
+                << ",\"args\":{\"job\":" << job << (suspend ? ",\"suspended\":true" : "") << "}}";
+            std::erase(nested[s.tid], job);
+            if (!suspend)
+                running.erase(it);
+        };
+
+        out.precision(3);
+        out << std::fixed;
+        for (const auto& e : events)
+        {
+            switch (e.type)
+            {
+                case EventType::job_begin:
+                    if (const auto it = incoming.find(e.id); it != std::end(incoming))
+                    {
+                        for (const auto flow : it->second)
+                            begin_event("dependency", "f", e.tid, time(e.timestamp))
+                                << ",\"cat\":\"dependency\",\"bp\":\"e\",\"id\":" << flow << "}";
+                        incoming.erase(it);
+                    }
+                    running[e.id] = { e.tid, e.timestamp, e.arg };
+                    nested[e.tid].push_back(e.id);
+                    break;
+
+                case EventType::job_end:
+                    close(e.id, e.timestamp, false);
+                    break;
+
+                case EventType::job_suspend:
+                    if (auto& jobs = nested[e.tid]; !std::empty(jobs))
+                    {
+                        suspended[e.id] = jobs.back();
+                        close(jobs.back(), e.timestamp, true);
+                    }
+                    break;
+
+                case EventType::job_resume:
+                    if (const auto it = suspended.find(e.id); it != std::end(suspended))
+                    {
+                        if (const auto job = running.find(it->second); job != std::end(running))
+                        {
+                            job->second = { e.tid, e.timestamp, job->second.priority };
+                            nested[e.tid].push_back(it->second);
+                        }
+                        suspended.erase(it);
+                    }
+                    break;
+
+                case EventType::release:
+                    begin_event("dependency", "s", e.tid, time(e.timestamp))
+                        << ",\"cat\":\"dependency\",\"id\":" << ++flows << "}";
+                    incoming[e.id].push_back(flows);
+                    break;
+
+                case EventType::steal:
+                    begin_event("steal", "i", e.tid, time(e.timestamp))
+                        << ",\"s\":\"t\",\"args\":{\"job\":" << e.id << ",\"victim\":" << e.arg << "}}";
+                    break;
+
+                case EventType::park:
+                    parked[e.tid] = e.timestamp;
+                    break;
+
+                case EventType::unpark:
+                    if (const auto it = parked.find(e.tid); it != std::end(parked))
+                    {
+                        begin_event("idle", "X", e.tid, time(it->second))
+                            << ",\"cat\":\"idle\",\"dur\":" << time(e.timestamp) - time(it->second) << "}";
+                        parked.erase(it);
+                    }
+                    break;
+            }
+        }
+        out << "\n]}\n";
+    }
+
+#else
+
+    void start(std::size_t) {}
+
+    void stop() noexcept {}
+
+    bool is_recording() noexcept { return false; }
+
+    void name_this_thread(std::string_view) {}
+
+    void _detail::record(EventType, std::uint64_t, std::uint64_t) noexcept {}
+
+    void write(std::ostream& out)
+    {
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[]}\n";
+    }
+
+#endif
+
+    void flush(const std::filesystem::path& file)
+    {
+        std::ofstream out{ file, std::ios::trunc };
+        if (!out)
+            throw std::runtime_error{ "Can't open the trace file " + file.string() + "." };
+
+        write(out);
+        if (!out.flush())
+            throw std::runtime_error{ "Can't write the trace file " + file.string() + "." };
+    }
+
+} // namespace drako::jobs::trace
@@ -0,0 +1,536 @@
+#include "drako/jobs/job_system.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace drako::jobs;
+
+// busy wait until the counter reaches the expected value
+static void _wait_until(const std::atomic<int>& counter, int expected)
+{
+    while (counter.load(std::memory_order::acquire) != expected)
+        std::this_thread::yield();
+}
+
+GTEST_TEST(Scheduler, ExecutesExternalSubmissions)
+{
+    Scheduler s{ { .workers = 4 } };
+    ASSERT_EQ(s.size(), 4);
+
+    const auto       count = 10'000;
+    std::atomic<int> done  = 0;
+    for (auto i = 0; i < count; ++i)
+        s.submit([&]() { done.fetch_add(1, std::memory_order::release); });
+
+    _wait_until(done, count);
+}
+
+GTEST_TEST(Scheduler, ExecutesNestedSubmissions)
+{
+    Scheduler s{ { .workers = 4, .queue_size = 64 } };
+
+    const auto       fanout = 100;
+    std::atomic<int> done   = 0;
+    for (auto i = 0; i < fanout; ++i)
+        s.submit([&]() {
+            // overflows the local queue on purpose
+            for (auto j = 0; j < fanout; ++j)
+                s.submit([&]() { done.fetch_add(1, std::memory_order::release); });
+        });
+
+    _wait_until(done, fanout * fanout);
+}
+
+GTEST_TEST(Scheduler, DrainsWorkOnDestruction)
+{
+    std::atomic<int> done = 0;
+    {
+        Scheduler s{ { .workers = 2 } };
+        for (auto i = 0; i < 1000; ++i)
+            s.submit([&]() { done.fetch_add(1, std::memory_order::release); });
+    }
+    EXPECT_EQ(done.load(), 1000);
+}
+
+GTEST_TEST(Scheduler, SignalsEventOnCompletion)
+{
+    Scheduler s{ { .workers = 4 } };
+
+    const auto       count = 1000;
+    std::atomic<int> done  = 0;
+    Event            e{ count };
+    for (auto i = 0; i < count; ++i)
+        s.submit([&]() { done.fetch_add(1, std::memory_order::relaxed); }, e);
+
+    s.wait_for(e);
+    EXPECT_EQ(done.load(), count);
+}
+
+GTEST_TEST(Scheduler, WaitsForEventBeforeStart)
+{
+    Scheduler s{ { .workers = 4 } };
+
+    std::atomic<int> stage = 0;
+    Event            first{ 1 };
+    Event            second{ 1 };
+    s.submit(first, [&]() { EXPECT_EQ(stage.exchange(2), 1); }, second);
+    s.submit([&]() { EXPECT_EQ(stage.exchange(1), 0); }, first);
+
+    s.wait_for(second);
+    EXPECT_EQ(stage.load(), 2);
+
+    // events already signalled don't delay the job
+    Event third{ 1 };
+    s.submit(first, [&]() { stage = 3; }, third);
+    s.wait_for(third);
+    EXPECT_EQ(stage.load(), 3);
+}
+
+GTEST_TEST(Scheduler, DestroysEventsOnceReady)
+{
+    Scheduler s{ { .workers = 4 } };
+
+    // the signalling job must be done with the event when the waiter sees it ready
+    for (auto round = 0; round < 10000; ++round)
+    {
+        Event e{ 1 };
+        s.submit([&]() { e.signal(); });
+        while (!e.ready())
+            std::this_thread::yield();
+    }
+}
+
+GTEST_TEST(Scheduler, WaitsForMultipleEvents)
+{
+    Scheduler s{ { .workers = 4 } };
+
+    for (auto round = 0; round < 100; ++round)
+    {
+        // each job is enlisted in both events, in opposite order
+        Event            first{ 1 };
+        Event            second{ 1 };
+        Event            done{ 2 };
+        std::atomic<int> runs = 0;
+
+        const auto a = s.create([&]() { runs.fetch_add(1); }, done);
+        const auto b = s.create([&]() { runs.fetch_add(1); }, done);
+        s.precede(first, a);
+        s.precede(second, a);
+        s.precede(second, b);
+        s.precede(first, b);
+        s.submit(a);
+        s.submit(b);
+
+        s.submit([&]() { first.signal(); });
+        s.submit([&]() { second.signal(); });
+        s.wait_for(done);
+        EXPECT_EQ(runs.load(), 2);
+    }
+}
+
+GTEST_TEST(Scheduler, RejectsTooManyEvents)
+{
+    Scheduler s{ { .workers = 1 } };
+
+    Event      ready{ 0 };
+    Event      done{ 1 };
+    const auto h = s.create([]() {}, done);
+    for (std::size_t i = 0; i < Scheduler::max_event_predecessors; ++i)
+        s.precede(ready, h);
+    EXPECT_THROW(s.precede(ready, h), std::length_error);
+
+    s.submit(h);
+    s.wait_for(done);
+}
+
+GTEST_TEST(Scheduler, ExecutesGraphInDependencyOrder)
+{
+    Scheduler s{ { .workers = 4 } };
+
+    // animation -> transforms (x4) -> culling -> draw list
+    std::atomic<int> animation = 0, transforms = 0, culling = 0;
+    Event            frame{ 1 };
+
+    const auto a = s.create([&]() { animation = 1; });
+    const auto c = s.create([&]() {
+        EXPECT_EQ(transforms.load(), 4);
+        culling = 1;
+    });
+    const auto d = s.create([&]() { EXPECT_EQ(culling.load(), 1); }, frame);
+    s.precede(c, d);
+
+    JobHandle t[4];
+    for (auto& h : t)
+    {
+        h = s.create([&]() {
+            EXPECT_EQ(animation.load(), 1);
+            transforms.fetch_add(1);
+        });
+        s.precede(a, h);
+        s.precede(h, c);
+    }
+
+    // submission order doesn't matter
+    s.submit(d);
+    s.submit(c);
+    for (auto h : t)
+        s.submit(h);
+    s.submit(a);
+
+    s.wait_for(frame);
+}
+
+GTEST_TEST(Scheduler, RejectsTooManySuccessors)
+{
+    Scheduler s{ { .workers = 1 } };
+
+    Event      done{ 1 };
+    const auto first = s.create([]() {});
+    JobHandle  next[JobChain::max_successors];
+    for (auto& h : next)
+    {
+        h = s.create([]() {});
+        s.precede(first, h);
+    }
+    const auto last = s.create([]() {}, done);
+    EXPECT_THROW(s.precede(first, last), std::length_error);
+
+    s.submit(first);
+    for (auto h : next)
+        s.submit(h);
+    s.submit(last);
+    s.wait_for(done);
+}
+
+GTEST_TEST(Scheduler, SuspendsWaitingJobs)
+{
+    // a single worker would deadlock if waiting blocked the thread
+    Scheduler s{ { .workers = 1, .fibers = 4 } };
+
+    Event            produced{ 1 };
+    Event            consumed{ 1 };
+    std::atomic<int> value = 0;
+
+    s.submit([&]() {
+        s.submit([&]() { value.store(42, std::memory_order::relaxed); }, produced);
+        s.wait_for(produced);
+        EXPECT_EQ(value.load(std::memory_order::relaxed), 42);
+    }, consumed);
+
+    s.wait_for(consumed);
+}
+
+GTEST_TEST(Scheduler, ResumesManySuspendedJobs)
+{
+    Scheduler s{ { .workers = 4, .fibers = 64 } };
+
+    const auto       count = 32;
+    Event            gate{ 1 };
+    Event            done{ count };
+    std::atomic<int> resumed = 0;
+    for (auto i = 0; i < count; ++i)
+        s.submit([&]() {
+            s.wait_for(gate);
+            resumed.fetch_add(1, std::memory_order::relaxed);
+        }, done);
+
+    s.submit([&]() { gate.signal(); });
+    s.wait_for(done);
+    EXPECT_EQ(resumed.load(), count);
+}
+
+static void _add(std::atomic<int>* counter, int value)
+{
+    counter->fetch_add(value, std::memory_order::release);
+}
+
+GTEST_TEST(Job, EmbedsCallableState)
+{
+    static_assert(sizeof(Job) == drako::cache_line_size);
+
+    std::atomic<int> counter = 0;
+
+    Job from_lambda{ [&counter, value = 2]() { counter.fetch_add(value); } };
+    Job from_function{ &_add, &counter, 3 };
+    from_lambda();
+    from_function();
+
+    auto copy = from_lambda; // copies the embedded state
+    copy();
+    EXPECT_EQ(counter.load(), 7);
+}
+
+GTEST_TEST(Scheduler, RecyclesJobRecords)
+{
+    Scheduler s{ { .workers = 2 } };
+
+    const auto       rounds = 8;
+    const auto       count  = 4'096;
+    std::atomic<int> done   = 0;
+    for (auto r = 1; r <= rounds; ++r)
+    {
+        // records released by the previous round are reused
+        for (auto i = 0; i < count; ++i)
+            s.submit(Job{ &_add, &done, 1 });
+        _wait_until(done, r * count);
+    }
+}
+
+GTEST_TEST(Scheduler, ParksIdleWorkers)
+{
+    Scheduler s{ { .workers = 2, .idle = { .spins = 1, .yields = 1 } } };
+
+    // workers without jobs go to sleep
+    while (s.idle_stats().parks == 0)
+        std::this_thread::yield();
+
+    // a submission wakes a sleeping worker
+    std::atomic<int> done = 0;
+    for (auto i = 0; i < 100; ++i)
+    {
+        s.submit([&]() { done.fetch_add(1, std::memory_order::release); });
+        _wait_until(done, i + 1);
+    }
+    EXPECT_GT(s.idle_stats().wakes, 0);
+}
+
+// keeps the single worker busy until the gate opens, so that the queues fill up
+static void _block_worker(Scheduler& s, std::atomic<int>& gate)
+{
+    std::atomic<int> started = 0;
+    s.submit([&]() {
+        started.store(1, std::memory_order::release);
+        while (gate.load(std::memory_order::acquire) == 0)
+            std::this_thread::yield();
+    });
+    _wait_until(started, 1);
+}
+
+GTEST_TEST(Scheduler, DrainsHigherPrioritiesFirst)
+{
+    Scheduler s{ { .workers = 1 } };
+
+    std::atomic<int> gate = 0;
+    _block_worker(s, gate);
+
+    std::mutex       lock;
+    std::vector<int> order;
+    std::atomic<int> done = 0;
+    const auto       log  = [&](int p) {
+        const std::scoped_lock guard{ lock };
+        order.push_back(p);
+        done.fetch_add(1, std::memory_order::release);
+    };
+
+    for (auto i = 0; i < 4; ++i)
+        s.submit([&]() { log(2); }, JobPriority::background);
+    for (auto i = 0; i < 4; ++i)
+        s.submit([&]() { log(1); }, JobPriority::frame);
+    for (auto i = 0; i < 4; ++i)
+        s.submit([&]() { log(0); }, JobPriority::critical);
+
+    gate.store(1, std::memory_order::release);
+    _wait_until(done, 12);
+    EXPECT_TRUE(std::is_sorted(std::begin(order), std::end(order)));
+}
+
+GTEST_TEST(Scheduler, ProtectsLowerPrioritiesFromStarvation)
+{
+    Scheduler s{ { .workers = 1, .fairness = 4 } };
+
+    std::atomic<int> gate = 0;
+    _block_worker(s, gate);
+
+    const auto       count      = 32;
+    std::atomic<int> critical   = 0;
+    std::atomic<int> background = -1; // critical jobs completed before the background one
+    s.submit([&]() { background.store(critical.load()); }, JobPriority::background);
+    for (auto i = 0; i < count; ++i)
+        s.submit([&]() { critical.fetch_add(1, std::memory_order::release); }, JobPriority::critical);
+
+    gate.store(1, std::memory_order::release);
+    _wait_until(critical, count);
+    while (background.load() < 0)
+        std::this_thread::yield();
+    EXPECT_LT(background.load(), count);
+}
+
+namespace
+{
+    // chain of background jobs, each submitted from the previous one to the local queue
+    struct _background_chain
+    {
+        Scheduler*        scheduler;
+        std::atomic<int>  steps    = 0;
+        std::atomic<bool> stop     = false;
+        std::atomic<bool> finished = false;
+    };
+
+    void _chain_step(_background_chain* c)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds{ 20 });
+        if (c->steps.fetch_add(1) + 1 < 100'000 && !c->stop.load())
+            c->scheduler->submit([c]() { _chain_step(c); }, JobPriority::background);
+        else
+            c->finished.store(true, std::memory_order::release);
+    }
+} // namespace
+
+GTEST_TEST(Scheduler, ExternalCriticalJobsOvertakeLocalBackgroundWork)
+{
+    Scheduler s{ { .workers = 1, .fairness = 8 } };
+
+    _background_chain chain{ .scheduler = &s };
+    s.submit([c = &chain]() { _chain_step(c); }, JobPriority::background);
+    while (chain.steps.load() < 10)
+        std::this_thread::yield();
+
+    std::atomic<int> overtaken = -1; // background steps executed before the critical job
+    const auto       submitted = chain.steps.load();
+    s.submit([&]() { overtaken.store(chain.steps.load() - submitted); }, JobPriority::critical);
+    while (overtaken.load() < 0)
+        std::this_thread::yield();
+
+    chain.stop.store(true);
+    while (!chain.finished.load(std::memory_order::acquire))
+        std::this_thread::yield();
+    EXPECT_LT(overtaken.load(), 2 * 8);
+}
+
+GTEST_TEST(Scheduler, HelpsWhenSharedQueueIsFull)
+{
+    Scheduler s{ { .workers = 1, .shared_queue_size = 16 } };
+
+    // external submissions overflow the shared queue
+    const auto       count = 10'000;
+    std::atomic<int> done  = 0;
+    for (auto i = 0; i < count; ++i)
+        s.submit([&]() { done.fetch_add(1, std::memory_order::release); });
+
+    _wait_until(done, count);
+}
+
+GTEST_TEST(Scheduler, AllocatesFrameMemoryFromWorkers)
+{
+    Scheduler s{ { .workers = 1, .frame_arena_size = 1024, .shared_frame_arena_size = 1024 } };
+
+    std::atomic<void*> first = nullptr;
+    for (auto frame = 0; frame < 3; ++frame)
+    {
+        std::atomic<int> done = 0;
+        s.submit([&]() {
+            const auto values = this_worker::frame_alloc<std::uint64_t>(16);
+            ASSERT_NE(values, nullptr);
+            EXPECT_EQ(reinterpret_cast<std::uintptr_t>(values) % alignof(std::uint64_t), 0);
+            for (auto i = 0; i < 16; ++i)
+                values[i] = i;
+
+            const auto aligned = this_worker::frame_alloc(8, 256);
+            ASSERT_NE(aligned, nullptr);
+            EXPECT_EQ(reinterpret_cast<std::uintptr_t>(aligned) % 256, 0);
+
+            // each frame starts again from the beginning of the arena
+            void* expected = nullptr;
+            if (!first.compare_exchange_strong(expected, values))
+            {
+                EXPECT_EQ(expected, values);
+            }
+            done.store(1, std::memory_order::release);
+        });
+        _wait_until(done, 1); // doesn't help, so that the worker runs the job
+        EXPECT_EQ(s.shared_frame_usage(), 0); // the worker arena was enough
+        s.reset_frame();
+    }
+}
+
+GTEST_TEST(Scheduler, SpillsFrameMemoryToSharedArena)
+{
+    Scheduler s{ { .workers = 2, .frame_arena_size = 256, .shared_frame_arena_size = 4096 } };
+
+    // the worker arenas are too small, jobs of all workers allocate from the shared one
+    const auto       count = 32;
+    std::atomic<int> spilled = 0;
+    Event            done{ count };
+    for (auto i = 0; i < count; ++i)
+        s.submit([&]() {
+            const auto bytes = this_worker::frame_alloc<std::byte>(100);
+            if (bytes == nullptr)
+                return;
+            std::fill_n(bytes, 100, std::byte{ 0xcd });
+            spilled.fetch_add(1, std::memory_order::relaxed);
+        }, done);
+    s.wait_for(done);
+
+    EXPECT_EQ(spilled.load(), count);
+    EXPECT_GE(s.shared_frame_usage(), 100 * (count - 4));
+
+    // external threads use the shared arena, until it's exhausted
+    while (s.frame_alloc(100) != nullptr)
+        ;
+    EXPECT_LE(s.shared_frame_usage(), 4096);
+
+    s.reset_frame();
+    EXPECT_EQ(s.shared_frame_usage(), 0);
+    EXPECT_NE(s.frame_alloc(4096, 64), nullptr);
+}
+
+GTEST_TEST(Scheduler, HelpedJobsAllocateFromTheirScheduler)
+{
+    Scheduler s{ { .workers = 1, .frame_arena_size = 256, .shared_frame_arena_size = 4096 } };
+
+    std::atomic<int> gate = 0;
+    _block_worker(s, gate);
+
+    // the only worker is busy, so the waiting thread executes the job
+    Event done{ 1 };
+    s.submit([&]() { EXPECT_NE(this_worker::frame_alloc(64), nullptr); }, done);
+    s.wait_for(done);
+    EXPECT_EQ(s.shared_frame_usage(), 64);
+
+    gate.store(1, std::memory_order::release);
+}
+
+GTEST_TEST(Scheduler, PinsWorkersToPhysicalCores)
+{
+    const auto topology = drako::sys::cpu_topology();
+    ASSERT_FALSE(std::empty(topology));
+
+    std::vector<std::uint32_t> cores;
+    for (const auto& cpu : topology)
+        cores.push_back(cpu.physical_core);
+    std::sort(std::begin(cores), std::end(cores));
+    cores.erase(std::unique(std::begin(cores), std::end(cores)), std::end(cores));
+
+    {
+        Scheduler s{ { .pin_workers = true } };
+        EXPECT_EQ(s.size(), std::size(cores));
+    }
+
+#if defined(DRAKO_PLT_LINUX)
+    // a bound worker never migrates
+    Scheduler s{ { .workers = 1, .pin_workers = true } };
+
+    const auto       count = 100;
+    std::atomic<int> done  = 0;
+    std::atomic<int> first = -1;
+    std::atomic<int> moved = 0;
+    for (auto i = 0; i < count; ++i)
+        s.submit([&]() {
+            const auto cpu      = static_cast<int>(drako::sys::current_process_cpu().cpu_number);
+            auto       expected = -1;
+            if (!first.compare_exchange_strong(expected, cpu) && expected != cpu)
+                moved.fetch_add(1, std::memory_order::relaxed);
+            done.fetch_add(1, std::memory_order::release);
+        });
+    _wait_until(done, count);
+    EXPECT_EQ(moved.load(), 0);
+#endif
+}
@@ -0,0 +1,124 @@
+#include "drako/jobs/job_system.hpp"
+#include "drako/jobs/job_trace.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+
+using namespace drako::jobs;
+
+// counts the non overlapping occurrences of a pattern
+static std::size_t _count(std::string_view text, std::string_view pattern)
+{
+    std::size_t count = 0;
+    for (auto pos = text.find(pattern); pos != std::string_view::npos; pos = text.find(pattern, pos + std::size(pattern)))
+        ++count;
+    return count;
+}
+
+GTEST_TEST(Trace, RecordsJobsAndDependencies)
+{
+    if constexpr (!trace::compiled)
+        GTEST_SKIP() << "Tracing is compiled out.";
+
+    trace::start();
+    {
+        Scheduler s{ { .workers = 2 } };
+
+        // a chain of three jobs, plus independent ones
+        Event      done{ 1 };
+        const auto first  = s.create([]() {});
+        const auto second = s.create([]() {}, JobPriority::critical);
+        const auto third  = s.create([]() {}, done);
+        s.precede(first, second);
+        s.precede(second, third);
+        s.submit(third);
+        s.submit(second);
+        s.submit(first);
+
+        Event others{ 10 };
+        for (auto i = 0; i < 10; ++i)
+            s.submit([]() {}, others, JobPriority::background);
+
+        s.wait_for(done);
+        s.wait_for(others);
+    }
+    trace::stop();
+
+    std::ostringstream out;
+    trace::write(out);
+    const auto json = out.str();
+
+    EXPECT_TRUE(json.starts_with("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["));
+    EXPECT_TRUE(json.ends_with("]}\n"));
+    EXPECT_EQ(_count(json, "\"cat\":\"job\""), 13);
+    EXPECT_EQ(_count(json, "\"name\":\"critical job\""), 1);
+    EXPECT_EQ(_count(json, "\"name\":\"background job\""), 10);
+    EXPECT_EQ(_count(json, "\"ph\":\"s\""), 2); // one flow for each dependency
+    EXPECT_EQ(_count(json, "\"ph\":\"f\""), 2);
+    EXPECT_NE(json.find("\"name\":\"worker 0\""), std::string::npos);
+
+    // exported events are discarded
+    std::ostringstream again;
+    trace::write(again);
+    EXPECT_EQ(_count(again.str(), "\"cat\":\"job\""), 0);
+}
+
+GTEST_TEST(Trace, SplitsSuspendedJobs)
+{
+    if constexpr (!trace::compiled)
+        GTEST_SKIP() << "Tracing is compiled out.";
+
+    trace::start();
+    {
+        Scheduler s{ { .workers = 1 } };
+
+        Event            gate{ 1 };
+        Event            done{ 1 };
+        std::atomic<int> waiting = 0;
+        s.submit([&]() {
+            waiting.store(1, std::memory_order::release);
+            s.wait_for(gate); // the fiber is parked, the worker moves on
+        }, done);
+        while (waiting.load(std::memory_order::acquire) == 0)
+            std::this_thread::yield();
+        s.submit([&]() { gate.signal(); });
+        s.wait_for(done);
+    }
+    trace::stop();
+
+    std::ostringstream out;
+    trace::write(out);
+    const auto json = out.str();
+
+    // the waiting job appears as two slices, around the one that signals the event
+    EXPECT_EQ(_count(json, "\"suspended\":true"), 1);
+    EXPECT_EQ(_count(json, "\"cat\":\"job\""), 3);
+}
+
+GTEST_TEST(Trace, FlushesToFile)
+{
+    const auto file = std::filesystem::temp_directory_path() / "drako_trace_test.json";
+
+    trace::start();
+    {
+        Scheduler s{ { .workers = 1 } };
+        Event     done{ 1 };
+        s.submit([]() {}, done);
+        s.wait_for(done);
+    }
+    trace::stop();
+
+    trace::flush(file);
+    EXPECT_GT(std::filesystem::file_size(file), 0);
+    std::filesystem::remove(file);
+
+    EXPECT_THROW(trace::flush(file / "not_a_directory" / "trace.json"), std::runtime_error);
+}
@@ -0,0 +1,77 @@
+#include "drako/jobs/parallel.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+using namespace drako::jobs;
+
+GTEST_TEST(ParallelFor, VisitsEachIndexOnce)
+{
+    Scheduler s{ { .workers = 4 } };
+
+    std::vector<std::atomic<int>> visits(100'000);
+    parallel_for(s, std::size_t{ 0 }, std::size(visits), 64, [&](std::size_t i) {
+        visits[i].fetch_add(1, std::memory_order::relaxed);
+    });
+
+    for (const auto& v : visits)
+        ASSERT_EQ(v.load(), 1);
+}
+
+GTEST_TEST(ParallelFor, SplitsInGrainSizedRanges)
+{
+    Scheduler s{ { .workers = 4 } };
+
+    const auto       grain = 100;
+    std::atomic<int> total = 0;
+    parallel_for(s, 0, 10'000, grain, [&](int first, int last) {
+        EXPECT_LE(last - first, grain);
+        total.fetch_add(last - first, std::memory_order::relaxed);
+    });
+    EXPECT_EQ(total.load(), 10'000);
+}
+
+GTEST_TEST(ParallelFor, NestsInsideJobs)
+{
+    Scheduler s{ { .workers = 2 } };
+
+    Event            done{ 1 };
+    std::atomic<int> total = 0;
+    s.submit([&]() {
+        parallel_for(s, 0, 64, 1, [&](int) {
+            parallel_for(s, 0, 64, 8, [&](int) { total.fetch_add(1, std::memory_order::relaxed); });
+        });
+    }, done);
+
+    s.wait_for(done);
+    EXPECT_EQ(total.load(), 64 * 64);
+}
+
+GTEST_TEST(ParallelReduce, SumsRange)
+{
+    Scheduler s{ { .workers = 4 } };
+
+    std::vector<std::int64_t> values(1'000'000);
+    std::iota(std::begin(values), std::end(values), 0);
+
+    const auto sum = parallel_reduce(s, std::size_t{ 0 }, std::size(values), 1'024, std::int64_t{ 0 },
+        [&](std::size_t first, std::size_t last) {
+            return std::accumulate(std::begin(values) + first, std::begin(values) + last, std::int64_t{ 0 });
+        },
+        [](std::int64_t a, std::int64_t b) { return a + b; });
+
+    EXPECT_EQ(sum, std::int64_t{ 999'999 } * 1'000'000 / 2);
+}
+
+GTEST_TEST(ParallelReduce, ReturnsIdentityOnEmptyRange)
+{
+    Scheduler s{ { .workers = 1 } };
+
+    const auto result = parallel_reduce(s, 0, 0, 1, 7,
+        [](int, int) { return 0; }, [](int a, int b) { return a + b; });
+    EXPECT_EQ(result, 7);
+}
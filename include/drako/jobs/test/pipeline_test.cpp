@@ -0,0 +1,137 @@
+#include "drako/jobs/pipeline.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace drako::jobs;
+using namespace drako::pipeline;
+
+GTEST_TEST(Pipeline, ProcessesEachItemOnce)
+{
+    Scheduler s{ { .workers = 4 } };
+
+    int           next = 0;
+    std::int64_t  sum  = 0;
+    std::atomic<int> converted = 0;
+    run(s, { .tokens = 8 },
+        [&]() -> std::optional<int> {
+            if (next == 10'000)
+                return std::nullopt;
+            return next++;
+        },
+        stage<Mode::parallel>([&](int i) {
+            converted.fetch_add(1, std::memory_order::relaxed);
+            return std::to_string(i);
+        }),
+        stage<Mode::serial_out_of_order>([&](std::string&& text) {
+            sum += std::stoi(text); // serial stages need no synchronization
+        }));
+
+    EXPECT_EQ(converted.load(), 10'000);
+    EXPECT_EQ(sum, std::int64_t{ 9'999 } * 10'000 / 2);
+}
+
+GTEST_TEST(Pipeline, PreservesSourceOrderInOrderedStages)
+{
+    Scheduler s{ { .workers = 4 } };
+
+    int              next = 0;
+    std::vector<int> forwarded;
+    std::vector<int> consumed;
+    run(s, { .tokens = 5 },
+        [&]() -> std::optional<int> {
+            if (next == 2'000)
+                return std::nullopt;
+            return next++;
+        },
+        stage<Mode::parallel>([](int i) {
+            // uneven work, so items complete out of order
+            volatile int spin = 0;
+            for (auto k = 0; k < (i % 7) * 200; ++k)
+                spin = spin + 1;
+            return i;
+        }),
+        stage<Mode::serial_in_order>([&](int i) {
+            forwarded.push_back(i);
+            return i;
+        }),
+        stage<Mode::parallel>([](int i) { return i; }),
+        stage<Mode::serial_in_order>([&](int i) { consumed.push_back(i); }));
+
+    std::vector<int> expected(2'000);
+    std::iota(std::begin(expected), std::end(expected), 0);
+    EXPECT_EQ(forwarded, expected);
+    EXPECT_EQ(consumed, expected);
+}
+
+GTEST_TEST(Pipeline, LimitsItemsInFlight)
+{
+    Scheduler s{ { .workers = 4 } };
+
+    const std::size_t        tokens    = 3;
+    int                      next      = 0;
+    std::atomic<std::size_t> in_flight = 0;
+    std::size_t              peak      = 0;
+    run(s, { .tokens = tokens },
+        [&]() -> std::optional<std::unique_ptr<int>> {
+            if (next == 1'000)
+                return std::nullopt;
+            peak = std::max(peak, in_flight.fetch_add(1, std::memory_order::relaxed) + 1);
+            return std::make_unique<int>(next++);
+        },
+        stage<Mode::parallel>([](std::unique_ptr<int>&& p) {
+            *p *= 2;
+            return std::move(p);
+        }),
+        stage<Mode::serial_out_of_order>([&](std::unique_ptr<int>&& p) {
+            EXPECT_EQ(*p % 2, 0);
+            in_flight.fetch_sub(1, std::memory_order::relaxed);
+        }));
+
+    EXPECT_LE(peak, tokens);
+    EXPECT_EQ(in_flight.load(), 0);
+}
+
+GTEST_TEST(Pipeline, CompletesWithEmptySource)
+{
+    Scheduler s{ { .workers = 1 } };
+
+    Pipeline p{ s, {},
+        []() -> std::optional<int> { return std::nullopt; },
+        stage<Mode::serial_in_order>([](int) { ADD_FAILURE(); }) };
+    EXPECT_FALSE(p.done());
+    p.start();
+    p.wait();
+    EXPECT_TRUE(p.done());
+}
+
+GTEST_TEST(Pipeline, RunsInsideJobs)
+{
+    Scheduler s{ { .workers = 2 } };
+
+    std::atomic<int> total = 0;
+    Event            done{ 4 };
+    for (auto j = 0; j < 4; ++j)
+        s.submit([&]() {
+            int next = 0;
+            run(s, { .tokens = 2 },
+                [&]() -> std::optional<int> {
+                    if (next == 100)
+                        return std::nullopt;
+                    return next++;
+                },
+                stage<Mode::parallel>([](int i) { return i + 1; }),
+                stage<Mode::serial_out_of_order>([&](int i) { total.fetch_add(i, std::memory_order::relaxed); }));
+        }, done);
+    s.wait_for(done);
+
+    EXPECT_EQ(total.load(), 4 * 5'050);
+}
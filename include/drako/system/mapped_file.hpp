@@ -0,0 +1,84 @@
+#pragma once
+#ifndef DRAKO_MAPPED_FILE_HPP
+#define DRAKO_MAPPED_FILE_HPP
+
+/// @file
+/// @brief  Read-only memory mappings of whole files.
+/// @author Grassi Edoardo
+///
+/// The content of a mapped file is loaded by the page faults of the first
+/// accesses, so reading a small range costs no allocation and no copy.
+/// Ranges that will be read soon can be prefetched to hide the faults.
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <utility>
+
+namespace drako::sys
+{
+    /// @brief Read-only view of the whole content of a file.
+    class MappedFile
+    {
+    public:
+        /// @brief Creates an empty mapping.
+        constexpr explicit MappedFile() noexcept = default;
+
+        /// @brief Maps the content of a file.
+        ///
+        /// The file can be closed or renamed while the mapping is alive,
+        /// but its content must not be truncated.
+        ///
+        /// @throw std::system_error Thrown if the file can't be opened or mapped.
+        ///
+        explicit MappedFile(const std::filesystem::path&);
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        MappedFile(MappedFile&& other) noexcept
+            : _data{ std::exchange(other._data, nullptr) }
+            , _size{ std::exchange(other._size, 0) }
+        {
+        }
+
+        MappedFile& operator=(MappedFile&& other) noexcept
+        {
+            if (this != &other)
+            {
+                _unmap();
+                _data = std::exchange(other._data, nullptr);
+                _size = std::exchange(other._size, 0);
+            }
+            return *this;
+        }
+
+        ~MappedFile() noexcept { _unmap(); }
+
+        /// @brief Mapped content of the file.
+        [[nodiscard]] std::span<const std::byte> bytes() const noexcept { return { _data, _size }; }
+
+        /// @brief Size of the file as bytes.
+        [[nodiscard]] std::size_t size() const noexcept { return _size; }
+
+        [[nodiscard]] explicit operator bool() const noexcept { return _data != nullptr; }
+
+        /// @brief Hints the system to start loading a range of the file.
+        ///
+        /// Doesn't block and can be ignored by the system.
+        ///
+        /// @param[in] offset Offset of the range as bytes.
+        /// @param[in] size   Size of the range as bytes.
+        ///
+        void prefetch(std::size_t offset, std::size_t size) const noexcept;
+
+    private:
+        const std::byte* _data = nullptr;
+        std::size_t      _size = 0;
+
+        void _unmap() noexcept;
+    };
+
+} // namespace drako::sys
+
+#endif // !DRAKO_MAPPED_FILE_HPP
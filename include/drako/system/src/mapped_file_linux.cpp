@@ -0,0 +1,81 @@
+#include "drako/system/mapped_file.hpp"
+
+#include "drako/core/compiler.hpp"
+#include "drako/core/platform.hpp"
+
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if !defined(DRAKO_PLT_LINUX)
+#error This source file should be included only on Linux builds
+#endif
+
+namespace drako::sys
+{
+    namespace
+    {
+        [[noreturn]] void _throw_last_error(const char* what)
+        {
+            throw std::system_error{ errno, std::system_category(), what };
+        }
+    } // namespace
+
+    MappedFile::MappedFile(const std::filesystem::path& file)
+    {
+        const auto fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            _throw_last_error("open");
+
+        struct ::stat info;
+        if (::fstat(fd, &info) != 0)
+        {
+            const auto error = errno;
+            ::close(fd);
+            throw std::system_error{ error, std::system_category(), "fstat" };
+        }
+
+        // empty files can't be mapped
+        if (info.st_size > 0)
+        {
+            const auto size    = static_cast<std::size_t>(info.st_size);
+            const auto address = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED)
+            {
+                const auto error = errno;
+                ::close(fd);
+                throw std::system_error{ error, std::system_category(), "mmap" };
+            }
+            _data = static_cast<const std::byte*>(address);
+            _size = size;
+        }
+        ::close(fd); // the mapping keeps its own reference to the file
+    }
+
+    void MappedFile::prefetch(std::size_t offset, std::size_t size) const noexcept
+    {
+        assert(offset + size <= _size);
+        if (size == 0)
+            return;
+
+        // the advice applies to whole pages, starting from an aligned address
+        static const auto page  = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        const auto        begin = offset & ~(page - 1);
+        static_cast<void>(::madvise(const_cast<std::byte*>(_data) + begin, offset + size - begin, MADV_WILLNEED));
+    }
+
+    void MappedFile::_unmap() noexcept
+    {
+        if (_data)
+            ::munmap(const_cast<std::byte*>(_data), _size);
+    }
+
+} // namespace drako::sys
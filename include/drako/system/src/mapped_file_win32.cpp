@@ -0,0 +1,80 @@
+#include "drako/system/mapped_file.hpp"
+
+#include "drako/core/compiler.hpp"
+#include "drako/core/platform.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <filesystem>
+#include <system_error>
+
+#include <Windows.h>
+
+#if !defined(DRAKO_PLT_WIN32)
+#error This source file should be included only on Windows builds
+#endif
+
+namespace drako::sys
+{
+    namespace
+    {
+        [[noreturn]] void _throw_last_error(const char* what)
+        {
+            throw std::system_error{ static_cast<int>(::GetLastError()), std::system_category(), what };
+        }
+    } // namespace
+
+    MappedFile::MappedFile(const std::filesystem::path& file)
+    {
+        const auto handle = ::CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (handle == INVALID_HANDLE_VALUE)
+            _throw_last_error("CreateFileW");
+
+        LARGE_INTEGER size;
+        if (!::GetFileSizeEx(handle, &size))
+        {
+            const auto error = ::GetLastError();
+            ::CloseHandle(handle);
+            throw std::system_error{ static_cast<int>(error), std::system_category(), "GetFileSizeEx" };
+        }
+
+        // empty files can't be mapped
+        if (size.QuadPart > 0)
+        {
+            const auto mapping = ::CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            const auto error   = ::GetLastError();
+            ::CloseHandle(handle); // the mapping keeps its own reference to the file
+            if (!mapping)
+                throw std::system_error{ static_cast<int>(error), std::system_category(), "CreateFileMappingW" };
+
+            const auto address = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            const auto view_error = ::GetLastError();
+            ::CloseHandle(mapping); // the view keeps its own reference to the mapping
+            if (!address)
+                throw std::system_error{ static_cast<int>(view_error), std::system_category(), "MapViewOfFile" };
+
+            _data = static_cast<const std::byte*>(address);
+            _size = static_cast<std::size_t>(size.QuadPart);
+        }
+        else
+            ::CloseHandle(handle);
+    }
+
+    void MappedFile::prefetch(std::size_t offset, std::size_t size) const noexcept
+    {
+        assert(offset + size <= _size);
+        if (size == 0)
+            return;
+
+        WIN32_MEMORY_RANGE_ENTRY range{ .VirtualAddress = const_cast<std::byte*>(_data) + offset, .NumberOfBytes = size };
+        static_cast<void>(::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0));
+    }
+
+    void MappedFile::_unmap() noexcept
+    {
+        if (_data)
+            ::UnmapViewOfFile(_data);
+    }
+
+} // namespace drako::sys
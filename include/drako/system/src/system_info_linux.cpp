@@ -0,0 +1,161 @@
+#include "drako/system/system_info.hpp"
+
+#include "drako/core/compiler.hpp"
+#include "drako/core/platform.hpp"
+
+#include <cassert>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <sched.h>
+#include <sys/sysinfo.h>
+#include <unistd.h>
+
+#if !defined(DRAKO_PLT_LINUX)
+#error This source file should be included only on Linux builds
+#endif
+
+namespace drako::sys
+{
+    namespace
+    {
+        // sysfs description of a logical processor
+        [[nodiscard]] std::filesystem::path _cpu_path(std::uint32_t cpu)
+        {
+            return std::filesystem::path{ "/sys/devices/system/cpu" } / ("cpu" + std::to_string(cpu));
+        }
+
+        // reads the first number of a sysfs file, like the first processor of a cpu list
+        [[nodiscard]] bool _read_first_number(const std::filesystem::path& file, std::uint32_t& value)
+        {
+            std::ifstream in{ file };
+            std::string   line;
+            if (!std::getline(in, line))
+                return false;
+
+            const auto [_, ec] = std::from_chars(line.data(), line.data() + line.size(), value);
+            return ec == std::errc{};
+        }
+
+        // the node of a processor is exposed as a link named after it
+        [[nodiscard]] bool _read_node(std::uint32_t cpu, std::uint32_t& node)
+        {
+            std::error_code ec;
+            for (const auto& entry : std::filesystem::directory_iterator{ _cpu_path(cpu), ec })
+            {
+                const auto name = entry.path().filename().string();
+                if (!std::string_view{ name }.starts_with("node"))
+                    continue;
+
+                const auto [_, error] = std::from_chars(name.data() + 4, name.data() + name.size(), node);
+                if (error == std::errc{})
+                    return true;
+            }
+            return false;
+        }
+    } // namespace
+
+
+    [[nodiscard]] native_cpu_core current_process_cpu() noexcept
+    {
+        const auto cpu = ::sched_getcpu();
+        return native_cpu_core{ cpu < 0 ? 0u : static_cast<std::uint32_t>(cpu) };
+    }
+
+    [[nodiscard]] std::uint32_t cpu_logical_core_count() noexcept
+    {
+        const auto count = ::get_nprocs();
+        assert(count > 0);
+        return static_cast<std::uint32_t>(count);
+    }
+
+    [[nodiscard]] std::uint32_t cpu_memory_page_size() noexcept
+    {
+        const auto size = ::sysconf(_SC_PAGESIZE);
+        assert(size > 0);
+        return static_cast<std::uint32_t>(size);
+    }
+
+    [[nodiscard]] std::int64_t cpu_counter_value() noexcept
+    {
+        ::timespec now = {};
+        // doesn't fail with a valid clock id
+        ::clock_gettime(CLOCK_MONOTONIC, &now);
+
+        return static_cast<std::int64_t>(now.tv_sec) * 1'000'000'000 + now.tv_nsec;
+    }
+
+    [[nodiscard]] std::int64_t cpu_counter_frequency() noexcept
+    {
+        return 1'000'000'000; // the counter is in nanoseconds
+    }
+
+    [[nodiscard]] native_numa_node cpu_numa_node(native_cpu_core core) noexcept
+    {
+        try
+        {
+            std::uint32_t node;
+            if (_read_node(core.cpu_number, node))
+                return native_numa_node{ node };
+        }
+        catch (...) // the path couldn't be built
+        {
+        }
+        return native_numa_node{ 0 }; // kernels without NUMA support
+    }
+
+    [[nodiscard]] std::vector<cpu_topology_entry> cpu_topology()
+    {
+        std::vector<std::uint32_t> allowed;
+
+        ::cpu_set_t set;
+        CPU_ZERO(&set);
+        if (::sched_getaffinity(0, sizeof(set), &set) == 0)
+        {
+            for (std::uint32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+                if (CPU_ISSET(cpu, &set))
+                    allowed.push_back(cpu);
+        }
+        else
+        {
+            for (std::uint32_t cpu = 0; cpu < cpu_logical_core_count(); ++cpu)
+                allowed.push_back(cpu);
+        }
+
+        std::vector<cpu_topology_entry> topology;
+        topology.reserve(std::size(allowed));
+        for (const auto cpu : allowed)
+        {
+            // the lowest sibling identifies the physical core across packages
+            std::uint32_t physical_core;
+            if (!_read_first_number(_cpu_path(cpu) / "topology" / "thread_siblings_list", physical_core))
+                physical_core = cpu;
+
+            std::uint32_t node;
+            if (!_read_node(cpu, node))
+                node = 0;
+
+            topology.push_back({ native_cpu_core{ cpu }, physical_core, native_numa_node{ node } });
+        }
+        return topology;
+    }
+
+    bool pin_current_thread(native_cpu_core core) noexcept
+    {
+        if (core.cpu_number >= CPU_SETSIZE)
+            return false;
+
+        ::cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core.cpu_number, &set);
+        return ::sched_setaffinity(0, sizeof(set), &set) == 0;
+    }
+} // namespace drako::sys
@@ -6,6 +6,8 @@
 #include "drako/devel/assertion.hpp"
 
 #include <cstddef>
+#include <memory>
+#include <vector>
 
 // #include <WinBase.h>
 // #include <sysinfoapi.h>
@@ -87,4 +89,56 @@ namespace drako::sys
 #error Platform not supported
 #endif
     }
-} // namespace drako::sys
\ No newline at end of file
+
+    [[nodiscard]] std::vector<cpu_topology_entry> cpu_topology()
+    {
+        std::vector<cpu_topology_entry> topology;
+
+        DWORD bytes = 0;
+        ::GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &bytes);
+        const auto buffer = std::make_unique<std::byte[]>(bytes);
+        const auto info   = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.get());
+        if (bytes == 0 || !::GetLogicalProcessorInformationEx(RelationProcessorCore, info, &bytes))
+        {
+            for (std::uint32_t i = 0; i < cpu_logical_core_count(); ++i)
+            {
+                PROCESSOR_NUMBER p = {};
+                p.Number           = static_cast<BYTE>(i);
+                topology.push_back({ native_cpu_core{ p }, i, native_numa_node{ 0 } });
+            }
+            return topology;
+        }
+
+        // one record per physical core, with the mask of its hardware threads
+        std::uint32_t physical_core = 0;
+        for (DWORD offset = 0; offset < bytes; ++physical_core)
+        {
+            const auto core = reinterpret_cast<const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.get() + offset);
+            for (WORD g = 0; g < core->Processor.GroupCount; ++g)
+            {
+                const auto& group = core->Processor.GroupMask[g];
+                for (BYTE i = 0; i < sizeof(KAFFINITY) * 8; ++i)
+                    if (group.Mask & (KAFFINITY{ 1 } << i))
+                    {
+                        PROCESSOR_NUMBER p = {};
+                        p.Group            = group.Group;
+                        p.Number           = i;
+
+                        USHORT node = 0;
+                        ::GetNumaProcessorNodeEx(&p, &node);
+                        topology.push_back({ native_cpu_core{ p }, physical_core, native_numa_node{ node } });
+                    }
+            }
+            offset += core->Size;
+        }
+        return topology;
+    }
+
+    bool pin_current_thread(native_cpu_core core) noexcept
+    {
+        GROUP_AFFINITY affinity = {};
+        affinity.Group          = core.cpu_number.Group;
+        affinity.Mask           = KAFFINITY{ 1 } << core.cpu_number.Number;
+        return ::SetThreadGroupAffinity(::GetCurrentThread(), &affinity, nullptr) != 0;
+    }
+} // namespace drako::sys
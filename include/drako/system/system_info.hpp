@@ -3,7 +3,9 @@
 #define DRAKO_SYSTEM_INFO_HPP
 
 #include <cstdint>
+#include <vector>
 
+#include "drako/core/compiler.hpp"
 #include "drako/core/platform.hpp"
 
 #if defined(DRAKO_PLT_WIN32)
@@ -25,6 +27,15 @@ namespace drako::sys
 
         PROCESSOR_NUMBER cpu_number;
 
+#elif defined(DRAKO_PLT_LINUX)
+
+        constexpr explicit native_cpu_core(std::uint32_t desc_) noexcept
+            : cpu_number(desc_)
+        {
+        }
+
+        std::uint32_t cpu_number; // index used by the cpu_set_t masks
+
 #else
 #error Platform not supported
 #endif
@@ -55,7 +66,7 @@ namespace drako::sys
     // Platoform specific descriptor of a NUMA processor group.
     struct native_numa_node
     {
-#if defined(DRAKO_PLT_WIN32)
+#if defined(DRAKO_PLT_WIN32) || defined(DRAKO_PLT_LINUX)
 
         constexpr explicit native_numa_node(std::uint32_t id) noexcept
             : guid{ id }
@@ -72,6 +83,29 @@ namespace drako::sys
     // Returns the numa node of a logical processor.
     //
     [[nodiscard]] native_numa_node cpu_numa_node(native_cpu_core core) noexcept;
+
+
+    // Placement of a logical processor in the hardware topology.
+    struct cpu_topology_entry
+    {
+        native_cpu_core  core;
+        std::uint32_t    physical_core; // shared by the hardware threads of the same core
+        native_numa_node node;
+    };
+
+    // Gets the logical processors the current process is allowed to run on.
+    //
+    // Entries are sorted by logical processor, in the order used by the system.
+    // When the topology can't be read, each processor is reported as a distinct
+    // physical core of NUMA node 0.
+    //
+    [[nodiscard]] std::vector<cpu_topology_entry> cpu_topology();
+
+    // Binds the calling thread to a single logical processor.
+    //
+    // Returns false if the affinity couldn't be changed.
+    //
+    bool pin_current_thread(native_cpu_core core) noexcept;
 } // namespace drako::sys
 
 #endif // !DRAKO_SYSTEM_INFO_HPP
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include "drako/system/mapped_file.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+#include <utility>
+
+using namespace drako::sys;
+
+namespace
+{
+    // file filled with a known pattern, removed on destruction
+    class TestFile
+    {
+    public:
+        explicit TestFile(std::size_t size)
+            : _path{ std::filesystem::temp_directory_path() / "drako_mapped_file_test.bin" }
+        {
+            std::ofstream out{ _path, std::ios::binary };
+            for (std::size_t i = 0; i < size; ++i)
+                out.put(static_cast<char>(_byte(i)));
+        }
+
+        ~TestFile() { std::filesystem::remove(_path); }
+
+        [[nodiscard]] const std::filesystem::path& path() const noexcept { return _path; }
+
+        [[nodiscard]] static std::byte _byte(std::size_t offset) noexcept
+        {
+            return static_cast<std::byte>((offset * 7) ^ (offset >> 8));
+        }
+
+    private:
+        std::filesystem::path _path;
+    };
+} // namespace
+
+GTEST_TEST(MappedFile, MapsWholeContent)
+{
+    const std::size_t size = 3 * 4096 + 123;
+    const TestFile    file{ size };
+
+    const MappedFile mapping{ file.path() };
+    ASSERT_TRUE(mapping);
+    ASSERT_EQ(mapping.size(), size);
+
+    mapping.prefetch(5000, 3000); // unaligned range
+    const auto bytes = mapping.bytes();
+    for (std::size_t i = 0; i < size; ++i)
+        ASSERT_EQ(bytes[i], TestFile::_byte(i)) << "at offset " << i;
+}
+
+GTEST_TEST(MappedFile, OutlivesTheFile)
+{
+    MappedFile mapping;
+    {
+        const TestFile file{ 4096 };
+        mapping = MappedFile{ file.path() };
+    }
+    ASSERT_EQ(mapping.size(), 4096u);
+    EXPECT_EQ(mapping.bytes()[1000], TestFile::_byte(1000));
+
+    const auto moved = std::move(mapping);
+    EXPECT_FALSE(mapping);
+    EXPECT_EQ(moved.bytes()[4095], TestFile::_byte(4095));
+}
+
+GTEST_TEST(MappedFile, MapsEmptyFile)
+{
+    const TestFile   file{ 0 };
+    const MappedFile mapping{ file.path() };
+    EXPECT_FALSE(mapping);
+    EXPECT_TRUE(std::empty(mapping.bytes()));
+}
+
+GTEST_TEST(MappedFile, ThrowsOnMissingFile)
+{
+    EXPECT_THROW(MappedFile{ "drako_missing_file.bin" }, std::system_error);
+}